@@ -0,0 +1,250 @@
+#include "band_composite.h"
+#include "parallel_utils.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Кусочно-гауссово приближение CIE 1931 (Wyman, Sloan, Shirley, 2013)
+double piecewiseGaussian(double wavelength, double mu, double sigmaLeft, double sigmaRight) {
+    double t = (wavelength - mu) / (wavelength < mu ? sigmaLeft : sigmaRight);
+    return std::exp(-0.5 * t * t);
+}
+
+void cieColorMatching(double wavelength, double& x, double& y, double& z) {
+    x = 1.056 * piecewiseGaussian(wavelength, 599.8, 37.9, 31.0)
+      + 0.362 * piecewiseGaussian(wavelength, 442.0, 16.0, 26.7)
+      - 0.065 * piecewiseGaussian(wavelength, 501.1, 20.4, 26.2);
+    y = 0.821 * piecewiseGaussian(wavelength, 568.8, 46.9, 40.5)
+      + 0.286 * piecewiseGaussian(wavelength, 530.9, 16.3, 31.1);
+    z = 1.217 * piecewiseGaussian(wavelength, 437.0, 11.8, 36.0)
+      + 0.681 * piecewiseGaussian(wavelength, 459.0, 26.0, 13.8);
+}
+
+// Пикселей в плитке синтеза; плитка округляется до целых строк
+const int64_t kTilePixels = 16384;
+// Для оценки перцентилей достаточно равномерной выборки до миллиона значений
+const size_t kMaxSamples = 1 << 20;
+
+uint8_t encodeSrgb(float linear) {
+    float v = linear <= 0.0031308f ? 12.92f * linear : 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+    return static_cast<uint8_t>(std::clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+} // namespace
+
+std::vector<BandComposite::BandWeight> BandComposite::cieTrueColorWeights(const std::vector<double>& wavelengths) {
+    const double minVisible = 380.0;
+    const double maxVisible = 780.0;
+    
+    // Каналы видимого диапазона по возрастанию длины волны
+    std::vector<std::pair<double, int>> visible;
+    for (size_t i = 0; i < wavelengths.size(); i++) {
+        if (wavelengths[i] >= minVisible && wavelengths[i] <= maxVisible) {
+            visible.emplace_back(wavelengths[i], static_cast<int>(i));
+        }
+    }
+    std::sort(visible.begin(), visible.end());
+    
+    std::vector<BandWeight> weights;
+    if (visible.size() < 3) return weights;
+    
+    // XYZ -> линейный sRGB (D65)
+    const double xyzToRgb[3][3] = {
+        { 3.2406, -1.5372, -0.4986},
+        {-0.9689,  1.8758,  0.0415},
+        { 0.0557, -0.2040,  1.0570}
+    };
+    
+    double ySum = 0.0;
+    std::vector<double> xyz(visible.size() * 3);
+    for (size_t i = 0; i < visible.size(); i++) {
+        // Ширина интервала, который представляет канал (интегрирование методом трапеций)
+        double left = i > 0 ? visible[i - 1].first : visible[i].first;
+        double right = i + 1 < visible.size() ? visible[i + 1].first : visible[i].first;
+        double step = (right - left) / 2.0;
+        
+        double x, y, z;
+        cieColorMatching(visible[i].first, x, y, z);
+        xyz[i * 3] = x * step;
+        xyz[i * 3 + 1] = y * step;
+        xyz[i * 3 + 2] = z * step;
+        ySum += y * step;
+    }
+    if (ySum <= 0.0) return weights;
+    
+    for (size_t i = 0; i < visible.size(); i++) {
+        BandWeight weight;
+        weight.channelIndex = visible[i].second;
+        for (int c = 0; c < 3; c++) {
+            double value = xyzToRgb[c][0] * xyz[i * 3] + xyzToRgb[c][1] * xyz[i * 3 + 1] + xyzToRgb[c][2] * xyz[i * 3 + 2];
+            weight.rgb[c] = static_cast<float>(value / ySum);
+        }
+        weights.push_back(weight);
+    }
+    
+    // Баланс белого: плоский спектр (равноэнергетический источник) даёт нейтральный серый
+    double flatResponse[3] = {0.0, 0.0, 0.0};
+    for (const BandWeight& weight : weights) {
+        for (int c = 0; c < 3; c++) {
+            flatResponse[c] += weight.rgb[c];
+        }
+    }
+    for (BandWeight& weight : weights) {
+        for (int c = 0; c < 3; c++) {
+            if (flatResponse[c] > 0.0) {
+                weight.rgb[c] = static_cast<float>(weight.rgb[c] / flatResponse[c]);
+            }
+        }
+    }
+    
+    return weights;
+}
+
+BandComposite::Source BandComposite::makeSource(const HyperspectralImage& image, const std::vector<BandWeight>& weights) {
+    Source source;
+    source.width = image.getWidth();
+    source.height = image.getHeight();
+    const size_t numPixels = static_cast<size_t>(source.width) * source.height;
+    
+    // Отбираем загруженные каналы с ненулевым вкладом
+    for (const BandWeight& weight : weights) {
+        const auto& data = image.get16bitData(weight.channelIndex);
+        if (numPixels == 0 || data.size() != numPixels) continue;
+        if (weight.rgb[0] == 0.0f && weight.rgb[1] == 0.0f && weight.rgb[2] == 0.0f) continue;
+        source.bands.push_back(data.data());
+        source.weights.push_back(weight);
+    }
+    return source;
+}
+
+QImage BandComposite::compose(const Source& source, double percentCut, bool linkedStretch, bool srgbGamma) {
+    const uint32_t width = source.width;
+    const uint32_t height = source.height;
+    const size_t numPixels = static_cast<size_t>(width) * height;
+    if (!source.isValid() || numPixels == 0 || source.weights.size() != source.bands.size()) return QImage();
+    
+    QImage image(width, height, QImage::Format_RGB32);
+    if (image.isNull()) return image;
+    
+    // Плитка из нескольких строк: три float-аккумулятора помещаются в L2,
+    // а каждый канал читается по ней один раз непрерывным блоком
+    const int64_t rowsPerTile = std::max<int64_t>(1, kTilePixels / width);
+    const size_t tilePixels = static_cast<size_t>(rowsPerTile) * width;
+    const int64_t numTiles = (height + rowsPerTile - 1) / rowsPerTile;
+    
+    // Сумма каналов плитки [begin, begin + count) в три плоскости по tilePixels значений
+    auto accumulate = [&source, tilePixels](size_t begin, size_t count, float* acc) {
+        float* accRed = acc;
+        float* accGreen = acc + tilePixels;
+        float* accBlue = acc + 2 * tilePixels;
+        std::fill_n(accRed, count, 0.0f);
+        std::fill_n(accGreen, count, 0.0f);
+        std::fill_n(accBlue, count, 0.0f);
+        
+        for (size_t band = 0; band < source.bands.size(); band++) {
+            const uint16_t* src = source.bands[band] + begin;
+            const float wr = source.weights[band].rgb[0];
+            const float wg = source.weights[band].rgb[1];
+            const float wb = source.weights[band].rgb[2];
+            
+            for (size_t i = 0; i < count; i++) {
+                float v = src[i];
+                accRed[i] += wr * v;
+                accGreen[i] += wg * v;
+                accBlue[i] += wb * v;
+            }
+        }
+    };
+    
+    // Проход 1: для перцентилей достаточно каждого stride-го пикселя, до kMaxSamples значений.
+    // Плитки пишут в свои ячейки выборки, поэтому без блокировки
+    const size_t stride = std::max<size_t>(1, numPixels / kMaxSamples);
+    const size_t numSamples = (numPixels + stride - 1) / stride;
+    std::vector<float> samples[3];
+    for (int c = 0; c < 3; c++) samples[c].resize(numSamples);
+    
+    Parallel::forRange(0, numTiles, 1, [&](int64_t tileBegin, int64_t tileEnd) {
+        std::vector<float> acc(tilePixels * 3);
+        for (int64_t tile = tileBegin; tile < tileEnd; tile++) {
+            const size_t begin = static_cast<size_t>(tile) * tilePixels;
+            const size_t count = std::min(tilePixels, numPixels - begin);
+            accumulate(begin, count, acc.data());
+            
+            for (size_t p = (begin + stride - 1) / stride * stride; p < begin + count; p += stride) {
+                for (int c = 0; c < 3; c++) samples[c][p / stride] = acc[c * tilePixels + (p - begin)];
+            }
+        }
+    });
+    
+    float low[3], high[3];
+    for (int c = 0; c < 3; c++) {
+        auto range = percentileRange(samples[c], percentCut, percentCut);
+        low[c] = range.first;
+        high[c] = range.second;
+        std::vector<float>().swap(samples[c]);
+    }
+    
+    if (linkedStretch) {
+        float commonLow = std::min({low[0], low[1], low[2]});
+        float commonHigh = std::max({high[0], high[1], high[2]});
+        for (int c = 0; c < 3; c++) {
+            low[c] = commonLow;
+            high[c] = commonHigh;
+        }
+    }
+    
+    float scale[3];
+    for (int c = 0; c < 3; c++) {
+        scale[c] = high[c] > low[c] ? 1.0f / (high[c] - low[c]) : 1.0f;
+    }
+    
+    uint8_t gammaLUT[4096];
+    for (int i = 0; i < 4096; i++) {
+        float linear = i / 4095.0f;
+        gammaLUT[i] = srgbGamma ? encodeSrgb(linear) : static_cast<uint8_t>(linear * 255.0f + 0.5f);
+    }
+    
+    // Проход 2: плитка считается заново и сразу переводится в 8 бит
+    Parallel::forRange(0, numTiles, 1, [&](int64_t tileBegin, int64_t tileEnd) {
+        std::vector<float> acc(tilePixels * 3);
+        for (int64_t tile = tileBegin; tile < tileEnd; tile++) {
+            const int64_t rowBegin = tile * rowsPerTile;
+            const int64_t rowEnd = std::min<int64_t>(height, rowBegin + rowsPerTile);
+            const size_t begin = static_cast<size_t>(rowBegin) * width;
+            accumulate(begin, static_cast<size_t>(rowEnd - rowBegin) * width, acc.data());
+            
+            for (int64_t y = rowBegin; y < rowEnd; y++) {
+                QRgb* scanLine = reinterpret_cast<QRgb*>(image.scanLine(static_cast<int>(y)));
+                const size_t rowOffset = static_cast<size_t>(y - rowBegin) * width;
+                
+                for (uint32_t x = 0; x < width; x++) {
+                    uint8_t out[3];
+                    for (int c = 0; c < 3; c++) {
+                        float v = (acc[c * tilePixels + rowOffset + x] - low[c]) * scale[c];
+                        out[c] = gammaLUT[static_cast<int>(std::clamp(v, 0.0f, 1.0f) * 4095.0f)];
+                    }
+                    scanLine[x] = qRgb(out[0], out[1], out[2]);
+                }
+            }
+        }
+    });
+    
+    return image;
+}
+
+std::pair<float, float> BandComposite::percentileRange(std::vector<float>& samples, double percentLow, double percentHigh) {
+    if (samples.empty()) return {0.0f, 1.0f};
+    
+    size_t lowIndex = static_cast<size_t>(samples.size() * percentLow / 100.0);
+    size_t highIndex = static_cast<size_t>(samples.size() * (100.0 - percentHigh) / 100.0);
+    lowIndex = std::min(lowIndex, samples.size() - 1);
+    highIndex = std::min(std::max(highIndex, lowIndex), samples.size() - 1);
+    
+    std::nth_element(samples.begin(), samples.begin() + lowIndex, samples.end());
+    float low = samples[lowIndex];
+    std::nth_element(samples.begin(), samples.begin() + highIndex, samples.end());
+    float high = samples[highIndex];
+    
+    return {low, high};
+}
@@ -0,0 +1,44 @@
+#ifndef BAND_COMPOSITE_H
+#define BAND_COMPOSITE_H
+
+#include <QImage>
+#include <vector>
+#include <cstdint>
+#include "hyperspectral_image.h"
+
+// Синтез RGB из произвольного числа каналов по матрице весов
+class BandComposite {
+public:
+    struct BandWeight {
+        int channelIndex = 0;
+        float rgb[3] = {0.0f, 0.0f, 0.0f};
+    };
+
+    // Веса по функциям сложения цветов CIE 1931, пересчитанные в линейный sRGB
+    // и сбалансированные так, что плоский спектр даёт нейтральный серый.
+    // wavelengths[i] - длина волны канала i в нм (<= 0, если неизвестна)
+    static std::vector<BandWeight> cieTrueColorWeights(const std::vector<double>& wavelengths);
+
+    // Снимок для синтеза в фоновом потоке: указатели на 16-битные каналы с ненулевым вкладом и их веса
+    struct Source {
+        std::vector<const uint16_t*> bands;
+        std::vector<BandWeight> weights;
+        uint32_t width = 0;
+        uint32_t height = 0;
+
+        bool isValid() const { return !bands.empty(); }
+    };
+    static Source makeSource(const HyperspectralImage& image, const std::vector<BandWeight>& weights);
+
+    // Взвешенная сумма каналов сразу в 8 бит с обрезкой percentCut % с каждого края.
+    // Два прохода по плиткам строк: первый собирает выборку для перцентилей, второй
+    // считает плитку заново и пишет пиксели, так что float-копии изображения нет.
+    // linkedStretch задаёт общий масштаб для трёх плоскостей, что сохраняет баланс белого
+    static QImage compose(const Source& source, double percentCut, bool linkedStretch, bool srgbGamma);
+
+private:
+    // Переставляет samples
+    static std::pair<float, float> percentileRange(std::vector<float>& samples, double percentLow, double percentHigh);
+};
+
+#endif
@@ -0,0 +1,429 @@
+#include "band_math.h"
+#include "parallel_utils.h"
+#include <QLocale>
+#include <QMutex>
+#include <QMutexLocker>
+#include <algorithm>
+#include <string>
+#include <cstdlib>
+#include <cctype>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// Стек выражения на блок - несколько массивов по 4 КБ, остаётся в L1/L2
+const size_t kBlockPixels = 1024;
+
+struct Function {
+    const char* name;
+    BandMath::Op op;
+    int arguments;
+};
+
+const Function kFunctions[] = {
+    {"sqrt", BandMath::SQRT, 1}, {"abs", BandMath::ABS, 1}, {"log", BandMath::LOG, 1},
+    {"exp", BandMath::EXP, 1},   {"min", BandMath::MIN, 2}, {"max", BandMath::MAX, 2},
+};
+
+bool isUnary(BandMath::Op op) {
+    return op == BandMath::NEG || op == BandMath::SQRT || op == BandMath::ABS || op == BandMath::LOG ||
+           op == BandMath::EXP;
+}
+
+float applyUnary(BandMath::Op op, float a) {
+    switch (op) {
+    case BandMath::NEG: return -a;
+    case BandMath::SQRT: return std::sqrt(a);
+    case BandMath::ABS: return std::fabs(a);
+    case BandMath::LOG: return std::log(a);
+    case BandMath::EXP: return std::exp(a);
+    default: return a;
+    }
+}
+
+float applyBinary(BandMath::Op op, float a, float b) {
+    switch (op) {
+    case BandMath::ADD: return a + b;
+    case BandMath::SUB: return a - b;
+    case BandMath::MUL: return a * b;
+    case BandMath::DIV: return a / b;
+    case BandMath::POW: return std::pow(a, b);
+    case BandMath::MIN: return std::min(a, b);
+    case BandMath::MAX: return std::max(a, b);
+    default: return a;
+    }
+}
+
+// Рекурсивный спуск:
+//   expr  := term (('+' | '-') term)*
+//   term  := unary (('*' | '/') unary)*
+//   unary := '-' unary | power
+//   power := primary ('^' unary)?
+//   primary := число | bN | @λ | функция '(' expr [',' expr] ')' | '(' expr ')'
+class Parser {
+public:
+    Parser(const std::string& text, int numChannels, const std::vector<double>& wavelengths,
+           BandMath::Program& program)
+        : text(text), numChannels(numChannels), wavelengths(wavelengths), program(program) {}
+
+    bool parse(QString& error) {
+        bool ok = parseExpression();
+        skipSpaces();
+        if (ok && position != text.size()) ok = fail("лишний символ");
+        if (!ok) error = QString("%1 (позиция %2)").arg(message).arg(position + 1);
+        return ok;
+    }
+
+private:
+    bool fail(const QString& reason) {
+        if (message.isEmpty()) message = reason;
+        return false;
+    }
+
+    void skipSpaces() {
+        while (position < text.size() && std::isspace(static_cast<unsigned char>(text[position]))) position++;
+    }
+
+    bool accept(char symbol) {
+        skipSpaces();
+        if (position < text.size() && text[position] == symbol) {
+            position++;
+            return true;
+        }
+        return false;
+    }
+
+    // Только десятичная запись с точкой: [цифры][.цифры][e[+-]цифры]. Число читает
+    // QLocale::c(), а не strtod - тот зависит от локали процесса и понимает 0x10
+    bool parseNumber(double& value) {
+        skipSpaces();
+        const size_t begin = position;
+        auto skipDigits = [this]() {
+            const size_t first = position;
+            while (position < text.size() && std::isdigit(static_cast<unsigned char>(text[position]))) position++;
+            return position > first;
+        };
+        bool digits = skipDigits();
+        if (position < text.size() && text[position] == '.') {
+            position++;
+            digits = skipDigits() || digits;
+        }
+        if (!digits) {
+            position = begin;
+            return fail("ожидалось число");
+        }
+        if (position < text.size() && (text[position] == 'e' || text[position] == 'E')) {
+            const size_t mantissaEnd = position;
+            position++;
+            if (position < text.size() && (text[position] == '+' || text[position] == '-')) position++;
+            if (!skipDigits()) position = mantissaEnd;
+        }
+
+        bool ok = false;
+        value = QLocale::c().toDouble(QString::fromStdString(text.substr(begin, position - begin)), &ok);
+        if (!ok) {
+            position = begin;
+            return fail("ожидалось число");
+        }
+        return true;
+    }
+
+    void appendConstant(double value) {
+        program.constants.push_back(static_cast<float>(value));
+        program.code.push_back({BandMath::LOAD_CONST, static_cast<int>(program.constants.size()) - 1});
+    }
+
+    bool isConstant(size_t fromEnd) const {
+        return program.code.size() > fromEnd && program.code[program.code.size() - 1 - fromEnd].op == BandMath::LOAD_CONST;
+    }
+
+    float constantAt(size_t fromEnd) const {
+        return program.constants[program.code[program.code.size() - 1 - fromEnd].operand];
+    }
+
+    // Операция над одними константами считается сразу, а не на каждом пикселе
+    void append(BandMath::Op op) {
+        if (isUnary(op) && isConstant(0)) {
+            const float value = applyUnary(op, constantAt(0));
+            program.code.pop_back();
+            appendConstant(value);
+            return;
+        }
+        if (!isUnary(op) && isConstant(0) && isConstant(1)) {
+            const float value = applyBinary(op, constantAt(1), constantAt(0));
+            program.code.pop_back();
+            program.code.pop_back();
+            appendConstant(value);
+            return;
+        }
+        program.code.push_back({op, 0});
+    }
+
+    void appendChannel(int channel) {
+        auto slot = std::find(program.channels.begin(), program.channels.end(), channel);
+        if (slot == program.channels.end()) {
+            program.channels.push_back(channel);
+            slot = program.channels.end() - 1;
+        }
+        program.code.push_back({BandMath::LOAD_BAND, static_cast<int>(slot - program.channels.begin())});
+    }
+
+    bool parseExpression() {
+        if (!parseTerm()) return false;
+        while (true) {
+            if (accept('+')) {
+                if (!parseTerm()) return false;
+                append(BandMath::ADD);
+            } else if (accept('-')) {
+                if (!parseTerm()) return false;
+                append(BandMath::SUB);
+            } else {
+                return true;
+            }
+        }
+    }
+
+    bool parseTerm() {
+        if (!parseUnary()) return false;
+        while (true) {
+            if (accept('*')) {
+                if (!parseUnary()) return false;
+                append(BandMath::MUL);
+            } else if (accept('/')) {
+                if (!parseUnary()) return false;
+                append(BandMath::DIV);
+            } else {
+                return true;
+            }
+        }
+    }
+
+    bool parseUnary() {
+        if (accept('-')) {
+            if (!parseUnary()) return false;
+            append(BandMath::NEG);
+            return true;
+        }
+        if (accept('+')) return parseUnary();
+        return parsePower();
+    }
+
+    bool parsePower() {
+        if (!parsePrimary()) return false;
+        if (accept('^')) {
+            if (!parseUnary()) return false;
+            append(BandMath::POW);
+        }
+        return true;
+    }
+
+    bool parsePrimary() {
+        skipSpaces();
+        if (position >= text.size()) return fail("выражение оборвано");
+
+        if (accept('(')) {
+            if (!parseExpression()) return false;
+            return accept(')') || fail("ожидалась ')'");
+        }
+
+        if (accept('@')) {
+            double wavelength = 0.0;
+            if (!parseNumber(wavelength)) return false;
+            int nearest = -1;
+            for (int i = 0; i < static_cast<int>(wavelengths.size()); i++) {
+                if (wavelengths[i] <= 0) continue;
+                if (nearest < 0 || std::fabs(wavelengths[i] - wavelength) < std::fabs(wavelengths[nearest] - wavelength)) {
+                    nearest = i;
+                }
+            }
+            if (nearest < 0) return fail("длины волн каналов неизвестны, используйте bN");
+            appendChannel(nearest);
+            return true;
+        }
+
+        const char symbol = text[position];
+        if (std::isdigit(static_cast<unsigned char>(symbol)) || symbol == '.') {
+            double value = 0.0;
+            if (!parseNumber(value)) return false;
+            appendConstant(value);
+            return true;
+        }
+
+        if (!std::isalpha(static_cast<unsigned char>(symbol))) return fail("неожиданный символ");
+        const size_t begin = position;
+        while (position < text.size() && std::isalnum(static_cast<unsigned char>(text[position]))) position++;
+        std::string name = text.substr(begin, position - begin);
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+
+        for (const Function& function : kFunctions) {
+            if (name != function.name) continue;
+            if (!accept('(')) return fail("ожидалась '(' после имени функции");
+            for (int argument = 0; argument < function.arguments; argument++) {
+                if (argument > 0 && !accept(',')) return fail("ожидалась ','");
+                if (!parseExpression()) return false;
+            }
+            if (!accept(')')) return fail("ожидалась ')'");
+            append(function.op);
+            return true;
+        }
+
+        if (name.size() > 1 && name[0] == 'b' &&
+            std::all_of(name.begin() + 1, name.end(), [](unsigned char c) { return std::isdigit(c); })) {
+            const int number = std::atoi(name.c_str() + 1);
+            if (number < 1 || number > numChannels) {
+                position = begin;
+                return fail(QString("нет канала %1").arg(number));
+            }
+            appendChannel(number - 1);
+            return true;
+        }
+
+        position = begin;
+        return fail(QString("неизвестное имя '%1'").arg(QString::fromStdString(name)));
+    }
+
+    const std::string& text;
+    const int numChannels;
+    const std::vector<double>& wavelengths;
+    BandMath::Program& program;
+    size_t position = 0;
+    QString message;
+};
+
+// Байткод над блоком из count пикселей с begin; stack - stackDepth массивов по kBlockPixels.
+// Результат остаётся в нижнем массиве стека
+const float* evaluateBlock(const BandMath::Program& program, const std::vector<const uint16_t*>& bands,
+                           const std::vector<SampleQuantization>& quantization, size_t begin, size_t count,
+                           float* stack) {
+    int top = 0;
+    for (const BandMath::Instruction& instruction : program.code) {
+        // b - вершина стека, a - под ней; бинарная операция пишет в a
+        float* b = top > 0 ? stack + static_cast<size_t>(top - 1) * kBlockPixels : nullptr;
+        float* a = top > 1 ? b - kBlockPixels : nullptr;
+        switch (instruction.op) {
+        case BandMath::LOAD_BAND: {
+            float* target = stack + static_cast<size_t>(top++) * kBlockPixels;
+            const uint16_t* source = bands[instruction.operand] + begin;
+            const float offset = static_cast<float>(quantization[instruction.operand].offset);
+            const float scale = static_cast<float>(quantization[instruction.operand].scale);
+            for (size_t p = 0; p < count; p++) target[p] = offset + scale * source[p];
+            break;
+        }
+        case BandMath::LOAD_CONST: {
+            float* target = stack + static_cast<size_t>(top++) * kBlockPixels;
+            std::fill(target, target + count, program.constants[instruction.operand]);
+            break;
+        }
+        case BandMath::ADD: for (size_t p = 0; p < count; p++) a[p] += b[p]; top--; break;
+        case BandMath::SUB: for (size_t p = 0; p < count; p++) a[p] -= b[p]; top--; break;
+        case BandMath::MUL: for (size_t p = 0; p < count; p++) a[p] *= b[p]; top--; break;
+        case BandMath::DIV: for (size_t p = 0; p < count; p++) a[p] /= b[p]; top--; break;
+        case BandMath::POW: for (size_t p = 0; p < count; p++) a[p] = std::pow(a[p], b[p]); top--; break;
+        case BandMath::MIN: for (size_t p = 0; p < count; p++) a[p] = std::min(a[p], b[p]); top--; break;
+        case BandMath::MAX: for (size_t p = 0; p < count; p++) a[p] = std::max(a[p], b[p]); top--; break;
+        case BandMath::NEG: for (size_t p = 0; p < count; p++) b[p] = -b[p]; break;
+        case BandMath::SQRT: for (size_t p = 0; p < count; p++) b[p] = std::sqrt(b[p]); break;
+        case BandMath::ABS: for (size_t p = 0; p < count; p++) b[p] = std::fabs(b[p]); break;
+        case BandMath::LOG: for (size_t p = 0; p < count; p++) b[p] = std::log(b[p]); break;
+        case BandMath::EXP: for (size_t p = 0; p < count; p++) b[p] = std::exp(b[p]); break;
+        }
+    }
+    return stack;
+}
+
+} // namespace
+
+bool BandMath::compile(const QString& expression, int numChannels, const std::vector<double>& wavelengths,
+                       Program& program, QString& error) {
+    program = Program();
+    program.expression = expression.trimmed();
+    if (program.expression.isEmpty()) {
+        error = "Пустое выражение";
+        return false;
+    }
+
+    const std::string text = program.expression.toStdString();
+    Parser parser(text, numChannels, wavelengths, program);
+    if (!parser.parse(error)) {
+        program = Program();
+        return false;
+    }
+
+    // Глубина стека - сколько блоков держит одна задача
+    int depth = 0;
+    for (const Instruction& instruction : program.code) {
+        if (instruction.op == LOAD_BAND || instruction.op == LOAD_CONST) {
+            depth++;
+        } else if (!isUnary(instruction.op)) {
+            depth--;
+        }
+        program.stackDepth = std::max(program.stackDepth, depth);
+    }
+    return true;
+}
+
+SpectralTransform::CubeProduct BandMath::evaluate(const Program& program, const std::vector<const uint16_t*>& bands,
+                                                  const std::vector<SampleQuantization>& quantization,
+                                                  size_t numPixels) {
+    SpectralTransform::CubeProduct product;
+    if (!program.isValid() || numPixels == 0 || bands.size() != program.channels.size() ||
+        quantization.size() != bands.size()) {
+        return product;
+    }
+
+    // Диапазон результата известен только после вычисления: первый проход по блокам
+    // собирает его, второй вычисляет блоки заново и сразу кодирует. Байткод над блоком
+    // дешевле, чем хранить значения всего изображения в float
+    float minimum = std::numeric_limits<float>::max();
+    float maximum = std::numeric_limits<float>::lowest();
+    QMutex mutex;
+
+    const int64_t numBlocks = static_cast<int64_t>((numPixels + kBlockPixels - 1) / kBlockPixels);
+    const int64_t grainSize = std::max<int64_t>(1, numBlocks / (4 * Parallel::threadCount()));
+    Parallel::forRange(0, numBlocks, grainSize, [&](int64_t blockBegin, int64_t blockEnd) {
+        std::vector<float> stack(static_cast<size_t>(program.stackDepth) * kBlockPixels);
+        float localMin = std::numeric_limits<float>::max();
+        float localMax = std::numeric_limits<float>::lowest();
+
+        for (int64_t blockIndex = blockBegin; blockIndex < blockEnd; blockIndex++) {
+            const size_t begin = static_cast<size_t>(blockIndex) * kBlockPixels;
+            const size_t count = std::min(kBlockPixels, numPixels - begin);
+            const float* result = evaluateBlock(program, bands, quantization, begin, count, stack.data());
+            for (size_t p = 0; p < count; p++) {
+                if (!std::isfinite(result[p])) continue;
+                localMin = std::min(localMin, result[p]);
+                localMax = std::max(localMax, result[p]);
+            }
+        }
+
+        QMutexLocker locker(&mutex);
+        minimum = std::min(minimum, localMin);
+        maximum = std::max(maximum, localMax);
+    });
+
+    // Минимум получает код 1, максимум - 65535; код kNoDataCode остаётся нечисловым значениям
+    SampleQuantization scale;
+    if (maximum >= minimum) {
+        scale.scale = maximum > minimum ? (static_cast<double>(maximum) - minimum) / (65535.0 - 1.0) : 1.0;
+        scale.offset = minimum - scale.scale;
+    }
+
+    product.bands.assign(1, std::vector<uint16_t>(numPixels));
+    product.quantization.assign(1, scale);
+    uint16_t* codes = product.bands[0].data();
+    Parallel::forRange(0, numBlocks, grainSize, [&](int64_t blockBegin, int64_t blockEnd) {
+        std::vector<float> stack(static_cast<size_t>(program.stackDepth) * kBlockPixels);
+
+        for (int64_t blockIndex = blockBegin; blockIndex < blockEnd; blockIndex++) {
+            const size_t begin = static_cast<size_t>(blockIndex) * kBlockPixels;
+            const size_t count = std::min(kBlockPixels, numPixels - begin);
+            const float* result = evaluateBlock(program, bands, quantization, begin, count, stack.data());
+            for (size_t p = 0; p < count; p++) {
+                const float value = result[p];
+                codes[begin + p] = std::isfinite(value) ? std::max<uint16_t>(1, scale.encode(value)) : kNoDataCode;
+            }
+        }
+    });
+    return product;
+}
@@ -0,0 +1,64 @@
+#ifndef BAND_MATH_H
+#define BAND_MATH_H
+
+#include <QString>
+#include <vector>
+#include <cstdint>
+#include "spectral_transform.h"
+
+// Выражения над каналами вида (b54 - b28) / (b54 + b28) или (@860 - @660) / (@860 + @660):
+// bN - канал с номером N (с 1), @λ - спектральный канал с ближайшей длиной волны.
+// Операции + - * / ^, функции sqrt, abs, log, exp, min, max.
+// Выражение разбирается один раз в стековый байткод, который исполняется над блоками
+// пикселей целиком: каждая инструкция - один цикл по блоку float, без ветвлений на пиксель
+class BandMath {
+public:
+    enum Op {
+        LOAD_BAND,   // operand - слот в Program::channels
+        LOAD_CONST,  // operand - индекс в Program::constants
+        ADD,
+        SUB,
+        MUL,
+        DIV,
+        POW,
+        NEG,
+        SQRT,
+        ABS,
+        LOG,
+        EXP,
+        MIN,
+        MAX
+    };
+
+    struct Instruction {
+        Op op;
+        int operand = 0;
+    };
+
+    struct Program {
+        QString expression;
+        std::vector<Instruction> code;
+        std::vector<float> constants;
+        std::vector<int> channels;  // каналы, которые читает выражение, без повторов
+        int stackDepth = 0;
+
+        bool isValid() const { return !code.empty(); }
+    };
+
+    // numChannels - сколько каналов доступно по bN; wavelengths - длины волн
+    // спектральных каналов для @λ (0 - неизвестна). Константы сворачиваются при разборе
+    static bool compile(const QString& expression, int numChannels, const std::vector<double>& wavelengths,
+                        Program& program, QString& error);
+
+    // bands[i] и quantization[i] - данные канала program.channels[i]. Значения считаются в
+    // исходных единицах; блоки пикселей - в пуле потоков. Результат кодируется по своему
+    // диапазону: первый проход ищет диапазон, второй вычисляет блоки заново и кодирует.
+    // Код 0 зарезервирован за нечисловыми значениями (деление на 0, корень из
+    // отрицательного): конечные значения кодируются в 1..65535 и в диапазон не входят
+    static const uint16_t kNoDataCode = 0;
+    static SpectralTransform::CubeProduct evaluate(const Program& program, const std::vector<const uint16_t*>& bands,
+                                                   const std::vector<SampleQuantization>& quantization,
+                                                   size_t numPixels);
+};
+
+#endif
@@ -0,0 +1,241 @@
+#include "channel_statistics.h"
+#include "parallel_utils.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Блок меньше этого размера не стоит отдельной задачи:
+// слияние 65536 счётчиков дороже самого подсчёта
+const size_t kMinBlockPixels = 1 << 18;
+
+// Блок строк для моментов помещается в L2, второй проход по нему не идёт в память
+const uint32_t kMomentBlockPixels = 1 << 16;
+
+} // namespace
+
+void ChannelStatistics::Histogram::updateCumulative() {
+    cumulative.resize(bins.size());
+    uint64_t sum = 0;
+    for (size_t i = 0; i < bins.size(); i++) {
+        sum += bins[i];
+        cumulative[i] = sum;
+    }
+    total = sum;
+}
+
+uint16_t ChannelStatistics::Histogram::valueAtRank(uint64_t rank) const {
+    if (cumulative.empty()) return 0;
+    auto it = std::lower_bound(cumulative.begin(), cumulative.end(), rank);
+    if (it == cumulative.end()) return maxVal;
+    return static_cast<uint16_t>(minVal + (it - cumulative.begin()));
+}
+
+std::pair<uint16_t, uint16_t> ChannelStatistics::Histogram::percentileBounds(double percentLow, double percentHigh) const {
+    if (isEmpty()) return {0, 65535};
+
+    uint64_t lowCutoff = static_cast<uint64_t>(total * percentLow / 100.0);
+    uint64_t highCutoff = static_cast<uint64_t>(total * (100.0 - percentHigh) / 100.0);
+
+    return {valueAtRank(lowCutoff), valueAtRank(highCutoff)};
+}
+
+void ChannelStatistics::countValues(const uint16_t* data, size_t count, uint32_t* bins) {
+    uint32_t* bank0 = bins;
+    uint32_t* bank1 = bins + 65536;
+    uint32_t* bank2 = bins + 2 * 65536;
+    uint32_t* bank3 = bins + 3 * 65536;
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        bank0[data[i]]++;
+        bank1[data[i + 1]]++;
+        bank2[data[i + 2]]++;
+        bank3[data[i + 3]]++;
+    }
+    for (; i < count; i++) {
+        bank0[data[i]]++;
+    }
+}
+
+ChannelStatistics::Histogram ChannelStatistics::compute(const uint16_t* data, size_t count) {
+    HistogramAccumulator accumulator(1);
+    accumulator.addChannel(0, data, count);
+    return std::move(accumulator.takeResults()[0]);
+}
+
+ChannelStatistics::Histogram ChannelStatistics::fromCounts(const std::vector<int>& counts, int firstValue) {
+    Histogram histogram;
+    auto first = std::find_if(counts.begin(), counts.end(), [](int count) { return count > 0; });
+    if (first == counts.end()) return histogram;
+
+    auto last = std::find_if(counts.rbegin(), counts.rend(), [](int count) { return count > 0; });
+    histogram.minVal = static_cast<uint16_t>(firstValue + (first - counts.begin()));
+    histogram.maxVal = static_cast<uint16_t>(firstValue + (counts.rend() - last - 1));
+    histogram.bins.assign(first, last.base());
+    histogram.updateCumulative();
+    return histogram;
+}
+
+void ChannelStatistics::Moments::merge(const Moments& other) {
+    if (other.count == 0) return;
+    if (count == 0) {
+        *this = other;
+        return;
+    }
+
+    const double na = static_cast<double>(count);
+    const double nb = static_cast<double>(other.count);
+    const double n = na + nb;
+    const double delta = other.mean - mean;
+    const double delta2 = delta * delta;
+
+    m4 += other.m4 + delta2 * delta2 * na * nb * (na * na - na * nb + nb * nb) / (n * n * n)
+        + 6.0 * delta2 * (na * na * other.m2 + nb * nb * m2) / (n * n)
+        + 4.0 * delta * (na * other.m3 - nb * m3) / n;
+    m3 += other.m3 + delta2 * delta * na * nb * (na - nb) / (n * n)
+        + 3.0 * delta * (na * other.m2 - nb * m2) / n;
+    m2 += other.m2 + delta2 * na * nb / n;
+    mean += delta * nb / n;
+    count += other.count;
+}
+
+double ChannelStatistics::Moments::skewness() const {
+    if (count == 0 || m2 <= 0.0) return 0.0;
+    return std::sqrt(static_cast<double>(count)) * m3 / std::pow(m2, 1.5);
+}
+
+double ChannelStatistics::Moments::kurtosis() const {
+    if (count == 0 || m2 <= 0.0) return 0.0;
+    return static_cast<double>(count) * m4 / (m2 * m2) - 3.0;
+}
+
+ChannelStatistics::BandStatistics ChannelStatistics::computeBandStatistics(const uint16_t* data, uint32_t width, uint32_t height) {
+    BandStatistics result;
+    if (!data || width == 0 || height == 0) return result;
+
+    Moments values;
+    Moments differences;  // только count, mean и m2
+    const uint32_t rowsPerBlock = std::max<uint32_t>(1, kMomentBlockPixels / width);
+
+    for (uint32_t rowBegin = 0; rowBegin < height; rowBegin += rowsPerBlock) {
+        const uint32_t rowEnd = std::min(height, rowBegin + rowsPerBlock);
+        const uint16_t* block = data + static_cast<size_t>(rowBegin) * width;
+        const size_t blockPixels = static_cast<size_t>(rowEnd - rowBegin) * width;
+
+        // Целочисленные суммы по блоку точны
+        uint64_t sum = 0;
+        int64_t diffSum = 0;
+        uint64_t diffSquares = 0;
+        for (uint32_t y = 0; y < rowEnd - rowBegin; y++) {
+            const uint16_t* row = block + static_cast<size_t>(y) * width;
+            sum += row[0];
+            for (uint32_t x = 1; x < width; x++) {
+                const int64_t diff = static_cast<int64_t>(row[x]) - row[x - 1];
+                sum += row[x];
+                diffSum += diff;
+                diffSquares += static_cast<uint64_t>(diff * diff);
+            }
+        }
+
+        Moments blockMoments;
+        blockMoments.count = blockPixels;
+        blockMoments.mean = static_cast<double>(sum) / blockPixels;
+        for (size_t i = 0; i < blockPixels; i++) {
+            const double d = block[i] - blockMoments.mean;
+            const double d2 = d * d;
+            blockMoments.m2 += d2;
+            blockMoments.m3 += d2 * d;
+            blockMoments.m4 += d2 * d2;
+        }
+        values.merge(blockMoments);
+
+        const uint64_t diffCount = static_cast<uint64_t>(rowEnd - rowBegin) * (width - 1);
+        if (diffCount > 0) {
+            Moments blockDifferences;
+            blockDifferences.count = diffCount;
+            blockDifferences.mean = static_cast<double>(diffSum) / diffCount;
+            blockDifferences.m2 = std::max(0.0, static_cast<double>(diffSquares) - blockDifferences.mean * diffSum);
+            differences.merge(blockDifferences);
+        }
+    }
+
+    result.mean = values.mean;
+    result.stdDev = std::sqrt(values.variance());
+    result.skewness = values.skewness();
+    result.kurtosis = values.kurtosis();
+    // Разность двух соседей с независимым шумом имеет дисперсию 2 * sigma^2
+    result.noise = std::sqrt(differences.variance() / 2.0);
+    result.snr = result.noise > 0.0 ? result.mean / result.noise : 0.0;
+    return result;
+}
+
+HistogramAccumulator::HistogramAccumulator(int numChannels) {
+    channels.resize(std::max(0, numChannels));
+}
+
+HistogramAccumulator::~HistogramAccumulator() {
+    pending.waitForFinished();
+}
+
+void HistogramAccumulator::addChannel(int channelIndex, const uint16_t* data, size_t count) {
+    if (channelIndex < 0 || channelIndex >= static_cast<int>(channels.size())) return;
+
+    auto& state = channels[channelIndex];
+    state = std::make_unique<ChannelState>();
+    if (!data || count == 0) return;
+
+    const size_t numBlocks = std::clamp<size_t>(count / kMinBlockPixels, 1, Parallel::threadCount());
+    const size_t blockSize = (count + numBlocks - 1) / numBlocks;
+
+    state->counts.assign(65536, 0);
+    state->pendingBlocks = static_cast<int>((count + blockSize - 1) / blockSize);
+
+    ChannelState* target = state.get();
+    for (size_t begin = 0; begin < count; begin += blockSize) {
+        const uint16_t* blockData = data + begin;
+        const size_t blockCount = std::min(blockSize, count - begin);
+        pending.addFuture(QtConcurrent::run([target, blockData, blockCount]() {
+            countBlock(target, blockData, blockCount);
+        }));
+    }
+}
+
+void HistogramAccumulator::countBlock(ChannelState* state, const uint16_t* data, size_t count) {
+    // Банки принадлежат потоку пула и переиспользуются его задачами
+    thread_local std::vector<uint32_t> banks;
+    banks.assign(4 * 65536, 0);
+    ChannelStatistics::countValues(data, count, banks.data());
+
+    const uint32_t* bank0 = banks.data();
+    const uint32_t* bank1 = bank0 + 65536;
+    const uint32_t* bank2 = bank0 + 2 * 65536;
+    const uint32_t* bank3 = bank0 + 3 * 65536;
+
+    QMutexLocker locker(&state->mutex);
+    int* counts = state->counts.data();
+    for (int val = 0; val < 65536; val++) {
+        counts[val] += static_cast<int>(bank0[val] + bank1[val] + bank2[val] + bank3[val]);
+    }
+
+    if (--state->pendingBlocks == 0) {
+        finishChannel(state);
+    }
+}
+
+void HistogramAccumulator::finishChannel(ChannelState* state) {
+    state->histogram = ChannelStatistics::fromCounts(state->counts, 0);
+    std::vector<int>().swap(state->counts);
+}
+
+std::vector<ChannelStatistics::Histogram> HistogramAccumulator::takeResults() {
+    pending.waitForFinished();
+    pending.clearFutures();
+
+    std::vector<ChannelStatistics::Histogram> results(channels.size());
+    for (size_t i = 0; i < channels.size(); i++) {
+        if (channels[i]) results[i] = std::move(channels[i]->histogram);
+    }
+    channels.clear();
+    return results;
+}
@@ -0,0 +1,106 @@
+#ifndef CHANNEL_STATISTICS_H
+#define CHANNEL_STATISTICS_H
+
+#include <QFutureSynchronizer>
+#include <QMutex>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <utility>
+
+// Гистограммы 16-битных каналов
+class ChannelStatistics {
+public:
+    // Хранится только диапазон [minVal, maxVal]: bins[value - minVal].
+    // Для 12-битных данных это не больше 4096 бинов вместо 65536
+    struct Histogram {
+        std::vector<int> bins;
+        std::vector<uint64_t> cumulative;  // cumulative[i] = bins[0] + ... + bins[i]
+        uint16_t minVal = 65535;
+        uint16_t maxVal = 0;
+        uint64_t total = 0;
+
+        int count(int value) const {
+            return value < minVal || value > maxVal ? 0 : bins[value - minVal];
+        }
+        bool isEmpty() const { return total == 0; }
+        size_t getMemoryUsage() const { return bins.size() * sizeof(int) + cumulative.size() * sizeof(uint64_t); }
+
+        // Пересчитывает cumulative и total по bins
+        void updateCumulative();
+        // Наименьшее значение, до которого включительно набирается rank пикселей; O(log n)
+        uint16_t valueAtRank(uint64_t rank) const;
+        // Границы после обрезки percentLow % снизу и percentHigh % сверху
+        std::pair<uint16_t, uint16_t> percentileBounds(double percentLow, double percentHigh) const;
+    };
+
+    // Последовательное ядро. Счёт идёт в четыре банка по 65536 счётчиков
+    // (bins[0..4*65536)), чтобы подряд идущие одинаковые значения не ждали
+    // предыдущую запись в тот же счётчик
+    static void countValues(const uint16_t* data, size_t count, uint32_t* bins);
+
+    // Гистограмма одного буфера, блоки строк считаются в пуле потоков
+    static Histogram compute(const uint16_t* data, size_t count);
+
+    // counts[i] - число пикселей со значением firstValue + i; пустые края отбрасываются
+    static Histogram fromCounts(const std::vector<int>& counts, int firstValue);
+
+    // Центральные моменты до четвёртого порядка. Частичные результаты
+    // сливаются попарно (формулы Пебея), без потери точности на больших n
+    struct Moments {
+        uint64_t count = 0;
+        double mean = 0.0;
+        double m2 = 0.0;  // суммы (x - mean)^k
+        double m3 = 0.0;
+        double m4 = 0.0;
+
+        void merge(const Moments& other);
+        double variance() const { return count > 1 ? m2 / (count - 1) : 0.0; }
+        double skewness() const;
+        double kurtosis() const;  // избыточный: 0 для нормального распределения
+    };
+
+    struct BandStatistics {
+        double mean = 0.0;
+        double stdDev = 0.0;
+        double skewness = 0.0;
+        double kurtosis = 0.0;
+        double noise = 0.0;  // СКО шума по разностям соседних пикселей строки
+        double snr = 0.0;    // mean / noise
+    };
+
+    // Один проход по каналу. Блок строк сначала даёт точное целое среднее,
+    // затем, пока он в кэше, - центральные суммы; блоки сливаются по порядку
+    static BandStatistics computeBandStatistics(const uint16_t* data, uint32_t width, uint32_t height);
+};
+
+// Считает гистограммы каналов по мере их поступления: каждый канал делится на
+// блоки, блоки считаются в пуле потоков в приватные счётчики и сливаются в
+// гистограмму канала. Данные каналов должны жить до вызова takeResults()
+class HistogramAccumulator {
+public:
+    explicit HistogramAccumulator(int numChannels);
+    ~HistogramAccumulator();
+
+    void addChannel(int channelIndex, const uint16_t* data, size_t count);
+    // Дожидается всех задач. Канал без данных даёт пустую гистограмму
+    std::vector<ChannelStatistics::Histogram> takeResults();
+
+private:
+    struct ChannelState {
+        QMutex mutex;
+        std::vector<int> counts;  // полные 65536 счётчиков, пока канал считается
+        int pendingBlocks = 0;
+        ChannelStatistics::Histogram histogram;
+    };
+
+    // Обрезает счётчики до непустого диапазона и освобождает полный буфер
+    static void finishChannel(ChannelState* state);
+
+    static void countBlock(ChannelState* state, const uint16_t* data, size_t count);
+
+    std::vector<std::unique_ptr<ChannelState>> channels;
+    QFutureSynchronizer<void> pending;
+};
+
+#endif
@@ -0,0 +1,150 @@
+#include "clahe.h"
+#include "parallel_utils.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Индексы двух соседних центров плиток вдоль оси и вес второго
+struct TileInterp {
+    int tile0;
+    int tile1;
+    float weight;
+};
+
+inline TileInterp tileInterp(uint32_t coord, float tileSize, int numTiles) {
+    float f = (coord + 0.5f) / tileSize - 0.5f;
+    if (f <= 0.0f) return {0, 0, 0.0f};
+
+    int tile0 = static_cast<int>(f);
+    if (tile0 >= numTiles - 1) return {numTiles - 1, numTiles - 1, 0.0f};
+    return {tile0, tile0 + 1, f - tile0};
+}
+
+} // namespace
+
+uint8_t Clahe::TileMap::map(uint16_t value, uint32_t x, uint32_t y) const {
+    const TileInterp ix = tileInterp(x, tileWidth, tilesX);
+    const TileInterp iy = tileInterp(y, tileHeight, tilesY);
+    const int bin = binOf[value];
+
+    float top = tileLUT(ix.tile0, iy.tile0)[bin] * (1.0f - ix.weight) + tileLUT(ix.tile1, iy.tile0)[bin] * ix.weight;
+    float bottom = tileLUT(ix.tile0, iy.tile1)[bin] * (1.0f - ix.weight) + tileLUT(ix.tile1, iy.tile1)[bin] * ix.weight;
+    return static_cast<uint8_t>(top * (1.0f - iy.weight) + bottom * iy.weight + 0.5f);
+}
+
+void Clahe::TileMap::mapRow(const uint16_t* row, uint32_t y, int step, uint32_t outWidth, uint8_t* out) const {
+    const TileInterp iy = tileInterp(y, tileHeight, tilesY);
+    const float wy = iy.weight;
+
+    for (uint32_t x = 0; x < outWidth; x++) {
+        const size_t index = static_cast<size_t>(x) * step;
+        const TileInterp ix = tileInterp(static_cast<uint32_t>(index), tileWidth, tilesX);
+        const int bin = binOf[row[index]];
+
+        float top = tileLUT(ix.tile0, iy.tile0)[bin] * (1.0f - ix.weight) + tileLUT(ix.tile1, iy.tile0)[bin] * ix.weight;
+        float bottom = tileLUT(ix.tile0, iy.tile1)[bin] * (1.0f - ix.weight) + tileLUT(ix.tile1, iy.tile1)[bin] * ix.weight;
+        out[x] = static_cast<uint8_t>(top * (1.0f - wy) + bottom * wy + 0.5f);
+    }
+}
+
+size_t Clahe::TileMap::getMemoryUsage() const {
+    return binOf.size() * sizeof(uint16_t) + tileLUTs.size();
+}
+
+std::shared_ptr<const Clahe::TileMap> Clahe::build(const uint16_t* data, uint32_t width, uint32_t height,
+                                                   uint16_t minVal, uint16_t maxVal,
+                                                   int tilesX, int tilesY, double clipLimit) {
+    if (!data || width == 0 || height == 0) return nullptr;
+
+    auto tileMap = std::make_shared<TileMap>();
+    tileMap->width = width;
+    tileMap->height = height;
+    tileMap->tilesX = std::clamp<int>(tilesX, 1, static_cast<int>(width));
+    tileMap->tilesY = std::clamp<int>(tilesY, 1, static_cast<int>(height));
+    tileMap->tileWidth = static_cast<float>(width) / tileMap->tilesX;
+    tileMap->tileHeight = static_cast<float>(height) / tileMap->tilesY;
+
+    // Окно контраста делится на бины; значения за его пределами попадают в крайние
+    const int64_t low = minVal;
+    const int64_t high = std::max<int64_t>(maxVal, low + 1);
+    const int64_t range = high - low + 1;
+    const int numBins = static_cast<int>(std::min<int64_t>(kMaxBins, range));
+    tileMap->numBins = numBins;
+
+    tileMap->binOf.resize(65536);
+    for (int64_t val = 0; val < 65536; val++) {
+        int64_t clamped = std::clamp(val, low, high);
+        tileMap->binOf[val] = static_cast<uint16_t>(std::min<int64_t>(numBins - 1, (clamped - low) * numBins / range));
+    }
+
+    const int numTiles = tileMap->tilesX * tileMap->tilesY;
+    tileMap->tileLUTs.resize(static_cast<size_t>(numTiles) * numBins);
+
+    // Каждая плитка - независимая задача со своей гистограммой
+    Parallel::forRange(0, numTiles, 1, [&](int64_t tileBegin, int64_t tileEnd) {
+        std::vector<uint32_t> histogram(numBins);
+
+        for (int64_t tile = tileBegin; tile < tileEnd; tile++) {
+            const int tileX = static_cast<int>(tile % tileMap->tilesX);
+            const int tileY = static_cast<int>(tile / tileMap->tilesX);
+            const uint32_t x0 = static_cast<uint32_t>(static_cast<uint64_t>(width) * tileX / tileMap->tilesX);
+            const uint32_t x1 = static_cast<uint32_t>(static_cast<uint64_t>(width) * (tileX + 1) / tileMap->tilesX);
+            const uint32_t y0 = static_cast<uint32_t>(static_cast<uint64_t>(height) * tileY / tileMap->tilesY);
+            const uint32_t y1 = static_cast<uint32_t>(static_cast<uint64_t>(height) * (tileY + 1) / tileMap->tilesY);
+
+            std::fill(histogram.begin(), histogram.end(), 0);
+            const uint16_t* binOf = tileMap->binOf.data();
+            for (uint32_t y = y0; y < y1; y++) {
+                const uint16_t* row = data + static_cast<size_t>(y) * width;
+                for (uint32_t x = x0; x < x1; x++) {
+                    histogram[binOf[row[x]]]++;
+                }
+            }
+
+            const uint64_t tilePixels = static_cast<uint64_t>(x1 - x0) * (y1 - y0);
+
+            if (clipLimit > 0.0) {
+                const uint32_t limit = std::max<uint32_t>(1, static_cast<uint32_t>(clipLimit * tilePixels / numBins));
+                uint64_t excess = 0;
+                for (uint32_t& count : histogram) {
+                    if (count > limit) {
+                        excess += count - limit;
+                        count = limit;
+                    }
+                }
+
+                const uint32_t add = static_cast<uint32_t>(excess / numBins);
+                uint64_t remainder = excess % numBins;
+                for (uint32_t& count : histogram) count += add;
+                if (remainder > 0) {
+                    const int stride = std::max<int>(1, static_cast<int>(numBins / remainder));
+                    for (int bin = 0; bin < numBins && remainder > 0; bin += stride, remainder--) {
+                        histogram[bin]++;
+                    }
+                }
+            }
+
+            uint8_t* lut = tileMap->tileLUTs.data() + static_cast<size_t>(tile) * numBins;
+            uint64_t cumulative = 0;
+            for (int bin = 0; bin < numBins; bin++) {
+                cumulative += histogram[bin];
+                lut[bin] = static_cast<uint8_t>(std::min<uint64_t>(255, (cumulative * 255 + tilePixels / 2) / tilePixels));
+            }
+        }
+    });
+
+    return tileMap;
+}
+
+void Clahe::apply(const TileMap& tileMap, const uint16_t* data, uint8_t* output) {
+    const uint32_t width = tileMap.getWidth();
+    const int64_t rowsPerBlock = std::max<int64_t>(1, (1 << 18) / std::max<uint32_t>(1, width));
+
+    Parallel::forRange(0, tileMap.getHeight(), rowsPerBlock, [&](int64_t rowBegin, int64_t rowEnd) {
+        for (int64_t y = rowBegin; y < rowEnd; y++) {
+            const size_t rowOffset = static_cast<size_t>(y) * width;
+            tileMap.mapRow(data + rowOffset, static_cast<uint32_t>(y), 1, width, output + rowOffset);
+        }
+    });
+}
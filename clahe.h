@@ -0,0 +1,55 @@
+#ifndef CLAHE_H
+#define CLAHE_H
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+// Адаптивное выравнивание гистограммы с ограничением контраста (CLAHE)
+// для 16-битных каналов
+class Clahe {
+public:
+    // Таблицы отображения плиток. Значение пикселя получается билинейной
+    // интерполяцией таблиц четырёх ближайших центров плиток
+    class TileMap {
+    public:
+        uint8_t map(uint16_t value, uint32_t x, uint32_t y) const;
+        // Каждый step-й пиксель строки y, результат пишется в out[0..outWidth)
+        void mapRow(const uint16_t* row, uint32_t y, int step, uint32_t outWidth, uint8_t* out) const;
+
+        uint32_t getWidth() const { return width; }
+        uint32_t getHeight() const { return height; }
+        size_t getMemoryUsage() const;
+
+    private:
+        friend class Clahe;
+
+        const uint8_t* tileLUT(int tileX, int tileY) const {
+            return tileLUTs.data() + (static_cast<size_t>(tileY) * tilesX + tileX) * numBins;
+        }
+
+        uint32_t width = 0;
+        uint32_t height = 0;
+        int tilesX = 1;
+        int tilesY = 1;
+        int numBins = 1;
+        float tileWidth = 1.0f;
+        float tileHeight = 1.0f;
+        std::vector<uint16_t> binOf;     // 16 бит -> номер бина внутри окна контраста
+        std::vector<uint8_t> tileLUTs;   // tilesX * tilesY таблиц по numBins значений
+    };
+
+    static const int kMaxBins = 4096;
+
+    // Гистограммы плиток строятся параллельно по окну [minVal, maxVal].
+    // clipLimit - порог бина в долях среднего заполнения, излишек
+    // равномерно перераспределяется по всем бинам
+    static std::shared_ptr<const TileMap> build(const uint16_t* data, uint32_t width, uint32_t height,
+                                                uint16_t minVal, uint16_t maxVal,
+                                                int tilesX, int tilesY, double clipLimit);
+
+    // Полное изображение width*height в 8 бит
+    static void apply(const TileMap& tileMap, const uint16_t* data, uint8_t* output);
+};
+
+#endif
@@ -0,0 +1,101 @@
+#include "colormap.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Опорные точки перцептивных палитр matplotlib через равные интервалы
+const QRgb kViridisAnchors[] = {
+    0x440154, 0x472d7b, 0x3b528b, 0x2c728e, 0x21918c, 0x28ae80, 0x5ec962, 0xaddc30, 0xfde725
+};
+const QRgb kInfernoAnchors[] = {
+    0x000004, 0x1f0c48, 0x550f6d, 0x88226a, 0xba3655, 0xe35933, 0xf98e09, 0xf9cb35, 0xfcffa4
+};
+const QRgb kMagmaAnchors[] = {
+    0x000004, 0x1c1044, 0x4f127b, 0x812581, 0xb5367a, 0xe55064, 0xfb8761, 0xfec287, 0xfcfdbf
+};
+const QRgb kPlasmaAnchors[] = {
+    0x0d0887, 0x4c02a1, 0x7e03a8, 0xa92395, 0xcc4778, 0xe56b5d, 0xf89441, 0xfdc328, 0xf0f921
+};
+
+std::vector<QRgb> interpolateAnchors(const QRgb* anchors, int numAnchors) {
+    std::vector<QRgb> palette(256);
+    for (int i = 0; i < 256; i++) {
+        double position = i / 255.0 * (numAnchors - 1);
+        int left = std::min(static_cast<int>(position), numAnchors - 2);
+        double t = position - left;
+        
+        QRgb a = anchors[left];
+        QRgb b = anchors[left + 1];
+        int r = static_cast<int>(std::lround(qRed(a) + (qRed(b) - qRed(a)) * t));
+        int g = static_cast<int>(std::lround(qGreen(a) + (qGreen(b) - qGreen(a)) * t));
+        int bl = static_cast<int>(std::lround(qBlue(a) + (qBlue(b) - qBlue(a)) * t));
+        palette[i] = qRgb(r, g, bl);
+    }
+    return palette;
+}
+
+// Тепловая палитра "hot": чёрный -> красный -> жёлтый -> белый
+std::vector<QRgb> hotPalette() {
+    std::vector<QRgb> palette(256);
+    for (int i = 0; i < 256; i++) {
+        double x = i / 255.0;
+        auto ramp = [x](double from, double to) {
+            return static_cast<int>(std::lround(std::clamp((x - from) / (to - from), 0.0, 1.0) * 255.0));
+        };
+        palette[i] = qRgb(ramp(0.0, 0.365), ramp(0.365, 0.746), ramp(0.746, 1.0));
+    }
+    return palette;
+}
+
+} // namespace
+
+QString Colormap::name(Type type) {
+    switch (type) {
+        case GRAYSCALE: return QString::fromUtf8("Оттенки серого");
+        case VIRIDIS: return "Viridis";
+        case INFERNO: return "Inferno";
+        case MAGMA: return "Magma";
+        case PLASMA: return "Plasma";
+        case HOT: return "Hot";
+        default: return QString();
+    }
+}
+
+QStringList Colormap::names() {
+    QStringList result;
+    for (int i = 0; i < NUM_COLORMAPS; i++) {
+        result << name(static_cast<Type>(i));
+    }
+    return result;
+}
+
+const std::vector<QRgb>& Colormap::palette(Type type) {
+    static const std::vector<std::vector<QRgb>> palettes = []() {
+        std::vector<std::vector<QRgb>> result;
+        for (int i = 0; i < NUM_COLORMAPS; i++) {
+            result.push_back(buildPalette(static_cast<Type>(i)));
+        }
+        return result;
+    }();
+    
+    if (type < 0 || type >= NUM_COLORMAPS) return palettes[GRAYSCALE];
+    return palettes[type];
+}
+
+std::vector<QRgb> Colormap::buildPalette(Type type) {
+    switch (type) {
+        case VIRIDIS: return interpolateAnchors(kViridisAnchors, 9);
+        case INFERNO: return interpolateAnchors(kInfernoAnchors, 9);
+        case MAGMA: return interpolateAnchors(kMagmaAnchors, 9);
+        case PLASMA: return interpolateAnchors(kPlasmaAnchors, 9);
+        case HOT: return hotPalette();
+        default: break;
+    }
+    
+    std::vector<QRgb> gray(256);
+    for (int i = 0; i < 256; i++) {
+        gray[i] = qRgb(i, i, i);
+    }
+    return gray;
+}
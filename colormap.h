@@ -0,0 +1,31 @@
+#ifndef COLORMAP_H
+#define COLORMAP_H
+
+#include <QString>
+#include <QStringList>
+#include <QColor>
+#include <vector>
+
+class Colormap {
+public:
+    enum Type {
+        GRAYSCALE,
+        VIRIDIS,
+        INFERNO,
+        MAGMA,
+        PLASMA,
+        HOT,
+        NUM_COLORMAPS
+    };
+
+    static QString name(Type type);
+    static QStringList names();
+
+    // 256 цветов палитры, индекс - 8-битная яркость после контрастирования
+    static const std::vector<QRgb>& palette(Type type);
+
+private:
+    static std::vector<QRgb> buildPalette(Type type);
+};
+
+#endif
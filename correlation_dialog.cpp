@@ -0,0 +1,252 @@
+#include "correlation_dialog.h"
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QPushButton>
+#include <QPainter>
+#include <QLinearGradient>
+#include <QFontMetrics>
+#include <QApplication>
+#include <QClipboard>
+#include <QMessageBox>
+#include <QtConcurrent>
+#include <algorithm>
+
+namespace {
+
+// Без флажка "все пиксели" матрица оценивается примерно по стольким пикселям
+const size_t kSamplePixels = 4 * 1024 * 1024;
+
+} // namespace
+
+CorrelationMatrixWidget::CorrelationMatrixWidget(QWidget* parent) : QWidget(parent) {
+    setMinimumSize(460, 400);
+    setMouseTracking(true);
+    setStyleSheet("background-color: white;");
+}
+
+void CorrelationMatrixWidget::setMatrix(const std::vector<double>& correlation, int numBands) {
+    matrixImage = SpectralCovariance::correlationImage(correlation, numBands);
+    bandCount = matrixImage.isNull() ? 0 : numBands;
+    update();
+}
+
+QRect CorrelationMatrixWidget::matrixRect() const {
+    const int margin = 20;
+    const int legendWidth = 70;
+    int side = std::min(width() - 2 * margin - legendWidth, height() - 2 * margin);
+    return QRect(margin, margin, std::max(1, side), std::max(1, side));
+}
+
+void CorrelationMatrixWidget::paintEvent(QPaintEvent* event) {
+    QPainter painter(this);
+    QRect rect = matrixRect();
+
+    if (matrixImage.isNull()) {
+        painter.setPen(Qt::gray);
+        painter.drawText(rect, Qt::AlignCenter, "Нет данных");
+        return;
+    }
+
+    // Каждая ячейка - ровный квадрат, без сглаживания соседних каналов
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, false);
+    painter.drawImage(rect, matrixImage);
+    painter.setPen(QPen(Qt::black, 1));
+    painter.drawRect(rect.adjusted(0, 0, -1, -1));
+
+    drawLegend(painter, rect);
+}
+
+void CorrelationMatrixWidget::drawLegend(QPainter& painter, const QRect& rect) {
+    QRect legendRect(rect.right() + 15, rect.top(), 16, rect.height());
+
+    QLinearGradient gradient(legendRect.topLeft(), legendRect.bottomLeft());
+    gradient.setColorAt(0.0, QColor(255, 0, 0));
+    gradient.setColorAt(0.5, QColor(255, 255, 255));
+    gradient.setColorAt(1.0, QColor(0, 0, 255));
+    painter.fillRect(legendRect, gradient);
+    painter.setPen(QPen(Qt::black, 1));
+    painter.drawRect(legendRect.adjusted(0, 0, -1, -1));
+
+    QFontMetrics metrics(painter.font());
+    painter.drawText(legendRect.right() + 5, legendRect.top() + metrics.ascent(), "+1");
+    painter.drawText(legendRect.right() + 5, legendRect.center().y() + metrics.ascent() / 2, "0");
+    painter.drawText(legendRect.right() + 5, legendRect.bottom(), "-1");
+}
+
+void CorrelationMatrixWidget::mouseMoveEvent(QMouseEvent* event) {
+    QRect rect = matrixRect();
+    if (bandCount == 0 || !rect.contains(event->pos())) {
+        emit cellHovered(-1, -1);
+        return;
+    }
+
+    int column = std::min(bandCount - 1, (event->pos().x() - rect.left()) * bandCount / rect.width());
+    int row = std::min(bandCount - 1, (event->pos().y() - rect.top()) * bandCount / rect.height());
+    emit cellHovered(row, column);
+}
+
+void CorrelationMatrixWidget::leaveEvent(QEvent* event) {
+    emit cellHovered(-1, -1);
+    QWidget::leaveEvent(event);
+}
+
+CorrelationDialog::CorrelationDialog(const HyperspectralImage* image, QWidget* parent)
+    : QDialog(parent), hyperspectralImage(image) {
+    setWindowTitle("Корреляция каналов");
+    resize(640, 640);
+
+    QVBoxLayout* mainLayout = new QVBoxLayout(this);
+
+    allPixelsCheckBox = new QCheckBox("По всем пикселям (медленно для больших сцен)");
+    mainLayout->addWidget(allPixelsCheckBox);
+
+    matrixWidget = new CorrelationMatrixWidget();
+    mainLayout->addWidget(matrixWidget, 1);
+
+    cellLabel = new QLabel(" ");
+    mainLayout->addWidget(cellLabel);
+    infoLabel = new QLabel();
+    mainLayout->addWidget(infoLabel);
+
+    QHBoxLayout* buttonLayout = new QHBoxLayout();
+    QPushButton* copyCorrelationButton = new QPushButton("Копировать корреляцию");
+    QPushButton* copyCovarianceButton = new QPushButton("Копировать ковариацию");
+    QPushButton* closeButton = new QPushButton("Закрыть");
+    buttonLayout->addWidget(copyCorrelationButton);
+    buttonLayout->addWidget(copyCovarianceButton);
+    buttonLayout->addStretch();
+    buttonLayout->addWidget(closeButton);
+    mainLayout->addLayout(buttonLayout);
+
+    cube = image->makeCubeSource();
+    covarianceWatcher = new QFutureWatcher<std::shared_ptr<const SpectralCovariance::Result>>(this);
+    connect(covarianceWatcher, &QFutureWatcher<std::shared_ptr<const SpectralCovariance::Result>>::finished,
+            this, &CorrelationDialog::onCovarianceReady);
+
+    connect(allPixelsCheckBox, &QCheckBox::toggled, this, &CorrelationDialog::recompute);
+    connect(matrixWidget, &CorrelationMatrixWidget::cellHovered, this, &CorrelationDialog::onCellHovered);
+    connect(copyCorrelationButton, &QPushButton::clicked, this, &CorrelationDialog::copyCorrelation);
+    connect(copyCovarianceButton, &QPushButton::clicked, this, &CorrelationDialog::copyCovariance);
+    connect(closeButton, &QPushButton::clicked, this, &QDialog::accept);
+
+    recompute();
+}
+
+CorrelationDialog::~CorrelationDialog() {
+    covarianceWatcher->waitForFinished();
+}
+
+void CorrelationDialog::recompute() {
+    const size_t step = allPixelsCheckBox->isChecked() ? 1 : std::max<size_t>(1, cube.numPixels() / kSamplePixels);
+
+    covarianceGeneration++;
+    pendingStep = 0;
+    if (auto cached = hyperspectralImage->findBandCovariance(step)) {
+        showCovariance(cached, step);
+        return;
+    }
+
+    covariance.reset();
+    correlation.clear();
+    matrixWidget->setMatrix(correlation, 0);
+    cellLabel->setText(" ");
+    if (!cube.isValid()) {
+        infoLabel->setText("Недостаточно данных для расчёта");
+        return;
+    }
+    infoLabel->setText(step > 1 ? QString("Корреляция считается по каждому %1-му пикселю...").arg(step)
+                                : QString("Корреляция считается по всем пикселям..."));
+
+    pendingStep = step;
+    if (!covarianceWatcher->isRunning()) {
+        startCovariance();
+    }
+}
+
+void CorrelationDialog::startCovariance() {
+    if (pendingStep == 0) return;
+
+    runningGeneration = covarianceGeneration;
+    runningStep = pendingStep;
+    pendingStep = 0;
+
+    const HyperspectralImage::CubeSource source = cube;
+    const size_t step = runningStep;
+    covarianceWatcher->setFuture(QtConcurrent::run([source, step]() {
+        return std::make_shared<const SpectralCovariance::Result>(
+            SpectralCovariance::compute(source.bands, source.numPixels(), step));
+    }));
+}
+
+void CorrelationDialog::onCovarianceReady() {
+    // Посчитанная матрица пригодится и потом (например, для PCA), даже если уже не нужна здесь
+    auto result = covarianceWatcher->result();
+    hyperspectralImage->cacheBandCovariance(runningStep, result);
+    if (runningGeneration == covarianceGeneration) {
+        showCovariance(result, runningStep);
+    }
+
+    startCovariance();
+}
+
+void CorrelationDialog::showCovariance(std::shared_ptr<const SpectralCovariance::Result> result, size_t step) {
+    covariance = std::move(result);
+    if (!covariance || covariance->isEmpty()) {
+        covariance.reset();
+        correlation.clear();
+        matrixWidget->setMatrix(correlation, 0);
+        infoLabel->setText("Недостаточно данных для расчёта");
+        return;
+    }
+
+    correlation = covariance->correlation();
+    matrixWidget->setMatrix(correlation, covariance->numBands);
+    infoLabel->setText(QString("Каналов: %1 | Учтено пикселей: %2%3")
+                       .arg(covariance->numBands)
+                       .arg(covariance->count)
+                       .arg(step > 1 ? QString(" (каждый %1-й)").arg(step) : QString()));
+}
+
+void CorrelationDialog::onCellHovered(int row, int column) {
+    if (row < 0 || column < 0 || !covariance) {
+        cellLabel->setText(" ");
+        return;
+    }
+
+    cellLabel->setText(QString("Каналы %1 и %2: r = %3, ковариация = %4")
+                       .arg(row + 1)
+                       .arg(column + 1)
+                       .arg(correlation[static_cast<size_t>(row) * covariance->numBands + column], 0, 'f', 4)
+                       .arg(covariance->at(row, column), 0, 'g', 6));
+}
+
+void CorrelationDialog::copyCorrelation() {
+    copyMatrix(correlation, "корреляции");
+}
+
+void CorrelationDialog::copyCovariance() {
+    copyMatrix(covariance ? covariance->covariance : std::vector<double>(), "ковариации");
+}
+
+void CorrelationDialog::copyMatrix(const std::vector<double>& matrix, const QString& title) {
+    if (!covariance || matrix.empty()) return;
+
+    const int numBands = covariance->numBands;
+    QString text;
+    for (int j = 0; j < numBands; j++) {
+        text += QString("\tКанал %1").arg(j + 1);
+    }
+    text += "\n";
+
+    for (int i = 0; i < numBands; i++) {
+        text += QString("Канал %1").arg(i + 1);
+        for (int j = 0; j < numBands; j++) {
+            text += "\t" + QString::number(matrix[static_cast<size_t>(i) * numBands + j], 'g', 8);
+        }
+        text += "\n";
+    }
+
+    QApplication::clipboard()->setText(text);
+    QMessageBox::information(this, "Копирование завершено",
+        QString("Матрица %1 скопирована в буфер обмена").arg(title));
+}
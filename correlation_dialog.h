@@ -0,0 +1,79 @@
+#ifndef CORRELATION_DIALOG_H
+#define CORRELATION_DIALOG_H
+
+#include <QDialog>
+#include <QWidget>
+#include <QLabel>
+#include <QCheckBox>
+#include <QImage>
+#include <QPaintEvent>
+#include <QMouseEvent>
+#include <QFutureWatcher>
+#include <vector>
+#include <memory>
+#include "hyperspectral_image.h"
+
+// Тепловая карта матрицы корреляции каналов
+class CorrelationMatrixWidget : public QWidget {
+    Q_OBJECT
+
+public:
+    CorrelationMatrixWidget(QWidget* parent = nullptr);
+    void setMatrix(const std::vector<double>& correlation, int numBands);
+
+signals:
+    // -1, -1 - курсор вне матрицы
+    void cellHovered(int row, int column);
+
+protected:
+    void paintEvent(QPaintEvent* event) override;
+    void mouseMoveEvent(QMouseEvent* event) override;
+    void leaveEvent(QEvent* event) override;
+
+private:
+    QRect matrixRect() const;
+    void drawLegend(QPainter& painter, const QRect& rect);
+
+    QImage matrixImage;
+    int bandCount = 0;
+};
+
+class CorrelationDialog : public QDialog {
+    Q_OBJECT
+
+public:
+    CorrelationDialog(const HyperspectralImage* image, QWidget* parent = nullptr);
+    ~CorrelationDialog();
+
+private slots:
+    void recompute();
+    void onCovarianceReady();
+    void onCellHovered(int row, int column);
+    void copyCorrelation();
+    void copyCovariance();
+
+private:
+    void copyMatrix(const std::vector<double>& matrix, const QString& title);
+    void startCovariance();
+    void showCovariance(std::shared_ptr<const SpectralCovariance::Result> result, size_t step);
+
+    const HyperspectralImage* hyperspectralImage;
+    CorrelationMatrixWidget* matrixWidget;
+    QCheckBox* allPixelsCheckBox;
+    QLabel* infoLabel;
+    QLabel* cellLabel;
+
+    // Ковариация считается в фоне по снимку каналов. Результаты с другим поколением
+    // отбрасываются; если подсчёт ещё идёт, следующий запустится по его завершении
+    HyperspectralImage::CubeSource cube;
+    QFutureWatcher<std::shared_ptr<const SpectralCovariance::Result>>* covarianceWatcher;
+    int covarianceGeneration = 0;
+    int runningGeneration = -1;
+    size_t pendingStep = 0;  // 0 - новый подсчёт не нужен
+    size_t runningStep = 0;
+
+    std::shared_ptr<const SpectralCovariance::Result> covariance;
+    std::vector<double> correlation;
+};
+
+#endif
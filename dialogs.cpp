@@ -6,10 +6,11 @@
 #include <QPushButton>
 #include <QGroupBox>
 
-RGBSettingsDialog::RGBSettingsDialog(int numChannels, int currentR, int currentG, int currentB, QWidget* parent) 
+RGBSettingsDialog::RGBSettingsDialog(const QStringList& channelNames, int currentR, int currentG, int currentB,
+                                     bool trueColorAvailable, bool trueColorChecked, QWidget* parent) 
     : QDialog(parent) {
     setWindowTitle("Настройки RGB синтеза");
-    setFixedSize(300, 200);
+    setFixedSize(340, 230);
     
     QGridLayout* layout = new QGridLayout(this);
     
@@ -17,8 +18,7 @@ RGBSettingsDialog::RGBSettingsDialog(int numChannels, int currentR, int currentG
     greenChannelSelector = new QComboBox();
     blueChannelSelector = new QComboBox();
     
-    for (int i = 0; i < numChannels; i++) {
-        QString channelName = QString("Канал %1").arg(i + 1);
+    for (const QString& channelName : channelNames) {
         redChannelSelector->addItem(channelName);
         greenChannelSelector->addItem(channelName);
         blueChannelSelector->addItem(channelName);
@@ -35,6 +35,23 @@ RGBSettingsDialog::RGBSettingsDialog(int numChannels, int currentR, int currentG
     layout->addWidget(new QLabel("Синий:"), 2, 0);
     layout->addWidget(blueChannelSelector, 2, 1);
     
+    trueColorCheckBox = new QCheckBox("Истинный цвет по кривым CIE 1931");
+    trueColorCheckBox->setEnabled(trueColorAvailable);
+    trueColorCheckBox->setChecked(trueColorAvailable && trueColorChecked);
+    if (!trueColorAvailable) {
+        trueColorCheckBox->setToolTip("Нужны длины волн каналов видимого диапазона");
+    }
+    connect(trueColorCheckBox, &QCheckBox::toggled, [this](bool checked) {
+        redChannelSelector->setEnabled(!checked);
+        greenChannelSelector->setEnabled(!checked);
+        blueChannelSelector->setEnabled(!checked);
+    });
+    layout->addWidget(trueColorCheckBox, 3, 0, 1, 2);
+    
+    redChannelSelector->setEnabled(!trueColorCheckBox->isChecked());
+    greenChannelSelector->setEnabled(!trueColorCheckBox->isChecked());
+    blueChannelSelector->setEnabled(!trueColorCheckBox->isChecked());
+    
     QHBoxLayout* buttonLayout = new QHBoxLayout();
     QPushButton* okButton = new QPushButton("OK");
     QPushButton* cancelButton = new QPushButton("Отмена");
@@ -45,14 +62,14 @@ RGBSettingsDialog::RGBSettingsDialog(int numChannels, int currentR, int currentG
     buttonLayout->addWidget(okButton);
     buttonLayout->addWidget(cancelButton);
     
-    layout->addLayout(buttonLayout, 3, 0, 1, 2);
+    layout->addLayout(buttonLayout, 4, 0, 1, 2);
 }
 
 // Contrast Dialog
 ContrastDialog::ContrastDialog(HyperspectralImage* image, int channelIndex, QWidget* parent) 
     : QDialog(parent), hyperspectralImage(image), currentChannel(channelIndex), contrastMode(GRAYSCALE_MODE) {
     setWindowTitle("Контрастирование канала " + QString::number(channelIndex + 1));
-    setFixedSize(500, 400);
+    setFixedSize(500, 510);
     
     setupUI();
     loadCurrentParams();
@@ -61,7 +78,7 @@ ContrastDialog::ContrastDialog(HyperspectralImage* image, int channelIndex, QWid
 ContrastDialog::ContrastDialog(HyperspectralImage* image, int redCh, int greenCh, int blueCh, QWidget* parent) 
     : QDialog(parent), hyperspectralImage(image), redChannel(redCh), greenChannel(greenCh), blueChannel(blueCh), contrastMode(RGB_MODE) {
     setWindowTitle("RGB Контрастирование");
-    setFixedSize(600, 500);
+    setFixedSize(600, 680);
     
     setupUI();
     loadRGBParams();
@@ -167,9 +184,28 @@ void ContrastDialog::setupGrayscaleUI() {
     percentHighSpinBox->setMinimumHeight(30);
     percentileLayout->addWidget(percentHighSpinBox, 1, 1);
     
+    QGroupBox* stretchGroup = new QGroupBox("Функция растяжения");
+    QGridLayout* stretchLayout = new QGridLayout(stretchGroup);
+    
+    stretchLayout->addWidget(new QLabel("Растяжение:"), 0, 0);
+    stretchSelector = createStretchSelector();
+    stretchSelector->setMinimumHeight(30);
+    stretchLayout->addWidget(stretchSelector, 0, 1);
+    
+    stretchLayout->addWidget(new QLabel("Гамма:"), 1, 0);
+    gammaSpinBox = createGammaSpinBox();
+    gammaSpinBox->setMinimumHeight(30);
+    stretchLayout->addWidget(gammaSpinBox, 1, 1);
+    
+    stretchLayout->addWidget(new QLabel("Порог CLAHE:"), 2, 0);
+    clipLimitSpinBox = createClipLimitSpinBox();
+    clipLimitSpinBox->setMinimumHeight(30);
+    stretchLayout->addWidget(clipLimitSpinBox, 2, 1);
+    
     grayscaleLayout->addLayout(methodLayout);
     grayscaleLayout->addWidget(minMaxGroup);
     grayscaleLayout->addWidget(percentileGroup);
+    grayscaleLayout->addWidget(stretchGroup);
     
     mainLayout->insertWidget(1, grayscaleGroup);
 }
@@ -221,6 +257,18 @@ void ContrastDialog::setupRGBUI() {
     redPercentHighSpinBox->setDecimals(1);
     redLayout->addWidget(redPercentHighSpinBox, 1, 3);
     
+    redLayout->addWidget(new QLabel("Растяжение:"), 2, 0);
+    redStretchSelector = createStretchSelector();
+    redLayout->addWidget(redStretchSelector, 2, 1);
+    
+    redLayout->addWidget(new QLabel("Гамма:"), 2, 2);
+    redGammaSpinBox = createGammaSpinBox();
+    redLayout->addWidget(redGammaSpinBox, 2, 3);
+    
+    redLayout->addWidget(new QLabel("Порог CLAHE:"), 3, 2);
+    redClipLimitSpinBox = createClipLimitSpinBox();
+    redLayout->addWidget(redClipLimitSpinBox, 3, 3);
+    
     // Green Channel
     QGroupBox* greenGroup = new QGroupBox("Зеленый канал");
     QGridLayout* greenLayout = new QGridLayout(greenGroup);
@@ -249,6 +297,18 @@ void ContrastDialog::setupRGBUI() {
     greenPercentHighSpinBox->setDecimals(1);
     greenLayout->addWidget(greenPercentHighSpinBox, 1, 3);
     
+    greenLayout->addWidget(new QLabel("Растяжение:"), 2, 0);
+    greenStretchSelector = createStretchSelector();
+    greenLayout->addWidget(greenStretchSelector, 2, 1);
+    
+    greenLayout->addWidget(new QLabel("Гамма:"), 2, 2);
+    greenGammaSpinBox = createGammaSpinBox();
+    greenLayout->addWidget(greenGammaSpinBox, 2, 3);
+    
+    greenLayout->addWidget(new QLabel("Порог CLAHE:"), 3, 2);
+    greenClipLimitSpinBox = createClipLimitSpinBox();
+    greenLayout->addWidget(greenClipLimitSpinBox, 3, 3);
+    
     // Blue Channel
     QGroupBox* blueGroup = new QGroupBox("Синий канал");
     QGridLayout* blueLayout = new QGridLayout(blueGroup);
@@ -277,6 +337,18 @@ void ContrastDialog::setupRGBUI() {
     bluePercentHighSpinBox->setDecimals(1);
     blueLayout->addWidget(bluePercentHighSpinBox, 1, 3);
     
+    blueLayout->addWidget(new QLabel("Растяжение:"), 2, 0);
+    blueStretchSelector = createStretchSelector();
+    blueLayout->addWidget(blueStretchSelector, 2, 1);
+    
+    blueLayout->addWidget(new QLabel("Гамма:"), 2, 2);
+    blueGammaSpinBox = createGammaSpinBox();
+    blueLayout->addWidget(blueGammaSpinBox, 2, 3);
+    
+    blueLayout->addWidget(new QLabel("Порог CLAHE:"), 3, 2);
+    blueClipLimitSpinBox = createClipLimitSpinBox();
+    blueLayout->addWidget(blueClipLimitSpinBox, 3, 3);
+    
     rgbLayout->addWidget(redGroup);
     rgbLayout->addWidget(greenGroup);
     rgbLayout->addWidget(blueGroup);
@@ -284,6 +356,66 @@ void ContrastDialog::setupRGBUI() {
     mainLayout->insertWidget(2, rgbGroup);
 }
 
+QComboBox* ContrastDialog::createStretchSelector() {
+    QComboBox* selector = new QComboBox();
+    for (int i = 0; i < HyperspectralImage::NUM_STRETCH_MODES; i++) {
+        selector->addItem(HyperspectralImage::stretchModeName(static_cast<HyperspectralImage::StretchMode>(i)));
+    }
+    connect(selector, QOverload<int>::of(&QComboBox::currentIndexChanged),
+            this, &ContrastDialog::onStretchModeChanged);
+    return selector;
+}
+
+QDoubleSpinBox* ContrastDialog::createGammaSpinBox() {
+    QDoubleSpinBox* spinBox = new QDoubleSpinBox();
+    spinBox->setRange(0.1, 10.0);
+    spinBox->setSingleStep(0.1);
+    spinBox->setDecimals(2);
+    spinBox->setValue(1.0);
+    spinBox->setEnabled(false);
+    return spinBox;
+}
+
+QDoubleSpinBox* ContrastDialog::createClipLimitSpinBox() {
+    QDoubleSpinBox* spinBox = new QDoubleSpinBox();
+    spinBox->setRange(0.0, 100.0);
+    spinBox->setSingleStep(0.5);
+    spinBox->setDecimals(1);
+    spinBox->setValue(2.0);
+    spinBox->setToolTip("Ограничение бина гистограммы плитки в долях среднего (0 - без ограничения)");
+    spinBox->setEnabled(false);
+    return spinBox;
+}
+
+void ContrastDialog::setStretchControls(QComboBox* selector, QDoubleSpinBox* gammaSpinBox, QDoubleSpinBox* clipLimitSpinBox,
+                                        const HyperspectralImage::ContrastParams& params) {
+    selector->setCurrentIndex(params.stretchMode);
+    gammaSpinBox->setValue(params.gamma);
+    gammaSpinBox->setEnabled(params.stretchMode == HyperspectralImage::STRETCH_GAMMA);
+    clipLimitSpinBox->setValue(params.claheClipLimit);
+    clipLimitSpinBox->setEnabled(params.stretchMode == HyperspectralImage::STRETCH_CLAHE);
+}
+
+void ContrastDialog::applyStretch(int channelIndex, QComboBox* selector, QDoubleSpinBox* gammaSpinBox,
+                                  QDoubleSpinBox* clipLimitSpinBox) {
+    auto mode = static_cast<HyperspectralImage::StretchMode>(selector->currentIndex());
+    hyperspectralImage->setStretchMode(channelIndex, mode, gammaSpinBox->value(), clipLimitSpinBox->value());
+}
+
+void ContrastDialog::onStretchModeChanged() {
+    // Коэффициент гаммы и порог CLAHE активны только в своих режимах
+    const int gammaMode = HyperspectralImage::STRETCH_GAMMA;
+    const int claheMode = HyperspectralImage::STRETCH_CLAHE;
+    gammaSpinBox->setEnabled(stretchSelector->currentIndex() == gammaMode);
+    redGammaSpinBox->setEnabled(redStretchSelector->currentIndex() == gammaMode);
+    greenGammaSpinBox->setEnabled(greenStretchSelector->currentIndex() == gammaMode);
+    blueGammaSpinBox->setEnabled(blueStretchSelector->currentIndex() == gammaMode);
+    clipLimitSpinBox->setEnabled(stretchSelector->currentIndex() == claheMode);
+    redClipLimitSpinBox->setEnabled(redStretchSelector->currentIndex() == claheMode);
+    greenClipLimitSpinBox->setEnabled(greenStretchSelector->currentIndex() == claheMode);
+    blueClipLimitSpinBox->setEnabled(blueStretchSelector->currentIndex() == claheMode);
+}
+
 void ContrastDialog::onModeChanged() {
     bool useMinMax = minMaxRadio->isChecked();
     
@@ -339,6 +471,7 @@ void ContrastDialog::applyContrast() {
             double percentHigh = percentHighSpinBox->value();
             hyperspectralImage->normalizeByPercentile(currentChannel, percentLow, percentHigh);
         }
+        applyStretch(currentChannel, stretchSelector, gammaSpinBox, clipLimitSpinBox);
     } else {
         // RGB режим
         if (rgbMinMaxRadio->isChecked()) {
@@ -360,6 +493,10 @@ void ContrastDialog::applyContrast() {
             hyperspectralImage->normalizeByPercentile(blueChannel, 
                 bluePercentLowSpinBox->value(), bluePercentHighSpinBox->value());
         }
+        
+        applyStretch(redChannel, redStretchSelector, redGammaSpinBox, redClipLimitSpinBox);
+        applyStretch(greenChannel, greenStretchSelector, greenGammaSpinBox, greenClipLimitSpinBox);
+        applyStretch(blueChannel, blueStretchSelector, blueGammaSpinBox, blueClipLimitSpinBox);
     }
     
     emit contrastChanged();
@@ -372,6 +509,7 @@ void ContrastDialog::resetToDefault() {
         maxSpinBox->setValue(maxVal);
         percentLowSpinBox->setValue(2.0);
         percentHighSpinBox->setValue(2.0);
+        setStretchControls(stretchSelector, gammaSpinBox, clipLimitSpinBox, HyperspectralImage::ContrastParams{});
     } else {
         auto [redMin, redMax] = hyperspectralImage->getChannelMinMax16bit(redChannel);
         auto [greenMin, greenMax] = hyperspectralImage->getChannelMinMax16bit(greenChannel);
@@ -391,6 +529,11 @@ void ContrastDialog::resetToDefault() {
         blueMaxSpinBox->setValue(blueMax);
         bluePercentLowSpinBox->setValue(2.0);
         bluePercentHighSpinBox->setValue(2.0);
+        
+        HyperspectralImage::ContrastParams defaults;
+        setStretchControls(redStretchSelector, redGammaSpinBox, redClipLimitSpinBox, defaults);
+        setStretchControls(greenStretchSelector, greenGammaSpinBox, greenClipLimitSpinBox, defaults);
+        setStretchControls(blueStretchSelector, blueGammaSpinBox, blueClipLimitSpinBox, defaults);
     }
 }
 
@@ -401,6 +544,7 @@ void ContrastDialog::loadCurrentParams() {
     maxSpinBox->setValue(params.maxVal);
     percentLowSpinBox->setValue(params.percentCutLow);
     percentHighSpinBox->setValue(params.percentCutHigh);
+    setStretchControls(stretchSelector, gammaSpinBox, clipLimitSpinBox, params);
     
     if (params.usePercentile) {
         percentileRadio->setChecked(true);
@@ -431,6 +575,10 @@ void ContrastDialog::loadRGBParams() {
     bluePercentLowSpinBox->setValue(blueParams.percentCutLow);
     bluePercentHighSpinBox->setValue(blueParams.percentCutHigh);
     
+    setStretchControls(redStretchSelector, redGammaSpinBox, redClipLimitSpinBox, redParams);
+    setStretchControls(greenStretchSelector, greenGammaSpinBox, greenClipLimitSpinBox, greenParams);
+    setStretchControls(blueStretchSelector, blueGammaSpinBox, blueClipLimitSpinBox, blueParams);
+    
     if (redParams.usePercentile || greenParams.usePercentile || blueParams.usePercentile) {
         rgbPercentileRadio->setChecked(true);
     } else {
@@ -13,22 +13,28 @@
 #include <QGroupBox>
 #include <QLabel>
 #include <QPushButton>
+#include <QCheckBox>
 #include "hyperspectral_image.h"
 
 class RGBSettingsDialog : public QDialog {
     Q_OBJECT
     
 public:
-    RGBSettingsDialog(int numChannels, int currentR, int currentG, int currentB, QWidget* parent = nullptr);
+    // channelNames - все каналы, которые можно показать, включая производные
+    RGBSettingsDialog(const QStringList& channelNames, int currentR, int currentG, int currentB,
+                      bool trueColorAvailable = false, bool trueColorChecked = false,
+                      QWidget* parent = nullptr);
     
     int getRedChannel() const { return redChannelSelector->currentIndex(); }
     int getGreenChannel() const { return greenChannelSelector->currentIndex(); }
     int getBlueChannel() const { return blueChannelSelector->currentIndex(); }
+    bool useTrueColor() const { return trueColorCheckBox->isChecked(); }
     
 private:
     QComboBox* redChannelSelector;
     QComboBox* greenChannelSelector;
     QComboBox* blueChannelSelector;
+    QCheckBox* trueColorCheckBox;
 };
 
 class ContrastDialog : public QDialog {
@@ -47,6 +53,7 @@ private slots:
     void onModeChanged();
     void onContrastModeChanged();
     void onRGBModeChanged();
+    void onStretchModeChanged();
     void applyContrast();
     void resetToDefault();
 
@@ -59,6 +66,13 @@ private:
     void setupRGBUI();
     void loadCurrentParams();
     void loadRGBParams();
+    QComboBox* createStretchSelector();
+    QDoubleSpinBox* createGammaSpinBox();
+    QDoubleSpinBox* createClipLimitSpinBox();
+    void setStretchControls(QComboBox* selector, QDoubleSpinBox* gammaSpinBox, QDoubleSpinBox* clipLimitSpinBox,
+                            const HyperspectralImage::ContrastParams& params);
+    void applyStretch(int channelIndex, QComboBox* selector, QDoubleSpinBox* gammaSpinBox,
+                      QDoubleSpinBox* clipLimitSpinBox);
     
     HyperspectralImage* hyperspectralImage;
     int currentChannel;
@@ -77,6 +91,9 @@ private:
     QSpinBox* maxSpinBox;
     QDoubleSpinBox* percentLowSpinBox;
     QDoubleSpinBox* percentHighSpinBox;
+    QComboBox* stretchSelector;
+    QDoubleSpinBox* gammaSpinBox;
+    QDoubleSpinBox* clipLimitSpinBox;
     
     // RGB контролы
     QRadioButton* rgbMinMaxRadio;
@@ -87,18 +104,27 @@ private:
     QSpinBox* redMaxSpinBox;
     QDoubleSpinBox* redPercentLowSpinBox;
     QDoubleSpinBox* redPercentHighSpinBox;
+    QComboBox* redStretchSelector;
+    QDoubleSpinBox* redGammaSpinBox;
+    QDoubleSpinBox* redClipLimitSpinBox;
     
     // Green channel
     QSpinBox* greenMinSpinBox;
     QSpinBox* greenMaxSpinBox;
     QDoubleSpinBox* greenPercentLowSpinBox;
     QDoubleSpinBox* greenPercentHighSpinBox;
+    QComboBox* greenStretchSelector;
+    QDoubleSpinBox* greenGammaSpinBox;
+    QDoubleSpinBox* greenClipLimitSpinBox;
     
     // Blue channel
     QSpinBox* blueMinSpinBox;
     QSpinBox* blueMaxSpinBox;
     QDoubleSpinBox* bluePercentLowSpinBox;
     QDoubleSpinBox* bluePercentHighSpinBox;
+    QComboBox* blueStretchSelector;
+    QDoubleSpinBox* blueGammaSpinBox;
+    QDoubleSpinBox* blueClipLimitSpinBox;
 };
 
 #endif
@@ -11,46 +11,50 @@ HistogramWidget::HistogramWidget(QWidget *parent) : QWidget(parent) {
     setMouseTracking(true);
 }
 
-void HistogramWidget::setHistogramData16bit(const std::vector<int>& hist, int channelIndex) {
+void HistogramWidget::setHistogramData16bit(const HistogramPtr& hist, int channelIndex) {
     histogram16bit = hist;
+    grayPyramid.build(hist.get());
     channel = channelIndex;
     is16bit = true;
     
-    if (!isZoomed) {
-        calculateInformativeRange(hist, zoomMinValue, zoomMaxValue);
+    if (!isZoomed && hist) {
+        calculateInformativeRange(*hist, zoomMinValue, zoomMaxValue);
         isZoomed = true;
     }
     
-    update();
+    invalidatePlot();
 }
 
-void HistogramWidget::setRGBHistogramData(const std::vector<int>& redHist, 
-                        const std::vector<int>& greenHist, 
-                        const std::vector<int>& blueHist,
+void HistogramWidget::setRGBHistogramData(const HistogramPtr& redHist, 
+                        const HistogramPtr& greenHist, 
+                        const HistogramPtr& blueHist,
                         int redCh, int greenCh, int blueCh) {
     redHistogram = redHist;
     greenHistogram = greenHist;
     blueHistogram = blueHist;
+    redPyramid.build(redHist.get());
+    greenPyramid.build(greenHist.get());
+    bluePyramid.build(blueHist.get());
     redChannelIndex = redCh;
     greenChannelIndex = greenCh;
     blueChannelIndex = blueCh;
     displayMode = RGB;
-    update();
+    invalidatePlot();
 }
 
 void HistogramWidget::setDisplayMode(DisplayMode mode) {
     displayMode = mode;
-    update();
+    invalidatePlot();
 }
 
 void HistogramWidget::setRGBChannel(RGBChannel ch) {
     rgbChannel = ch;
-    update();
+    invalidatePlot();
 }
 
 void HistogramWidget::setChannel(int ch) {
     channel = ch;
-    update();
+    invalidatePlot();
 }
 
 void HistogramWidget::resetZoom() {
@@ -60,12 +64,12 @@ void HistogramWidget::resetZoom() {
     zoomMinCount = 0;
     zoomMaxCount = 0;
     
-    if (!histogram16bit.empty()) {
-        calculateInformativeRange(histogram16bit, zoomMinValue, zoomMaxValue);
+    if (histogram16bit) {
+        calculateInformativeRange(*histogram16bit, zoomMinValue, zoomMaxValue);
         isZoomed = true;
     }
     
-    update();
+    invalidatePlot();
 }
 
 void HistogramWidget::mousePressEvent(QMouseEvent *event) {
@@ -139,22 +143,9 @@ void HistogramWidget::mouseReleaseEvent(QMouseEvent *event) {
                 zoomMinValue = newMinValue;
                 zoomMaxValue = newMaxValue;
                 
-                const std::vector<int>* currentHist = nullptr;
-                if (displayMode == GRAYSCALE) {
-                    currentHist = &histogram16bit;
-                } else {
-                    switch (rgbChannel) {
-                        case RED_CHANNEL: currentHist = &redHistogram; break;
-                        case GREEN_CHANNEL: currentHist = &greenHistogram; break;
-                        case BLUE_CHANNEL: currentHist = &blueHistogram; break;
-                    }
-                }
-                
-                if (currentHist && !currentHist->empty()) {
-                    int maxInRange = 0;
-                    for (int i = zoomMinValue; i <= zoomMaxValue && i < static_cast<int>(currentHist->size()); i++) {
-                        maxInRange = std::max(maxInRange, (*currentHist)[i]);
-                    }
+                const MaxPyramid* pyramid = nullptr;
+                if (currentHistogram(&pyramid)) {
+                    int maxInRange = pyramid->maxInRange(zoomMinValue, zoomMaxValue);
                     
                     if (maxInRange > 0) {
                         int currentMaxCount = isZoomed && zoomMaxCount > 0 ? zoomMaxCount : maxInRange;
@@ -167,12 +158,36 @@ void HistogramWidget::mouseReleaseEvent(QMouseEvent *event) {
             }
         }
         
-        update();
+        invalidatePlot();
     }
 }
 
 void HistogramWidget::paintEvent(QPaintEvent *event) {
+    const qreal ratio = devicePixelRatioF();
+    const QSize pixelSize(qRound(width() * ratio), qRound(height() * ratio));
+    
+    if (!plotCacheValid || plotCache.size() != pixelSize) {
+        plotCache = QPixmap(pixelSize);
+        plotCache.setDevicePixelRatio(ratio);
+        QPainter cachePainter(&plotCache);
+        renderPlot(cachePainter);
+        plotCacheValid = true;
+    }
+    
     QPainter painter(this);
+    painter.drawPixmap(0, 0, plotCache);
+    
+    if (isSelecting) {
+        drawSelectionRect(painter);
+    }
+}
+
+void HistogramWidget::invalidatePlot() {
+    plotCacheValid = false;
+    update();
+}
+
+void HistogramWidget::renderPlot(QPainter& painter) {
     painter.fillRect(rect(), Qt::white);
 
     const int leftMargin = 80;
@@ -187,10 +202,6 @@ void HistogramWidget::paintEvent(QPaintEvent *event) {
     } else {
         drawRGBHistogram(painter, leftMargin, rightMargin, topMargin, bottomMargin, plotWidth, plotHeight);
     }
-    
-    if (isSelecting) {
-        drawSelectionRect(painter);
-    }
 }
 
 void HistogramWidget::drawSelectionRect(QPainter& painter) {
@@ -202,7 +213,7 @@ void HistogramWidget::drawSelectionRect(QPainter& painter) {
 }
 
 void HistogramWidget::drawGrayscaleHistogram(QPainter& painter, int leftMargin, int rightMargin, int topMargin, int bottomMargin, int plotWidth, int plotHeight) {
-    if (histogram16bit.empty()) {
+    if (!histogram16bit) {
         painter.drawText(rect(), Qt::AlignCenter, QString::fromUtf8("Нет данных гистограммы"));
         return;
     }
@@ -215,10 +226,7 @@ void HistogramWidget::drawGrayscaleHistogram(QPainter& painter, int leftMargin,
         maxValue = 65535;
     }
     
-    int maxCount = 0;
-    for (int i = minValue; i <= maxValue && i < static_cast<int>(histogram16bit.size()); i++) {
-        maxCount = std::max(maxCount, histogram16bit[i]);
-    }
+    int maxCount = grayPyramid.maxInRange(minValue, maxValue);
     
     if (isZoomed && zoomMaxCount > 0) {
         maxCount = std::min(maxCount, zoomMaxCount);
@@ -239,13 +247,8 @@ void HistogramWidget::drawGrayscaleHistogram(QPainter& painter, int leftMargin,
     if (numBins == 0) numBins = 1;
     
     for (int bin = 0; bin < numBins; bin++) {
-        int binCount = 0;
-        for (int i = 0; i < binSize; i++) {
-            int index = minValue + bin * binSize + i;
-            if (index >= 0 && index < static_cast<int>(histogram16bit.size())) {
-                binCount += histogram16bit[index];
-            }
-        }
+        int binStart = minValue + bin * binSize;
+        int binCount = static_cast<int>(sumInRange(*histogram16bit, binStart, binStart + binSize - 1));
         
         if (binCount > 0 && binCount <= maxCount) {
             float heightRatio = static_cast<float>(binCount) / maxCount;
@@ -282,31 +285,35 @@ void HistogramWidget::drawGrayscaleHistogram(QPainter& painter, int leftMargin,
 }
 
 void HistogramWidget::drawRGBHistogram(QPainter& painter, int leftMargin, int rightMargin, int topMargin, int bottomMargin, int plotWidth, int plotHeight) {
-    if (redHistogram.empty() || greenHistogram.empty() || blueHistogram.empty()) {
+    if (!redHistogram || !greenHistogram || !blueHistogram) {
         painter.drawText(rect(), Qt::AlignCenter, QString::fromUtf8("Нет данных RGB гистограммы"));
         return;
     }
 
-    const std::vector<int>* currentHist = nullptr;
+    const ChannelStatistics::Histogram* currentHist = nullptr;
+    const MaxPyramid* pyramid = nullptr;
     QColor histColor;
     QString channelName;
     int channelIndex = 0;
 
     switch (rgbChannel) {
         case RED_CHANNEL:
-            currentHist = &redHistogram;
+            currentHist = redHistogram.get();
+            pyramid = &redPyramid;
             histColor = QColor(200, 50, 50);
             channelName = QString::fromUtf8("Красный");
             channelIndex = redChannelIndex;
             break;
         case GREEN_CHANNEL:
-            currentHist = &greenHistogram;
+            currentHist = greenHistogram.get();
+            pyramid = &greenPyramid;
             histColor = QColor(50, 200, 50);
             channelName = QString::fromUtf8("Зеленый");
             channelIndex = greenChannelIndex;
             break;
         case BLUE_CHANNEL:
-            currentHist = &blueHistogram;
+            currentHist = blueHistogram.get();
+            pyramid = &bluePyramid;
             histColor = QColor(50, 50, 200);
             channelName = QString::fromUtf8("Синий");
             channelIndex = blueChannelIndex;
@@ -321,10 +328,7 @@ void HistogramWidget::drawRGBHistogram(QPainter& painter, int leftMargin, int ri
         maxValue = 65535;
     }
     
-    int maxCount = 0;
-    for (int i = minValue; i <= maxValue && i < static_cast<int>(currentHist->size()); i++) {
-        maxCount = std::max(maxCount, (*currentHist)[i]);
-    }
+    int maxCount = pyramid->maxInRange(minValue, maxValue);
     
     if (isZoomed && zoomMaxCount > 0) {
         maxCount = std::min(maxCount, zoomMaxCount);
@@ -345,13 +349,8 @@ void HistogramWidget::drawRGBHistogram(QPainter& painter, int leftMargin, int ri
     if (numBins == 0) numBins = 1;
     
     for (int bin = 0; bin < numBins; bin++) {
-        int binCount = 0;
-        for (int i = 0; i < binSize; i++) {
-            int index = minValue + bin * binSize + i;
-            if (index >= 0 && index < static_cast<int>(currentHist->size())) {
-                binCount += (*currentHist)[index];
-            }
-        }
+        int binStart = minValue + bin * binSize;
+        int binCount = static_cast<int>(sumInRange(*currentHist, binStart, binStart + binSize - 1));
         
         if (binCount > 0 && binCount <= maxCount) {
             float heightRatio = static_cast<float>(binCount) / maxCount;
@@ -451,30 +450,87 @@ void HistogramWidget::drawAxes(QPainter& painter, int leftMargin, int rightMargi
     }
 }
 
-void HistogramWidget::calculateInformativeRange(const std::vector<int>& hist, int& outMin, int& outMax) {
-    if (hist.empty()) {
-        outMin = 0;
-        outMax = 65535;
-        return;
+void HistogramWidget::MaxPyramid::build(const ChannelStatistics::Histogram* hist) {
+    levels.clear();
+    offset = 0;
+    if (!hist || hist->bins.empty()) return;
+    
+    offset = hist->minVal;
+    levels.push_back(hist->bins);
+    while (levels.back().size() > 1) {
+        const std::vector<int>& lower = levels.back();
+        std::vector<int> upper((lower.size() + 1) / 2);
+        for (size_t i = 0; i < upper.size(); i++) {
+            int left = lower[2 * i];
+            int right = 2 * i + 1 < lower.size() ? lower[2 * i + 1] : 0;
+            upper[i] = std::max(left, right);
+        }
+        levels.push_back(std::move(upper));
     }
+}
+
+int HistogramWidget::MaxPyramid::maxInRange(int minValue, int maxValue) const {
+    if (levels.empty()) return 0;
     
-    int firstNonZero = 0;
-    int lastNonZero = hist.size() - 1;
+    // Полуинтервал [left, right) в индексах нижнего уровня
+    int left = std::max(0, minValue - offset);
+    int right = std::min(static_cast<int>(levels[0].size()), maxValue - offset + 1);
     
-    for (size_t i = 0; i < hist.size(); i++) {
-        if (hist[i] > 0) {
-            firstNonZero = i;
-            break;
-        }
+    int result = 0;
+    for (size_t level = 0; left < right && level < levels.size(); level++) {
+        const std::vector<int>& values = levels[level];
+        if (left & 1) result = std::max(result, values[left++]);
+        if (right & 1) result = std::max(result, values[--right]);
+        left >>= 1;
+        right >>= 1;
     }
+    return result;
+}
+
+int64_t HistogramWidget::sumInRange(const ChannelStatistics::Histogram& hist, int minValue, int maxValue) {
+    if (hist.isEmpty()) return 0;
     
-    for (int i = hist.size() - 1; i >= 0; i--) {
-        if (hist[i] > 0) {
-            lastNonZero = i;
-            break;
+    // Накопленная сумма до значения включительно
+    auto cumulativeAt = [&hist](int value) -> int64_t {
+        if (value < hist.minVal) return 0;
+        if (value >= hist.maxVal) return static_cast<int64_t>(hist.total);
+        return static_cast<int64_t>(hist.cumulative[value - hist.minVal]);
+    };
+    
+    if (maxValue < minValue) return 0;
+    return cumulativeAt(maxValue) - cumulativeAt(minValue - 1);
+}
+
+const ChannelStatistics::Histogram* HistogramWidget::currentHistogram(const MaxPyramid** pyramid) const {
+    const ChannelStatistics::Histogram* hist = nullptr;
+    const MaxPyramid* histPyramid = nullptr;
+    
+    if (displayMode == GRAYSCALE) {
+        hist = histogram16bit.get();
+        histPyramid = &grayPyramid;
+    } else {
+        switch (rgbChannel) {
+            case RED_CHANNEL: hist = redHistogram.get(); histPyramid = &redPyramid; break;
+            case GREEN_CHANNEL: hist = greenHistogram.get(); histPyramid = &greenPyramid; break;
+            case BLUE_CHANNEL: hist = blueHistogram.get(); histPyramid = &bluePyramid; break;
         }
     }
     
+    if (pyramid) *pyramid = histPyramid;
+    return hist;
+}
+
+void HistogramWidget::calculateInformativeRange(const ChannelStatistics::Histogram& hist, int& outMin, int& outMax) {
+    if (hist.isEmpty()) {
+        outMin = 0;
+        outMax = 65535;
+        return;
+    }
+    
+    // Гистограмма хранит только непустой диапазон значений
+    int firstNonZero = hist.minVal;
+    int lastNonZero = hist.maxVal;
+    
     int range = lastNonZero - firstNonZero;
     int padding = std::max(100, range / 20);
     
@@ -8,7 +8,10 @@
 #include <QFont>
 #include <QFontMetrics>
 #include <QMouseEvent>
+#include <QPixmap>
 #include <vector>
+#include <memory>
+#include "channel_statistics.h"
 
 class HistogramWidget : public QWidget {
     Q_OBJECT
@@ -25,12 +28,14 @@ public:
         BLUE_CHANNEL
     };
 
+    using HistogramPtr = std::shared_ptr<const ChannelStatistics::Histogram>;
+
     HistogramWidget(QWidget *parent = nullptr);
 
-    void setHistogramData16bit(const std::vector<int>& hist, int channelIndex);
-    void setRGBHistogramData(const std::vector<int>& redHist, 
-                            const std::vector<int>& greenHist, 
-                            const std::vector<int>& blueHist,
+    void setHistogramData16bit(const HistogramPtr& hist, int channelIndex);
+    void setRGBHistogramData(const HistogramPtr& redHist, 
+                            const HistogramPtr& greenHist, 
+                            const HistogramPtr& blueHist,
                             int redCh, int greenCh, int blueCh);
     void setDisplayMode(DisplayMode mode);
     void setRGBChannel(RGBChannel ch);
@@ -44,6 +49,23 @@ protected:
     void mouseReleaseEvent(QMouseEvent *event) override;
 
 private:
+    // Пирамида максимумов по бинам гистограммы: уровень k хранит максимумы
+    // по блокам из 2^k соседних значений. Максимум на любом диапазоне - O(log n)
+    struct MaxPyramid {
+        std::vector<std::vector<int>> levels;
+        int offset = 0;  // значение, соответствующее levels[0][0]
+
+        void build(const ChannelStatistics::Histogram* hist);
+        int maxInRange(int minValue, int maxValue) const;
+    };
+
+    // Сумма бинов [minValue, maxValue] по накопленной гистограмме, O(1)
+    static int64_t sumInRange(const ChannelStatistics::Histogram& hist, int minValue, int maxValue);
+
+    const ChannelStatistics::Histogram* currentHistogram(const MaxPyramid** pyramid = nullptr) const;
+    void invalidatePlot();
+    void renderPlot(QPainter& painter);
+
     void drawGrayscaleHistogram(QPainter& painter, int leftMargin, int rightMargin, 
                                int topMargin, int bottomMargin, int plotWidth, int plotHeight);
     void drawRGBHistogram(QPainter& painter, int leftMargin, int rightMargin, 
@@ -52,12 +74,21 @@ private:
                  int topMargin, int bottomMargin, int plotWidth, int plotHeight, 
                  int maxCount, int minVal = 0, int maxVal = 65535);
     void drawSelectionRect(QPainter& painter);
-    void calculateInformativeRange(const std::vector<int>& hist, int& outMin, int& outMax);
+    void calculateInformativeRange(const ChannelStatistics::Histogram& hist, int& outMin, int& outMax);
 
-    std::vector<int> histogram16bit;
-    std::vector<int> redHistogram;
-    std::vector<int> greenHistogram;
-    std::vector<int> blueHistogram;
+    HistogramPtr histogram16bit;
+    HistogramPtr redHistogram;
+    HistogramPtr greenHistogram;
+    HistogramPtr blueHistogram;
+    MaxPyramid grayPyramid;
+    MaxPyramid redPyramid;
+    MaxPyramid greenPyramid;
+    MaxPyramid bluePyramid;
+    
+    // Отрисованный график; перерисовывается только при смене данных, режима,
+    // масштаба или размера. Рамка выделения рисуется поверх
+    QPixmap plotCache;
+    bool plotCacheValid = false;
     int channel;
     int redChannelIndex = 0;
     int greenChannelIndex = 0;
@@ -1,5 +1,7 @@
 #include "hyperspectral_image.h"
 #include "tiff_reader.h"
+#include "parallel_utils.h"
+#include "channel_statistics.h"
 #include <QDebug>
 #include <algorithm>
 #include <cmath>
@@ -17,14 +19,45 @@ bool HyperspectralImage::loadFromTiff(const QString& filePath) {
     tiffFilePath = filePath;
     
     std::vector<std::vector<uint16_t>> tempChannels;
-    if (!TiffReader::loadTiffData(filePath, tempChannels, info)) {
+    std::vector<QuantileSketch> sketches;
+    
+    // Гистограммы считаются в пуле потоков, пока декодируются следующие каналы
+    HistogramAccumulator accumulator(static_cast<int>(numChannels));
+    std::vector<bool> channelCounted(numChannels, false);
+    auto countChannel = [&](int channelIndex) {
+        if (channelIndex < 0 || channelIndex >= static_cast<int>(tempChannels.size())) return;
+        const auto& channel = tempChannels[channelIndex];
+        accumulator.addChannel(channelIndex, channel.data(), channel.size());
+        channelCounted[channelIndex] = true;
+    };
+    
+    if (!TiffReader::loadTiffData(filePath, tempChannels, info, countChannel, &sketches)) {
         qDebug() << "Failed to load TIFF data from" << filePath;
         return false;
     }
     
+    // Каналы, которые не удалось прочитать, остаются нулевыми и тоже учитываются
+    for (int i = 0; i < static_cast<int>(numChannels); i++) {
+        if (!channelCounted[i]) countChannel(i);
+    }
+    std::vector<ChannelStatistics::Histogram> histograms = accumulator.takeResults();
+    
     img16bit.clear();
     img8bit.clear();
     histogramCache.clear();
+    contrastLUTCache.clear();
+    claheCache.clear();
+    tileHistogramCache.clear();
+    bandStatisticsCache.clear();
+    covarianceCache.clear();
+    shiftDifferenceCache.reset();
+    derivedChannels.clear();
+    
+    sampleSketches = std::move(sketches);
+    sampleQuantization.clear();
+    for (const QuantileSketch& sketch : sampleSketches) {
+        sampleQuantization.push_back(SampleQuantization::fromSketch(sketch));
+    }
     
     for (int i = 0; i < static_cast<int>(numChannels); i++) {
         if (i < static_cast<int>(tempChannels.size())) {
@@ -32,28 +65,14 @@ bool HyperspectralImage::loadFromTiff(const QString& filePath) {
         }
     }
     
-    channelContrast.resize(numChannels);
+    channelContrast.assign(numChannels, ContrastParams{});
     
     for (int i = 0; i < static_cast<int>(numChannels); i++) {
-        CachedHistogram cachedHist;
-        cachedHist.histogram.resize(65536, 0);
-        
-        uint16_t minVal = 65535;
-        uint16_t maxVal = 0;
-        
-        for (uint16_t val : img16bit[i]) {
-            cachedHist.histogram[val]++;
-            minVal = std::min(minVal, val);
-            maxVal = std::max(maxVal, val);
-        }
-        
-        cachedHist.minMax = {minVal, maxVal};
-        cachedHist.isValid = true;
-        histogramCache[i] = std::move(cachedHist);
-        
         // Set default contrast parameters
-        channelContrast[i].minVal = minVal;
-        channelContrast[i].maxVal = maxVal;
+        channelContrast[i].minVal = histograms[i].minVal;
+        channelContrast[i].maxVal = histograms[i].maxVal;
+        
+        histogramCache[i] = std::make_shared<const ChannelStatistics::Histogram>(std::move(histograms[i]));
     }
     
     qDebug() << "Successfully loaded TIFF:" << numChannels << "channels," << width << "x" << height;
@@ -62,36 +81,87 @@ bool HyperspectralImage::loadFromTiff(const QString& filePath) {
 }
 
 void HyperspectralImage::normalizeToRange(int channelIndex, uint16_t minVal, uint16_t maxVal) {
-    if (channelIndex < 0 || channelIndex >= static_cast<int>(numChannels)) return;
+    if (channelIndex < 0 || channelIndex >= getNumDisplayChannels()) return;
     if (maxVal <= minVal) maxVal = minVal + 1;
     
     channelContrast[channelIndex].minVal = minVal;
     channelContrast[channelIndex].maxVal = maxVal;
     channelContrast[channelIndex].usePercentile = false;
     
-    update8bitData(channelIndex);
+    invalidate8bitData(channelIndex);
 }
 
 void HyperspectralImage::normalizeByPercentile(int channelIndex, double percentLow, double percentHigh) {
-    if (channelIndex < 0 || channelIndex >= static_cast<int>(numChannels)) return;
+    if (channelIndex < 0 || channelIndex >= getNumDisplayChannels()) return;
     
     channelContrast[channelIndex].percentCutLow = percentLow;
     channelContrast[channelIndex].percentCutHigh = percentHigh;
     channelContrast[channelIndex].usePercentile = true;
     
-    auto histogram = calculateHistogram16bit(channelIndex);
-    auto [minVal, maxVal] = calculatePercentileBounds(histogram, percentLow, percentHigh);
+    HistogramPtr histogram = getHistogram(channelIndex);
+    auto [minVal, maxVal] = channelPercentileBounds(channelIndex, *histogram, percentLow, percentHigh);
     
     channelContrast[channelIndex].minVal = minVal;
     channelContrast[channelIndex].maxVal = maxVal;
     
-    update8bitData(channelIndex);
+    invalidate8bitData(channelIndex);
+}
+
+void HyperspectralImage::normalizeRegionByPercentile(int channelIndex, const QRect& region,
+                                                     double percentLow, double percentHigh) {
+    if (channelIndex < 0 || channelIndex >= getNumDisplayChannels()) return;
+    
+    HistogramPtr histogram = getRegionHistogram(channelIndex, region);
+    if (histogram->isEmpty()) return;
+    
+    auto [minVal, maxVal] = histogram->percentileBounds(percentLow, percentHigh);
+    normalizeToRange(channelIndex, minVal, maxVal);
+}
+
+void HyperspectralImage::setStretchMode(int channelIndex, StretchMode mode, double gamma, double claheClipLimit) {
+    if (channelIndex < 0 || channelIndex >= getNumDisplayChannels()) return;
+    
+    channelContrast[channelIndex].stretchMode = mode;
+    channelContrast[channelIndex].gamma = std::clamp(gamma, 0.1, 10.0);
+    channelContrast[channelIndex].claheClipLimit = std::clamp(claheClipLimit, 0.0, 100.0);
+    
+    invalidate8bitData(channelIndex);
+}
+
+QString HyperspectralImage::stretchModeName(StretchMode mode) {
+    switch (mode) {
+    case STRETCH_LINEAR: return "Линейное";
+    case STRETCH_EQUALIZE: return "Выравнивание гистограммы";
+    case STRETCH_GAMMA: return "Гамма";
+    case STRETCH_LOG: return "Логарифмическое";
+    case STRETCH_GAUSSIAN: return "Гауссово";
+    case STRETCH_CLAHE: return "Локальное (CLAHE)";
+    default: return QString();
+    }
+}
+
+void HyperspectralImage::normalizeAllByPercentile(double percentLow, double percentHigh) {
+    std::vector<int> channelIndices(numChannels);
+    for (int i = 0; i < static_cast<int>(numChannels); i++) channelIndices[i] = i;
+    
+    auto bounds = calculatePercentileBounds(channelIndices, percentLow, percentHigh);
+    
+    for (int i = 0; i < static_cast<int>(numChannels); i++) {
+        channelContrast[i].percentCutLow = percentLow;
+        channelContrast[i].percentCutHigh = percentHigh;
+        channelContrast[i].usePercentile = true;
+        channelContrast[i].minVal = bounds[i].first;
+        channelContrast[i].maxVal = bounds[i].second;
+        
+        invalidate8bitData(i);
+    }
 }
 
 QImage HyperspectralImage::getChannelImage(int channelIndex) {
-    if (channelIndex < 0 || channelIndex >= static_cast<int>(numChannels)) {
+    if (channelIndex < 0 || channelIndex >= getNumDisplayChannels()) {
         return QImage();
     }
+    preloadChannels({channelIndex});
     
     if (img16bit.find(channelIndex) == img16bit.end()) {
         return QImage();
@@ -117,16 +187,20 @@ QImage HyperspectralImage::getChannelImage(int channelIndex) {
 }
 
 QImage HyperspectralImage::getRGBImage(int redChannel, int greenChannel, int blueChannel) {
-    if (redChannel < 0 || redChannel >= static_cast<int>(numChannels) ||
-        greenChannel < 0 || greenChannel >= static_cast<int>(numChannels) ||
-        blueChannel < 0 || blueChannel >= static_cast<int>(numChannels)) {
+    if (redChannel < 0 || redChannel >= getNumDisplayChannels() ||
+        greenChannel < 0 || greenChannel >= getNumDisplayChannels() ||
+        blueChannel < 0 || blueChannel >= getNumDisplayChannels()) {
         return QImage();
     }
     
+    preloadChannels({redChannel, greenChannel, blueChannel});
+    
     // Ensure 8-bit data is available for RGB channels
-    update8bitData(redChannel);
-    update8bitData(greenChannel);
-    update8bitData(blueChannel);
+    for (int channelIndex : {redChannel, greenChannel, blueChannel}) {
+        if (img8bit.find(channelIndex) == img8bit.end()) {
+            update8bitData(channelIndex);
+        }
+    }
     
     QImage image(width, height, QImage::Format_RGB32);
     
@@ -150,64 +224,504 @@ QImage HyperspectralImage::getRGBImage(int redChannel, int greenChannel, int blu
     return image;
 }
 
-std::vector<int> HyperspectralImage::calculateHistogram16bit(int channelIndex) {
-    if (channelIndex < 0 || channelIndex >= static_cast<int>(numChannels)) {
-        return std::vector<int>(65536, 0);
+QImage HyperspectralImage::getPseudoColorImage(int channelIndex, Colormap::Type colormap) {
+    return renderImage(makeChannelRenderSource(channelIndex, colormap), 1);
+}
+
+HyperspectralImage::RenderSource HyperspectralImage::makeChannelRenderSource(int channelIndex, Colormap::Type colormap) const {
+    RenderSource source;
+    if (channelIndex < 0 || channelIndex >= getNumDisplayChannels()) return source;
+    
+    auto it = img16bit.find(channelIndex);
+    if (it == img16bit.end() || it->second.size() != static_cast<size_t>(width) * height) return source;
+    
+    source.channels[0] = it->second.data();
+    source.tileMaps[0] = getClaheTileMap(channelIndex);
+    if (source.tileMaps[0]) {
+        if (colormap != Colormap::GRAYSCALE) source.colorLUT = Colormap::palette(colormap);
+    } else if (colormap == Colormap::GRAYSCALE) {
+        source.luts[0] = getContrastLUT(channelIndex);
+    } else {
+        source.colorLUT = buildColorLUT(channelIndex, colormap);
+    }
+    source.numComponents = 1;
+    source.width = width;
+    source.height = height;
+    return source;
+}
+
+HyperspectralImage::RenderSource HyperspectralImage::makeRGBRenderSource(int redChannel, int greenChannel, int blueChannel) const {
+    RenderSource source;
+    const int rgb[3] = {redChannel, greenChannel, blueChannel};
+    
+    for (int c = 0; c < 3; c++) {
+        if (rgb[c] < 0 || rgb[c] >= getNumDisplayChannels()) return RenderSource();
+        
+        auto it = img16bit.find(rgb[c]);
+        if (it == img16bit.end() || it->second.size() != static_cast<size_t>(width) * height) return RenderSource();
+        
+        source.channels[c] = it->second.data();
+        source.tileMaps[c] = getClaheTileMap(rgb[c]);
+        if (!source.tileMaps[c]) source.luts[c] = getContrastLUT(rgb[c]);
+    }
+    
+    source.numComponents = 3;
+    source.width = width;
+    source.height = height;
+    return source;
+}
+
+QImage HyperspectralImage::renderImage(const RenderSource& source, int step) {
+    if (!source.isValid() || source.width == 0 || source.height == 0) return QImage();
+    step = std::max(1, step);
+    
+    const uint32_t outWidth = (source.width + step - 1) / step;
+    const uint32_t outHeight = (source.height + step - 1) / step;
+    const bool isRGB = source.numComponents == 3;
+    const bool isPseudoColor = !isRGB && !source.colorLUT.empty();
+    
+    QImage image(outWidth, outHeight, isRGB || isPseudoColor ? QImage::Format_RGB32 : QImage::Format_Grayscale8);
+    if (image.isNull()) return image;
+    
+    // Строки пишутся независимо, поэтому делим изображение на полосы
+    const int64_t rowsPerBlock = std::max<int64_t>(1, (1 << 18) / outWidth);
+    
+    if (source.tileMaps[0] || source.tileMaps[1] || source.tileMaps[2]) {
+        // CLAHE зависит от положения пикселя: компоненты сначала переводятся в 8 бит построчно
+        Parallel::forRange(0, outHeight, rowsPerBlock, [&](int64_t rowBegin, int64_t rowEnd) {
+            std::vector<uint8_t> rowBuffer(static_cast<size_t>(outWidth) * source.numComponents);
+            
+            for (int64_t y = rowBegin; y < rowEnd; y++) {
+                const size_t rowOffset = static_cast<size_t>(y) * step * source.width;
+                
+                for (int c = 0; c < source.numComponents; c++) {
+                    const uint16_t* row = source.channels[c] + rowOffset;
+                    uint8_t* out = rowBuffer.data() + static_cast<size_t>(c) * outWidth;
+                    if (source.tileMaps[c]) {
+                        source.tileMaps[c]->mapRow(row, static_cast<uint32_t>(y * step), step, outWidth, out);
+                    } else {
+                        const uint8_t* lut = source.luts[c].data();
+                        for (uint32_t x = 0; x < outWidth; x++) {
+                            out[x] = lut[row[static_cast<size_t>(x) * step]];
+                        }
+                    }
+                }
+                
+                if (isRGB) {
+                    const uint8_t* red = rowBuffer.data();
+                    const uint8_t* green = red + outWidth;
+                    const uint8_t* blue = green + outWidth;
+                    QRgb* scanLine = reinterpret_cast<QRgb*>(image.scanLine(static_cast<int>(y)));
+                    for (uint32_t x = 0; x < outWidth; x++) {
+                        scanLine[x] = qRgb(red[x], green[x], blue[x]);
+                    }
+                } else if (isPseudoColor) {
+                    const QRgb* palette = source.colorLUT.data();
+                    QRgb* scanLine = reinterpret_cast<QRgb*>(image.scanLine(static_cast<int>(y)));
+                    for (uint32_t x = 0; x < outWidth; x++) {
+                        scanLine[x] = palette[rowBuffer[x]];
+                    }
+                } else {
+                    std::copy(rowBuffer.begin(), rowBuffer.begin() + outWidth, image.scanLine(static_cast<int>(y)));
+                }
+            }
+        });
+        return image;
+    }
+    
+    Parallel::forRange(0, outHeight, rowsPerBlock, [&](int64_t rowBegin, int64_t rowEnd) {
+        for (int64_t y = rowBegin; y < rowEnd; y++) {
+            const size_t rowOffset = static_cast<size_t>(y) * step * source.width;
+            
+            if (isRGB) {
+                const uint16_t* red = source.channels[0] + rowOffset;
+                const uint16_t* green = source.channels[1] + rowOffset;
+                const uint16_t* blue = source.channels[2] + rowOffset;
+                const uint8_t* redLUT = source.luts[0].data();
+                const uint8_t* greenLUT = source.luts[1].data();
+                const uint8_t* blueLUT = source.luts[2].data();
+                
+                QRgb* scanLine = reinterpret_cast<QRgb*>(image.scanLine(static_cast<int>(y)));
+                for (uint32_t x = 0; x < outWidth; x++) {
+                    const size_t index = static_cast<size_t>(x) * step;
+                    scanLine[x] = qRgb(redLUT[red[index]], greenLUT[green[index]], blueLUT[blue[index]]);
+                }
+            } else if (isPseudoColor) {
+                // Один проход 16 бит -> RGB32 без промежуточного 8-битного буфера
+                const uint16_t* gray = source.channels[0] + rowOffset;
+                const QRgb* lut = source.colorLUT.data();
+                
+                QRgb* scanLine = reinterpret_cast<QRgb*>(image.scanLine(static_cast<int>(y)));
+                if (step == 1) {
+                    for (uint32_t x = 0; x < outWidth; x++) {
+                        scanLine[x] = lut[gray[x]];
+                    }
+                } else {
+                    for (uint32_t x = 0; x < outWidth; x++) {
+                        scanLine[x] = lut[gray[static_cast<size_t>(x) * step]];
+                    }
+                }
+            } else {
+                const uint16_t* gray = source.channels[0] + rowOffset;
+                const uint8_t* lut = source.luts[0].data();
+                
+                uchar* scanLine = image.scanLine(static_cast<int>(y));
+                for (uint32_t x = 0; x < outWidth; x++) {
+                    scanLine[x] = lut[gray[static_cast<size_t>(x) * step]];
+                }
+            }
+        }
+    });
+    
+    return image;
+}
+
+HyperspectralImage::CubeSource HyperspectralImage::makeCubeSource() const {
+    CubeSource source;
+    if (!collectSpectralBands(source.bands, &source.quantization)) return CubeSource();
+    source.width = width;
+    source.height = height;
+    return source;
+}
+
+HyperspectralImage::HistogramPtr HyperspectralImage::getHistogram(int channelIndex) const {
+    static const HistogramPtr empty = std::make_shared<const ChannelStatistics::Histogram>();
+    if (channelIndex < 0 || channelIndex >= getNumDisplayChannels()) {
+        return empty;
     }
     
     auto it = histogramCache.find(channelIndex);
-    if (it != histogramCache.end() && it->second.isValid) {
-        return it->second.histogram;
+    if (it != histogramCache.end()) {
+        return it->second;
     }
     
     // Fallback: calculate histogram if not cached
-    std::vector<int> histogram(65536, 0);
-    if (img16bit.find(channelIndex) != img16bit.end()) {
-        for (uint16_t val : img16bit[channelIndex]) {
-            histogram[val]++;
-        }
+    auto data = img16bit.find(channelIndex);
+    if (data == img16bit.end()) {
+        return empty;
     }
     
+    HistogramPtr histogram = std::make_shared<const ChannelStatistics::Histogram>(
+        ChannelStatistics::compute(data->second.data(), data->second.size()));
+    histogramCache[channelIndex] = histogram;
     return histogram;
 }
 
-std::pair<uint16_t, uint16_t> HyperspectralImage::calculatePercentileBounds(const std::vector<int>& histogram, 
+HyperspectralImage::HistogramPtr HyperspectralImage::getRegionHistogram(int channelIndex, const QRect& region) const {
+    static const HistogramPtr empty = std::make_shared<const ChannelStatistics::Histogram>();
+    if (channelIndex < 0 || channelIndex >= getNumDisplayChannels()) return empty;
+    
+    const QRect clipped = region.intersected(QRect(0, 0, width, height));
+    if (clipped.isEmpty()) return empty;
+    if (clipped.width() == static_cast<int>(width) && clipped.height() == static_cast<int>(height)) {
+        return getHistogram(channelIndex);
+    }
+    
+    auto data = img16bit.find(channelIndex);
+    if (data == img16bit.end() || data->second.size() != static_cast<size_t>(width) * height) return empty;
+    
+    // Индекс строится один раз на канал; дальше каждый запрос - O(бинов) плюс краевые полосы
+    auto cached = tileHistogramCache.find(channelIndex);
+    if (cached == tileHistogramCache.end()) {
+        HistogramPtr full = getHistogram(channelIndex);
+        auto index = TileHistogramIndex::build(data->second.data(), width, height, full->minVal, full->maxVal);
+        cached = tileHistogramCache.emplace(channelIndex, index).first;
+    }
+    if (!cached->second) return empty;
+    
+    return std::make_shared<const ChannelStatistics::Histogram>(
+        cached->second->regionHistogram(data->second.data(), clipped.x(), clipped.y(), clipped.width(), clipped.height()));
+}
+
+std::pair<uint16_t, uint16_t> HyperspectralImage::calculatePercentileBounds(const ChannelStatistics::Histogram& histogram, 
                                                        double percentLow, double percentHigh) {
-    size_t totalPixels = width * height;
-    size_t lowCutoff = static_cast<size_t>(totalPixels * percentLow / 100.0);
-    size_t highCutoff = static_cast<size_t>(totalPixels * (100.0 - percentHigh) / 100.0);
-    
-    uint16_t minVal = 0;
-    uint16_t maxVal = 65535;
-    
-    size_t cumulative = 0;
-    for (int i = 0; i < 65536; i++) {
-        cumulative += histogram[i];
-        if (cumulative >= lowCutoff && minVal == 0) {
-            minVal = static_cast<uint16_t>(i);
-        }
-        if (cumulative >= highCutoff) {
-            maxVal = static_cast<uint16_t>(i);
-            break;
-        }
+    return histogram.percentileBounds(percentLow, percentHigh);
+}
+
+std::vector<std::pair<uint16_t, uint16_t>> HyperspectralImage::calculatePercentileBounds(const std::vector<int>& channelIndices,
+                                                                                        double percentLow, double percentHigh) {
+    // Кэш гистограмм заполняется в вызывающем потоке, дальше только чтение
+    std::vector<HistogramPtr> histograms;
+    histograms.reserve(channelIndices.size());
+    for (int channelIndex : channelIndices) {
+        histograms.push_back(getHistogram(channelIndex));
     }
     
-    return {minVal, maxVal};
+    std::vector<std::pair<uint16_t, uint16_t>> bounds(channelIndices.size());
+    Parallel::forRange(0, static_cast<int64_t>(bounds.size()), 64, [&](int64_t begin, int64_t end) {
+        for (int64_t i = begin; i < end; i++) {
+            bounds[i] = channelPercentileBounds(channelIndices[i], *histograms[i], percentLow, percentHigh);
+        }
+    });
+    return bounds;
+}
+
+std::pair<uint16_t, uint16_t> HyperspectralImage::channelPercentileBounds(int channelIndex,
+                                                                          const ChannelStatistics::Histogram& histogram,
+                                                                          double percentLow, double percentHigh) const {
+    const QuantileSketch* sketch = getSampleSketch(channelIndex);
+    if (!sketch || sketch->isEmpty()) return histogram.percentileBounds(percentLow, percentHigh);
+    
+    // Гистограмма кодов не видит значений за краями шкалы квантования, эскиз видит все
+    auto [low, high] = sketch->percentileBounds(percentLow, percentHigh);
+    const SampleQuantization& quantization = sampleQuantization[channelIndex];
+    return {quantization.encode(low), quantization.encode(high)};
+}
+
+SampleQuantization HyperspectralImage::getSampleQuantization(int channelIndex) const {
+    const int derivedIndex = channelIndex - static_cast<int>(numChannels);
+    if (derivedIndex >= 0 && derivedIndex < static_cast<int>(derivedChannels.size())) {
+        return derivedChannels[derivedIndex].quantization;
+    }
+    if (channelIndex < 0 || channelIndex >= static_cast<int>(sampleQuantization.size())) return SampleQuantization{};
+    return sampleQuantization[channelIndex];
+}
+
+const QuantileSketch* HyperspectralImage::getSampleSketch(int channelIndex) const {
+    if (channelIndex < 0 || channelIndex >= static_cast<int>(sampleSketches.size())) return nullptr;
+    return &sampleSketches[channelIndex];
 }
 
 std::pair<uint16_t, uint16_t> HyperspectralImage::getChannelMinMax16bit(int channelIndex) {
-    if (channelIndex < 0 || channelIndex >= static_cast<int>(numChannels)) {
+    if (channelIndex < 0 || channelIndex >= getNumDisplayChannels()) {
         return {0, 65535};
     }
     
     auto it = histogramCache.find(channelIndex);
-    if (it != histogramCache.end() && it->second.isValid) {
-        return it->second.minMax;
+    if (it != histogramCache.end()) {
+        return {it->second->minVal, it->second->maxVal};
     }
     
     return {0, 65535};
 }
 
+std::vector<ChannelStatistics::BandStatistics> HyperspectralImage::getBandStatistics() const {
+    std::vector<ChannelStatistics::BandStatistics> statistics(numChannels);
+    
+    // Кэши читаются только в этом потоке; задачи получают готовые указатели
+    std::vector<int> missing;
+    std::vector<const uint16_t*> missingData;
+    for (int i = 0; i < static_cast<int>(numChannels); i++) {
+        auto cached = bandStatisticsCache.find(i);
+        if (cached != bandStatisticsCache.end()) {
+            statistics[i] = cached->second;
+            continue;
+        }
+        auto data = img16bit.find(i);
+        if (data != img16bit.end() && data->second.size() == static_cast<size_t>(width) * height) {
+            missing.push_back(i);
+            missingData.push_back(data->second.data());
+        }
+    }
+    
+    Parallel::forRange(0, static_cast<int64_t>(missing.size()), 1, [&](int64_t begin, int64_t end) {
+        for (int64_t i = begin; i < end; i++) {
+            statistics[missing[i]] = ChannelStatistics::computeBandStatistics(missingData[i], width, height);
+        }
+    });
+    
+    for (int channelIndex : missing) {
+        bandStatisticsCache[channelIndex] = statistics[channelIndex];
+    }
+    
+    // Кэш хранит статистику кодов; наружу - в исходных единицах 32-битного файла
+    for (size_t i = 0; i < sampleQuantization.size() && i < statistics.size(); i++) {
+        const SampleQuantization& quantization = sampleQuantization[i];
+        ChannelStatistics::BandStatistics& band = statistics[i];
+        band.mean = quantization.decode(band.mean);
+        band.stdDev *= quantization.scale;
+        band.noise *= quantization.scale;
+        band.snr = band.noise > 0.0 ? band.mean / band.noise : 0.0;
+    }
+    return statistics;
+}
+
+std::shared_ptr<const SpectralCovariance::Result> HyperspectralImage::getBandCovariance(size_t step) const {
+    step = std::max<size_t>(1, step);
+    auto cached = covarianceCache.find(step);
+    if (cached != covarianceCache.end()) return cached->second;
+    
+    const size_t numPixels = static_cast<size_t>(width) * height;
+    std::vector<const uint16_t*> bands;
+    if (!collectSpectralBands(bands)) return nullptr;
+    
+    auto covariance = std::make_shared<const SpectralCovariance::Result>(SpectralCovariance::compute(bands, numPixels, step));
+    covarianceCache[step] = covariance;
+    return covariance;
+}
+
+std::shared_ptr<const SpectralCovariance::Result> HyperspectralImage::findBandCovariance(size_t step) const {
+    auto cached = covarianceCache.find(std::max<size_t>(1, step));
+    return cached != covarianceCache.end() ? cached->second : nullptr;
+}
+
+void HyperspectralImage::cacheBandCovariance(size_t step,
+                                             std::shared_ptr<const SpectralCovariance::Result> covariance) const {
+    if (!covariance || covariance->numBands != static_cast<int>(numChannels)) return;
+    covarianceCache[std::max<size_t>(1, step)] = std::move(covariance);
+}
+
+std::shared_ptr<const SpectralCovariance::Result> HyperspectralImage::getShiftDifferenceCovariance() const {
+    if (shiftDifferenceCache) return shiftDifferenceCache;
+    
+    std::vector<const uint16_t*> bands;
+    if (!collectSpectralBands(bands)) return nullptr;
+    shiftDifferenceCache = std::make_shared<const SpectralCovariance::Result>(
+        SpectralCovariance::computeShiftDifference(bands, width, height));
+    return shiftDifferenceCache;
+}
+
+int HyperspectralImage::addDerivedChannel(const QString& name, std::vector<uint16_t> data,
+                                          const SampleQuantization& quantization) {
+    if (data.size() != static_cast<size_t>(width) * height) return -1;
+    
+    const int channelIndex = getNumDisplayChannels();
+    derivedChannels.push_back({name, quantization});
+    img16bit[channelIndex] = std::move(data);
+    channelContrast.push_back(ContrastParams{});
+    normalizeByPercentile(channelIndex, 2.0, 2.0);
+    return channelIndex;
+}
+
+int HyperspectralImage::addProjectedChannel(const QString& name, std::shared_ptr<const PcaTransform::Basis> basis,
+                                            int component) {
+    if (!basis || component < 0 || component >= basis->numComponents() ||
+        basis->numBands != static_cast<int>(numChannels)) {
+        return -1;
+    }
+    
+    const int channelIndex = getNumDisplayChannels();
+    derivedChannels.push_back({name, SampleQuantization{}, std::move(basis), component});
+    channelContrast.push_back(ContrastParams{});
+    return channelIndex;
+}
+
+int HyperspectralImage::addTransformedChannel(const QString& name, SpectralTransform::Type type,
+                                              std::shared_ptr<const SpectralTransform::Grid> grid, int band) {
+    if (!grid || type == SpectralTransform::NONE || grid->size() != static_cast<int>(numChannels) ||
+        band < 0 || band >= grid->size()) {
+        return -1;
+    }
+    
+    DerivedChannel channel;
+    channel.name = name;
+    channel.grid = std::move(grid);
+    channel.transform = type;
+    channel.band = band;
+    
+    const int channelIndex = getNumDisplayChannels();
+    derivedChannels.push_back(std::move(channel));
+    channelContrast.push_back(ContrastParams{});
+    return channelIndex;
+}
+
+int HyperspectralImage::addReconstructedChannel(const QString& name, std::shared_ptr<const PcaTransform::Basis> basis,
+                                                int numComponents, int band) {
+    if (!basis || numComponents <= 0 || numComponents > basis->numComponents() ||
+        basis->numBands != static_cast<int>(numChannels) || band < 0 || band >= basis->numBands ||
+        basis->inverse.size() != static_cast<size_t>(basis->numBands) * basis->numComponents()) {
+        return -1;
+    }
+    
+    DerivedChannel channel;
+    channel.name = name;
+    channel.basis = std::move(basis);
+    channel.numComponents = numComponents;
+    channel.band = band;
+    
+    const int channelIndex = getNumDisplayChannels();
+    derivedChannels.push_back(std::move(channel));
+    channelContrast.push_back(ContrastParams{});
+    return channelIndex;
+}
+
+int HyperspectralImage::findTransformedChannel(SpectralTransform::Type type, const SpectralTransform::Grid& grid) const {
+    for (size_t i = 0; i < derivedChannels.size(); i++) {
+        const DerivedChannel& channel = derivedChannels[i];
+        if (channel.grid && channel.transform == type && channel.grid->order == grid.order &&
+            channel.grid->wavelengths == grid.wavelengths) {
+            return static_cast<int>(numChannels + i);
+        }
+    }
+    return -1;
+}
+
+std::shared_ptr<const PcaTransform::Basis> HyperspectralImage::computeMnf(int maxComponents) const {
+    auto covariance = getBandCovariance(1);
+    auto shiftDifference = getShiftDifferenceCovariance();
+    if (!covariance || !shiftDifference) return nullptr;
+    
+    std::vector<SampleQuantization> quantization;
+    for (int i = 0; i < static_cast<int>(numChannels); i++) quantization.push_back(getSampleQuantization(i));
+    auto basis = std::make_shared<const PcaTransform::Basis>(
+        MnfTransform::compute(*covariance, *shiftDifference, quantization, maxComponents));
+    if (basis->isEmpty()) return nullptr;
+    return basis;
+}
+
+std::shared_ptr<const PcaTransform::Basis> HyperspectralImage::computePca(int maxComponents) const {
+    auto covariance = getBandCovariance(1);
+    if (!covariance || covariance->isEmpty()) return nullptr;
+    
+    std::vector<SampleQuantization> quantization;
+    for (int i = 0; i < static_cast<int>(numChannels); i++) quantization.push_back(getSampleQuantization(i));
+    auto basis = std::make_shared<const PcaTransform::Basis>(PcaTransform::compute(*covariance, quantization, maxComponents));
+    if (basis->isEmpty()) return nullptr;
+    return basis;
+}
+
+QString HyperspectralImage::getChannelName(int channelIndex) const {
+    const int derivedIndex = channelIndex - static_cast<int>(numChannels);
+    if (derivedIndex >= 0 && derivedIndex < static_cast<int>(derivedChannels.size())) {
+        return derivedChannels[derivedIndex].name;
+    }
+    return QString("Канал %1").arg(channelIndex + 1);
+}
+
+SpectralTransform::CubeProduct HyperspectralImage::computeResampledProduct(const SpectralResampler::Matrix& matrix) const {
+    if (matrix.numSourceBands != static_cast<int>(numChannels)) return SpectralTransform::CubeProduct();
+    
+    std::vector<const uint16_t*> bands;
+    std::vector<SampleQuantization> quantization;
+    if (!collectSpectralBands(bands, &quantization)) return SpectralTransform::CubeProduct();
+    return SpectralResampler::apply(matrix, bands, quantization, static_cast<size_t>(width) * height);
+}
+
+SpectralTransform::CubeProduct HyperspectralImage::computeBandMath(const BandMath::Program& program) const {
+    const size_t numPixels = static_cast<size_t>(width) * height;
+    std::vector<const uint16_t*> bands;
+    std::vector<SampleQuantization> quantization;
+    for (int channel : program.channels) {
+        auto data = img16bit.find(channel);
+        if (data == img16bit.end() || data->second.size() != numPixels) return SpectralTransform::CubeProduct();
+        bands.push_back(data->second.data());
+        quantization.push_back(getSampleQuantization(channel));
+    }
+    return BandMath::evaluate(program, bands, quantization, numPixels);
+}
+
+RoiStatistics::Result HyperspectralImage::getRoiStatistics(const RoiMask& mask) const {
+    if (mask.getImageSize() != QSize(static_cast<int>(width), static_cast<int>(height))) return RoiStatistics::Result();
+    
+    std::vector<const uint16_t*> bands;
+    if (!collectSpectralBands(bands)) return RoiStatistics::Result();
+    return RoiStatistics::compute(bands, mask);
+}
+
+bool HyperspectralImage::collectSpectralBands(std::vector<const uint16_t*>& bands,
+                                              std::vector<SampleQuantization>* quantization) const {
+    const size_t numPixels = static_cast<size_t>(width) * height;
+    bands.clear();
+    bands.reserve(numChannels);
+    for (int i = 0; i < static_cast<int>(numChannels); i++) {
+        auto data = img16bit.find(i);
+        if (data == img16bit.end() || data->second.size() != numPixels) return false;
+        bands.push_back(data->second.data());
+        if (quantization) quantization->push_back(getSampleQuantization(i));
+    }
+    return true;
+}
+
 HyperspectralImage::ContrastParams HyperspectralImage::getContrastParams(int channelIndex) const {
     if (channelIndex >= 0 && channelIndex < static_cast<int>(channelContrast.size())) {
         return channelContrast[channelIndex];
@@ -215,8 +729,139 @@ HyperspectralImage::ContrastParams HyperspectralImage::getContrastParams(int cha
     return ContrastParams{};
 }
 
+const std::vector<uint8_t>& HyperspectralImage::getContrastLUT(int channelIndex) const {
+    static const std::vector<uint8_t> empty(65536, 0);
+    if (channelIndex < 0 || channelIndex >= static_cast<int>(channelContrast.size())) return empty;
+    
+    auto it = contrastLUTCache.find(channelIndex);
+    if (it != contrastLUTCache.end()) return it->second;
+    
+    return contrastLUTCache[channelIndex] = buildStretchLUT(channelIndex);
+}
+
+std::shared_ptr<const Clahe::TileMap> HyperspectralImage::getClaheTileMap(int channelIndex) const {
+    if (channelIndex < 0 || channelIndex >= static_cast<int>(channelContrast.size())) return nullptr;
+    
+    const auto& params = channelContrast[channelIndex];
+    if (params.stretchMode != STRETCH_CLAHE) return nullptr;
+    
+    auto cached = claheCache.find(channelIndex);
+    if (cached != claheCache.end()) return cached->second;
+    
+    auto it = img16bit.find(channelIndex);
+    if (it == img16bit.end() || it->second.size() != static_cast<size_t>(width) * height) return nullptr;
+    
+    auto tileMap = Clahe::build(it->second.data(), width, height, params.minVal, params.maxVal,
+                                params.claheTiles, params.claheTiles, params.claheClipLimit);
+    claheCache[channelIndex] = tileMap;
+    return tileMap;
+}
+
+std::vector<uint8_t> HyperspectralImage::buildStretchLUT(int channelIndex) const {
+    const auto& params = channelContrast[channelIndex];
+    const int minVal = params.minVal;
+    const int maxVal = std::max<int>(params.maxVal, minVal + 1);
+    
+    std::vector<uint8_t> lut(65536);
+    for (int val = 0; val < 65536 && val <= minVal; val++) lut[val] = 0;
+    for (int val = maxVal; val < 65536; val++) lut[val] = 255;
+    
+    StretchMode mode = params.stretchMode;
+    
+    // Ранговые режимы строятся по кэшированной гистограмме, без прохода по пикселям.
+    // u - средний ранг значения внутри окна, лежит строго в (0, 1).
+    std::vector<double> rank;
+    if (mode == STRETCH_EQUALIZE || mode == STRETCH_GAUSSIAN) {
+        auto cached = histogramCache.find(channelIndex);
+        if (cached != histogramCache.end()) {
+            const ChannelStatistics::Histogram& histogram = *cached->second;
+            const int last = std::min(maxVal, 65535);
+            
+            double total = 0.0;
+            for (int val = minVal; val <= last; val++) total += histogram.count(val);
+            
+            if (total > 0.0) {
+                rank.resize(65536, 0.0);
+                double cumulative = 0.0;
+                for (int val = minVal; val <= last; val++) {
+                    rank[val] = (cumulative + histogram.count(val) * 0.5) / total;
+                    cumulative += histogram.count(val);
+                }
+            }
+        }
+        if (rank.empty()) mode = STRETCH_LINEAR;
+    }
+    
+    const int range = maxVal - minVal;
+    
+    switch (mode) {
+    case STRETCH_EQUALIZE:
+        for (int val = minVal + 1; val < maxVal; val++) {
+            lut[val] = static_cast<uint8_t>(std::min(255.0, rank[val] * 256.0));
+        }
+        break;
+        
+    case STRETCH_GAUSSIAN: {
+        // Уровень k занимает интервал [k, k+1) на оси 127.5 + sigma * z, z ~ N(0, 1),
+        // границы уровней переводятся в значения функции распределения
+        const double sigma = 256.0 / 6.0;
+        double bounds[255];
+        for (int k = 0; k < 255; k++) {
+            double z = (k + 1 - 128.0) / sigma;
+            bounds[k] = 0.5 * std::erfc(-z / std::sqrt(2.0));
+        }
+        
+        int level = 0;
+        for (int val = minVal + 1; val < maxVal; val++) {
+            while (level < 255 && rank[val] >= bounds[level]) level++;
+            lut[val] = static_cast<uint8_t>(level);
+        }
+        break;
+    }
+        
+    case STRETCH_GAMMA: {
+        const double invGamma = 1.0 / std::max(0.01, params.gamma);
+        for (int val = minVal + 1; val < maxVal; val++) {
+            double normalized = static_cast<double>(val - minVal) / range;
+            lut[val] = static_cast<uint8_t>(std::pow(normalized, invGamma) * 255);
+        }
+        break;
+    }
+        
+    case STRETCH_LOG: {
+        const double strength = 100.0;
+        const double scale = 255 / std::log1p(strength);
+        for (int val = minVal + 1; val < maxVal; val++) {
+            double normalized = static_cast<double>(val - minVal) / range;
+            lut[val] = static_cast<uint8_t>(std::log1p(strength * normalized) * scale);
+        }
+        break;
+    }
+        
+    default:
+        for (int val = minVal + 1; val < maxVal; val++) {
+            float normalized = static_cast<float>(val - minVal) / range;
+            lut[val] = static_cast<uint8_t>(normalized * 255);
+        }
+        break;
+    }
+    
+    return lut;
+}
+
+std::vector<QRgb> HyperspectralImage::buildColorLUT(int channelIndex, Colormap::Type colormap) const {
+    const std::vector<uint8_t>& contrastLUT = getContrastLUT(channelIndex);
+    const std::vector<QRgb>& palette = Colormap::palette(colormap);
+    
+    std::vector<QRgb> colorLUT(65536);
+    for (int val = 0; val < 65536; val++) {
+        colorLUT[val] = palette[contrastLUT[val]];
+    }
+    return colorLUT;
+}
+
 uint16_t HyperspectralImage::getPixel16bit(int channelIndex, int x, int y) const {
-    if (channelIndex < 0 || channelIndex >= static_cast<int>(numChannels) ||
+    if (channelIndex < 0 || channelIndex >= getNumDisplayChannels() ||
         x < 0 || x >= static_cast<int>(width) ||
         y < 0 || y >= static_cast<int>(height)) {
         return 0;
@@ -232,42 +877,104 @@ uint16_t HyperspectralImage::getPixel16bit(int channelIndex, int x, int y) const
 }
 
 uint8_t HyperspectralImage::getPixel8bit(int channelIndex, int x, int y) const {
-    if (channelIndex < 0 || channelIndex >= static_cast<int>(numChannels) ||
+    if (channelIndex < 0 || channelIndex >= getNumDisplayChannels() ||
         x < 0 || x >= static_cast<int>(width) ||
         y < 0 || y >= static_cast<int>(height)) {
         return 0;
     }
     
-    auto it = img8bit.find(channelIndex);
-    if (it == img8bit.end()) {
+    auto it = img16bit.find(channelIndex);
+    if (it == img16bit.end()) {
         return 0;
     }
     
     uint32_t index = y * width + x;
-    return it->second[index];
+    if (auto tileMap = getClaheTileMap(channelIndex)) {
+        return tileMap->map(it->second[index], x, y);
+    }
+    return getContrastLUT(channelIndex)[it->second[index]];
 }
 
 std::vector<uint16_t> HyperspectralImage::getPixelSpectrum16bit(int x, int y) const {
-    std::vector<uint16_t> spectrum;
-    spectrum.reserve(numChannels);
+    std::vector<uint16_t> spectrum(numChannels, 0);
+    if (!getPixelSpectrum(x, y, spectrum.data())) spectrum.clear();
+    return spectrum;
+}
+
+bool HyperspectralImage::getPixelSpectrum(int x, int y, uint16_t* values16, uint8_t* values8) const {
+    if (x < 0 || x >= static_cast<int>(width) ||
+        y < 0 || y >= static_cast<int>(height)) {
+        return false;
+    }
+    
+    std::fill(values16, values16 + numChannels, 0);
+    if (values8) std::fill(values8, values8 + numChannels, 0);
     
+    const size_t index = static_cast<size_t>(y) * width + x;
+    for (const auto& pair : img16bit) {
+        const int channelIndex = pair.first;
+        if (channelIndex < 0 || channelIndex >= static_cast<int>(numChannels) || index >= pair.second.size()) continue;
+        
+        const uint16_t value = pair.second[index];
+        values16[channelIndex] = value;
+        if (!values8) continue;
+        
+        // Карта плиток нужна только каналам в режиме CLAHE, остальным хватает таблицы
+        std::shared_ptr<const Clahe::TileMap> tileMap;
+        if (channelContrast[channelIndex].stretchMode == STRETCH_CLAHE) tileMap = getClaheTileMap(channelIndex);
+        values8[channelIndex] = tileMap ? tileMap->map(value, x, y) : getContrastLUT(channelIndex)[value];
+    }
+    return true;
+}
+
+bool HyperspectralImage::getWindowSpectrum(int x, int y, int windowSize, double* mean, double* stdDev) const {
     if (x < 0 || x >= static_cast<int>(width) ||
         y < 0 || y >= static_cast<int>(height)) {
-        return spectrum;
+        return false;
     }
     
-    uint32_t index = y * width + x;
+    const int radius = std::max(0, windowSize > kMaxProbeWindow ? kMaxProbeWindow / 2 : windowSize / 2);
+    const int left = std::max(0, x - radius);
+    const int right = std::min(static_cast<int>(width) - 1, x + radius);
+    const int top = std::max(0, y - radius);
+    const int bottom = std::min(static_cast<int>(height) - 1, y + radius);
+    const int columns = right - left + 1;
+    const uint64_t count = static_cast<uint64_t>(columns) * (bottom - top + 1);
     
-    for (int channelIndex = 0; channelIndex < static_cast<int>(numChannels); channelIndex++) {
-        auto it = img16bit.find(channelIndex);
-        if (it != img16bit.end() && index < it->second.size()) {
-            spectrum.push_back(it->second[index]);
-        } else {
-            spectrum.push_back(0);
+    std::fill(mean, mean + numChannels, 0.0);
+    std::fill(stdDev, stdDev + numChannels, 0.0);
+    
+    for (const auto& pair : img16bit) {
+        const int channelIndex = pair.first;
+        if (channelIndex < 0 || channelIndex >= static_cast<int>(numChannels) ||
+            pair.second.size() != static_cast<size_t>(width) * height) {
+            continue;
+        }
+        
+        // Строка окна внутри канала непрерывна: целые суммы по ней векторизуются компилятором
+        uint64_t sum = 0;
+        uint64_t sumSquares = 0;
+        for (int row = top; row <= bottom; row++) {
+            const uint16_t* values = pair.second.data() + static_cast<size_t>(row) * width + left;
+            uint32_t rowSum = 0;
+            uint64_t rowSquares = 0;
+            for (int i = 0; i < columns; i++) {
+                const uint32_t value = values[i];
+                rowSum += value;
+                rowSquares += value * value;
+            }
+            sum += rowSum;
+            sumSquares += rowSquares;
+        }
+        
+        // При окне до 31 x 31 count * sumSquares - sum^2 точно помещается в 64 бита
+        mean[channelIndex] = static_cast<double>(sum) / count;
+        if (count > 1) {
+            const uint64_t spread = count * sumSquares - sum * sum;
+            stdDev[channelIndex] = std::sqrt(static_cast<double>(spread) / (static_cast<double>(count) * (count - 1)));
         }
     }
-    
-    return spectrum;
+    return true;
 }
 
 const std::vector<uint16_t>& HyperspectralImage::get16bitData(int channelIndex) const {
@@ -281,33 +988,24 @@ const std::vector<uint16_t>& HyperspectralImage::get16bitData(int channelIndex)
 }
 
 void HyperspectralImage::update8bitData(int channelIndex) {
-    if (channelIndex < 0 || channelIndex >= static_cast<int>(numChannels)) return;
+    if (channelIndex < 0 || channelIndex >= getNumDisplayChannels()) return;
     
     auto it16 = img16bit.find(channelIndex);
     if (it16 == img16bit.end()) return;
     
     img8bit[channelIndex].resize(width * height);
     
-    const auto& params = channelContrast[channelIndex];
-    uint16_t minVal = params.minVal;
-    uint16_t maxVal = params.maxVal;
-    
-    if (maxVal <= minVal) maxVal = minVal + 1;
+    if (auto tileMap = getClaheTileMap(channelIndex)) {
+        Clahe::apply(*tileMap, it16->second.data(), img8bit[channelIndex].data());
+        return;
+    }
     
+    const uint8_t* lut = getContrastLUT(channelIndex).data();
     const auto& channel16bit = it16->second;
     auto& channel8bit = img8bit[channelIndex];
     
     for (size_t i = 0; i < channel16bit.size(); i++) {
-        uint16_t val = channel16bit[i];
-        
-        if (val <= minVal) {
-            channel8bit[i] = 0;
-        } else if (val >= maxVal) {
-            channel8bit[i] = 255;
-        } else {
-            float normalized = static_cast<float>(val - minVal) / (maxVal - minVal);
-            channel8bit[i] = static_cast<uint8_t>(normalized * 255);
-        }
+        channel8bit[i] = lut[channel16bit[i]];
     }
 }
 
@@ -317,6 +1015,13 @@ void HyperspectralImage::updateAll8bitData() {
     }
 }
 
+void HyperspectralImage::invalidate8bitData(int channelIndex) {
+    // 8-битные данные пересчитываются лениво при следующем запросе изображения
+    contrastLUTCache.erase(channelIndex);
+    claheCache.erase(channelIndex);
+    img8bit.erase(channelIndex);
+}
+
 bool HyperspectralImage::loadChannel16bit(int channelIndex) const {
     return img16bit.find(channelIndex) != img16bit.end();
 }
@@ -332,6 +1037,59 @@ void HyperspectralImage::clearUnusedChannels() {
 }
 
 void HyperspectralImage::preloadChannels(const std::vector<int>& channelIndices) {
+    // Невычисленные виртуальные каналы, сгруппированные по источнику
+    std::vector<std::vector<int>> pending;
+    for (int channelIndex : channelIndices) {
+        const int derivedIndex = channelIndex - static_cast<int>(numChannels);
+        if (derivedIndex < 0 || derivedIndex >= static_cast<int>(derivedChannels.size())) continue;
+        const DerivedChannel& channel = derivedChannels[derivedIndex];
+        if (!channel.isVirtual() || img16bit.find(channelIndex) != img16bit.end()) continue;
+        
+        auto group = std::find_if(pending.begin(), pending.end(), [&](const std::vector<int>& entry) {
+            return derivedChannels[entry.front() - static_cast<int>(numChannels)].sameSource(channel);
+        });
+        if (group == pending.end()) {
+            pending.emplace_back();
+            group = pending.end() - 1;
+        }
+        if (std::find(group->begin(), group->end(), channelIndex) == group->end()) {
+            group->push_back(channelIndex);
+        }
+    }
+    if (pending.empty()) return;
+    
+    std::vector<const uint16_t*> bands;
+    std::vector<SampleQuantization> quantization;
+    if (!collectSpectralBands(bands, &quantization)) return;
+    const size_t numPixels = static_cast<size_t>(width) * height;
+    
+    for (const std::vector<int>& channels : pending) {
+        const DerivedChannel& source = derivedChannels[channels.front() - static_cast<int>(numChannels)];
+        // Номера компонент базиса или каналов восстановления и преобразования
+        const bool projected = source.basis && source.numComponents == 0;
+        std::vector<int> outputs;
+        for (int channelIndex : channels) {
+            const DerivedChannel& channel = derivedChannels[channelIndex - static_cast<int>(numChannels)];
+            outputs.push_back(projected ? channel.component : channel.band);
+        }
+        
+        SpectralTransform::CubeProduct product;
+        if (projected) {
+            product = PcaTransform::project(*source.basis, outputs, bands, quantization, numPixels);
+        } else if (source.basis) {
+            product = PcaTransform::reconstruct(*source.basis, source.numComponents, outputs, bands, quantization,
+                                                numPixels);
+        } else {
+            product = SpectralTransform::computeCube(source.transform, *source.grid, outputs, bands, quantization,
+                                                     numPixels);
+        }
+        if (product.bands.size() != channels.size()) continue;
+        for (size_t i = 0; i < channels.size(); i++) {
+            derivedChannels[channels[i] - static_cast<int>(numChannels)].quantization = product.quantization[i];
+            img16bit[channels[i]] = std::move(product.bands[i]);
+            normalizeByPercentile(channels[i], 2.0, 2.0);
+        }
+    }
 }
 
 size_t HyperspectralImage::getMemoryUsage() const {
@@ -348,7 +1106,29 @@ size_t HyperspectralImage::getMemoryUsage() const {
     }
     
     // Histograms
-    total += histogramCache.size() * 65536 * sizeof(int);
+    for (const auto& pair : histogramCache) {
+        total += pair.second->getMemoryUsage();
+    }
+    
+    // Contrast LUTs
+    total += contrastLUTCache.size() * 65536 * sizeof(uint8_t);
+    
+    for (const auto& pair : claheCache) {
+        if (pair.second) total += pair.second->getMemoryUsage();
+    }
+    
+    for (const auto& pair : tileHistogramCache) {
+        if (pair.second) total += pair.second->getMemoryUsage();
+    }
+    
+    for (const auto& pair : covarianceCache) {
+        if (pair.second) total += pair.second->covariance.size() * sizeof(double);
+    }
+    if (shiftDifferenceCache) total += shiftDifferenceCache->covariance.size() * sizeof(double);
+    
+    for (const QuantileSketch& sketch : sampleSketches) {
+        total += sketch.getMemoryUsage();
+    }
     
     return total;
 }
@@ -3,49 +3,179 @@
 
 #include <QString>
 #include <QImage>
+#include <QRect>
 #include <vector>
 #include <cstdint>
 #include <unordered_map>
 #include <unordered_set>
 #include <memory>
+#include "colormap.h"
+#include "clahe.h"
+#include "channel_statistics.h"
+#include "tile_histogram_index.h"
+#include "spectral_covariance.h"
+#include "quantile_sketch.h"
+#include "roi_mask.h"
+#include "spectral_transform.h"
+#include "spectral_resampler.h"
+#include "band_math.h"
+#include "pca_transform.h"
+#include "mnf_transform.h"
 
 class HyperspectralImage {
 public:
+    // Форма кривой растяжения внутри окна [minVal, maxVal]
+    enum StretchMode {
+        STRETCH_LINEAR,
+        STRETCH_EQUALIZE,   // выравнивание гистограммы
+        STRETCH_GAMMA,
+        STRETCH_LOG,
+        STRETCH_GAUSSIAN,   // приведение гистограммы к нормальному распределению
+        STRETCH_CLAHE,      // локальное выравнивание по плиткам
+        NUM_STRETCH_MODES
+    };
+
     struct ContrastParams {
         uint16_t minVal = 0;
         uint16_t maxVal = 65535;
         double percentCutLow = 2.0;
         double percentCutHigh = 2.0;
         bool usePercentile = false;
+        StretchMode stretchMode = STRETCH_LINEAR;
+        double gamma = 1.0;
+        double claheClipLimit = 2.0;
+        int claheTiles = 8;  // сетка claheTiles x claheTiles
+    };
+
+    // Гистограммы неизменяемы и раздаются без копирования
+    using HistogramPtr = std::shared_ptr<const ChannelStatistics::Histogram>;
+
+    // Снимок данных для отрисовки: указатели на 16-битные каналы и копии таблиц контраста.
+    // Не ссылается на кэши объекта, поэтому изображение можно строить в фоновом потоке.
+    struct RenderSource {
+        const uint16_t* channels[3] = {nullptr, nullptr, nullptr};
+        std::vector<uint8_t> luts[3];
+        std::vector<QRgb> colorLUT;  // 16 бит -> цвет палитры, если задан псевдоцвет
+        // Для каналов в режиме CLAHE вместо luts[c]; colorLUT тогда индексируется 8-битным значением
+        std::shared_ptr<const Clahe::TileMap> tileMaps[3];
+        int numComponents = 0;  // 1 - оттенки серого, 3 - RGB
+        uint32_t width = 0;
+        uint32_t height = 0;
+
+        bool isValid() const { return numComponents > 0; }
     };
 
-    struct CachedHistogram {
-        std::vector<int> histogram;
-        std::pair<uint16_t, uint16_t> minMax;
-        bool isValid = false;
+    // Снимок спектральных каналов для вычислений в фоновом потоке: указатели на 16-битные
+    // данные и копии шкал. Данные живут, пока не загружен другой файл
+    struct CubeSource {
+        std::vector<const uint16_t*> bands;
+        std::vector<SampleQuantization> quantization;
+        uint32_t width = 0;
+        uint32_t height = 0;
+
+        size_t numPixels() const { return static_cast<size_t>(width) * height; }
+        bool isValid() const { return !bands.empty(); }
     };
 
     bool loadFromTiff(const QString& filePath);
     
     void normalizeToRange(int channelIndex, uint16_t minVal, uint16_t maxVal);
     void normalizeByPercentile(int channelIndex, double percentLow, double percentHigh);
+    void normalizeAllByPercentile(double percentLow, double percentHigh);
+    // Границы окна по перцентилям только внутри области (например, видимой части)
+    void normalizeRegionByPercentile(int channelIndex, const QRect& region, double percentLow, double percentHigh);
+    void setStretchMode(int channelIndex, StretchMode mode, double gamma = 1.0, double claheClipLimit = 2.0);
+    static QString stretchModeName(StretchMode mode);
     
     QImage getChannelImage(int channelIndex);
     QImage getRGBImage(int redChannel, int greenChannel, int blueChannel);
+    QImage getPseudoColorImage(int channelIndex, Colormap::Type colormap);
+    
+    RenderSource makeChannelRenderSource(int channelIndex, Colormap::Type colormap = Colormap::GRAYSCALE) const;
+    RenderSource makeRGBRenderSource(int redChannel, int greenChannel, int blueChannel) const;
+    // Каждый step-й пиксель по обеим осям; step = 1 даёт полное разрешение
+    static QImage renderImage(const RenderSource& source, int step = 1);
+    // Пустой снимок, если загружены не все спектральные каналы
+    CubeSource makeCubeSource() const;
     
-    std::vector<int> calculateHistogram16bit(int channelIndex);
-    std::pair<uint16_t, uint16_t> calculatePercentileBounds(const std::vector<int>& histogram, 
+    // Всегда не nullptr; для неверного индекса - пустая гистограмма
+    HistogramPtr getHistogram(int channelIndex) const;
+    // Гистограмма прямоугольника по индексу плиток; бины огрублены до TileHistogramIndex::kNumBins.
+    // Область на всё изображение отдаёт точную гистограмму канала
+    HistogramPtr getRegionHistogram(int channelIndex, const QRect& region) const;
+    std::pair<uint16_t, uint16_t> calculatePercentileBounds(const ChannelStatistics::Histogram& histogram, 
                                                            double percentLow, double percentHigh);
+    // Границы для набора каналов за один параллельный проход
+    std::vector<std::pair<uint16_t, uint16_t>> calculatePercentileBounds(const std::vector<int>& channelIndices,
+                                                                        double percentLow, double percentHigh);
     std::pair<uint16_t, uint16_t> getChannelMinMax16bit(int channelIndex);
+    // Шкала 16-битных кодов канала в исходных единицах; для 8/16-битных файлов тождественная
+    SampleQuantization getSampleQuantization(int channelIndex) const;
+    // Эскиз исходных 32-битных значений канала; nullptr для 8/16-битных файлов
+    const QuantileSketch* getSampleSketch(int channelIndex) const;
+    // Среднее, СКО, асимметрия, эксцесс, шум и ОСШ всех каналов.
+    // Недостающие считаются параллельно по каналам и кэшируются
+    std::vector<ChannelStatistics::BandStatistics> getBandStatistics() const;
+    // Ковариация всех каналов по каждому step-му пикселю; кэшируется для каждого step
+    std::shared_ptr<const SpectralCovariance::Result> getBandCovariance(size_t step = 1) const;
+    // Для подсчёта в фоновом потоке по makeCubeSource: готовая ковариация или nullptr, и запись в кэш
+    std::shared_ptr<const SpectralCovariance::Result> findBandCovariance(size_t step) const;
+    void cacheBandCovariance(size_t step, std::shared_ptr<const SpectralCovariance::Result> covariance) const;
+    // Ковариация разностей соседних по строке пикселей (оценка шума для MNF); кэшируется
+    std::shared_ptr<const SpectralCovariance::Result> getShiftDifferenceCovariance() const;
+    // Среднее, СКО, минимум, максимум и медиана каждого канала по пикселям области (16-битные коды)
+    RoiStatistics::Result getRoiStatistics(const RoiMask& mask) const;
     
     ContrastParams getContrastParams(int channelIndex) const;
+    const std::vector<uint8_t>& getContrastLUT(int channelIndex) const;
+    // nullptr, если канал не в режиме CLAHE
+    std::shared_ptr<const Clahe::TileMap> getClaheTileMap(int channelIndex) const;
+    // Контраст и палитра в одной таблице на 65536 значений
+    std::vector<QRgb> buildColorLUT(int channelIndex, Colormap::Type colormap) const;
     
     uint16_t getPixel16bit(int channelIndex, int x, int y) const;
     uint8_t getPixel8bit(int channelIndex, int x, int y) const;
     
     std::vector<uint16_t> getPixelSpectrum16bit(int x, int y) const;
+    // Спектр пикселя в буферы на getNumChannels() элементов (values8 может быть nullptr).
+    // Один проход по хранилищу каналов без поиска каждого канала; false вне изображения
+    bool getPixelSpectrum(int x, int y, uint16_t* values16, uint8_t* values8 = nullptr) const;
+    // Среднее и СКО спектра по окну windowSize x windowSize (до kMaxProbeWindow) вокруг (x, y),
+    // обрезанному краями изображения. Буферы на getNumChannels() элементов; false вне изображения
+    static const int kMaxProbeWindow = 31;
+    bool getWindowSpectrum(int x, int y, int windowSize, double* mean, double* stdDev) const;
     
     int getNumChannels() const { return numChannels; }
+    // Спектральные и производные каналы - всё, что можно показать как изображение
+    int getNumDisplayChannels() const { return static_cast<int>(numChannels + derivedChannels.size()); }
+    
+    // Производные каналы (продукты обработки куба) идут после спектральных: индекс numChannels + i.
+    // Спектр пикселя, ковариация и статистика области их не видят, а отображение,
+    // гистограммы и контраст работают с ними как с обычными каналами. Возвращает индекс
+    int addDerivedChannel(const QString& name, std::vector<uint16_t> data, const SampleQuantization& quantization);
+    int getNumDerivedChannels() const { return static_cast<int>(derivedChannels.size()); }
+    QString getChannelName(int channelIndex) const;
+    // Каналы другого датчика: строки матрицы - целевые каналы, столбцы - спектральные
+    SpectralTransform::CubeProduct computeResampledProduct(const SpectralResampler::Matrix& matrix) const;
+    // Значение выражения по каналам; читаются только каналы из program.channels
+    SpectralTransform::CubeProduct computeBandMath(const BandMath::Program& program) const;
+    // Главные компоненты по ковариации всех пикселей (кэшируется вместе с ковариацией)
+    std::shared_ptr<const PcaTransform::Basis> computePca(int maxComponents) const;
+    // Компоненты MNF: по ковариации всех пикселей и ковариации шума
+    std::shared_ptr<const PcaTransform::Basis> computeMnf(int maxComponents) const;
+    // Виртуальный канал - проекция куба на компоненту базиса. Данные считаются в
+    // preloadChannels при первом показе, а не при добавлении. Возвращает индекс
+    int addProjectedChannel(const QString& name, std::shared_ptr<const PcaTransform::Basis> basis, int component);
+    // Виртуальный канал band преобразования type всех спектров куба по сетке grid.
+    // Считается в preloadChannels вместе с другими каналами того же преобразования
+    int addTransformedChannel(const QString& name, SpectralTransform::Type type,
+                              std::shared_ptr<const SpectralTransform::Grid> grid, int band);
+    // Индекс первого канала уже добавленного преобразования с той же сеткой или -1
+    int findTransformedChannel(SpectralTransform::Type type, const SpectralTransform::Grid& grid) const;
+    // Виртуальный канал band куба, восстановленного по первым numComponents компонентам
+    // базиса (подавление шума MNF). Каналы одного восстановления считаются вместе
+    int addReconstructedChannel(const QString& name, std::shared_ptr<const PcaTransform::Basis> basis,
+                                int numComponents, int band);
     int getWidth() const { return width; }
     int getHeight() const { return height; }
     
@@ -53,20 +183,36 @@ public:
 
     void setMaxCachedChannels(int maxChannels) { maxCached16bit = maxChannels; }
     void clearUnusedChannels();
+    // Считает ещё не вычисленные виртуальные каналы из списка: компоненты одного
+    // базиса или каналы одного преобразования - за один проход по кубу
     void preloadChannels(const std::vector<int>& channelIndices);
     size_t getMemoryUsage() const;
 
 private:
     void update8bitData(int channelIndex);
     void updateAll8bitData();
+    void invalidate8bitData(int channelIndex);
+    std::vector<uint8_t> buildStretchLUT(int channelIndex) const;
+    // Перцентили по эскизу исходных значений, если он есть, иначе по гистограмме кодов
+    std::pair<uint16_t, uint16_t> channelPercentileBounds(int channelIndex, const ChannelStatistics::Histogram& histogram,
+                                                          double percentLow, double percentHigh) const;
     
     bool loadChannel16bit(int channelIndex) const;
     void evictOldestChannel();
     void markChannelAsUsed(int channelIndex) const;
+    // Указатели на все спектральные каналы и их шкалы; false, если загружены не все
+    bool collectSpectralBands(std::vector<const uint16_t*>& bands,
+                              std::vector<SampleQuantization>* quantization = nullptr) const;
 
     mutable std::unordered_map<int, std::vector<uint16_t>> img16bit;  // Ленивая загрузка каналов
     mutable std::unordered_map<int, std::vector<uint8_t>> img8bit;    // Кэш 8-битных данных
-    mutable std::unordered_map<int, CachedHistogram> histogramCache;  // Кэш гистограмм
+    mutable std::unordered_map<int, HistogramPtr> histogramCache;  // Кэш гистограмм
+    mutable std::unordered_map<int, std::vector<uint8_t>> contrastLUTCache;  // 16 -> 8 бит по параметрам контраста
+    mutable std::unordered_map<int, std::shared_ptr<const Clahe::TileMap>> claheCache;
+    mutable std::unordered_map<int, std::shared_ptr<const TileHistogramIndex>> tileHistogramCache;
+    mutable std::unordered_map<int, ChannelStatistics::BandStatistics> bandStatisticsCache;
+    mutable std::unordered_map<size_t, std::shared_ptr<const SpectralCovariance::Result>> covarianceCache;
+    mutable std::shared_ptr<const SpectralCovariance::Result> shiftDifferenceCache;
     
     mutable std::vector<int> channelAccessOrder;  // Порядок доступа к каналам (LRU)
     mutable std::unordered_set<int> activeChannels;  // Активные каналы в памяти
@@ -75,6 +221,31 @@ private:
     uint32_t height = 0;
     uint32_t numChannels = 0;
     std::vector<ContrastParams> channelContrast;
+    // Только для 32-битных файлов: эскизы и шкалы квантования по каналам
+    std::vector<QuantileSketch> sampleSketches;
+    std::vector<SampleQuantization> sampleQuantization;
+    
+    struct DerivedChannel {
+        QString name;
+        SampleQuantization quantization;
+        // Только у виртуальных каналов: компонента, на которую проецируется куб,
+        // канал band куба, восстановленного по numComponents компонентам базиса,
+        // или канал band преобразования transform по сетке grid
+        std::shared_ptr<const PcaTransform::Basis> basis;
+        int component = -1;
+        int numComponents = 0;
+        std::shared_ptr<const SpectralTransform::Grid> grid;
+        SpectralTransform::Type transform = SpectralTransform::NONE;
+        int band = -1;
+
+        bool isVirtual() const { return basis || grid; }
+        // Каналы одного источника считаются вместе
+        bool sameSource(const DerivedChannel& other) const {
+            return basis == other.basis && numComponents == other.numComponents && grid == other.grid &&
+                   transform == other.transform;
+        }
+    };
+    std::vector<DerivedChannel> derivedChannels;
     
     QString tiffFilePath;  // Путь к TIFF файлу для ленивой загрузки
     int maxCached16bit = 5;  // Максимальное количество каналов в памяти
@@ -1,8 +1,10 @@
 #include "image_label.h"
 #include <algorithm>
+#include <cmath>
 #include <QMenu>
 #include <QAction>
 #include <QStyle>
+#include <QPainter>
 
 ImageLabel::ImageLabel(QWidget* parent) : QLabel(parent) {
     setMouseTracking(true);
@@ -10,21 +12,164 @@ ImageLabel::ImageLabel(QWidget* parent) : QLabel(parent) {
     setContextMenuPolicy(Qt::DefaultContextMenu);
 }
 
+void ImageLabel::setImage(const QImage& image, const QSize& sourceSize) {
+    displayPixmap = QPixmap::fromImage(image);
+    imageSize = sourceSize;
+    resize(sourceSize);
+    update();
+}
+
+void ImageLabel::setOverlay(const QImage& overlay) {
+    overlayPixmap = overlay.isNull() ? QPixmap() : QPixmap::fromImage(overlay);
+    update();
+}
+
+void ImageLabel::clearImage() {
+    displayPixmap = QPixmap();
+    overlayPixmap = QPixmap();
+    imageSize = QSize();
+    roiPolygon.clear();
+    roiDrawing = false;
+    clear();
+    update();
+}
+
+void ImageLabel::paintEvent(QPaintEvent* event) {
+    if (displayPixmap.isNull()) {
+        QLabel::paintEvent(event);
+        return;
+    }
+    
+    // Масштабирование при отрисовке затрагивает только видимую часть,
+    // поэтому превью не нужно растягивать до полного размера заранее
+    QPainter painter(this);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, false);
+    painter.drawPixmap(imageRect(), displayPixmap);
+    if (!overlayPixmap.isNull()) {
+        painter.drawPixmap(imageRect(), overlayPixmap);
+    }
+    
+    if (roiPolygon.isEmpty()) return;
+    QPolygonF outline;
+    for (const QPointF& point : roiPolygon) outline << widgetPointFromImage(point);
+    if (roiDrawing && roiTool == ROI_POLYGON) outline << widgetPointFromImage(roiCursor);
+    
+    // Двойной контур виден и на светлом, и на тёмном изображении
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setBrush(Qt::NoBrush);
+    for (const QPen& pen : {QPen(Qt::black, 1), QPen(Qt::yellow, 1, Qt::DashLine)}) {
+        painter.setPen(pen);
+        if (roiDrawing) {
+            painter.drawPolyline(outline);
+        } else {
+            painter.drawPolygon(outline);
+        }
+    }
+}
+
+void ImageLabel::setRoiTool(RoiTool tool) {
+    roiTool = tool;
+    roiDrawing = false;
+    setCursor(tool == ROI_NONE ? Qt::ArrowCursor : Qt::CrossCursor);
+    update();
+}
+
+void ImageLabel::clearRoi() {
+    roiPolygon.clear();
+    roiDrawing = false;
+    update();
+}
+
+void ImageLabel::mousePressEvent(QMouseEvent* event) {
+    if (roiTool == ROI_NONE || event->button() != Qt::LeftButton || !hasImage() || imageRect().isEmpty()) {
+        QLabel::mousePressEvent(event);
+        return;
+    }
+    
+    const QPointF point = imagePointFromWidget(event->pos());
+    if (roiTool == ROI_POLYGON && roiDrawing) {
+        roiPolygon << point;
+    } else {
+        roiDrawing = true;
+        roiAnchor = point;
+        roiPolygon.clear();
+        roiPolygon << point;
+        if (roiTool == ROI_RECTANGLE) roiPolygon = rectanglePolygon(point);
+    }
+    roiCursor = point;
+    update();
+}
+
+void ImageLabel::mouseReleaseEvent(QMouseEvent* event) {
+    if (roiDrawing && event->button() == Qt::LeftButton && roiTool != ROI_POLYGON) {
+        finishRoi();
+        return;
+    }
+    QLabel::mouseReleaseEvent(event);
+}
+
+void ImageLabel::mouseDoubleClickEvent(QMouseEvent* event) {
+    // Первый щелчок пары уже добавил вершину, двойной только замыкает контур
+    if (roiDrawing && event->button() == Qt::LeftButton && roiTool == ROI_POLYGON) {
+        finishRoi();
+        return;
+    }
+    QLabel::mouseDoubleClickEvent(event);
+}
+
+void ImageLabel::finishRoi() {
+    roiDrawing = false;
+    // Многоугольник из двойного щелчка заканчивается повтором последней вершины
+    while (roiPolygon.size() > 1 && roiPolygon.last() == roiPolygon[roiPolygon.size() - 2]) {
+        roiPolygon.removeLast();
+    }
+    update();
+    if (roiPolygon.size() >= 3) {
+        emit roiSelected(roiPolygon);
+    } else {
+        roiPolygon.clear();
+    }
+}
+
+QPolygonF ImageLabel::rectanglePolygon(const QPointF& corner) const {
+    // Углы по границам пикселей: в прямоугольник входят оба пикселя под углами
+    const double left = std::floor(std::min(roiAnchor.x(), corner.x()));
+    const double top = std::floor(std::min(roiAnchor.y(), corner.y()));
+    const double right = std::min<double>(imageSize.width(), std::floor(std::max(roiAnchor.x(), corner.x())) + 1);
+    const double bottom = std::min<double>(imageSize.height(), std::floor(std::max(roiAnchor.y(), corner.y())) + 1);
+    QPolygonF polygon;
+    polygon << QPointF(left, top) << QPointF(right, top) << QPointF(right, bottom) << QPointF(left, bottom);
+    return polygon;
+}
+
 void ImageLabel::mouseMoveEvent(QMouseEvent* event) {
-    QPixmap currentPixmap = pixmap(Qt::ReturnByValue);
-    if (!currentPixmap.isNull()) {
+    if (hasImage()) {
         QPoint imagePos = imageCoordinatesFromWidget(event->pos());
         if (imagePos.x() >= 0 && imagePos.y() >= 0) {
             emit mousePosition(imagePos.x(), imagePos.y());
         }
     }
     
+    if (roiDrawing) {
+        const QPointF point = imagePointFromWidget(event->pos());
+        if (roiTool == ROI_RECTANGLE) {
+            roiPolygon = rectanglePolygon(point);
+        } else if (roiTool == ROI_FREEHAND) {
+            // Точки ближе пикселя экрана контур не уточняют
+            const QPointF last = widgetPointFromImage(roiPolygon.last());
+            if (std::abs(last.x() - event->pos().x()) + std::abs(last.y() - event->pos().y()) >= 1.0) {
+                roiPolygon << point;
+            }
+        }
+        roiCursor = point;
+        update();
+    }
+    
     QLabel::mouseMoveEvent(event);
 }
 
 void ImageLabel::contextMenuEvent(QContextMenuEvent* event) {
-    QPixmap currentPixmap = pixmap(Qt::ReturnByValue);
-    if (currentPixmap.isNull()) {
+    if (!hasImage()) {
         return;
     }
     
@@ -46,39 +191,87 @@ void ImageLabel::contextMenuEvent(QContextMenuEvent* event) {
     }
 }
 
-QPoint ImageLabel::imageCoordinatesFromWidget(const QPoint& widgetPos) {
-    QPixmap currentPixmap = pixmap(Qt::ReturnByValue);
-    if (currentPixmap.isNull()) {
-        return QPoint(-1, -1);
-    }
-    
-
-    QRect pixmapRect = currentPixmap.rect();
+QRect ImageLabel::imageRect() const {
     QRect widgetRect = rect();
+    if (imageSize.isEmpty() || widgetRect.isEmpty()) {
+        return QRect();
+    }
     
-    double scaleX = static_cast<double>(pixmapRect.width()) / widgetRect.width();
-    double scaleY = static_cast<double>(pixmapRect.height()) / widgetRect.height();
+    double scaleX = static_cast<double>(imageSize.width()) / widgetRect.width();
+    double scaleY = static_cast<double>(imageSize.height()) / widgetRect.height();
     double scale = std::max(scaleX, scaleY);
     
-    int scaledWidth = static_cast<int>(pixmapRect.width() / scale);
-    int scaledHeight = static_cast<int>(pixmapRect.height() / scale);
+    int scaledWidth = static_cast<int>(imageSize.width() / scale);
+    int scaledHeight = static_cast<int>(imageSize.height() / scale);
     
     int offsetX = (widgetRect.width() - scaledWidth) / 2;
     int offsetY = (widgetRect.height() - scaledHeight) / 2;
     
-    QPoint localPos = widgetPos - QPoint(offsetX, offsetY);
+    return QRect(offsetX, offsetY, scaledWidth, scaledHeight);
+}
+
+QRect ImageLabel::visibleImageRect() const {
+    QRect targetRect = imageRect();
+    if (!hasImage() || targetRect.isEmpty()) {
+        return QRect();
+    }
     
-    if (localPos.x() >= 0 && localPos.x() < scaledWidth &&
-        localPos.y() >= 0 && localPos.y() < scaledHeight) {
+    QRect visible = visibleRegion().boundingRect().intersected(targetRect);
+    if (visible.isEmpty()) {
+        return QRect();
+    }
+    
+    double scaleX = static_cast<double>(imageSize.width()) / targetRect.width();
+    double scaleY = static_cast<double>(imageSize.height()) / targetRect.height();
+    
+    int x0 = static_cast<int>(std::floor((visible.left() - targetRect.left()) * scaleX));
+    int y0 = static_cast<int>(std::floor((visible.top() - targetRect.top()) * scaleY));
+    int x1 = static_cast<int>(std::ceil((visible.right() + 1 - targetRect.left()) * scaleX));
+    int y1 = static_cast<int>(std::ceil((visible.bottom() + 1 - targetRect.top()) * scaleY));
+    
+    return QRect(x0, y0, x1 - x0, y1 - y0).intersected(QRect(QPoint(0, 0), imageSize));
+}
+
+QPoint ImageLabel::imageCoordinatesFromWidget(const QPoint& widgetPos) {
+    QRect targetRect = imageRect();
+    if (!hasImage() || targetRect.isEmpty()) {
+        return QPoint(-1, -1);
+    }
+    
+    double scale = static_cast<double>(imageSize.width()) / targetRect.width();
+    
+    QPoint localPos = widgetPos - targetRect.topLeft();
+    
+    if (localPos.x() >= 0 && localPos.x() < targetRect.width() &&
+        localPos.y() >= 0 && localPos.y() < targetRect.height()) {
         
         int imageX = static_cast<int>(localPos.x() * scale);
         int imageY = static_cast<int>(localPos.y() * scale);
         
-        imageX = std::max(0, std::min(imageX, pixmapRect.width() - 1));
-        imageY = std::max(0, std::min(imageY, pixmapRect.height() - 1));
+        imageX = std::max(0, std::min(imageX, imageSize.width() - 1));
+        imageY = std::max(0, std::min(imageY, imageSize.height() - 1));
         
         return QPoint(imageX, imageY);
     }
     
     return QPoint(-1, -1);
 }
+
+QPointF ImageLabel::imagePointFromWidget(const QPoint& widgetPos) const {
+    const QRect targetRect = imageRect();
+    if (targetRect.isEmpty()) return QPointF();
+    
+    const double scale = static_cast<double>(imageSize.width()) / targetRect.width();
+    const double x = (widgetPos.x() - targetRect.left()) * scale;
+    const double y = (widgetPos.y() - targetRect.top()) * scale;
+    return QPointF(std::clamp(x, 0.0, static_cast<double>(imageSize.width())),
+                   std::clamp(y, 0.0, static_cast<double>(imageSize.height())));
+}
+
+QPointF ImageLabel::widgetPointFromImage(const QPointF& imagePos) const {
+    const QRect targetRect = imageRect();
+    if (imageSize.isEmpty()) return QPointF();
+    
+    const double scale = static_cast<double>(targetRect.width()) / imageSize.width();
+    return QPointF(targetRect.left() + imagePos.x() * scale, targetRect.top() + imagePos.y() * scale);
+}
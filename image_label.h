@@ -3,28 +3,75 @@
 
 #include <QLabel>
 #include <QMouseEvent>
+#include <QPaintEvent>
 #include <QPixmap>
+#include <QImage>
+#include <QSize>
 #include <QRect>
 #include <QPoint>
 #include <QContextMenuEvent>
+#include <QPolygonF>
 
 class ImageLabel : public QLabel {
     Q_OBJECT
 
 public:
+    // Чем рисуется область интереса левой кнопкой мыши
+    enum RoiTool {
+        ROI_NONE,
+        ROI_RECTANGLE,
+        ROI_POLYGON,     // вершины по щелчкам, двойной щелчок замыкает
+        ROI_FREEHAND     // контур за курсором, пока кнопка нажата
+    };
+
     ImageLabel(QWidget* parent = nullptr);
 
+    // image может быть уменьшенным превью: оно растягивается до sourceSize,
+    // а координаты мыши всегда выдаются в пикселях исходного изображения
+    void setImage(const QImage& image, const QSize& sourceSize);
+    void clearImage();
+    // Полупрозрачный слой поверх изображения, растягивается так же, как само изображение
+    void setOverlay(const QImage& overlay);
+    bool hasImage() const { return !displayPixmap.isNull(); }
+    // Часть изображения, видимая в области прокрутки, в пикселях исходного изображения
+    QRect visibleImageRect() const;
+    void setRoiTool(RoiTool tool);
+    RoiTool getRoiTool() const { return roiTool; }
+    // Контур последней области остаётся на изображении до сброса
+    void clearRoi();
+
 signals:
     void mousePosition(int x, int y);
     void spectralCurveRequested(int x, int y);
+    // Замкнутый контур в непрерывных координатах исходного изображения
+    void roiSelected(const QPolygonF& polygon);
 
 protected:
+    void paintEvent(QPaintEvent* event) override;
+    void mousePressEvent(QMouseEvent* event) override;
     void mouseMoveEvent(QMouseEvent* event) override;
+    void mouseReleaseEvent(QMouseEvent* event) override;
+    void mouseDoubleClickEvent(QMouseEvent* event) override;
     void contextMenuEvent(QContextMenuEvent* event) override;
 
 private:
+    QRect imageRect() const;
     QPoint imageCoordinatesFromWidget(const QPoint& widgetPos);
+    // В отличие от imageCoordinatesFromWidget - без округления до пикселя, прижато к краям
+    QPointF imagePointFromWidget(const QPoint& widgetPos) const;
+    QPointF widgetPointFromImage(const QPointF& imagePos) const;
+    QPolygonF rectanglePolygon(const QPointF& corner) const;
+    void finishRoi();
     QPoint lastRightClickPos;
+    QPixmap displayPixmap;
+    QPixmap overlayPixmap;
+    QSize imageSize;
+    
+    RoiTool roiTool = ROI_NONE;
+    QPolygonF roiPolygon;    // в координатах изображения
+    QPointF roiAnchor;       // угол прямоугольника, с которого начато рисование
+    QPointF roiCursor;       // для линии от последней вершины многоугольника к курсору
+    bool roiDrawing = false;
 };
 
 #endif
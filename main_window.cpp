@@ -14,9 +14,36 @@
 #include <QIcon>
 #include <QStyle>
 #include <QSplitter>
+#include <QScrollBar>
+#include <QGuiApplication>
+#include <QScreen>
+#include <QActionGroup>
+#include <QElapsedTimer>
+#include <QInputDialog>
+#include <QLineEdit>
 #include "spectral_reader.h"
 #include "spectral_info_dialog.h"
 #include "spectral_curve_dialog.h"
+#include "band_composite.h"
+#include "scatter_plot_dialog.h"
+#include "correlation_dialog.h"
+#include "sam_classifier.h"
+#include "parallel_utils.h"
+#include <QtConcurrent>
+#include <cmath>
+#include <numeric>
+#include <limits>
+
+// Изображения меньше этого размера отрисовываются сразу в полном разрешении
+static const qint64 kProgressiveMinPixels = 2 * 1024 * 1024;
+// Предел числа спектров, закрепляемых из видимой области за раз
+static const qint64 kMaxAreaSpectra = 32 * 1024;
+// Пикселей, по которым оценивается шкала производных для кривой под курсором
+static const double kProbeScaleSamples = 4096;
+// Предел числа главных компонент, добавляемых как каналы
+static const int kMaxPrincipalComponents = 64;
+// Карта классов поверх изображения строится не больше чем по стольким пикселям
+static const double kMaxClassOverlayPixels = 16.0 * 1024 * 1024;
 
 MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent) {
     setWindowTitle("Hyperspectral Image Viewer");
@@ -24,19 +51,63 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent) {
     
     colorIndex = 0;
     
-    createUI();
+    renderWatcher = new QFutureWatcher<QImage>(this);
+    connect(renderWatcher, &QFutureWatcher<QImage>::finished, this, &MainWindow::onRenderStepFinished);
+    
+    // Чаще, чем обновляется экран, спектр перерисовывать бессмысленно
+    probeTimer = new QTimer(this);
+    probeTimer->setSingleShot(true);
+    QScreen* screen = QGuiApplication::primaryScreen();
+    const double refreshRate = screen && screen->refreshRate() > 0 ? screen->refreshRate() : 60.0;
+    probeTimer->setInterval(std::max(1, static_cast<int>(1000.0 / refreshRate)));
+    connect(probeTimer, &QTimer::timeout, this, &MainWindow::processMouseProbe);
+    
+    setupUI();
     createMenus();
     setupStatusBar();
 }
 
+MainWindow::~MainWindow() {
+    cancelProgressiveRender();
+    cancelBackgroundJobs();
+}
+
+template <typename Result>
+void MainWindow::runInBackground(std::function<Result()> job, std::function<void(const Result&)> done) {
+    auto* watcher = new QFutureWatcher<Result>(this);
+    backgroundJobs.append(watcher);
+    const int generation = imageGeneration;
+    connect(watcher, &QFutureWatcher<Result>::finished, this, [this, watcher, generation, done]() {
+        backgroundJobs.removeOne(watcher);
+        watcher->deleteLater();
+        if (generation == imageGeneration) done(watcher->result());
+    });
+    watcher->setFuture(QtConcurrent::run(job));
+}
+
+void MainWindow::cancelBackgroundJobs() {
+    // Фоновые вычисления читают 16-битные каналы напрямую,
+    // поэтому перед их заменой нужно дождаться завершения
+    imageGeneration++;
+    for (QFutureWatcherBase* watcher : backgroundJobs) {
+        watcher->waitForFinished();
+    }
+}
+
 void MainWindow::openFile() {
     QString filePath = QFileDialog::getOpenFileName(this, "Открыть TIFF файл", "", "TIFF Files (*.tif *.tiff)");
     if (filePath.isEmpty()) return;
 
+    cancelProgressiveRender();
+    cancelBackgroundJobs();
+
     if (!hyperspectralImage.loadFromTiff(filePath)) {
         QMessageBox::critical(this, "Оибка", "Не удалось загрузить TIFF файл");
         return;
     }
+    rebuildWavelengthTable();
+    clearRoi();
+    clearClassification();
 
     channelSelector->clear();
     histogramChannelSelector->clear();
@@ -137,6 +208,7 @@ void MainWindow::loadSpectralData(const QString& tiffFilePath) {
         if (success && !loadedBands.isEmpty()) {
             spectralBands = loadedBands;
             hasSpectralData = true;
+            rebuildWavelengthTable();
             statusBar->showMessage(QString("Загружены спектральные данные из %1 (%2 каналов)")
                                  .arg(QFileInfo(foundSpectralFile).fileName())
                                  .arg(loadedBands.size()), 3000);
@@ -156,6 +228,7 @@ void MainWindow::loadSpectralData(const QString& tiffFilePath) {
     } else {
         hasSpectralData = false;
         spectralBands.clear();
+        rebuildWavelengthTable();
         statusBar->showMessage("Изображение загружено без спектральных данных", 2000);
     }
 }
@@ -164,9 +237,7 @@ void MainWindow::applyAutoContrast() {
     if (hyperspectralImage.getNumChannels() == 0) return;
     
     // Применяем автоконтрастирование ко всем каналам
-    for (int i = 0; i < hyperspectralImage.getNumChannels(); i++) {
-        hyperspectralImage.normalizeByPercentile(i, 2.0, 2.0);
-    }
+    hyperspectralImage.normalizeAllByPercentile(2.0, 2.0);
 }
 
 void MainWindow::autoContrast() {
@@ -180,7 +251,7 @@ void MainWindow::autoContrast() {
     // Обновляем отображение
     if (isRGBMode) {
         displayRGBImage();
-    } else {
+    } else if (!isCompositeMode) {
         displayChannel(channelSelector->currentIndex());
     }
     updateHistogram();
@@ -208,72 +279,34 @@ void MainWindow::updateSpectralCurve() {
         return;
     }
     
-    std::vector<SpectralPoint> spectralPoints;
-    
-    // Создаем карту спектральных данных для быстрого поиска
-    QMap<int, SpectralBand> spectralMap;
-    for (const SpectralBand& band : spectralBands) {
-        if (band.bandNumber > 0) {
-            spectralMap[band.bandNumber] = band;
-        }
-    }
-    
-    bool hasSpectralDataLocal = !spectralBands.isEmpty();
-    
-    for (int i = 0; i < hyperspectralImage.getNumChannels(); i++) {
-        SpectralPoint point;
-        point.channelIndex = i;
-        point.value16 = hyperspectralImage.getPixel16bit(i, currentSpectralX, currentSpectralY);
-        point.value8 = hyperspectralImage.getPixel8bit(i, currentSpectralX, currentSpectralY);
-        
-        // Пытаемся найти спектральные данные для этого канала
-        bool foundSpectralData = false;
-        
-        if (hasSpectralDataLocal) {
-            // Вариант 1: прямое соответствие номера канала
-            int channelNum = i + 1;
-            if (spectralMap.contains(channelNum)) {
-                point.wavelength = spectralMap[channelNum].wavelength;
-                point.hasWavelength = (point.wavelength > 0);
-                foundSpectralData = true;
-            }
-            // Вариант 2: по порядку в массиве
-            else if (i < spectralBands.size() && spectralBands[i].wavelength > 0) {
-                point.wavelength = spectralBands[i].wavelength;
-                point.hasWavelength = true;
-                foundSpectralData = true;
-            }
-        }
-        
-        if (!foundSpectralData) {
-            // Используем номер канала как "длину волны"
-            point.wavelength = i + 1;
-            point.hasWavelength = false;
-        }
-        
-        spectralPoints.push_back(point);
-    }
+    std::vector<SpectralPoint> spectralPoints = spectralPointsAt(currentSpectralX, currentSpectralY);
     
     // Передаем данные виджету
     spectralCurveWidget->setSpectralData(spectralPoints);
     spectralCurveWidget->setCoordinates(currentSpectralX, currentSpectralY);
     
     // Обновляем заголовок
-    spectralCurveLabel->setText(QString("Спектральная кривая точки (%1, %2)")
-                               .arg(currentSpectralX).arg(currentSpectralY));
+    spectralCurveLabel->setText(spectralCurveTitle(currentSpectralX, currentSpectralY));
 }
 
 void MainWindow::displayChannel(int channelIndex) {
     if (channelIndex < 0) return;
     
     isRGBMode = false;
+    isCompositeMode = false;
     histogramChannelSelector->setEnabled(false);
     
-    QImage image = hyperspectralImage.getChannelImage(channelIndex);
-    if (image.isNull()) return;
+    // Виртуальный канал считается при первом показе
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    hyperspectralImage.preloadChannels({channelIndex});
+    QApplication::restoreOverrideCursor();
+    
+    HyperspectralImage::RenderSource source = hyperspectralImage.makeChannelRenderSource(channelIndex, currentColormap);
+    if (!source.isValid()) return;
+    
+    colormapSelector->setEnabled(true);
 
-    imageLabel->setPixmap(QPixmap::fromImage(image));
-    imageLabel->resize(image.size());
+    showImageProgressive(source);
     
     auto [minVal, maxVal] = hyperspectralImage.getChannelMinMax16bit(channelIndex);
     statusBar->showMessage(QString("Канал %1: 16-бит диапазон %2-%3")
@@ -283,9 +316,8 @@ void MainWindow::displayChannel(int channelIndex) {
     
     // Обновляем список гистограммы для одноканального режима
     histogramChannelSelector->clear();
-    for (int i = 0; i < hyperspectralImage.getNumChannels(); i++) {
-        QString channelName = QString("Канал %1").arg(i + 1);
-        histogramChannelSelector->addItem(channelName);
+    for (int i = 0; i < hyperspectralImage.getNumDisplayChannels(); i++) {
+        histogramChannelSelector->addItem(hyperspectralImage.getChannelName(i));
     }
     histogramChannelSelector->setCurrentIndex(channelIndex);
     histogramChannelSelector->setEnabled(true);
@@ -298,48 +330,723 @@ void MainWindow::updateHistogram() {
     
     if (isRGBMode) {
         // RGB режим гистограммы
-        auto redHist = hyperspectralImage.calculateHistogram16bit(currentRedChannel);
-        auto greenHist = hyperspectralImage.calculateHistogram16bit(currentGreenChannel);
-        auto blueHist = hyperspectralImage.calculateHistogram16bit(currentBlueChannel);
+        auto redHist = histogramForView(currentRedChannel);
+        auto greenHist = histogramForView(currentGreenChannel);
+        auto blueHist = histogramForView(currentBlueChannel);
         
         histogramWidget->setRGBHistogramData(redHist, greenHist, blueHist, 
                                            currentRedChannel, currentGreenChannel, currentBlueChannel);
     } else {
         // Одноканальный режим
         int selectedHistogramIndex = histogramChannelSelector->currentIndex();
-        if (selectedHistogramIndex >= 0 && selectedHistogramIndex < hyperspectralImage.getNumChannels()) {
-            auto histogram = hyperspectralImage.calculateHistogram16bit(selectedHistogramIndex);
+        if (selectedHistogramIndex >= 0 && selectedHistogramIndex < hyperspectralImage.getNumDisplayChannels()) {
+            hyperspectralImage.preloadChannels({selectedHistogramIndex});
+            auto histogram = histogramForView(selectedHistogramIndex);
             histogramWidget->setHistogramData16bit(histogram, selectedHistogramIndex);
             histogramWidget->setDisplayMode(HistogramWidget::GRAYSCALE);
         }
     }
 }
 
+HyperspectralImage::HistogramPtr MainWindow::histogramForView(int channelIndex) const {
+    if (viewportHistogramAction && viewportHistogramAction->isChecked()) {
+        QRect visible = imageLabel->visibleImageRect();
+        if (!visible.isEmpty()) {
+            return hyperspectralImage.getRegionHistogram(channelIndex, visible);
+        }
+    }
+    return hyperspectralImage.getHistogram(channelIndex);
+}
+
+void MainWindow::onViewportChanged() {
+    if (viewportHistogramAction && viewportHistogramAction->isChecked()) {
+        updateHistogram();
+    }
+}
+
+void MainWindow::autoContrastVisibleArea() {
+    if (hyperspectralImage.getNumChannels() == 0) {
+        QMessageBox::warning(this, "Предупреждение", "Сначала откройте TIFF файл");
+        return;
+    }
+    if (isCompositeMode) return;
+    
+    QRect visible = imageLabel->visibleImageRect();
+    if (visible.isEmpty()) return;
+    
+    if (isRGBMode) {
+        for (int channel : {currentRedChannel, currentGreenChannel, currentBlueChannel}) {
+            hyperspectralImage.normalizeRegionByPercentile(channel, visible, 2.0, 2.0);
+        }
+        displayRGBImage();
+    } else {
+        hyperspectralImage.normalizeRegionByPercentile(channelSelector->currentIndex(), visible, 2.0, 2.0);
+        displayChannel(channelSelector->currentIndex());
+    }
+    updateHistogram();
+    
+    statusBar->showMessage("Контраст подобран по видимой области", 2000);
+}
+
 void MainWindow::openRGBSettings() {
     if (hyperspectralImage.getNumChannels() == 0) {
         QMessageBox::warning(this, "Предупреждение", "Сначала откройте TIFF файл");
         return;
     }
     
-    RGBSettingsDialog dialog(hyperspectralImage.getNumChannels(), 
-                           currentRedChannel, currentGreenChannel, currentBlueChannel, this);
+    bool trueColorAvailable = !BandComposite::cieTrueColorWeights(channelWavelengths()).empty();
+    
+    QStringList channelNames;
+    for (int i = 0; i < hyperspectralImage.getNumDisplayChannels(); i++) {
+        channelNames << hyperspectralImage.getChannelName(i);
+    }
+    RGBSettingsDialog dialog(channelNames, 
+                           currentRedChannel, currentGreenChannel, currentBlueChannel,
+                           trueColorAvailable, isCompositeMode, this);
     if (dialog.exec() == QDialog::Accepted) {
         currentRedChannel = dialog.getRedChannel();
         currentGreenChannel = dialog.getGreenChannel();
         currentBlueChannel = dialog.getBlueChannel();
-        displayRGBImage();
+        if (dialog.useTrueColor()) {
+            displayTrueColorImage();
+        } else {
+            displayRGBImage();
+        }
+    }
+}
+
+void MainWindow::displayTrueColorImage() {
+    std::vector<BandComposite::BandWeight> weights = BandComposite::cieTrueColorWeights(channelWavelengths());
+    if (weights.empty()) {
+        statusBar->showMessage("Нет каналов видимого диапазона с известными длинами волн", 3000);
+        return;
+    }
+    
+    BandComposite::Source source = BandComposite::makeSource(hyperspectralImage, weights);
+    if (!source.isValid()) return;
+    
+    // Отбрасываем незавершённую прогрессивную отрисовку предыдущего режима;
+    // если до конца синтеза выбран другой режим, синтез не показывается
+    const int generation = ++renderGeneration;
+    pendingRenderStep = 0;
+    statusBar->showMessage("Синтез истинного цвета...");
+    
+    const int numBands = static_cast<int>(weights.size());
+    runInBackground<QImage>([source]() { return BandComposite::compose(source, 1.0, true, true); },
+                            [this, generation, numBands](const QImage& image) {
+        if (image.isNull() || generation != renderGeneration) return;
+        
+        compositeImage = image;
+        isRGBMode = false;
+        isCompositeMode = true;
+        colormapSelector->setEnabled(false);
+        
+        imageLabel->setImage(compositeImage, QSize(compositeImage.width(), compositeImage.height()));
+        
+        statusBar->showMessage(QString("Истинный цвет (CIE 1931): %1 каналов видимого диапазона").arg(numBands));
+    });
+}
+
+void MainWindow::rebuildWavelengthTable() {
+    wavelengthTable.assign(hyperspectralImage.getNumChannels(), 0.0);
+    bandwidthTable.assign(hyperspectralImage.getNumChannels(), 0.0);
+    
+    QMap<int, int> bandByNumber;
+    for (int k = 0; k < spectralBands.size(); k++) {
+        if (spectralBands[k].bandNumber > 0) {
+            bandByNumber[spectralBands[k].bandNumber] = k;
+        }
+    }
+    
+    // Сначала по номеру канала из описания, затем по порядку в массиве
+    for (int i = 0; i < static_cast<int>(wavelengthTable.size()); i++) {
+        if (bandByNumber.contains(i + 1)) {
+            const SpectralBand& band = spectralBands[bandByNumber.value(i + 1)];
+            wavelengthTable[i] = band.wavelength;
+            bandwidthTable[i] = std::max(0.0, band.waveDelta);
+        } else if (i < spectralBands.size() && spectralBands[i].wavelength > 0) {
+            wavelengthTable[i] = spectralBands[i].wavelength;
+            bandwidthTable[i] = std::max(0.0, spectralBands[i].waveDelta);
+        }
+    }
+    updateProbeTransform();
+}
+
+std::vector<SpectralPoint> MainWindow::spectralPointsAt(int x, int y) {
+    const int numChannels = hyperspectralImage.getNumChannels();
+    probeValues16.resize(numChannels);
+    probeValues8.resize(numChannels);
+    if (!hyperspectralImage.getPixelSpectrum(x, y, probeValues16.data(), probeValues8.data())) return {};
+    
+    // При окне больше пикселя кривая - среднее по окну, а 8-битные значения остаются от центра
+    const int windowSize = probeWindowSpin->value();
+    const bool averaged = windowSize > 1;
+    if (averaged) {
+        probeMean.resize(numChannels);
+        probeStdDev.resize(numChannels);
+        hyperspectralImage.getWindowSpectrum(x, y, windowSize, probeMean.data(), probeStdDev.data());
+    }
+    
+    // Преобразованный спектр считается в исходных единицах; полоса ±σ есть только у исходного
+    const bool transformed = probeTransform != SpectralTransform::NONE;
+    if (transformed) {
+        probePhysical.resize(numChannels);
+        for (int i = 0; i < numChannels; i++) {
+            probePhysical[i] = hyperspectralImage.getSampleQuantization(i).decode(averaged ? probeMean[i] : probeValues16[i]);
+        }
+        encodeProbeSpectrum(probePhysical.data(), probeValues16.data(), probeWorkspace, probeTransformed);
+    }
+    
+    std::vector<SpectralPoint> spectralPoints(numChannels);
+    for (int i = 0; i < numChannels; i++) {
+        SpectralPoint& point = spectralPoints[i];
+        point.channelIndex = i;
+        point.value16 = averaged && !transformed ? static_cast<uint16_t>(std::lround(probeMean[i])) : probeValues16[i];
+        point.value8 = probeValues8[i];
+        point.stdDev = averaged && !transformed ? probeStdDev[i] : 0.0;
+        
+        const double wavelength = i < static_cast<int>(wavelengthTable.size()) ? wavelengthTable[i] : 0.0;
+        point.hasWavelength = wavelength > 0;
+        // Без длины волны по оси откладывается номер канала
+        point.wavelength = point.hasWavelength ? wavelength : i + 1;
+    }
+    return spectralPoints;
+}
+
+std::vector<double> MainWindow::transformWavelengths() const {
+    bool hasWavelength = false;
+    std::vector<double> wavelengths = plotWavelengths(hasWavelength);
+    if (!hasWavelength) {
+        std::iota(wavelengths.begin(), wavelengths.end(), 1.0);
+    }
+    return wavelengths;
+}
+
+void MainWindow::updateProbeTransform() {
+    probeGrid = SpectralTransform::Grid::fromWavelengths(transformWavelengths());
+    probeScale = SampleQuantization{};
+    
+    const int numChannels = hyperspectralImage.getNumChannels();
+    if (probeTransform == SpectralTransform::CONTINUUM_REMOVED) {
+        probeScale.scale = 1.0 / 65535.0;
+    } else if (probeTransform != SpectralTransform::NONE && numChannels > 0) {
+        // Шкала не должна зависеть от точки под курсором: диапазон производной
+        // по всем каналам берётся с равномерной сетки из kProbeScaleSamples пикселей
+        const int width = hyperspectralImage.getWidth();
+        const int height = hyperspectralImage.getHeight();
+        const int step = std::max(1, static_cast<int>(std::ceil(std::sqrt(
+            static_cast<double>(width) * height / kProbeScaleSamples))));
+        
+        std::vector<uint16_t> codes(numChannels);
+        std::vector<double> physical(numChannels);
+        std::vector<double> transformed(numChannels);
+        double low = std::numeric_limits<double>::max();
+        double high = std::numeric_limits<double>::lowest();
+        for (int y = 0; y < height; y += step) {
+            for (int x = 0; x < width; x += step) {
+                hyperspectralImage.getPixelSpectrum(x, y, codes.data());
+                for (int i = 0; i < numChannels; i++) {
+                    physical[i] = hyperspectralImage.getSampleQuantization(i).decode(codes[i]);
+                }
+                SpectralTransform::apply(probeTransform, probeGrid, physical.data(), transformed.data(), probeWorkspace);
+                auto [minValue, maxValue] = std::minmax_element(transformed.begin(), transformed.end());
+                low = std::min(low, *minValue);
+                high = std::max(high, *maxValue);
+            }
+        }
+        if (high > low) {
+            const double margin = 0.05 * (high - low);
+            probeScale.offset = low - margin;
+            probeScale.scale = (high - low + 2 * margin) / 65535.0;
+        }
+    }
+    
+    spectralCurveWidget->setValueScale(probeScale, probeTransform == SpectralTransform::NONE
+                                                       ? QString::fromUtf8("Яркость")
+                                                       : SpectralTransform::typeName(probeTransform));
+}
+
+void MainWindow::encodeProbeSpectrum(const double* physical, uint16_t* codes, SpectralTransform::Workspace& workspace,
+                                     std::vector<double>& transformed) const {
+    transformed.resize(probeGrid.size());
+    SpectralTransform::apply(probeTransform, probeGrid, physical, transformed.data(), workspace);
+    for (size_t i = 0; i < transformed.size(); i++) {
+        codes[i] = probeScale.encode(transformed[i]);
+    }
+}
+
+void MainWindow::onSpectralViewChanged(int index) {
+    probeTransform = static_cast<SpectralTransform::Type>(index);
+    
+    // Закреплённые кривые и статистика области сняты в другой шкале значений - пересчитываются
+    updateProbeTransform();
+    reloadPinnedSpectra();
+    showRoiStatistics();
+    updateSpectralCurve();
+}
+
+void MainWindow::reloadPinnedSpectra() {
+    const PinnedSpectra& pinned = spectralCurveWidget->getPinnedSpectra();
+    const int numChannels = hyperspectralImage.getNumChannels();
+    if (pinned.isEmpty() || pinned.getNumBands() != numChannels) return;
+    
+    const bool transformed = probeTransform != SpectralTransform::NONE;
+    std::vector<SampleQuantization> scales(numChannels);
+    for (int i = 0; i < numChannels; i++) scales[i] = hyperspectralImage.getSampleQuantization(i);
+    
+    // Каждый спектр читается из куба заново по своей позиции и окну группы, как при закреплении
+    std::vector<uint16_t> values(pinned.size() * numChannels, 0);
+    for (const PinnedSpectra::Group& group : pinned.getGroups()) {
+        const int windowSize = group.windowSize;
+        Parallel::forRange(group.first, group.first + group.count, 1024, [&](int64_t begin, int64_t end) {
+            SpectralTransform::Workspace workspace;
+            std::vector<double> physical(numChannels);
+            std::vector<double> mean(windowSize > 1 ? numChannels : 0);
+            std::vector<double> stdDev(mean.size());
+            std::vector<double> transformedValues;
+            for (int64_t i = begin; i < end; i++) {
+                uint16_t* codes = values.data() + i * numChannels;
+                const QPoint position = pinned.position(i);
+                if (windowSize > 1) {
+                    if (!hyperspectralImage.getWindowSpectrum(position.x(), position.y(), windowSize, mean.data(),
+                                                              stdDev.data())) {
+                        continue;
+                    }
+                    for (int c = 0; c < numChannels; c++) {
+                        codes[c] = static_cast<uint16_t>(std::lround(mean[c]));
+                        physical[c] = scales[c].decode(mean[c]);
+                    }
+                } else {
+                    if (!hyperspectralImage.getPixelSpectrum(position.x(), position.y(), codes)) continue;
+                    for (int c = 0; c < numChannels; c++) physical[c] = scales[c].decode(codes[c]);
+                }
+                if (transformed) encodeProbeSpectrum(physical.data(), codes, workspace, transformedValues);
+            }
+        });
+    }
+    spectralCurveWidget->replacePinnedValues(std::move(values));
+}
+
+void MainWindow::computeCubeProduct(SpectralTransform::Type type) {
+    const int numChannels = hyperspectralImage.getNumChannels();
+    if (numChannels == 0) return;
+    
+    auto grid = std::make_shared<const SpectralTransform::Grid>(
+        SpectralTransform::Grid::fromWavelengths(transformWavelengths()));
+    
+    // Тот же продукт уже в списке - второй раз каналы не добавляются
+    const int existing = hyperspectralImage.findTransformedChannel(type, *grid);
+    if (existing >= 0) {
+        channelSelector->setCurrentIndex(existing);
+        statusBar->showMessage(QString::fromUtf8("%1: каналы уже в списке").arg(SpectralTransform::typeName(type)), 3000);
+        return;
+    }
+    
+    // Каждый канал продукта - виртуальный канал: куб преобразуется, только когда канал показывают
+    int added = 0;
+    for (int i = 0; i < numChannels; i++) {
+        const QString band = wavelengthTable[i] > 0 ? QString::fromUtf8("%1 нм").arg(wavelengthTable[i], 0, 'f', 1)
+                                                    : QString::fromUtf8("канал %1").arg(i + 1);
+        const int index = hyperspectralImage.addTransformedChannel(
+            QString("%1, %2").arg(SpectralTransform::typeName(type), band), type, grid, i);
+        if (index < 0) continue;
+        channelSelector->addItem(hyperspectralImage.getChannelName(index));
+        added++;
+    }
+    
+    statusBar->showMessage(QString::fromUtf8("%1: %2 виртуальных каналов")
+                               .arg(SpectralTransform::typeName(type))
+                               .arg(added));
+}
+
+void MainWindow::computeResampledBands(const QString& sensorName,
+                                       const std::vector<SpectralResampler::TargetBand>& targets) {
+    const int numChannels = hyperspectralImage.getNumChannels();
+    if (numChannels == 0) {
+        QMessageBox::warning(this, "Предупреждение", "Сначала откройте TIFF файл");
+        return;
+    }
+    bool hasWavelength = false;
+    const std::vector<double> wavelengths = plotWavelengths(hasWavelength);
+    if (!hasWavelength) {
+        statusBar->showMessage(QString::fromUtf8("Для пересчёта нужны длины волн всех каналов: загрузите описание каналов"), 5000);
+        return;
+    }
+    
+    // Каналы, которые куб покрывает меньше чем наполовину, не строятся: их значение было бы экстраполяцией
+    const double kMinCoverage = 0.5;
+    SpectralResampler::Matrix matrix = SpectralResampler::buildMatrix(wavelengths, bandwidthTable, targets);
+    std::vector<SpectralResampler::TargetBand> covered;
+    for (size_t t = 0; t < targets.size(); t++) {
+        if (matrix.coverage[t] >= kMinCoverage) covered.push_back(targets[t]);
+    }
+    if (covered.empty()) {
+        statusBar->showMessage(QString::fromUtf8("%1: ни один канал не попадает в спектральный диапазон куба")
+                                   .arg(sensorName), 5000);
+        return;
+    }
+    if (covered.size() != targets.size()) {
+        matrix = SpectralResampler::buildMatrix(wavelengths, bandwidthTable, covered);
+    }
+    
+    QElapsedTimer timer;
+    timer.start();
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    SpectralTransform::CubeProduct product = hyperspectralImage.computeResampledProduct(matrix);
+    QApplication::restoreOverrideCursor();
+    if (product.bands.size() != covered.size()) {
+        statusBar->showMessage(QString::fromUtf8("Не удалось построить продукт: загружены не все каналы"), 3000);
+        return;
+    }
+    
+    for (size_t t = 0; t < covered.size(); t++) {
+        const int index = hyperspectralImage.addDerivedChannel(
+            QString::fromUtf8("%1 %2 (%3 нм)").arg(sensorName, covered[t].name).arg(covered[t].center, 0, 'f', 0),
+            std::move(product.bands[t]), product.quantization[t]);
+        if (index >= 0) channelSelector->addItem(hyperspectralImage.getChannelName(index));
+    }
+    
+    statusBar->showMessage(QString::fromUtf8("%1: %2 из %3 каналов, %4 весов, %5 мс")
+                               .arg(sensorName)
+                               .arg(covered.size())
+                               .arg(targets.size())
+                               .arg(matrix.numWeights())
+                               .arg(timer.elapsed()));
+}
+
+void MainWindow::resampleFromResponseTable() {
+    QString filePath = QFileDialog::getOpenFileName(this,
+        "Открыть таблицу спектральной чувствительности",
+        "",
+        "Tables (*.csv *.txt);;All Files (*.*)");
+    if (filePath.isEmpty()) return;
+    
+    std::vector<SpectralResampler::TargetBand> targets;
+    QString error;
+    if (!SpectralResampler::loadResponseTable(filePath, targets, error)) {
+        QMessageBox::warning(this, "Ошибка", error);
+        return;
+    }
+    computeResampledBands(QFileInfo(filePath).completeBaseName(), targets);
+}
+
+void MainWindow::computeBandMath() {
+    if (hyperspectralImage.getNumChannels() == 0) {
+        QMessageBox::warning(this, "Предупреждение", "Сначала откройте TIFF файл");
+        return;
+    }
+    
+    bool accepted = false;
+    const QString expression = QInputDialog::getText(this, "Выражение по каналам",
+        "bN - канал с номером N, @λ - канал с ближайшей длиной волны (нм).\n"
+        "Операции + - * / ^, функции sqrt, abs, log, exp, min, max.\n"
+        "Например: (@860 - @660) / (@860 + @660)",
+        QLineEdit::Normal, lastBandMathExpression, &accepted);
+    if (!accepted || expression.trimmed().isEmpty()) return;
+    lastBandMathExpression = expression;
+    
+    BandMath::Program program;
+    QString error;
+    if (!BandMath::compile(expression, hyperspectralImage.getNumDisplayChannels(), wavelengthTable, program, error)) {
+        QMessageBox::warning(this, "Ошибка в выражении", error);
+        return;
+    }
+    
+    QElapsedTimer timer;
+    timer.start();
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    hyperspectralImage.preloadChannels(program.channels);
+    SpectralTransform::CubeProduct product = hyperspectralImage.computeBandMath(program);
+    QApplication::restoreOverrideCursor();
+    if (product.bands.empty()) {
+        statusBar->showMessage(QString::fromUtf8("Не удалось вычислить выражение: загружены не все каналы"), 3000);
+        return;
+    }
+    
+    const int index = hyperspectralImage.addDerivedChannel(program.expression, std::move(product.bands[0]),
+                                                           product.quantization[0]);
+    if (index < 0) return;
+    channelSelector->addItem(hyperspectralImage.getChannelName(index));
+    channelSelector->setCurrentIndex(index);
+    statusBar->showMessage(QString::fromUtf8("%1: %2 каналов, %3 мс")
+                               .arg(program.expression)
+                               .arg(program.channels.size())
+                               .arg(timer.elapsed()));
+}
+
+void MainWindow::computePrincipalComponents() {
+    const int numChannels = hyperspectralImage.getNumChannels();
+    if (numChannels < 2) {
+        QMessageBox::warning(this, "Предупреждение", "Сначала откройте TIFF файл с несколькими каналами");
+        return;
+    }
+    
+    bool accepted = false;
+    const int maxComponents = std::min(numChannels, kMaxPrincipalComponents);
+    const int count = QInputDialog::getInt(this, "Главные компоненты", "Сколько компонент добавить:",
+                                           std::min(maxComponents, 10), 1, maxComponents, 1, &accepted);
+    if (!accepted) return;
+    
+    QElapsedTimer timer;
+    timer.start();
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    std::shared_ptr<const PcaTransform::Basis> basis = hyperspectralImage.computePca(count);
+    QApplication::restoreOverrideCursor();
+    if (!basis) {
+        statusBar->showMessage(QString::fromUtf8("Не удалось построить главные компоненты: загружены не все каналы"), 3000);
+        return;
+    }
+    
+    // Компоненты - виртуальные каналы: проекция считается, только когда канал показывают
+    double explained = 0.0;
+    for (int k = 0; k < basis->numComponents(); k++) {
+        const double share = basis->totalVariance > 0 ? 100.0 * basis->variance[k] / basis->totalVariance : 0.0;
+        explained += share;
+        const int index = hyperspectralImage.addProjectedChannel(
+            QString::fromUtf8("ГК %1 (%2% дисперсии)").arg(k + 1).arg(share, 0, 'f', 2), basis, k);
+        if (index >= 0) channelSelector->addItem(hyperspectralImage.getChannelName(index));
     }
+    
+    statusBar->showMessage(QString::fromUtf8("Главные компоненты: %1 каналов, %2% дисперсии, %3 мс")
+                               .arg(basis->numComponents())
+                               .arg(explained, 0, 'f', 1)
+                               .arg(timer.elapsed()));
+}
+
+void MainWindow::computeMnfComponents() {
+    const int numChannels = hyperspectralImage.getNumChannels();
+    if (numChannels < 2) {
+        QMessageBox::warning(this, "Предупреждение", "Сначала откройте TIFF файл с несколькими каналами");
+        return;
+    }
+    
+    bool accepted = false;
+    const int maxComponents = std::min(numChannels, kMaxPrincipalComponents);
+    const int count = QInputDialog::getInt(this, "Компоненты MNF", "Сколько компонент добавить:",
+                                           std::min(maxComponents, 10), 1, maxComponents, 1, &accepted);
+    if (!accepted) return;
+    
+    QElapsedTimer timer;
+    timer.start();
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    std::shared_ptr<const PcaTransform::Basis> basis = hyperspectralImage.computeMnf(count);
+    QApplication::restoreOverrideCursor();
+    if (!basis) {
+        statusBar->showMessage(QString::fromUtf8("Не удалось построить MNF: загружены не все каналы или шум не оценивается"), 3000);
+        return;
+    }
+    
+    // Дисперсия компоненты MNF - (сигнал + шум) в единицах шума: 1 означает чистый шум
+    for (int k = 0; k < basis->numComponents(); k++) {
+        const double snr = std::max(0.0, basis->variance[k] - 1.0);
+        const int index = hyperspectralImage.addProjectedChannel(
+            QString::fromUtf8("MNF %1 (сигнал/шум %2)").arg(k + 1).arg(snr, 0, 'f', 1), basis, k);
+        if (index >= 0) channelSelector->addItem(hyperspectralImage.getChannelName(index));
+    }
+    
+    statusBar->showMessage(QString::fromUtf8("MNF: %1 виртуальных каналов, %2 мс")
+                               .arg(basis->numComponents())
+                               .arg(timer.elapsed()));
+}
+
+void MainWindow::denoiseWithMnf() {
+    const int numChannels = hyperspectralImage.getNumChannels();
+    if (numChannels < 2) {
+        QMessageBox::warning(this, "Предупреждение", "Сначала откройте TIFF файл с несколькими каналами");
+        return;
+    }
+    
+    bool accepted = false;
+    const int count = QInputDialog::getInt(this, "Подавление шума MNF",
+                                           "Сколько компонент MNF сохранить (остальные считаются шумом):",
+                                           std::min(numChannels, 10), 1, numChannels, 1, &accepted);
+    if (!accepted) return;
+    
+    QElapsedTimer timer;
+    timer.start();
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    std::shared_ptr<const PcaTransform::Basis> basis = hyperspectralImage.computeMnf(count);
+    QApplication::restoreOverrideCursor();
+    if (!basis) {
+        statusBar->showMessage(QString::fromUtf8("Не удалось подавить шум: загружены не все каналы или шум не оценивается"), 3000);
+        return;
+    }
+    
+    // Очищенные каналы - виртуальные: куб восстанавливается, только когда канал показывают
+    for (int i = 0; i < numChannels; i++) {
+        const QString band = wavelengthTable[i] > 0 ? QString::fromUtf8("%1 нм").arg(wavelengthTable[i], 0, 'f', 1)
+                                                    : QString::fromUtf8("канал %1").arg(i + 1);
+        const int index = hyperspectralImage.addReconstructedChannel(
+            QString::fromUtf8("MNF-очистка (%1), %2").arg(count).arg(band), basis, count, i);
+        if (index >= 0) channelSelector->addItem(hyperspectralImage.getChannelName(index));
+    }
+    
+    statusBar->showMessage(QString::fromUtf8("Подавление шума MNF: %1 компонент из %2, %3 мс")
+                               .arg(count)
+                               .arg(numChannels)
+                               .arg(timer.elapsed()));
+}
+
+void MainWindow::classifyByPinnedSpectra() {
+    const int numChannels = hyperspectralImage.getNumChannels();
+    if (numChannels == 0) {
+        QMessageBox::warning(this, "Предупреждение", "Сначала откройте TIFF файл");
+        return;
+    }
+    const PinnedSpectra& pinned = spectralCurveWidget->getPinnedSpectra();
+    if (pinned.isEmpty()) {
+        QMessageBox::warning(this, "Предупреждение", "Закрепите на графике спектры эталонов");
+        return;
+    }
+    
+    // Эталон группы - средний исходный спектр её пикселей. Сохранённые кривые не годятся:
+    // в виде континуума или производной они хранят преобразованные значения в другой шкале
+    QStringList names;
+    std::vector<QRgb> colors;
+    std::vector<std::vector<double>> references;
+    std::vector<uint16_t> spectrum(numChannels);
+    for (const PinnedSpectra::Group& group : pinned.getGroups()) {
+        std::vector<double> reference(numChannels, 0.0);
+        size_t numSpectra = 0;
+        for (size_t i = group.first; i < group.first + group.count; i++) {
+            const QPoint position = pinned.position(i);
+            if (!hyperspectralImage.getPixelSpectrum(position.x(), position.y(), spectrum.data())) continue;
+            for (int b = 0; b < numChannels; b++) reference[b] += spectrum[b];
+            numSpectra++;
+        }
+        if (numSpectra == 0) continue;
+        for (int b = 0; b < numChannels; b++) {
+            reference[b] = hyperspectralImage.getSampleQuantization(b).decode(reference[b] / numSpectra);
+        }
+        names << group.label;
+        colors.push_back(group.color.rgb());
+        references.push_back(std::move(reference));
+    }
+    if (references.empty()) {
+        QMessageBox::warning(this, "Предупреждение", "Закреплённые точки лежат вне изображения");
+        return;
+    }
+    classifySpectralAngle(names, colors, references);
+}
+
+void MainWindow::classifyBySpectralLibrary() {
+    if (hyperspectralImage.getNumChannels() == 0) {
+        QMessageBox::warning(this, "Предупреждение", "Сначала откройте TIFF файл");
+        return;
+    }
+    QString filePath = QFileDialog::getOpenFileName(this,
+        "Открыть библиотеку спектров",
+        "",
+        "Tables (*.csv *.txt);;All Files (*.*)");
+    if (filePath.isEmpty()) return;
+    
+    // Каналы без длины волны и вне диапазона библиотеки в угол не входят
+    QStringList names;
+    std::vector<std::vector<double>> references;
+    QString error;
+    if (!SamClassifier::loadLibrary(filePath, wavelengthTable, names, references, error)) {
+        QMessageBox::warning(this, "Ошибка", error);
+        return;
+    }
+    std::vector<QRgb> colors;
+    for (int k = 0; k < static_cast<int>(references.size()); k++) {
+        colors.push_back(QColor::fromHsv((k * 137) % 360, 230, 255).rgb());
+    }
+    classifySpectralAngle(names, colors, references);
+}
+
+void MainWindow::classifySpectralAngle(const QStringList& names, const std::vector<QRgb>& colors,
+                                       const std::vector<std::vector<double>>& references) {
+    if (static_cast<int>(references.size()) > SamClassifier::kMaxClasses) {
+        QMessageBox::warning(this, "Предупреждение",
+                             QString("Эталонов больше %1").arg(SamClassifier::kMaxClasses));
+        return;
+    }
+    
+    bool accepted = false;
+    const double maxAngle = QInputDialog::getDouble(this, "Классификация SAM",
+        "Наибольший угол до эталона, радиан (пиксели дальше остаются без класса):",
+        lastSamAngle, 0.001, 3.1416, 3, &accepted);
+    if (!accepted) return;
+    lastSamAngle = maxAngle;
+    
+    HyperspectralImage::CubeSource source = hyperspectralImage.makeCubeSource();
+    if (!source.isValid()) {
+        statusBar->showMessage(QString::fromUtf8("Не удалось классифицировать: загружены не все каналы"), 5000);
+        return;
+    }
+    
+    QElapsedTimer timer;
+    timer.start();
+    const bool ruleImages = samRuleImagesAction->isChecked();
+    statusBar->showMessage(QString::fromUtf8("SAM: классификация по %1 эталонам...").arg(references.size()));
+    
+    using ResultPtr = std::shared_ptr<SamClassifier::Result>;
+    runInBackground<ResultPtr>([source, references, maxAngle, ruleImages]() {
+        return std::make_shared<SamClassifier::Result>(SamClassifier::classify(
+            references, maxAngle, ruleImages, source.bands, source.quantization, source.numPixels()));
+    }, [this, names, colors, timer](const ResultPtr& result) {
+        if (result->isEmpty()) {
+            statusBar->showMessage(QString::fromUtf8("Не удалось классифицировать: у эталонов нет общих каналов"), 5000);
+            return;
+        }
+        
+        const uint32_t width = hyperspectralImage.getWidth();
+        const uint32_t height = hyperspectralImage.getHeight();
+        const int step = std::max(1, static_cast<int>(std::ceil(std::sqrt(double(width) * height / kMaxClassOverlayPixels))));
+        classOverlay = SamClassifier::classOverlay(result->classes, width, height, colors, step);
+        imageLabel->setOverlay(classOverlay);
+        
+        // Углы до эталонов и сама карта - производные каналы: их можно показать, сравнить и выгрузить
+        for (size_t k = 0; k < result->rules.bands.size(); k++) {
+            const int index = hyperspectralImage.addDerivedChannel(QString::fromUtf8("SAM, угол до %1").arg(names[k]),
+                                                                   std::move(result->rules.bands[k]),
+                                                                   result->rules.quantization[k]);
+            if (index >= 0) channelSelector->addItem(hyperspectralImage.getChannelName(index));
+        }
+        std::vector<uint16_t> classCodes(result->classes.begin(), result->classes.end());
+        std::vector<uint8_t>().swap(result->classes);
+        const int mapIndex = hyperspectralImage.addDerivedChannel(QString::fromUtf8("SAM, карта классов"),
+                                                                  std::move(classCodes), SampleQuantization());
+        if (mapIndex >= 0) channelSelector->addItem(hyperspectralImage.getChannelName(mapIndex));
+        
+        const double total = std::max<double>(1.0, double(width) * height);
+        statusBar->showMessage(QString::fromUtf8("SAM: %1 классов, без класса %2%, %3 мс")
+                                   .arg(result->numClasses)
+                                   .arg(100.0 * result->counts[0] / total, 0, 'f', 1)
+                                   .arg(timer.elapsed()));
+    });
+}
+
+void MainWindow::clearClassification() {
+    classOverlay = QImage();
+    imageLabel->setOverlay(QImage());
+}
+
+QString MainWindow::spectralCurveTitle(int x, int y) const {
+    const int windowSize = probeWindowSpin->value();
+    if (windowSize <= 1) {
+        return QString("Спектральная кривая точки (%1, %2)").arg(x).arg(y);
+    }
+    return QString("Средний спектр окна %1x%1 вокруг (%2, %3), полоса ±σ")
+        .arg(windowSize).arg(x).arg(y);
 }
 
 void MainWindow::displayRGBImage() {
-    QImage rgbImage = hyperspectralImage.getRGBImage(currentRedChannel, currentGreenChannel, currentBlueChannel);
-    if (rgbImage.isNull()) return;
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    hyperspectralImage.preloadChannels({currentRedChannel, currentGreenChannel, currentBlueChannel});
+    QApplication::restoreOverrideCursor();
+    
+    HyperspectralImage::RenderSource source = hyperspectralImage.makeRGBRenderSource(
+        currentRedChannel, currentGreenChannel, currentBlueChannel);
+    if (!source.isValid()) return;
     
     isRGBMode = true;
+    isCompositeMode = false;
     histogramChannelSelector->setEnabled(true);
+    colormapSelector->setEnabled(false);
     
-    imageLabel->setPixmap(QPixmap::fromImage(rgbImage));
-    imageLabel->resize(rgbImage.size());
+    showImageProgressive(source);
     
     statusBar->showMessage(QString("RGB Синтез: R=Канал %1, G=Канал %2, B=Канал %3")
                           .arg(currentRedChannel + 1)
@@ -383,10 +1090,37 @@ void MainWindow::openContrastDialog() {
     }
 }
 
+void MainWindow::openScatterPlot() {
+    if (hyperspectralImage.getNumChannels() == 0) {
+        QMessageBox::warning(this, "Предупреждение", "Сначала откройте TIFF файл");
+        return;
+    }
+    
+    int bandX = isRGBMode ? currentRedChannel : channelSelector->currentIndex();
+    int bandY = isRGBMode ? currentGreenChannel : std::min(bandX + 1, hyperspectralImage.getNumDisplayChannels() - 1);
+    
+    ScatterPlotDialog dialog(&hyperspectralImage, bandX, bandY, this);
+    connect(&dialog, &ScatterPlotDialog::selectionChanged, imageLabel, &ImageLabel::setOverlay);
+    dialog.exec();
+    
+    // Подсветка выделения снимается, карта классов возвращается
+    imageLabel->setOverlay(classOverlay);
+}
+
+void MainWindow::openCorrelationMatrix() {
+    if (hyperspectralImage.getNumChannels() == 0) {
+        QMessageBox::warning(this, "Предупреждение", "Сначала откройте TIFF файл");
+        return;
+    }
+    
+    CorrelationDialog dialog(&hyperspectralImage, this);
+    dialog.exec();
+}
+
 void MainWindow::onContrastChanged() {
     if (isRGBMode) {
         displayRGBImage();
-    } else {
+    } else if (!isCompositeMode) {
         displayChannel(channelSelector->currentIndex());
     }
     updateHistogram();
@@ -398,13 +1132,16 @@ void MainWindow::onContrastChanged() {
 }
 
 void MainWindow::closeImage() {
-    imageLabel->clear();
-    imageLabel->setPixmap(QPixmap());
+    cancelProgressiveRender();
+    cancelBackgroundJobs();
+    
+    imageLabel->clearImage();
     imageLabel->setMinimumSize(1, 1);
     imageLabel->resize(1, 1);
     
     channelSelector->clear();
     channelSelector->setEnabled(false);
+    colormapSelector->setEnabled(false);
     histogramChannelSelector->clear();
     histogramChannelSelector->setEnabled(false);
     autoContrastButton->setEnabled(false);
@@ -414,10 +1151,16 @@ void MainWindow::closeImage() {
     coordinatesLabel->clear();
     
     isRGBMode = false;
+    isCompositeMode = false;
+    compositeImage = QImage();
     hasSpectralData = false;
     spectralBands.clear();
+    probeTimer->stop();
     
     hyperspectralImage = HyperspectralImage();
+    rebuildWavelengthTable();
+    clearRoi();
+    classOverlay = QImage();
     
     histogramWidget->setHistogramData16bit({}, -1);
     
@@ -433,9 +1176,22 @@ void MainWindow::closeImage() {
 void MainWindow::onMousePosition(int x, int y) {
     if (hyperspectralImage.getNumChannels() == 0) return;
     
+    pendingProbePosition = QPoint(x, y);
+    if (!probeTimer->isActive()) probeTimer->start();
+}
+
+void MainWindow::processMouseProbe() {
+    if (hyperspectralImage.getNumChannels() == 0) return;
+    
+    const int x = pendingProbePosition.x();
+    const int y = pendingProbePosition.y();
     coordinatesLabel->setText(QString("X: %1, Y: %2").arg(x).arg(y));
     
-    if (isRGBMode) {
+    if (isCompositeMode) {
+        QRgb color = compositeImage.pixel(x, y);
+        pixelInfoLabel->setText(QString("Истинный цвет: [%1,%2,%3] (8-бит)")
+                              .arg(qRed(color)).arg(qGreen(color)).arg(qBlue(color)));
+    } else if (isRGBMode) {
         // Показываем значения для всех RGB каналов
         uint16_t r16 = hyperspectralImage.getPixel16bit(currentRedChannel, x, y);
         uint16_t g16 = hyperspectralImage.getPixel16bit(currentGreenChannel, x, y);
@@ -486,7 +1242,7 @@ void MainWindow::onHistogramChannelChanged() {
     }
 }
 
-void MainWindow::createUI() {
+void MainWindow::setupUI() {
     QWidget* centralWidget = new QWidget(this);
     setCentralWidget(centralWidget);
 
@@ -506,6 +1262,17 @@ void MainWindow::createUI() {
     connect(channelSelector, QOverload<int>::of(&QComboBox::currentIndexChanged),
             this, &MainWindow::displayChannel);
 
+    QLabel* colormapLabel = new QLabel("Палитра:");
+    
+    colormapSelector = new QComboBox();
+    colormapSelector->addItems(Colormap::names());
+    colormapSelector->setEnabled(false);
+    colormapSelector->setMinimumWidth(120);
+    colormapSelector->setMinimumHeight(30);
+    colormapSelector->setToolTip(QString::fromUtf8("Псевдоцветное отображение одного канала"));
+    connect(colormapSelector, QOverload<int>::of(&QComboBox::currentIndexChanged),
+            this, &MainWindow::onColormapChanged);
+
     QPushButton* contrastButton = new QPushButton("Контрастирование");
     contrastButton->setMinimumHeight(30);
     contrastButton->setMinimumWidth(150);
@@ -521,6 +1288,8 @@ void MainWindow::createUI() {
 
     controlLayout->addWidget(channelLabel);
     controlLayout->addWidget(channelSelector);
+    controlLayout->addWidget(colormapLabel);
+    controlLayout->addWidget(colormapSelector);
     controlLayout->addWidget(contrastButton);
     controlLayout->addWidget(autoContrastButton);
     controlLayout->addStretch();
@@ -539,10 +1308,16 @@ void MainWindow::createUI() {
     
     connect(imageLabel, &ImageLabel::mousePosition, this, &MainWindow::onMousePosition);
     connect(imageLabel, &ImageLabel::spectralCurveRequested, this, &MainWindow::showSpectralCurve);
+    connect(imageLabel, &ImageLabel::roiSelected, this, &MainWindow::onRoiSelected);
 
     scrollArea->setWidget(imageLabel);
     leftLayout->addWidget(scrollArea);
     
+    for (QScrollBar* scrollBar : {scrollArea->horizontalScrollBar(), scrollArea->verticalScrollBar()}) {
+        connect(scrollBar, &QScrollBar::valueChanged, this, &MainWindow::onViewportChanged);
+        connect(scrollBar, &QScrollBar::rangeChanged, this, &MainWindow::onViewportChanged);
+    }
+    
     // Правая панель с спектральной кривой и гистограммой
     QVBoxLayout* rightLayout = new QVBoxLayout();
     
@@ -588,10 +1363,43 @@ void MainWindow::createUI() {
     clearPointsButton->setMaximumSize(32, 32);
     connect(clearPointsButton, &QPushButton::clicked, this, &MainWindow::onClearPointsClicked);
     
+    pinAreaButton = new QPushButton();
+    pinAreaButton->setIcon(style()->standardIcon(QStyle::SP_FileDialogContentsView));
+    pinAreaButton->setToolTip(QString::fromUtf8("Закрепить спектры всех пикселей видимой области"));
+    pinAreaButton->setMinimumSize(32, 32);
+    pinAreaButton->setMaximumSize(32, 32);
+    connect(pinAreaButton, &QPushButton::clicked, this, &MainWindow::onPinVisibleAreaClicked);
+    
     pointControlLayout->addWidget(addPointButton);
+    pointControlLayout->addWidget(pinAreaButton);
     pointControlLayout->addWidget(removePointButton);
     pointControlLayout->addWidget(clearPointsButton);
     pointControlLayout->addStretch();
+    
+    // Нечётный размер окна, чтобы курсор был в центре
+    probeWindowSpin = new QSpinBox();
+    probeWindowSpin->setRange(1, HyperspectralImage::kMaxProbeWindow);
+    probeWindowSpin->setSingleStep(2);
+    probeWindowSpin->setValue(1);
+    probeWindowSpin->setToolTip(QString::fromUtf8("Размер окна усреднения спектра вокруг курсора"));
+    connect(probeWindowSpin, QOverload<int>::of(&QSpinBox::valueChanged), this, [this](int value) {
+        if (value % 2 == 0) {
+            probeWindowSpin->setValue(value + 1);
+            return;
+        }
+        updateSpectralCurve();
+    });
+    pointControlLayout->addWidget(new QLabel(QString::fromUtf8("Окно:")));
+    pointControlLayout->addWidget(probeWindowSpin);
+    
+    spectralViewSelector = new QComboBox();
+    for (int type = SpectralTransform::NONE; type <= SpectralTransform::SECOND_DERIVATIVE; type++) {
+        spectralViewSelector->addItem(SpectralTransform::typeName(static_cast<SpectralTransform::Type>(type)));
+    }
+    spectralViewSelector->setToolTip(QString::fromUtf8("Вид спектральной кривой под курсором"));
+    connect(spectralViewSelector, QOverload<int>::of(&QComboBox::currentIndexChanged),
+            this, &MainWindow::onSpectralViewChanged);
+    pointControlLayout->addWidget(spectralViewSelector);
     spectralLayout->addLayout(pointControlLayout);
     
     QLabel* legendLabel = new QLabel(QString::fromUtf8("Закрепленные точки:"));
@@ -653,6 +1461,16 @@ void MainWindow::createUI() {
     mainLayout->addLayout(rightLayout, 1);
 }
 
+void MainWindow::onColormapChanged(int index) {
+    if (index < 0) return;
+    
+    currentColormap = static_cast<Colormap::Type>(index);
+    
+    if (!isRGBMode && hyperspectralImage.getNumChannels() > 0) {
+        displayChannel(channelSelector->currentIndex());
+    }
+}
+
 void MainWindow::createMenus() {
     QMenu* fileMenu = menuBar()->addMenu("&Файл");
     QAction* openAction = new QAction("&Открыть", this);
@@ -672,10 +1490,89 @@ void MainWindow::createMenus() {
     connect(contrastAction, &QAction::triggered, this, &MainWindow::openContrastDialog);
     viewMenu->addAction(contrastAction);
 
+    progressiveRenderAction = new QAction("&Прогрессивная отрисовка", this);
+    progressiveRenderAction->setCheckable(true);
+    progressiveRenderAction->setChecked(true);
+    viewMenu->addAction(progressiveRenderAction);
+    
+    viewportHistogramAction = new QAction("Гистограмма &видимой области", this);
+    viewportHistogramAction->setCheckable(true);
+    connect(viewportHistogramAction, &QAction::toggled, this, &MainWindow::updateHistogram);
+    viewMenu->addAction(viewportHistogramAction);
+    
+    QAction* viewportContrastAction = new QAction("&Автоконтраст по видимой области", this);
+    connect(viewportContrastAction, &QAction::triggered, this, &MainWindow::autoContrastVisibleArea);
+    viewMenu->addAction(viewportContrastAction);
+
     viewMenu->addSeparator();
+    QAction* scatterPlotAction = new QAction("&Диаграмма рассеяния", this);
+    connect(scatterPlotAction, &QAction::triggered, this, &MainWindow::openScatterPlot);
+    viewMenu->addAction(scatterPlotAction);
+    
+    QAction* correlationAction = new QAction("&Корреляция каналов", this);
+    connect(correlationAction, &QAction::triggered, this, &MainWindow::openCorrelationMatrix);
+    viewMenu->addAction(correlationAction);
+    
     QAction* spectralInfoAction = new QAction("&Спектральная информация", this);
     connect(spectralInfoAction, &QAction::triggered, this, &MainWindow::openSpectralInfo);
     viewMenu->addAction(spectralInfoAction);
+    
+    QMenu* productMenu = menuBar()->addMenu("&Продукты");
+    for (SpectralTransform::Type type : {SpectralTransform::CONTINUUM_REMOVED, SpectralTransform::FIRST_DERIVATIVE,
+                                         SpectralTransform::SECOND_DERIVATIVE}) {
+        QAction* action = productMenu->addAction(SpectralTransform::typeName(type) + QString::fromUtf8(" (весь куб)"));
+        connect(action, &QAction::triggered, this, [this, type]() { computeCubeProduct(type); });
+    }
+    productMenu->addSeparator();
+    for (SpectralResampler::Sensor sensor : {SpectralResampler::SENTINEL2_MSI, SpectralResampler::LANDSAT8_OLI}) {
+        QAction* action = productMenu->addAction(QString::fromUtf8("Каналы %1").arg(SpectralResampler::sensorName(sensor)));
+        connect(action, &QAction::triggered, this, [this, sensor]() {
+            computeResampledBands(SpectralResampler::sensorName(sensor), SpectralResampler::sensorBands(sensor));
+        });
+    }
+    QAction* responseTableAction = productMenu->addAction("Каналы по таблице чувствительности...");
+    connect(responseTableAction, &QAction::triggered, this, &MainWindow::resampleFromResponseTable);
+    productMenu->addSeparator();
+    QAction* bandMathAction = productMenu->addAction("&Выражение по каналам...");
+    connect(bandMathAction, &QAction::triggered, this, &MainWindow::computeBandMath);
+    QAction* pcaAction = productMenu->addAction("&Главные компоненты...");
+    connect(pcaAction, &QAction::triggered, this, &MainWindow::computePrincipalComponents);
+    QAction* mnfAction = productMenu->addAction("Компоненты &MNF...");
+    connect(mnfAction, &QAction::triggered, this, &MainWindow::computeMnfComponents);
+    QAction* denoiseAction = productMenu->addAction("Подавление шума MNF (весь куб)...");
+    connect(denoiseAction, &QAction::triggered, this, &MainWindow::denoiseWithMnf);
+    
+    QMenu* classificationMenu = menuBar()->addMenu("&Классификация");
+    QAction* samPinnedAction = classificationMenu->addAction("SAM по &закреплённым спектрам...");
+    connect(samPinnedAction, &QAction::triggered, this, &MainWindow::classifyByPinnedSpectra);
+    QAction* samLibraryAction = classificationMenu->addAction("SAM по &библиотеке спектров...");
+    connect(samLibraryAction, &QAction::triggered, this, &MainWindow::classifyBySpectralLibrary);
+    samRuleImagesAction = classificationMenu->addAction("&Углы до эталонов как каналы");
+    samRuleImagesAction->setCheckable(true);
+    classificationMenu->addSeparator();
+    QAction* clearClassesAction = classificationMenu->addAction("&Скрыть карту классов");
+    connect(clearClassesAction, &QAction::triggered, this, &MainWindow::clearClassification);
+    
+    QMenu* roiMenu = menuBar()->addMenu("&Область");
+    QActionGroup* roiToolGroup = new QActionGroup(this);
+    const std::pair<const char*, ImageLabel::RoiTool> roiTools[] = {
+        {"&Без выделения", ImageLabel::ROI_NONE},
+        {"&Прямоугольник", ImageLabel::ROI_RECTANGLE},
+        {"&Многоугольник (двойной щелчок замыкает)", ImageLabel::ROI_POLYGON},
+        {"&Произвольный контур", ImageLabel::ROI_FREEHAND},
+    };
+    for (const auto& [title, tool] : roiTools) {
+        QAction* action = roiMenu->addAction(QString::fromUtf8(title));
+        action->setCheckable(true);
+        action->setChecked(tool == ImageLabel::ROI_NONE);
+        roiToolGroup->addAction(action);
+        connect(action, &QAction::triggered, this, [this, tool = tool]() { imageLabel->setRoiTool(tool); });
+    }
+    
+    roiMenu->addSeparator();
+    QAction* clearRoiAction = new QAction("&Сбросить область", this);
+    connect(clearRoiAction, &QAction::triggered, this, &MainWindow::clearRoi);
+    roiMenu->addAction(clearRoiAction);
 }
 
 void MainWindow::setupStatusBar() {
@@ -734,6 +1631,7 @@ void MainWindow::openSpectralInfo() {
     // Сохраняем загруженные данные
     spectralBands = loadedBands;
     hasSpectralData = true;
+    rebuildWavelengthTable();
     
     // Показываем информацию о загруженных данных
     QString infoMsg = QString("Успешно загружено %1 спектральных каналов из файла").arg(loadedBands.size());
@@ -745,7 +1643,11 @@ void MainWindow::openSpectralInfo() {
     }
     
     // Показываем диалог с данными из файла
-    SpectralInfoDialog dialog(loadedBands, this);
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    std::vector<ChannelStatistics::BandStatistics> statistics = hyperspectralImage.getBandStatistics();
+    QApplication::restoreOverrideCursor();
+    
+    SpectralInfoDialog dialog(loadedBands, statistics, this);
     dialog.exec();
 }
 
@@ -755,60 +1657,15 @@ void MainWindow::updateSpectralCurveForMousePosition(int x, int y) {
     currentSpectralX = x;
     currentSpectralY = y;
     
-    // Получаем спектральную характеристику для данной точки одним вызовом
-    std::vector<uint16_t> spectrum = hyperspectralImage.getPixelSpectrum16bit(x, y);
-    if (spectrum.empty()) return;
-    
-    std::vector<SpectralPoint> spectralPoints;
-    spectralPoints.reserve(spectrum.size());
-    
-    QMap<int, SpectralBand> spectralMap;
-    for (const SpectralBand& band : spectralBands) {
-        if (band.bandNumber > 0) {
-            spectralMap[band.bandNumber] = band;
-        }
-    }
-    
-    bool hasSpectralDataLocal = !spectralBands.isEmpty();
-    
-    for (int i = 0; i < static_cast<int>(spectrum.size()); i++) {
-        SpectralPoint point;
-        point.channelIndex = i;
-        point.value16 = spectrum[i];
-        point.value8 = hyperspectralImage.getPixel8bit(i, x, y);
-        
-        // Пытаемся найти спектральные данные для этого канала
-        bool foundSpectralData = false;
-        
-        if (hasSpectralDataLocal) {
-            int channelNum = i + 1;
-            if (spectralMap.contains(channelNum)) {
-                point.wavelength = spectralMap[channelNum].wavelength;
-                point.hasWavelength = (point.wavelength > 0);
-                foundSpectralData = true;
-            }
-            else if (i < spectralBands.size() && spectralBands[i].wavelength > 0) {
-                point.wavelength = spectralBands[i].wavelength;
-                point.hasWavelength = true;
-                foundSpectralData = true;
-            }
-        }
-        
-        if (!foundSpectralData) {
-            point.wavelength = i + 1;
-            point.hasWavelength = false;
-        }
-        
-        spectralPoints.push_back(point);
-    }
+    std::vector<SpectralPoint> spectralPoints = spectralPointsAt(x, y);
+    if (spectralPoints.empty()) return;
     
     // Передаем данные виджету
     spectralCurveWidget->setSpectralData(spectralPoints);
     spectralCurveWidget->setCoordinates(x, y);
     
     // Обновляем заголовок
-    spectralCurveLabel->setText(QString("Спектральная кривая точки (%1, %2)")
-                               .arg(x).arg(y));
+    spectralCurveLabel->setText(spectralCurveTitle(x, y));
 }
 
 void MainWindow::onAddPointClicked() {
@@ -816,96 +1673,156 @@ void MainWindow::onAddPointClicked() {
         return;
     }
     
-    // Получаем спектральные данные для текущей точки
-    std::vector<uint16_t> spectrum = hyperspectralImage.getPixelSpectrum16bit(currentSpectralX, currentSpectralY);
-    if (spectrum.empty()) return;
+    std::vector<SpectralPoint> spectralPoints = spectralPointsAt(currentSpectralX, currentSpectralY);
+    if (spectralPoints.empty()) return;
     
-    std::vector<SpectralPoint> spectralPoints;
-    spectralPoints.reserve(spectrum.size());
+    // Добавляем точку на график
+    QColor color = getNextColor();
+    if (!spectralCurveWidget->addPinnedPoint(currentSpectralX, currentSpectralY, spectralPoints, color,
+                                             probeWindowSpin->value())) {
+        return;
+    }
     
-    QMap<int, SpectralBand> spectralMap;
-    for (const SpectralBand& band : spectralBands) {
-        if (band.bandNumber > 0) {
-            spectralMap[band.bandNumber] = band;
+    // Легенда дополняется, а не строится заново
+    appendLegendItem(spectralCurveWidget->getPinnedSpectra().getGroups().back());
+}
+
+void MainWindow::onPinVisibleAreaClicked() {
+    const int numChannels = hyperspectralImage.getNumChannels();
+    if (numChannels == 0) return;
+    
+    const QRect region = imageLabel->visibleImageRect().intersected(
+        QRect(0, 0, hyperspectralImage.getWidth(), hyperspectralImage.getHeight()));
+    if (region.isEmpty()) return;
+    
+    // Большая область прореживается равномерной сеткой до kMaxAreaSpectra спектров
+    const qint64 area = static_cast<qint64>(region.width()) * region.height();
+    const int step = std::max(1, static_cast<int>(std::ceil(std::sqrt(static_cast<double>(area) / kMaxAreaSpectra))));
+    
+    std::vector<QPoint> positions;
+    for (int y = region.top(); y <= region.bottom(); y += step) {
+        for (int x = region.left(); x <= region.right(); x += step) {
+            positions.emplace_back(x, y);
         }
     }
     
-    bool hasSpectralDataLocal = !spectralBands.isEmpty();
-    
-    for (int i = 0; i < static_cast<int>(spectrum.size()); i++) {
-        SpectralPoint point;
-        point.channelIndex = i;
-        point.value16 = spectrum[i];
-        point.value8 = hyperspectralImage.getPixel8bit(i, currentSpectralX, currentSpectralY);
-        
-        bool foundSpectralData = false;
-        
-        if (hasSpectralDataLocal) {
-            int channelNum = i + 1;
-            if (spectralMap.contains(channelNum)) {
-                point.wavelength = spectralMap[channelNum].wavelength;
-                point.hasWavelength = (point.wavelength > 0);
-                foundSpectralData = true;
-            }
-            else if (i < spectralBands.size() && spectralBands[i].wavelength > 0) {
-                point.wavelength = spectralBands[i].wavelength;
-                point.hasWavelength = true;
-                foundSpectralData = true;
-            }
-        }
-        
-        if (!foundSpectralData) {
-            point.wavelength = i + 1;
-            point.hasWavelength = false;
+    // Без 8-битных значений getPixelSpectrum только читает каналы и безопасен из потоков
+    const bool transformed = probeTransform != SpectralTransform::NONE;
+    std::vector<SampleQuantization> scales(numChannels);
+    for (int i = 0; i < numChannels; i++) scales[i] = hyperspectralImage.getSampleQuantization(i);
+    
+    std::vector<uint16_t> values(positions.size() * numChannels);
+    Parallel::forRange(0, static_cast<int64_t>(positions.size()), 1024, [&](int64_t begin, int64_t end) {
+        SpectralTransform::Workspace workspace;
+        std::vector<double> physical(numChannels);
+        std::vector<double> transformedValues;
+        for (int64_t i = begin; i < end; i++) {
+            uint16_t* codes = values.data() + i * numChannels;
+            hyperspectralImage.getPixelSpectrum(positions[i].x(), positions[i].y(), codes);
+            if (!transformed) continue;
+            for (int c = 0; c < numChannels; c++) physical[c] = scales[c].decode(codes[c]);
+            encodeProbeSpectrum(physical.data(), codes, workspace, transformedValues);
         }
-        
-        spectralPoints.push_back(point);
+    });
+    
+    bool hasWavelength = false;
+    const std::vector<double> wavelengths = plotWavelengths(hasWavelength);
+    
+    QString label = QString::fromUtf8("Область (%1, %2)-(%3, %4): %5 спектров")
+                        .arg(region.left()).arg(region.top())
+                        .arg(region.right()).arg(region.bottom())
+                        .arg(positions.size());
+    if (step > 1) label += QString::fromUtf8(", каждый %1-й пиксель").arg(step);
+    
+    if (!spectralCurveWidget->addPinnedSpectra(label, getNextColor(), wavelengths, hasWavelength, values, positions)) {
+        statusBar->showMessage(QString::fromUtf8("Число каналов не совпадает с уже закреплёнными спектрами"), 3000);
+        return;
+    }
+    appendLegendItem(spectralCurveWidget->getPinnedSpectra().getGroups().back());
+}
+
+std::vector<double> MainWindow::plotWavelengths(bool& hasWavelength) const {
+    const int numChannels = hyperspectralImage.getNumChannels();
+    std::vector<double> wavelengths(numChannels);
+    hasWavelength = true;
+    for (int i = 0; i < numChannels; i++) {
+        const double wavelength = i < static_cast<int>(wavelengthTable.size()) ? wavelengthTable[i] : 0.0;
+        hasWavelength = hasWavelength && wavelength > 0;
+        wavelengths[i] = wavelength > 0 ? wavelength : i + 1;
+    }
+    return wavelengths;
+}
+
+void MainWindow::onRoiSelected(const QPolygonF& polygon) {
+    if (hyperspectralImage.getNumChannels() == 0) return;
+    
+    QElapsedTimer timer;
+    timer.start();
+    roiMask = RoiMask::fromPolygon(polygon, QSize(hyperspectralImage.getWidth(), hyperspectralImage.getHeight()));
+    if (roiMask.isEmpty()) {
+        statusBar->showMessage(QString::fromUtf8("В области нет ни одного пикселя"), 3000);
+        spectralCurveWidget->clearRoiStatistics();
+        return;
     }
     
-    // Добавляем точку на график
-    QColor color = getNextColor();
-    spectralCurveWidget->addPinnedPoint(currentSpectralX, currentSpectralY, spectralPoints, color);
+    showRoiStatistics();
     
-    // Обновляем легенду
-    updateLegend();
+    const QRect bounds = roiMask.getBoundingRect();
+    statusBar->showMessage(QString::fromUtf8("Область: %1 пикселей в (%2, %3)-(%4, %5), статистика за %6 мс")
+                               .arg(roiMask.getPixelCount())
+                               .arg(bounds.left()).arg(bounds.top())
+                               .arg(bounds.right()).arg(bounds.bottom())
+                               .arg(timer.elapsed()));
+}
+
+void MainWindow::showRoiStatistics() {
+    // Статистика считается по исходным кодам и в шкале преобразованного вида не имеет смысла
+    if (roiMask.isEmpty() || probeTransform != SpectralTransform::NONE) {
+        spectralCurveWidget->clearRoiStatistics();
+        return;
+    }
+    
+    const RoiStatistics::Result statistics = hyperspectralImage.getRoiStatistics(roiMask);
+    bool hasWavelength = false;
+    spectralCurveWidget->setRoiStatistics(statistics, plotWavelengths(hasWavelength));
+}
+
+void MainWindow::clearRoi() {
+    roiMask = RoiMask();
+    imageLabel->clearRoi();
+    spectralCurveWidget->clearRoiStatistics();
 }
 
 void MainWindow::onRemovePointClicked() {
     int currentRow = legendWidget->currentRow();
     if (currentRow >= 0) {
-        spectralCurveWidget->removePinnedPoint(currentRow);
-        updateLegend();
+        spectralCurveWidget->removePinnedGroup(currentRow);
+        delete legendWidget->takeItem(currentRow);
     }
 }
 
 void MainWindow::onClearPointsClicked() {
     spectralCurveWidget->clearPinnedPoints();
-    updateLegend();
+    legendWidget->clear();
 }
 
 void MainWindow::onLegendItemDoubleClicked(QListWidgetItem* item) {
     int row = legendWidget->row(item);
     if (row >= 0) {
-        spectralCurveWidget->removePinnedPoint(row);
-        updateLegend();
+        spectralCurveWidget->removePinnedGroup(row);
+        delete legendWidget->takeItem(row);
     }
 }
 
-void MainWindow::updateLegend() {
-    legendWidget->clear();
+void MainWindow::appendLegendItem(const PinnedSpectra::Group& group) {
+    QListWidgetItem* item = new QListWidgetItem(group.label);
     
-    const std::vector<PinnedPoint>& pinnedPoints = spectralCurveWidget->getPinnedPoints();
+    // Создаем иконку с цветом точки
+    QPixmap pixmap(16, 16);
+    pixmap.fill(group.color);
+    item->setIcon(QIcon(pixmap));
     
-    for (const PinnedPoint& point : pinnedPoints) {
-        QListWidgetItem* item = new QListWidgetItem(point.label);
-        
-        // Создаем иконку с цветом точки
-        QPixmap pixmap(16, 16);
-        pixmap.fill(point.color);
-        item->setIcon(QIcon(pixmap));
-        
-        legendWidget->addItem(item);
-    }
+    legendWidget->addItem(item);
 }
 
 QColor MainWindow::getNextColor() {
@@ -924,3 +1841,60 @@ QColor MainWindow::getNextColor() {
     colorIndex++;
     return color;
 }
+
+void MainWindow::showImageProgressive(const HyperspectralImage::RenderSource& source) {
+    // Результаты ранее запущенных шагов с другим поколением отбрасываются
+    renderGeneration++;
+    
+    QSize fullSize(source.width, source.height);
+    qint64 numPixels = static_cast<qint64>(source.width) * source.height;
+    
+    if (!progressiveRenderAction->isChecked() || numPixels < kProgressiveMinPixels) {
+        pendingRenderStep = 0;
+        imageLabel->setImage(HyperspectralImage::renderImage(source, 1), fullSize);
+        return;
+    }
+    
+    imageLabel->setImage(HyperspectralImage::renderImage(source, 8), fullSize);
+    
+    pendingRenderSource = source;
+    pendingRenderStep = 2;
+    
+    // Если фоновый шаг ещё выполняется, следующий запустится по его завершении
+    if (!renderWatcher->isRunning()) {
+        startRenderStep();
+    }
+}
+
+void MainWindow::startRenderStep() {
+    if (pendingRenderStep == 0) return;
+    
+    runningRenderGeneration = renderGeneration;
+    runningRenderStep = pendingRenderStep;
+    
+    HyperspectralImage::RenderSource source = pendingRenderSource;
+    int step = pendingRenderStep;
+    renderWatcher->setFuture(QtConcurrent::run([source, step]() {
+        return HyperspectralImage::renderImage(source, step);
+    }));
+}
+
+void MainWindow::onRenderStepFinished() {
+    if (runningRenderGeneration == renderGeneration) {
+        QImage image = renderWatcher->result();
+        if (!image.isNull()) {
+            imageLabel->setImage(image, QSize(pendingRenderSource.width, pendingRenderSource.height));
+        }
+        pendingRenderStep = runningRenderStep > 1 ? 1 : 0;
+    }
+    
+    startRenderStep();
+}
+
+void MainWindow::cancelProgressiveRender() {
+    // Фоновый шаг читает 16-битные данные изображения напрямую,
+    // поэтому перед их заменой нужно дождаться его завершения
+    renderGeneration++;
+    pendingRenderStep = 0;
+    renderWatcher->waitForFinished();
+}
@@ -11,8 +11,14 @@
 #include <QMenu>
 #include <QFrame>
 #include <QPushButton>
+#include <QSpinBox>
 #include <QSplitter>
 #include <QListWidget>
+#include <QFutureWatcher>
+#include <QTimer>
+#include <QImage>
+#include <QList>
+#include <functional>
 #include "image_label.h"
 #include "histogram_widget.h"
 #include "hyperspectral_image.h"
@@ -24,6 +30,7 @@ class MainWindow : public QMainWindow {
 
 public:
     MainWindow(QWidget* parent = nullptr);
+    ~MainWindow();
 
 private slots:
     void openFile();
@@ -31,19 +38,32 @@ private slots:
     void updateHistogram();
     void openRGBSettings();
     void displayRGBImage();
+    void displayTrueColorImage();
     void openContrastDialog();
     void onContrastChanged();
     void closeImage();
     void onMousePosition(int x, int y);
+    void processMouseProbe();
     void onHistogramChannelChanged();
     void openSpectralInfo();
     void autoContrast();
     void showSpectralCurve(int x, int y);
     void updateSpectralCurve();
     void onAddPointClicked();
+    void onPinVisibleAreaClicked();
     void onRemovePointClicked();
     void onClearPointsClicked();
     void onLegendItemDoubleClicked(QListWidgetItem* item);
+    void onRenderStepFinished();
+    void onColormapChanged(int index);
+    void onViewportChanged();
+    void autoContrastVisibleArea();
+    void openScatterPlot();
+    void openCorrelationMatrix();
+    void onRoiSelected(const QPolygonF& polygon);
+    void clearRoi();
+    void clearClassification();
+    void onSpectralViewChanged(int index);
 
 private:
     void setupUI();
@@ -52,12 +72,57 @@ private:
     void loadSpectralData(const QString& tiffFilePath);
     void applyAutoContrast();
     void updateSpectralCurveForMousePosition(int x, int y);
-    void updateLegend();
+    void appendLegendItem(const PinnedSpectra::Group& group);
     QColor getNextColor();
+    void showImageProgressive(const HyperspectralImage::RenderSource& source);
+    void startRenderStep();
+    void cancelProgressiveRender();
+    // Долгое вычисление в пуле потоков; done вызывается в потоке интерфейса, если за это
+    // время не открыт другой файл. job читает данные изображения только через снимки
+    template <typename Result>
+    void runInBackground(std::function<Result()> job, std::function<void(const Result&)> done);
+    // Перед заменой данных изображения: дождаться фоновых вычислений и отбросить их результаты
+    void cancelBackgroundJobs();
+    // Длина волны каждого канала, 0 - неизвестна
+    const std::vector<double>& channelWavelengths() const { return wavelengthTable; }
+    void rebuildWavelengthTable();
+    std::vector<SpectralPoint> spectralPointsAt(int x, int y);
+    QString spectralCurveTitle(int x, int y) const;
+    // Ось графика: длины волн каналов или их номера, если длины известны не у всех
+    std::vector<double> plotWavelengths(bool& hasWavelength) const;
+    // Ось для преобразований спектра: длины волн, если известны у всех каналов, иначе номера
+    std::vector<double> transformWavelengths() const;
+    // Сетка и шкала кодов вида спектра; шкала производной - по разреженной сетке пикселей
+    void updateProbeTransform();
+    // Спектр в исходных единицах -> вид probeTransform в кодах probeScale. Безопасно из потоков
+    void encodeProbeSpectrum(const double* physical, uint16_t* codes, SpectralTransform::Workspace& workspace,
+                             std::vector<double>& transformed) const;
+    void showRoiStatistics();
+    // Закреплённые спектры заново из куба по их позициям - в текущем виде кривой
+    void reloadPinnedSpectra();
+    void computeCubeProduct(SpectralTransform::Type type);
+    // Пересчёт в каналы другого датчика; нужны длины волн всех каналов
+    void computeResampledBands(const QString& sensorName, const std::vector<SpectralResampler::TargetBand>& targets);
+    void resampleFromResponseTable();
+    void computeBandMath();
+    // Базис считается сразу, компоненты - виртуальные каналы
+    void computePrincipalComponents();
+    void computeMnfComponents();
+    // Базис MNF считается сразу, куб по первым компонентам - виртуальные каналы
+    void denoiseWithMnf();
+    // Эталоны SAM: средние спектры групп на графике или столбцы таблицы
+    void classifyByPinnedSpectra();
+    void classifyBySpectralLibrary();
+    // Считается в фоне. Карта классов - слой поверх изображения и производный канал,
+    // углы до эталонов - производные каналы, только если включены в меню
+    void classifySpectralAngle(const QStringList& names, const std::vector<QRgb>& colors,
+                               const std::vector<std::vector<double>>& references);
+    HyperspectralImage::HistogramPtr histogramForView(int channelIndex) const;
 
     ImageLabel* imageLabel;
     QScrollArea* scrollArea;
     QComboBox* channelSelector;
+    QComboBox* colormapSelector;
     QComboBox* histogramChannelSelector;
     QStatusBar* statusBar;
     HistogramWidget* histogramWidget;
@@ -71,16 +136,42 @@ private:
     
     QListWidget* legendWidget;
     QPushButton* addPointButton;
+    QPushButton* pinAreaButton;
+    QSpinBox* probeWindowSpin;
+    QComboBox* spectralViewSelector;
     QPushButton* removePointButton;
     QPushButton* clearPointsButton;
     int colorIndex;
     
+    // Палитра псевдоцвета для одноканального режима
+    Colormap::Type currentColormap = Colormap::GRAYSCALE;
+    
     // RGB режим
     bool isRGBMode = false;
     int currentRedChannel = 0;
     int currentGreenChannel = 0;
     int currentBlueChannel = 0;
     
+    // Синтез истинного цвета из всех каналов видимого диапазона
+    bool isCompositeMode = false;
+    QImage compositeImage;
+    
+    // Прогрессивная отрисовка: превью 1/8, затем 1/2 и полное разрешение в фоне
+    QFutureWatcher<QImage>* renderWatcher;
+    HyperspectralImage::RenderSource pendingRenderSource;
+    QAction* progressiveRenderAction;
+    int renderGeneration = 0;
+    int pendingRenderStep = 0;
+    int runningRenderGeneration = -1;
+    int runningRenderStep = 0;
+    
+    // Фоновые вычисления по кубу; результаты с другим поколением изображения отбрасываются
+    QList<QFutureWatcherBase*> backgroundJobs;
+    int imageGeneration = 0;
+    
+    // Гистограмма только видимой части изображения, обновляется при прокрутке
+    QAction* viewportHistogramAction = nullptr;
+    
     // Статусная информация
     QLabel* pixelInfoLabel;
     QLabel* coordinatesLabel;
@@ -88,6 +179,35 @@ private:
     // Спектральная информация
     QVector<SpectralBand> spectralBands;
     bool hasSpectralData = false;
+    // Строится один раз при смене файла или описания каналов, а не на каждое движение мыши
+    std::vector<double> wavelengthTable;
+    // Ширина канала на половине высоты из описания, 0 - неизвестна
+    std::vector<double> bandwidthTable;
+    QString lastBandMathExpression;
+    double lastSamAngle = 0.1;
+    // Углы до эталонов - по 2 байта на пиксель на каждый эталон, поэтому по запросу
+    QAction* samRuleImagesAction = nullptr;
+    // Карта классов SAM; возвращается на изображение после временных слоёв
+    QImage classOverlay;
+    
+    // Движения мыши сливаются: обрабатывается последнее положение не чаще раза за кадр экрана
+    QTimer* probeTimer;
+    QPoint pendingProbePosition;
+    std::vector<uint16_t> probeValues16;
+    std::vector<uint8_t> probeValues8;
+    std::vector<double> probeMean;
+    std::vector<double> probeStdDev;
+    
+    // Вид кривой под курсором: исходный спектр, континуум удалён или производные
+    SpectralTransform::Type probeTransform = SpectralTransform::NONE;
+    SpectralTransform::Grid probeGrid;
+    SampleQuantization probeScale;
+    SpectralTransform::Workspace probeWorkspace;
+    std::vector<double> probePhysical;
+    std::vector<double> probeTransformed;
+    
+    // Последняя нарисованная область интереса
+    RoiMask roiMask;
     
     // Текущая точка для спектральной кривой
     int currentSpectralX = -1;
@@ -0,0 +1,109 @@
+#include "mnf_transform.h"
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+
+namespace {
+
+// Собственные значения шума ниже этой доли наибольшего поднимаются до неё:
+// канал без шума (константный или насыщенный) не должен давать деления на ноль
+const double kNoiseFloor = 1e-9;
+
+} // namespace
+
+PcaTransform::Basis MnfTransform::compute(const SpectralCovariance::Result& covariance,
+                                          const SpectralCovariance::Result& shiftDifference,
+                                          const std::vector<SampleQuantization>& quantization, int maxComponents) {
+    PcaTransform::Basis basis;
+    const int n = covariance.numBands;
+    if (covariance.isEmpty() || shiftDifference.isEmpty() || n == 0 || shiftDifference.numBands != n ||
+        quantization.size() != static_cast<size_t>(n)) {
+        return basis;
+    }
+    auto at = [n](std::vector<double>& matrix, int row, int column) -> double& {
+        return matrix[static_cast<size_t>(row) * n + column];
+    };
+
+    // Ковариации сигнала и шума в исходных единицах
+    std::vector<double> signal(static_cast<size_t>(n) * n);
+    std::vector<double> noise(static_cast<size_t>(n) * n);
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            const double scale = quantization[i].scale * quantization[j].scale;
+            at(signal, i, j) = covariance.at(i, j) * scale;
+            at(noise, i, j) = 0.5 * shiftDifference.at(i, j) * scale;
+        }
+    }
+
+    // Выбеливание шума: W = Λ^-1/2 U^T, строка k - u_k / sqrt(λ_k)
+    std::vector<double> noiseValues;
+    std::vector<double> noiseVectors;
+    PcaTransform::eigenDecompose(n, noise, noiseValues, noiseVectors);
+    if (noiseValues[0] <= 0) return basis;
+
+    std::vector<double> noiseScale(n);
+    std::vector<double> whitening(static_cast<size_t>(n) * n);
+    for (int k = 0; k < n; k++) {
+        noiseScale[k] = std::sqrt(std::max(noiseValues[k], kNoiseFloor * noiseValues[0]));
+        for (int i = 0; i < n; i++) at(whitening, k, i) = at(noiseVectors, k, i) / noiseScale[k];
+    }
+
+    // Ковариация сигнала в выбеленных координатах: W C W^T
+    std::vector<double> product(static_cast<size_t>(n) * n, 0.0);
+    for (int k = 0; k < n; k++) {
+        double* row = product.data() + static_cast<size_t>(k) * n;
+        for (int i = 0; i < n; i++) {
+            const double weight = at(whitening, k, i);
+            const double* source = signal.data() + static_cast<size_t>(i) * n;
+            for (int j = 0; j < n; j++) row[j] += weight * source[j];
+        }
+    }
+    std::vector<double> whitened(static_cast<size_t>(n) * n);
+    for (int k = 0; k < n; k++) {
+        for (int l = k; l < n; l++) {
+            const double* a = product.data() + static_cast<size_t>(k) * n;
+            const double* b = whitening.data() + static_cast<size_t>(l) * n;
+            const double value = std::inner_product(a, a + n, b, 0.0);
+            at(whitened, k, l) = value;
+            at(whitened, l, k) = value;
+        }
+    }
+
+    // Вторая PCA: собственные значения - дисперсия в единицах шума
+    std::vector<double> values;
+    std::vector<double> vectors;
+    PcaTransform::eigenDecompose(n, whitened, values, vectors);
+
+    const int numComponents = std::clamp(maxComponents, 0, n);
+    basis.numBands = n;
+    basis.mean.resize(n);
+    for (int i = 0; i < n; i++) basis.mean[i] = quantization[i].decode(covariance.mean[i]);
+    basis.totalVariance = std::accumulate(values.begin(), values.end(), 0.0);
+    basis.variance.resize(numComponents);
+    basis.components.assign(static_cast<size_t>(numComponents) * n, 0.0);
+    basis.inverse.assign(static_cast<size_t>(n) * numComponents, 0.0);
+
+    // Прямая строка a_k = v_k W, обратный столбец b_k = W^-1 v_k = U Λ^1/2 v_k
+    std::vector<double> restore(n);
+    for (int k = 0; k < numComponents; k++) {
+        basis.variance[k] = std::max(0.0, values[k]);
+        double* forward = basis.components.data() + static_cast<size_t>(k) * n;
+        std::fill(restore.begin(), restore.end(), 0.0);
+        for (int j = 0; j < n; j++) {
+            const double weight = at(vectors, k, j);
+            const double* whiteRow = whitening.data() + static_cast<size_t>(j) * n;
+            const double* noiseRow = noiseVectors.data() + static_cast<size_t>(j) * n;
+            for (int i = 0; i < n; i++) {
+                forward[i] += weight * whiteRow[i];
+                restore[i] += weight * noiseScale[j] * noiseRow[i];
+            }
+        }
+
+        const double sign = std::accumulate(forward, forward + n, 0.0) < 0 ? -1.0 : 1.0;
+        for (int i = 0; i < n; i++) {
+            forward[i] *= sign;
+            basis.inverse[static_cast<size_t>(i) * numComponents + k] = sign * restore[i];
+        }
+    }
+    return basis;
+}
@@ -0,0 +1,21 @@
+#ifndef MNF_TRANSFORM_H
+#define MNF_TRANSFORM_H
+
+#include <vector>
+#include "pca_transform.h"
+
+// Minimum Noise Fraction: главные компоненты после выбеливания шума. Компоненты
+// упорядочены по отношению сигнал/шум, а не по дисперсии, поэтому шумные каналы
+// (например, SWIR) не вытесняют слабый, но чистый сигнал
+class MnfTransform {
+public:
+    // covariance - ковариация кодов, shiftDifference - ковариация разностей соседних
+    // пикселей (SpectralCovariance::computeShiftDifference), шум - её половина.
+    // Дисперсия компоненты в Basis - в единицах дисперсии шума (1 - чистый шум).
+    // inverse заполнен: reconstruct по первым компонентам подавляет шум
+    static PcaTransform::Basis compute(const SpectralCovariance::Result& covariance,
+                                       const SpectralCovariance::Result& shiftDifference,
+                                       const std::vector<SampleQuantization>& quantization, int maxComponents);
+};
+
+#endif
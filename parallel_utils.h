@@ -0,0 +1,43 @@
+#ifndef PARALLEL_UTILS_H
+#define PARALLEL_UTILS_H
+
+#include <QtConcurrent>
+#include <QThread>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cstdint>
+
+namespace Parallel {
+
+inline int threadCount() {
+    return std::max(1, QThread::idealThreadCount());
+}
+
+// Делит диапазон [begin, end) на блоки по grainSize элементов и обрабатывает их
+// в глобальном пуле потоков Qt. func вызывается как func(blockBegin, blockEnd).
+template <typename Func>
+void forRange(int64_t begin, int64_t end, int64_t grainSize, Func func) {
+    if (end <= begin) return;
+    grainSize = std::max<int64_t>(1, grainSize);
+
+    int64_t numBlocks = (end - begin + grainSize - 1) / grainSize;
+    if (numBlocks == 1 || threadCount() == 1) {
+        func(begin, end);
+        return;
+    }
+
+    std::vector<std::pair<int64_t, int64_t>> blocks;
+    blocks.reserve(static_cast<size_t>(numBlocks));
+    for (int64_t blockBegin = begin; blockBegin < end; blockBegin += grainSize) {
+        blocks.emplace_back(blockBegin, std::min(end, blockBegin + grainSize));
+    }
+
+    QtConcurrent::blockingMap(blocks, [&func](const std::pair<int64_t, int64_t>& block) {
+        func(block.first, block.second);
+    });
+}
+
+} // namespace Parallel
+
+#endif
@@ -0,0 +1,395 @@
+#include "pca_transform.h"
+#include "parallel_utils.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <cmath>
+
+namespace {
+
+// Аккумуляторы блока - по 8 КБ double на компоненту
+const size_t kBlockPixels = 1024;
+
+// Редукция Хаусхолдера: v - матрица n x n по строкам, на выходе d - диагональ,
+// e - поддиагональ, v - накопленное ортогональное преобразование
+void tridiagonalize(int n, std::vector<double>& v, std::vector<double>& d, std::vector<double>& e) {
+    auto at = [&v, n](int row, int column) -> double& { return v[static_cast<size_t>(row) * n + column]; };
+
+    for (int j = 0; j < n; j++) d[j] = at(n - 1, j);
+
+    for (int i = n - 1; i > 0; i--) {
+        double scale = 0.0;
+        double h = 0.0;
+        for (int k = 0; k < i; k++) scale += std::fabs(d[k]);
+
+        if (scale == 0.0) {
+            e[i] = d[i - 1];
+            for (int j = 0; j < i; j++) {
+                d[j] = at(i - 1, j);
+                at(i, j) = 0.0;
+                at(j, i) = 0.0;
+            }
+        } else {
+            for (int k = 0; k < i; k++) {
+                d[k] /= scale;
+                h += d[k] * d[k];
+            }
+            double f = d[i - 1];
+            double g = f > 0 ? -std::sqrt(h) : std::sqrt(h);
+            e[i] = scale * g;
+            h -= f * g;
+            d[i - 1] = f - g;
+            for (int j = 0; j < i; j++) e[j] = 0.0;
+
+            for (int j = 0; j < i; j++) {
+                f = d[j];
+                at(j, i) = f;
+                g = e[j] + at(j, j) * f;
+                for (int k = j + 1; k <= i - 1; k++) {
+                    g += at(k, j) * d[k];
+                    e[k] += at(k, j) * f;
+                }
+                e[j] = g;
+            }
+            f = 0.0;
+            for (int j = 0; j < i; j++) {
+                e[j] /= h;
+                f += e[j] * d[j];
+            }
+            const double hh = f / (h + h);
+            for (int j = 0; j < i; j++) e[j] -= hh * d[j];
+            for (int j = 0; j < i; j++) {
+                f = d[j];
+                g = e[j];
+                for (int k = j; k <= i - 1; k++) at(k, j) -= f * e[k] + g * d[k];
+                d[j] = at(i - 1, j);
+                at(i, j) = 0.0;
+            }
+        }
+        d[i] = h;
+    }
+
+    // Накопление преобразований
+    for (int i = 0; i < n - 1; i++) {
+        at(n - 1, i) = at(i, i);
+        at(i, i) = 1.0;
+        const double h = d[i + 1];
+        if (h != 0.0) {
+            for (int k = 0; k <= i; k++) d[k] = at(k, i + 1) / h;
+            for (int j = 0; j <= i; j++) {
+                double g = 0.0;
+                for (int k = 0; k <= i; k++) g += at(k, i + 1) * at(k, j);
+                for (int k = 0; k <= i; k++) at(k, j) -= g * d[k];
+            }
+        }
+        for (int k = 0; k <= i; k++) at(k, i + 1) = 0.0;
+    }
+    for (int j = 0; j < n; j++) {
+        d[j] = at(n - 1, j);
+        at(n - 1, j) = 0.0;
+    }
+    at(n - 1, n - 1) = 1.0;
+    e[0] = 0.0;
+}
+
+// Неявный QL со сдвигами для трёхдиагональной матрицы; столбцы v становятся собственными векторами
+void diagonalize(int n, std::vector<double>& v, std::vector<double>& d, std::vector<double>& e) {
+    auto at = [&v, n](int row, int column) -> double& { return v[static_cast<size_t>(row) * n + column]; };
+
+    for (int i = 1; i < n; i++) e[i - 1] = e[i];
+    e[n - 1] = 0.0;
+
+    double f = 0.0;
+    double norm = 0.0;
+    const double eps = std::numeric_limits<double>::epsilon();
+    for (int l = 0; l < n; l++) {
+        norm = std::max(norm, std::fabs(d[l]) + std::fabs(e[l]));
+        int m = l;
+        while (m < n - 1 && std::fabs(e[m]) > eps * norm) m++;
+
+        if (m > l) {
+            do {
+                double g = d[l];
+                double p = (d[l + 1] - g) / (2.0 * e[l]);
+                double r = std::hypot(p, 1.0);
+                if (p < 0) r = -r;
+                d[l] = e[l] / (p + r);
+                d[l + 1] = e[l] * (p + r);
+                const double dl1 = d[l + 1];
+                double h = g - d[l];
+                for (int i = l + 2; i < n; i++) d[i] -= h;
+                f += h;
+
+                p = d[m];
+                double c = 1.0;
+                double c2 = c;
+                double c3 = c;
+                const double el1 = e[l + 1];
+                double s = 0.0;
+                double s2 = 0.0;
+                for (int i = m - 1; i >= l; i--) {
+                    c3 = c2;
+                    c2 = c;
+                    s2 = s;
+                    g = c * e[i];
+                    h = c * p;
+                    r = std::hypot(p, e[i]);
+                    e[i + 1] = s * r;
+                    s = e[i] / r;
+                    c = p / r;
+                    p = c * d[i] - s * g;
+                    d[i + 1] = h + s * (c * g + s * d[i]);
+                    for (int k = 0; k < n; k++) {
+                        h = at(k, i + 1);
+                        at(k, i + 1) = s * at(k, i) + c * h;
+                        at(k, i) = c * at(k, i) - s * h;
+                    }
+                }
+                p = -s * s2 * c3 * el1 * e[l] / dl1;
+                e[l] = s * p;
+                d[l] = c * p;
+            } while (std::fabs(e[l]) > eps * norm);
+        }
+        d[l] += f;
+        e[l] = 0.0;
+    }
+}
+
+// Компоненты блока пикселей [begin, begin + count): accumulator[c * kBlockPixels + p].
+// Канал читается один раз и добавляется во все компоненты
+void projectBlock(const std::vector<double>& weights, const std::vector<double>& constant,
+                  const std::vector<const uint16_t*>& bands, size_t begin, size_t count, double* accumulator) {
+    const int numOutputs = static_cast<int>(constant.size());
+    const int numBands = static_cast<int>(bands.size());
+    for (int c = 0; c < numOutputs; c++) {
+        std::fill_n(accumulator + static_cast<size_t>(c) * kBlockPixels, count, constant[c]);
+    }
+    for (int b = 0; b < numBands; b++) {
+        const uint16_t* source = bands[b] + begin;
+        const double* bandWeights = weights.data() + static_cast<size_t>(b) * numOutputs;
+        for (int c = 0; c < numOutputs; c++) {
+            const double weight = bandWeights[c];
+            double* sum = accumulator + static_cast<size_t>(c) * kBlockPixels;
+            for (size_t p = 0; p < count; p++) sum[p] += weight * source[p];
+        }
+    }
+}
+
+// Веса по кодам: w·(offset + scale·code - mean) = (w·scale)·code + w·(offset - mean).
+// weights - numBands x components.size()
+void codeWeights(const PcaTransform::Basis& basis, const std::vector<int>& components,
+                 const std::vector<SampleQuantization>& quantization, std::vector<double>& weights,
+                 std::vector<double>& constant) {
+    const int numBands = basis.numBands;
+    const int numOutputs = static_cast<int>(components.size());
+    weights.assign(static_cast<size_t>(numOutputs) * numBands, 0.0);
+    constant.assign(numOutputs, 0.0);
+    for (int c = 0; c < numOutputs; c++) {
+        const double* row = basis.component(components[c]);
+        for (int b = 0; b < numBands; b++) {
+            weights[static_cast<size_t>(b) * numOutputs + c] = row[b] * quantization[b].scale;
+            constant[c] += row[b] * (quantization[b].offset - basis.mean[b]);
+        }
+    }
+}
+
+} // namespace
+
+void PcaTransform::eigenDecompose(int n, const std::vector<double>& matrix, std::vector<double>& values,
+                                  std::vector<double>& vectors) {
+    values.assign(n, 0.0);
+    vectors.assign(static_cast<size_t>(n) * n, 0.0);
+    if (n <= 0 || matrix.size() != static_cast<size_t>(n) * n) return;
+
+    std::vector<double> v = matrix;
+    std::vector<double> d(n);
+    std::vector<double> e(n);
+    tridiagonalize(n, v, d, e);
+    diagonalize(n, v, d, e);
+
+    std::vector<int> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&d](int a, int b) { return d[a] > d[b]; });
+    for (int k = 0; k < n; k++) {
+        values[k] = d[order[k]];
+        double* row = vectors.data() + static_cast<size_t>(k) * n;
+        for (int i = 0; i < n; i++) row[i] = v[static_cast<size_t>(i) * n + order[k]];
+    }
+}
+
+PcaTransform::Basis PcaTransform::compute(const SpectralCovariance::Result& covariance,
+                                          const std::vector<SampleQuantization>& quantization, int maxComponents) {
+    Basis basis;
+    const int n = covariance.numBands;
+    if (covariance.isEmpty() || n == 0 || quantization.size() != static_cast<size_t>(n)) return basis;
+
+    // Ковариация кодов -> ковариация исходных значений: масштаб каналов входит множителями
+    std::vector<double> matrix(static_cast<size_t>(n) * n);
+    basis.numBands = n;
+    basis.mean.resize(n);
+    for (int i = 0; i < n; i++) {
+        basis.mean[i] = quantization[i].decode(covariance.mean[i]);
+        for (int j = 0; j < n; j++) {
+            matrix[static_cast<size_t>(i) * n + j] = covariance.at(i, j) * quantization[i].scale * quantization[j].scale;
+        }
+        basis.totalVariance += matrix[static_cast<size_t>(i) * n + i];
+    }
+
+    std::vector<double> values;
+    std::vector<double> vectors;
+    eigenDecompose(n, matrix, values, vectors);
+
+    const int numComponents = std::clamp(maxComponents, 0, n);
+    basis.variance.assign(values.begin(), values.begin() + numComponents);
+    basis.components.assign(vectors.begin(), vectors.begin() + static_cast<size_t>(numComponents) * n);
+    for (int k = 0; k < numComponents; k++) {
+        basis.variance[k] = std::max(0.0, basis.variance[k]);
+        double* row = basis.components.data() + static_cast<size_t>(k) * n;
+        if (std::accumulate(row, row + n, 0.0) < 0) {
+            for (int i = 0; i < n; i++) row[i] = -row[i];
+        }
+    }
+
+    // Базис ортонормирован: обратное преобразование - транспонирование
+    basis.inverse.resize(static_cast<size_t>(n) * numComponents);
+    for (int i = 0; i < n; i++) {
+        for (int k = 0; k < numComponents; k++) {
+            basis.inverse[static_cast<size_t>(i) * numComponents + k] = basis.component(k)[i];
+        }
+    }
+    return basis;
+}
+
+SpectralTransform::CubeProduct PcaTransform::project(const Basis& basis, const std::vector<int>& components,
+                                                     const std::vector<const uint16_t*>& bands,
+                                                     const std::vector<SampleQuantization>& quantization,
+                                                     size_t numPixels) {
+    SpectralTransform::CubeProduct product;
+    const int numBands = basis.numBands;
+    const int numOutputs = static_cast<int>(components.size());
+    if (numOutputs == 0 || numPixels == 0 || static_cast<int>(bands.size()) != numBands ||
+        quantization.size() != bands.size()) {
+        return product;
+    }
+    for (int component : components) {
+        if (component < 0 || component >= basis.numComponents()) return product;
+    }
+
+    std::vector<double> weights;
+    std::vector<double> constant;
+    codeWeights(basis, components, quantization, weights, constant);
+
+    // Диапазон компоненты известен только после проекции: первый проход находит его,
+    // второй проецирует блоки заново и сразу кодирует - промежуточный куб не хранится
+    std::vector<double> minimum(numOutputs, std::numeric_limits<double>::max());
+    std::vector<double> maximum(numOutputs, std::numeric_limits<double>::lowest());
+    QMutex mutex;
+
+    const int64_t numBlocks = static_cast<int64_t>((numPixels + kBlockPixels - 1) / kBlockPixels);
+    const int64_t grainSize = std::max<int64_t>(1, numBlocks / (4 * Parallel::threadCount()));
+    Parallel::forRange(0, numBlocks, grainSize, [&](int64_t blockBegin, int64_t blockEnd) {
+        std::vector<double> accumulator(static_cast<size_t>(numOutputs) * kBlockPixels);
+        std::vector<double> localMin(numOutputs, std::numeric_limits<double>::max());
+        std::vector<double> localMax(numOutputs, std::numeric_limits<double>::lowest());
+
+        for (int64_t blockIndex = blockBegin; blockIndex < blockEnd; blockIndex++) {
+            const size_t begin = static_cast<size_t>(blockIndex) * kBlockPixels;
+            const size_t count = std::min(kBlockPixels, numPixels - begin);
+            projectBlock(weights, constant, bands, begin, count, accumulator.data());
+            for (int c = 0; c < numOutputs; c++) {
+                const double* sum = accumulator.data() + static_cast<size_t>(c) * kBlockPixels;
+                const auto [low, high] = std::minmax_element(sum, sum + count);
+                localMin[c] = std::min(localMin[c], *low);
+                localMax[c] = std::max(localMax[c], *high);
+            }
+        }
+
+        QMutexLocker locker(&mutex);
+        for (int c = 0; c < numOutputs; c++) {
+            minimum[c] = std::min(minimum[c], localMin[c]);
+            maximum[c] = std::max(maximum[c], localMax[c]);
+        }
+    });
+
+    product.bands.assign(numOutputs, std::vector<uint16_t>(numPixels));
+    product.quantization.assign(numOutputs, SampleQuantization{});
+    for (int c = 0; c < numOutputs; c++) {
+        SampleQuantization& scale = product.quantization[c];
+        scale.offset = minimum[c];
+        scale.scale = maximum[c] > minimum[c] ? (maximum[c] - minimum[c]) / 65535.0 : 1.0;
+    }
+
+    Parallel::forRange(0, numBlocks, grainSize, [&](int64_t blockBegin, int64_t blockEnd) {
+        std::vector<double> accumulator(static_cast<size_t>(numOutputs) * kBlockPixels);
+
+        for (int64_t blockIndex = blockBegin; blockIndex < blockEnd; blockIndex++) {
+            const size_t begin = static_cast<size_t>(blockIndex) * kBlockPixels;
+            const size_t count = std::min(kBlockPixels, numPixels - begin);
+            projectBlock(weights, constant, bands, begin, count, accumulator.data());
+            for (int c = 0; c < numOutputs; c++) {
+                const double* sum = accumulator.data() + static_cast<size_t>(c) * kBlockPixels;
+                uint16_t* codes = product.bands[c].data() + begin;
+                const SampleQuantization& scale = product.quantization[c];
+                for (size_t p = 0; p < count; p++) codes[p] = scale.encode(sum[p]);
+            }
+        }
+    });
+    return product;
+}
+
+SpectralTransform::CubeProduct PcaTransform::reconstruct(const Basis& basis, int numComponents,
+                                                         const std::vector<int>& outputs,
+                                                         const std::vector<const uint16_t*>& bands,
+                                                         const std::vector<SampleQuantization>& quantization,
+                                                         size_t numPixels) {
+    SpectralTransform::CubeProduct product;
+    const int numBands = basis.numBands;
+    const int stride = basis.numComponents();
+    if (numComponents <= 0 || numComponents > stride || numPixels == 0 || static_cast<int>(bands.size()) != numBands ||
+        quantization.size() != bands.size() || basis.inverse.size() != static_cast<size_t>(numBands) * stride) {
+        return product;
+    }
+    for (int band : outputs) {
+        if (band < 0 || band >= numBands) return product;
+    }
+
+    std::vector<int> components(numComponents);
+    std::iota(components.begin(), components.end(), 0);
+    std::vector<double> weights;
+    std::vector<double> constant;
+    codeWeights(basis, components, quantization, weights, constant);
+
+    product.bands.assign(outputs.size(), std::vector<uint16_t>(numPixels));
+    for (int band : outputs) product.quantization.push_back(quantization[band]);
+
+    const int64_t numBlocks = static_cast<int64_t>((numPixels + kBlockPixels - 1) / kBlockPixels);
+    const int64_t grainSize = std::max<int64_t>(1, numBlocks / (4 * Parallel::threadCount()));
+    Parallel::forRange(0, numBlocks, grainSize, [&](int64_t blockBegin, int64_t blockEnd) {
+        std::vector<double> accumulator(static_cast<size_t>(numComponents) * kBlockPixels);
+        std::vector<double> restored(kBlockPixels);
+
+        for (int64_t blockIndex = blockBegin; blockIndex < blockEnd; blockIndex++) {
+            const size_t begin = static_cast<size_t>(blockIndex) * kBlockPixels;
+            const size_t count = std::min(kBlockPixels, numPixels - begin);
+            projectBlock(weights, constant, bands, begin, count, accumulator.data());
+
+            // Канал b блока = mean_b + сумма компонент с весами строки b обратной матрицы
+            for (size_t i = 0; i < outputs.size(); i++) {
+                const int b = outputs[i];
+                std::fill_n(restored.data(), count, basis.mean[b]);
+                const double* row = basis.inverse.data() + static_cast<size_t>(b) * stride;
+                for (int k = 0; k < numComponents; k++) {
+                    const double weight = row[k];
+                    const double* component = accumulator.data() + static_cast<size_t>(k) * kBlockPixels;
+                    for (size_t p = 0; p < count; p++) restored[p] += weight * component[p];
+                }
+                uint16_t* target = product.bands[i].data() + begin;
+                const SampleQuantization& scale = quantization[b];
+                for (size_t p = 0; p < count; p++) target[p] = scale.encode(restored[p]);
+            }
+        }
+    });
+    return product;
+}
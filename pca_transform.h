@@ -0,0 +1,58 @@
+#ifndef PCA_TRANSFORM_H
+#define PCA_TRANSFORM_H
+
+#include <vector>
+#include <cstdint>
+#include "spectral_covariance.h"
+#include "spectral_transform.h"
+
+// Главные компоненты куба: собственные векторы межканальной ковариации.
+// Ковариация считается один раз (SpectralCovariance), а компоненты проецируются
+// по запросу - куб не переписывается целиком в новый базис. Basis и проекция
+// общие для линейных преобразований спектра (см. MnfTransform)
+class PcaTransform {
+public:
+    // Линейный базис в исходных единицах: компонента k = components[k] · (x - mean)
+    struct Basis {
+        int numBands = 0;
+        std::vector<double> mean;
+        std::vector<double> variance;    // дисперсия вдоль каждой компоненты, по убыванию
+        std::vector<double> components;  // numComponents() x numBands по строкам
+        std::vector<double> inverse;     // numBands x numComponents(): столбец k возвращает компоненту в каналы
+        double totalVariance = 0.0;      // сумма дисперсий всех каналов
+
+        int numComponents() const { return static_cast<int>(variance.size()); }
+        const double* component(int k) const { return components.data() + static_cast<size_t>(k) * numBands; }
+        bool isEmpty() const { return variance.empty(); }
+    };
+
+    // Собственные значения и векторы симметричной матрицы n x n (по строкам):
+    // редукция Хаусхолдера к трёхдиагональной форме и неявный QL. values - по убыванию,
+    // vectors - n x n, строка k - вектор для values[k]
+    static void eigenDecompose(int n, const std::vector<double>& matrix, std::vector<double>& values,
+                               std::vector<double>& vectors);
+
+    // covariance - по 16-битным кодам; quantization переводит её в исходные единицы.
+    // Знак компоненты выбирается так, чтобы сумма весов была неотрицательной
+    static Basis compute(const SpectralCovariance::Result& covariance,
+                         const std::vector<SampleQuantization>& quantization, int maxComponents);
+
+    // Проекция сразу на несколько компонент: блок пикселей читает каждый канал один раз
+    // и добавляет его во все компоненты. Каждая компонента кодируется по своему диапазону:
+    // первый проход по кубу ищет диапазон, второй кодирует, так что память - только результат
+    static SpectralTransform::CubeProduct project(const Basis& basis, const std::vector<int>& components,
+                                                  const std::vector<const uint16_t*>& bands,
+                                                  const std::vector<SampleQuantization>& quantization,
+                                                  size_t numPixels);
+
+    // Обратное преобразование по первым numComponents компонентам: x' = mean + inverse · y.
+    // Отброшенные компоненты не возвращаются - для MNF это подавление шума. outputs - какие
+    // каналы восстановить; они кодируются в шкалах исходных, блоки пикселей - в пуле потоков
+    static SpectralTransform::CubeProduct reconstruct(const Basis& basis, int numComponents,
+                                                      const std::vector<int>& outputs,
+                                                      const std::vector<const uint16_t*>& bands,
+                                                      const std::vector<SampleQuantization>& quantization,
+                                                      size_t numPixels);
+};
+
+#endif
@@ -0,0 +1,125 @@
+#include "pinned_spectra.h"
+#include "parallel_utils.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <algorithm>
+
+bool PinnedSpectra::addGroup(const QString& label, const QColor& color, const std::vector<double>& bandWavelengths,
+                             bool hasWavelength, const std::vector<uint16_t>& groupValues,
+                             const std::vector<QPoint>& groupPositions, int windowSize) {
+    if (bandWavelengths.empty() || groupPositions.empty() ||
+        groupValues.size() != groupPositions.size() * bandWavelengths.size()) {
+        return false;
+    }
+
+    const bool wasEmpty = isEmpty();
+    if (wasEmpty) {
+        wavelengths = bandWavelengths;
+        wavelengthsKnown = hasWavelength;
+    } else if (bandWavelengths.size() != wavelengths.size()) {
+        return false;
+    }
+
+    Group group;
+    group.label = label;
+    group.color = color;
+    group.first = positions.size();
+    group.count = groupPositions.size();
+    group.windowSize = std::max(1, windowSize);
+    groups.push_back(group);
+
+    values.insert(values.end(), groupValues.begin(), groupValues.end());
+    positions.insert(positions.end(), groupPositions.begin(), groupPositions.end());
+
+    auto [groupMin, groupMax] = std::minmax_element(groupValues.begin(), groupValues.end());
+    minValue = wasEmpty ? *groupMin : std::min(minValue, *groupMin);
+    maxValue = wasEmpty ? *groupMax : std::max(maxValue, *groupMax);
+    return true;
+}
+
+void PinnedSpectra::removeGroup(int index) {
+    if (index < 0 || index >= static_cast<int>(groups.size())) return;
+
+    const Group removed = groups[index];
+    const size_t numBands = wavelengths.size();
+    values.erase(values.begin() + removed.first * numBands, values.begin() + (removed.first + removed.count) * numBands);
+    positions.erase(positions.begin() + removed.first, positions.begin() + removed.first + removed.count);
+    groups.erase(groups.begin() + index);
+    for (size_t i = index; i < groups.size(); i++) {
+        groups[i].first -= removed.count;
+    }
+
+    if (isEmpty()) {
+        clear();
+    } else {
+        updateValueRange();
+    }
+}
+
+bool PinnedSpectra::replaceValues(std::vector<uint16_t> newValues) {
+    if (newValues.size() != values.size()) return false;
+    values = std::move(newValues);
+    updateValueRange();
+    return true;
+}
+
+void PinnedSpectra::clear() {
+    wavelengths.clear();
+    wavelengthsKnown = false;
+    values.clear();
+    values.shrink_to_fit();
+    positions.clear();
+    positions.shrink_to_fit();
+    groups.clear();
+    minValue = 0;
+    maxValue = 0;
+}
+
+void PinnedSpectra::updateValueRange() {
+    if (values.empty()) return;
+    auto [rangeMin, rangeMax] = std::minmax_element(values.begin(), values.end());
+    minValue = *rangeMin;
+    maxValue = *rangeMax;
+}
+
+size_t PinnedSpectra::getMemoryUsage() const {
+    return values.capacity() * sizeof(uint16_t) + positions.capacity() * sizeof(QPoint) +
+           wavelengths.capacity() * sizeof(double);
+}
+
+PinnedSpectra::Density PinnedSpectra::computeDensity(double rangeMin, double rangeMax, int numBins) const {
+    Density density;
+    density.numBands = getNumBands();
+    density.numBins = std::max(1, numBins);
+    density.minValue = rangeMin;
+    density.maxValue = rangeMax;
+    density.counts.assign(static_cast<size_t>(density.numBins) * density.numBands, 0);
+    if (isEmpty() || density.numBands == 0 || rangeMax < rangeMin) return density;
+
+    const int numBands = density.numBands;
+    const int bins = density.numBins;
+    const double scale = rangeMax > rangeMin ? bins / (rangeMax - rangeMin) : 0.0;
+    const int64_t numSpectra = static_cast<int64_t>(size());
+    const int64_t grainSize = std::max<int64_t>(256, numSpectra / (4 * Parallel::threadCount()));
+    QMutex mutex;
+
+    // Каждая задача копит свою сетку и сливает её под мьютексом
+    Parallel::forRange(0, numSpectra, grainSize, [&](int64_t begin, int64_t end) {
+        std::vector<uint32_t> local(density.counts.size(), 0);
+        for (int64_t s = begin; s < end; s++) {
+            const uint16_t* row = spectrum(static_cast<size_t>(s));
+            for (int band = 0; band < numBands; band++) {
+                const double value = row[band];
+                if (value < rangeMin || value > rangeMax) continue;
+                const int bin = std::min(bins - 1, static_cast<int>((value - rangeMin) * scale));
+                local[static_cast<size_t>(bin) * numBands + band]++;
+            }
+        }
+
+        QMutexLocker locker(&mutex);
+        for (size_t i = 0; i < local.size(); i++) density.counts[i] += local[i];
+    });
+
+    density.maxCount = *std::max_element(density.counts.begin(), density.counts.end());
+    return density;
+}
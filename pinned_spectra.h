@@ -0,0 +1,70 @@
+#ifndef PINNED_SPECTRA_H
+#define PINNED_SPECTRA_H
+
+#include <QColor>
+#include <QPoint>
+#include <QString>
+#include <vector>
+#include <cstdint>
+
+// Закреплённые спектры одной непрерывной матрицей "спектр x канал" с общей осью
+// длин волн. Спектры добавляются группами - одна точка или сразу тысячи пикселей
+// области; легенда и удаление работают с группами, а не с отдельными спектрами
+class PinnedSpectra {
+public:
+    struct Group {
+        QString label;
+        QColor color;
+        size_t first = 0;  // первая строка матрицы
+        size_t count = 0;
+        int windowSize = 1;  // окно усреднения, по которому сняты спектры группы
+    };
+
+    // Сколько спектров попало в каждый бин значения каждого канала
+    struct Density {
+        int numBands = 0;
+        int numBins = 0;
+        double minValue = 0.0;
+        double maxValue = 0.0;
+        std::vector<uint32_t> counts;  // counts[bin * numBands + band]
+        uint32_t maxCount = 0;
+    };
+
+    // values - positions.size() спектров по wavelengths.size() значений подряд.
+    // Ось берётся у первой группы; группа с другим числом каналов отвергается
+    bool addGroup(const QString& label, const QColor& color, const std::vector<double>& wavelengths, bool hasWavelength,
+                  const std::vector<uint16_t>& values, const std::vector<QPoint>& positions, int windowSize = 1);
+    // Новые значения всех спектров тех же размеров: кривые, снятые заново в другом виде
+    bool replaceValues(std::vector<uint16_t> newValues);
+    void removeGroup(int index);
+    void clear();
+
+    bool isEmpty() const { return positions.empty(); }
+    size_t size() const { return positions.size(); }
+    int getNumBands() const { return static_cast<int>(wavelengths.size()); }
+    const std::vector<double>& getWavelengths() const { return wavelengths; }
+    bool hasWavelengths() const { return wavelengthsKnown; }
+    const std::vector<Group>& getGroups() const { return groups; }
+
+    const uint16_t* spectrum(size_t index) const { return values.data() + index * wavelengths.size(); }
+    QPoint position(size_t index) const { return positions[index]; }
+    uint16_t getMinValue() const { return minValue; }
+    uint16_t getMaxValue() const { return maxValue; }
+    size_t getMemoryUsage() const;
+
+    // numBins бинов на [minValue, maxValue]; блоки спектров считаются в пуле потоков
+    Density computeDensity(double minValue, double maxValue, int numBins) const;
+
+private:
+    void updateValueRange();
+
+    std::vector<double> wavelengths;
+    bool wavelengthsKnown = false;
+    std::vector<uint16_t> values;
+    std::vector<QPoint> positions;
+    std::vector<Group> groups;
+    uint16_t minValue = 0;
+    uint16_t maxValue = 0;
+};
+
+#endif
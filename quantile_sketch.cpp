@@ -0,0 +1,185 @@
+#include "quantile_sketch.h"
+#include "parallel_utils.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Ёмкость уровня падает в 3/2 раза с удалением от верхнего
+const double kCapacityDecay = 2.0 / 3.0;
+const int kMinLevelCapacity = 8;
+// Меньшие блоки не окупают слияние эскизов
+const size_t kMinBlockValues = 1 << 16;
+
+} // namespace
+
+QuantileSketch::QuantileSketch(int k) : k(std::max(kMinLevelCapacity, k)) {
+    levels.resize(1);
+    updateCapacity();
+}
+
+int QuantileSketch::levelCapacity(int level) const {
+    const int depth = static_cast<int>(levels.size()) - 1 - level;
+    return std::max(kMinLevelCapacity, static_cast<int>(std::ceil(k * std::pow(kCapacityDecay, depth))));
+}
+
+void QuantileSketch::add(float value) {
+    // Бесконечность сделала бы бесконечным диапазон, и весь канал ушёл бы в один код
+    if (!std::isfinite(value)) return;
+
+    if (count == 0) {
+        minValue = maxValue = value;
+    } else {
+        minValue = std::min(minValue, value);
+        maxValue = std::max(maxValue, value);
+    }
+    count++;
+
+    levels[0].push_back(value);
+    retained++;
+    if (retained >= capacity) compress();
+}
+
+void QuantileSketch::updateCapacity() {
+    capacity = 0;
+    for (size_t level = 0; level < levels.size(); level++) {
+        capacity += levelCapacity(static_cast<int>(level));
+    }
+}
+
+void QuantileSketch::compress() {
+    // Пока общий бюджет не исчерпан, уровни могут переполняться - так сжатий меньше
+    // и ошибка ниже. Затем сжимается нижний переполненный уровень: после сортировки
+    // на уровень выше уходит каждый второй элемент с удвоенным весом
+    while (retained >= capacity) {
+        size_t level = 0;
+        while (static_cast<int>(levels[level].size()) < levelCapacity(static_cast<int>(level))) level++;
+
+        // Добавление уровня перевыделяет levels - ссылки берутся после него
+        if (level + 1 == levels.size()) {
+            levels.emplace_back();
+            updateCapacity();
+        }
+        std::vector<float>& items = levels[level];
+        std::vector<float>& next = levels[level + 1];
+
+        std::sort(items.begin(), items.end());
+        const bool keepLast = items.size() % 2 != 0;
+        const float last = items.back();
+        const size_t pairs = items.size() / 2;
+
+        randomState ^= randomState << 13;
+        randomState ^= randomState >> 17;
+        randomState ^= randomState << 5;
+        const size_t offset = randomState & 1;
+
+        for (size_t i = 0; i < pairs; i++) {
+            next.push_back(items[2 * i + offset]);
+        }
+        items.clear();
+        if (keepLast) items.push_back(last);
+        retained -= pairs;
+    }
+}
+
+void QuantileSketch::merge(const QuantileSketch& other) {
+    if (other.count == 0) return;
+
+    if (count == 0) {
+        minValue = other.minValue;
+        maxValue = other.maxValue;
+    } else {
+        minValue = std::min(minValue, other.minValue);
+        maxValue = std::max(maxValue, other.maxValue);
+    }
+    count += other.count;
+
+    if (levels.size() < other.levels.size()) {
+        levels.resize(other.levels.size());
+        updateCapacity();
+    }
+    for (size_t level = 0; level < other.levels.size(); level++) {
+        levels[level].insert(levels[level].end(), other.levels[level].begin(), other.levels[level].end());
+        retained += other.levels[level].size();
+    }
+    compress();
+}
+
+float QuantileSketch::quantile(double fraction) const {
+    if (count == 0) return 0.0f;
+    if (fraction <= 0.0) return minValue;
+    if (fraction >= 1.0) return maxValue;
+
+    std::vector<std::pair<float, uint64_t>> weighted;
+    weighted.reserve(retained);
+    for (size_t level = 0; level < levels.size(); level++) {
+        const uint64_t weight = uint64_t(1) << level;
+        for (float value : levels[level]) weighted.emplace_back(value, weight);
+    }
+    std::sort(weighted.begin(), weighted.end());
+
+    const double target = fraction * static_cast<double>(count);
+    uint64_t cumulative = 0;
+    for (const auto& item : weighted) {
+        cumulative += item.second;
+        if (static_cast<double>(cumulative) >= target) return item.first;
+    }
+    return maxValue;
+}
+
+std::pair<float, float> QuantileSketch::percentileBounds(double percentLow, double percentHigh) const {
+    if (count == 0) return {0.0f, 0.0f};
+    return {quantile(percentLow / 100.0), quantile((100.0 - percentHigh) / 100.0)};
+}
+
+double QuantileSketch::normalizedRankError() const {
+    // Эмпирическая оценка для KLL (одиночный квантиль, 99%)
+    return 2.446 / std::pow(static_cast<double>(k), 0.9433);
+}
+
+size_t QuantileSketch::getMemoryUsage() const {
+    size_t total = sizeof(QuantileSketch);
+    for (const auto& items : levels) total += items.capacity() * sizeof(float);
+    return total;
+}
+
+QuantileSketch QuantileSketch::buildBlocks(size_t count, int k, void (*fill)(QuantileSketch&, const void*, size_t, size_t),
+                                           const void* data) {
+    const size_t blockSize = std::max(kMinBlockValues, (count + 4 * Parallel::threadCount() - 1) / (4 * Parallel::threadCount()));
+    const int64_t numBlocks = static_cast<int64_t>((count + blockSize - 1) / blockSize);
+
+    std::vector<QuantileSketch> blocks(numBlocks, QuantileSketch(k));
+    Parallel::forRange(0, numBlocks, 1, [&](int64_t blockBegin, int64_t blockEnd) {
+        for (int64_t block = blockBegin; block < blockEnd; block++) {
+            const size_t begin = static_cast<size_t>(block) * blockSize;
+            fill(blocks[block], data, begin, std::min(count, begin + blockSize));
+        }
+    });
+
+    // Слияние по порядку блоков: результат не зависит от расписания потоков
+    QuantileSketch result(k);
+    for (const QuantileSketch& block : blocks) result.merge(block);
+    return result;
+}
+
+SampleQuantization SampleQuantization::fromSketch(const QuantileSketch& sketch) {
+    SampleQuantization quantization;
+    if (sketch.isEmpty()) return quantization;
+
+    // Края эскиза точные, а квантили хвостов - нет: ошибка ранга k = 200 в сотни раз
+    // больше 0.01%, и отсечённые при загрузке значения уже не восстановить
+    const double low = sketch.getMin();
+    const double high = sketch.getMax();
+    const double span = high - low;
+    if (!std::isfinite(low) || !std::isfinite(span)) return quantization;
+    quantization.offset = low;
+    quantization.scale = span > 0 ? span / 65535.0 : 1.0;
+    return quantization;
+}
+
+uint16_t SampleQuantization::encode(double value) const {
+    // inf - inf даёт NaN и после деления; приведение NaN к целому не определено
+    const double code = std::round((value - offset) / scale);
+    if (std::isnan(code)) return 0;
+    return static_cast<uint16_t>(std::clamp(code, 0.0, 65535.0));
+}
@@ -0,0 +1,77 @@
+#ifndef QUANTILE_SKETCH_H
+#define QUANTILE_SKETCH_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+
+// Приближённые квантили потока значений (KLL). Память O(k log(n/k)),
+// ошибка ранга не больше normalizedRankError() с вероятностью 99%.
+// Эскизы частей данных сливаются в эскиз целого без потери гарантии
+class QuantileSketch {
+public:
+    static const int kDefaultK = 200;
+
+    explicit QuantileSketch(int k = kDefaultK);
+
+    void add(float value);  // NaN и ±inf пропускаются
+    void merge(const QuantileSketch& other);
+
+    uint64_t getCount() const { return count; }
+    bool isEmpty() const { return count == 0; }
+    float getMin() const { return minValue; }
+    float getMax() const { return maxValue; }
+
+    // Значение, ниже которого примерно fraction всех значений; края точные
+    float quantile(double fraction) const;
+    // Та же семантика, что у ChannelStatistics::Histogram::percentileBounds
+    std::pair<float, float> percentileBounds(double percentLow, double percentHigh) const;
+    double normalizedRankError() const;
+    size_t getMemoryUsage() const;
+
+    // Эскиз буфера любого числового типа: блоки считаются в пуле потоков и сливаются
+    template <typename T>
+    static QuantileSketch build(const T* data, size_t count, int k = kDefaultK);
+
+private:
+    int levelCapacity(int level) const;
+    void updateCapacity();
+    void compress();
+    static QuantileSketch buildBlocks(size_t count, int k, void (*fill)(QuantileSketch&, const void*, size_t, size_t),
+                                      const void* data);
+
+    int k;
+    uint64_t count = 0;
+    float minValue = 0.0f;
+    float maxValue = 0.0f;
+    size_t retained = 0;
+    size_t capacity = 0;  // сумма ёмкостей уровней: при retained >= capacity нужно сжатие
+    uint32_t randomState = 0x9E3779B9u;  // детерминированный выбор половины при сжатии
+    std::vector<std::vector<float>> levels;  // уровень h: каждый элемент весит 2^h
+};
+
+template <typename T>
+QuantileSketch QuantileSketch::build(const T* data, size_t count, int k) {
+    return buildBlocks(count, k, [](QuantileSketch& sketch, const void* source, size_t begin, size_t end) {
+        const T* values = static_cast<const T*>(source);
+        for (size_t i = begin; i < end; i++) {
+            sketch.add(static_cast<float>(values[i]));
+        }
+    }, data);
+}
+
+// Линейное отображение значений с плавающей точкой или 32-битных в 16-битный код.
+// Диапазон - точные минимум и максимум эскиза: коды хранятся вместо исходных
+// значений, поэтому при кодировании ничего не отсекается. NaN получает код 0,
+// ±inf прижимаются к краям шкалы
+struct SampleQuantization {
+    double offset = 0.0;
+    double scale = 1.0;  // значение = offset + scale * код
+
+    static SampleQuantization fromSketch(const QuantileSketch& sketch);
+    uint16_t encode(double value) const;
+    double decode(double code) const { return offset + scale * code; }
+};
+
+#endif
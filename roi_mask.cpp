@@ -0,0 +1,166 @@
+#include "roi_mask.h"
+#include "parallel_utils.h"
+#include <algorithm>
+#include <cmath>
+
+RoiMask RoiMask::fromPolygon(const QPolygonF& polygon, const QSize& imageSize) {
+    RoiMask mask;
+    mask.imageSize = imageSize;
+    if (polygon.size() < 3 || imageSize.isEmpty()) return mask;
+
+    const QRectF bounds = polygon.boundingRect();
+    const int top = std::max(0, static_cast<int>(std::floor(bounds.top())));
+    const int bottom = std::min(imageSize.height() - 1, static_cast<int>(std::ceil(bounds.bottom())));
+    if (top > bottom) return mask;
+
+    // Пересечения рёбер с горизонталями через центры пикселей, отдельно для каждой строки.
+    // Ребро берёт строки с центром в [yMin, yMax): общая вершина двух рёбер считается один раз
+    std::vector<std::vector<double>> crossings(bottom - top + 1);
+    const int numVertices = polygon.size();
+    for (int i = 0; i < numVertices; i++) {
+        const QPointF a = polygon[i];
+        const QPointF b = polygon[(i + 1) % numVertices];
+        if (a.y() == b.y()) continue;
+
+        const double yMin = std::min(a.y(), b.y());
+        const double yMax = std::max(a.y(), b.y());
+        const int first = std::max(top, static_cast<int>(std::ceil(yMin - 0.5)));
+        const int last = std::min(bottom, static_cast<int>(std::ceil(yMax - 0.5)) - 1);
+        const double slope = (b.x() - a.x()) / (b.y() - a.y());
+        for (int y = first; y <= last; y++) {
+            crossings[y - top].push_back(a.x() + (y + 0.5 - a.y()) * slope);
+        }
+    }
+
+    for (int y = top; y <= bottom; y++) {
+        std::vector<double>& row = crossings[y - top];
+        std::sort(row.begin(), row.end());
+        for (size_t i = 0; i + 1 < row.size(); i += 2) {
+            const int x0 = std::max(0, static_cast<int>(std::ceil(row[i] - 0.5)));
+            const int x1 = std::min(imageSize.width(), static_cast<int>(std::ceil(row[i + 1] - 0.5)));
+            if (x0 < x1) mask.addRun(y, x0, x1);
+        }
+    }
+
+    mask.buildBits();
+    return mask;
+}
+
+void RoiMask::addRun(int y, int x0, int x1) {
+    // Соседние отрезки одной строки сливаются
+    if (!runs.empty() && runs.back().y == y && runs.back().x1 >= x0) {
+        pixelCount += std::max(0, x1 - runs.back().x1);
+        runs.back().x1 = std::max(runs.back().x1, x1);
+        return;
+    }
+    Run run;
+    run.y = y;
+    run.x0 = x0;
+    run.x1 = x1;
+    runs.push_back(run);
+    pixelCount += x1 - x0;
+}
+
+void RoiMask::buildBits() {
+    if (runs.empty()) return;
+
+    int left = runs.front().x0;
+    int right = runs.front().x1;
+    for (const Run& run : runs) {
+        left = std::min(left, run.x0);
+        right = std::max(right, run.x1);
+    }
+    boundingRect = QRect(left, runs.front().y, right - left, runs.back().y - runs.front().y + 1);
+    wordsPerRow = (boundingRect.width() + 63) / 64;
+    bits.assign(static_cast<size_t>(wordsPerRow) * boundingRect.height(), 0);
+
+    // Отрезок ставит целые слова и маски на краях, а не по биту
+    for (const Run& run : runs) {
+        uint64_t* row = bits.data() + static_cast<size_t>(run.y - boundingRect.top()) * wordsPerRow;
+        const int begin = run.x0 - left;
+        const int end = run.x1 - left;
+        const int firstWord = begin / 64;
+        const int lastWord = (end - 1) / 64;
+        const uint64_t firstMask = ~uint64_t(0) << (begin % 64);
+        const uint64_t lastMask = ~uint64_t(0) >> (63 - (end - 1) % 64);
+        if (firstWord == lastWord) {
+            row[firstWord] |= firstMask & lastMask;
+            continue;
+        }
+        row[firstWord] |= firstMask;
+        for (int word = firstWord + 1; word < lastWord; word++) row[word] = ~uint64_t(0);
+        row[lastWord] |= lastMask;
+    }
+}
+
+bool RoiMask::contains(int x, int y) const {
+    if (!boundingRect.contains(x, y)) return false;
+    const int column = x - boundingRect.left();
+    const uint64_t word = bits[static_cast<size_t>(y - boundingRect.top()) * wordsPerRow + column / 64];
+    return (word >> (column % 64)) & 1;
+}
+
+size_t RoiMask::getMemoryUsage() const {
+    return bits.capacity() * sizeof(uint64_t) + runs.capacity() * sizeof(Run);
+}
+
+RoiStatistics::Result RoiStatistics::compute(const std::vector<const uint16_t*>& bands, const RoiMask& mask) {
+    Result result;
+    const int numBands = static_cast<int>(bands.size());
+    if (numBands == 0 || mask.isEmpty()) return result;
+
+    result.count = mask.getPixelCount();
+    result.mean.assign(numBands, 0.0);
+    result.stdDev.assign(numBands, 0.0);
+    result.minimum.assign(numBands, 0);
+    result.maximum.assign(numBands, 0);
+    result.median.assign(numBands, 0);
+
+    const std::vector<RoiMask::Run>& runs = mask.getRuns();
+    const size_t width = static_cast<size_t>(mask.getImageSize().width());
+    const uint64_t medianRank = (result.count + 1) / 2;
+
+    // Канал - единица работы: задача заводит одну гистограмму и переиспользует её
+    Parallel::forRange(0, numBands, 1, [&](int64_t bandBegin, int64_t bandEnd) {
+        std::vector<uint32_t> histogram(65536);
+        for (int64_t band = bandBegin; band < bandEnd; band++) {
+            std::fill(histogram.begin(), histogram.end(), 0);
+            const uint16_t* data = bands[band];
+            for (const RoiMask::Run& run : runs) {
+                const uint16_t* values = data + run.y * width;
+                for (int x = run.x0; x < run.x1; x++) histogram[values[x]]++;
+            }
+
+            // Сумма в целых точная; дисперсия - от среднего, без вычитания больших величин
+            uint64_t sum = 0;
+            uint64_t cumulative = 0;
+            int minimum = -1;
+            int maximum = 0;
+            int median = -1;
+            for (int value = 0; value < 65536; value++) {
+                const uint32_t count = histogram[value];
+                if (count == 0) continue;
+                if (minimum < 0) minimum = value;
+                maximum = value;
+                sum += static_cast<uint64_t>(value) * count;
+                cumulative += count;
+                if (median < 0 && cumulative >= medianRank) median = value;
+            }
+
+            const double mean = static_cast<double>(sum) / result.count;
+            double squares = 0.0;
+            for (int value = minimum; value <= maximum; value++) {
+                if (histogram[value] == 0) continue;
+                const double deviation = value - mean;
+                squares += deviation * deviation * histogram[value];
+            }
+
+            result.mean[band] = mean;
+            result.stdDev[band] = result.count > 1 ? std::sqrt(squares / (result.count - 1)) : 0.0;
+            result.minimum[band] = static_cast<uint16_t>(minimum);
+            result.maximum[band] = static_cast<uint16_t>(maximum);
+            result.median[band] = static_cast<uint16_t>(median);
+        }
+    });
+    return result;
+}
@@ -0,0 +1,66 @@
+#ifndef ROI_MASK_H
+#define ROI_MASK_H
+
+#include <QPolygonF>
+#include <QRect>
+#include <QSize>
+#include <vector>
+#include <cstdint>
+
+// Область интереса: по биту на пиксель внутри описанного прямоугольника и список
+// отрезков [x0, x1) по строкам. Биты - для проверки отдельных пикселей, отрезки -
+// для проходов по данным подряд по памяти
+class RoiMask {
+public:
+    struct Run {
+        int y = 0;
+        int x0 = 0;
+        int x1 = 0;  // не включая
+    };
+
+    // Пиксель входит, если его центр внутри многоугольника (правило чёт-нечет).
+    // Прямоугольник и контур от руки рисуются тем же способом
+    static RoiMask fromPolygon(const QPolygonF& polygon, const QSize& imageSize);
+
+    bool isEmpty() const { return pixelCount == 0; }
+    uint64_t getPixelCount() const { return pixelCount; }
+    QSize getImageSize() const { return imageSize; }
+    QRect getBoundingRect() const { return boundingRect; }
+    const std::vector<Run>& getRuns() const { return runs; }
+    bool contains(int x, int y) const;
+    size_t getMemoryUsage() const;
+
+private:
+    void addRun(int y, int x0, int x1);
+    void buildBits();
+
+    QSize imageSize;
+    QRect boundingRect;
+    std::vector<Run> runs;             // по строкам сверху вниз, внутри строки слева направо
+    std::vector<uint64_t> bits;        // строки boundingRect по wordsPerRow слов
+    int wordsPerRow = 0;
+    uint64_t pixelCount = 0;
+};
+
+// Поканальная статистика пикселей области. Каналы делятся между потоками, каждый
+// проходит по отрезкам маски в своём канале. Все величины выводятся из гистограммы
+// 16-битных кодов, поэтому медиана точная, а внутренний цикл - одно приращение
+class RoiStatistics {
+public:
+    struct Result {
+        uint64_t count = 0;
+        std::vector<double> mean;
+        std::vector<double> stdDev;  // несмещённое
+        std::vector<uint16_t> minimum;
+        std::vector<uint16_t> maximum;
+        std::vector<uint16_t> median;  // нижняя медиана
+
+        bool isEmpty() const { return count == 0; }
+        int numBands() const { return static_cast<int>(mean.size()); }
+    };
+
+    // bands[b] - канал b размером mask.getImageSize()
+    static Result compute(const std::vector<const uint16_t*>& bands, const RoiMask& mask);
+};
+
+#endif
@@ -0,0 +1,230 @@
+#include "sam_classifier.h"
+#include "spectral_resampler.h"
+#include "parallel_utils.h"
+#include <QMutex>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+// Суммы всех эталонов по блоку (до kMaxClasses строк float) должны оставаться в кэше.
+// Циклы по блоку всегда на kBlockPixels пикселей: постоянную длину векторизуют и -O2, и /O2
+constexpr size_t kBlockPixels = 512;
+// Непрозрачность карты классов поверх изображения
+const int kOverlayAlpha = 140;
+
+} // namespace
+
+SamClassifier::Result SamClassifier::classify(const std::vector<std::vector<double>>& references, double maxAngle,
+                                              bool ruleImages, const std::vector<const uint16_t*>& bands,
+                                              const std::vector<SampleQuantization>& quantization, size_t numPixels) {
+    Result result;
+    const int numBands = static_cast<int>(bands.size());
+    const int numRefs = static_cast<int>(references.size());
+    if (numRefs == 0 || numRefs > kMaxClasses || numPixels == 0 || quantization.size() != bands.size()) return result;
+    for (const auto& reference : references) {
+        if (reference.size() != bands.size()) return result;
+    }
+
+    // Угол считается только по каналам, известным у всех эталонов
+    std::vector<int> active;
+    for (int b = 0; b < numBands; b++) {
+        if (std::all_of(references.begin(), references.end(),
+                        [b](const std::vector<double>& reference) { return std::isfinite(reference[b]); })) {
+            active.push_back(b);
+        }
+    }
+    const int numActive = static_cast<int>(active.size());
+    if (numActive == 0) return result;
+
+    // Единичные эталоны по каналам: weights[i * numRefs + k] - канал active[i] эталона k
+    std::vector<float> weights(static_cast<size_t>(numActive) * numRefs);
+    for (int k = 0; k < numRefs; k++) {
+        double norm = 0.0;
+        for (int b : active) norm += references[k][b] * references[k][b];
+        if (norm <= 0) return result;
+        norm = std::sqrt(norm);
+        for (int i = 0; i < numActive; i++) {
+            weights[static_cast<size_t>(i) * numRefs + k] = static_cast<float>(references[k][active[i]] / norm);
+        }
+    }
+
+    const float minCosine = static_cast<float>(std::cos(std::clamp(maxAngle, 0.0, kPi)));
+    SampleQuantization angleScale;
+    angleScale.scale = kPi / 65535.0;
+    const float angleCodes = static_cast<float>(1.0 / angleScale.scale);  // угол -> код без вызова encode
+
+    result.numClasses = static_cast<uint32_t>(numRefs);
+    result.classes.resize(numPixels);
+    result.counts.assign(numRefs + 1, 0);
+    if (ruleImages) {
+        result.rules.bands.assign(numRefs, std::vector<uint16_t>(numPixels));
+        result.rules.quantization.assign(numRefs, angleScale);
+    }
+    QMutex mutex;
+
+    const int64_t numBlocks = static_cast<int64_t>((numPixels + kBlockPixels - 1) / kBlockPixels);
+    const int64_t grainSize = std::max<int64_t>(1, numBlocks / (4 * Parallel::threadCount()));
+    Parallel::forRange(0, numBlocks, grainSize, [&](int64_t blockBegin, int64_t blockEnd) {
+        std::vector<float> dots(static_cast<size_t>(numRefs) * kBlockPixels);
+        std::vector<uint16_t> padded(kBlockPixels, 0);  // коды неполного последнего блока
+        std::vector<float> values(kBlockPixels);
+        std::vector<float> norms(kBlockPixels);
+        std::vector<float> cosine(kBlockPixels);
+        std::vector<float> bestCosine(kBlockPixels);
+        std::vector<int> bestClass(kBlockPixels);
+        std::vector<size_t> localCounts(numRefs + 1, 0);
+
+        for (int64_t blockIndex = blockBegin; blockIndex < blockEnd; blockIndex++) {
+            const size_t begin = static_cast<size_t>(blockIndex) * kBlockPixels;
+            const size_t count = std::min(kBlockPixels, numPixels - begin);
+            std::fill(dots.begin(), dots.end(), 0.0f);
+            std::fill(norms.begin(), norms.end(), 0.0f);
+
+            // Канал блока переводится в исходные единицы один раз и идёт во все суммы;
+            // куб хранится по каналам, поэтому циклы по пикселям идут подряд по памяти и векторизуются
+            for (int i = 0; i < numActive; i++) {
+                const uint16_t* source = bands[active[i]] + begin;
+                if (count < kBlockPixels) {
+                    std::copy_n(source, count, padded.data());
+                    source = padded.data();
+                }
+                const float offset = static_cast<float>(quantization[active[i]].offset);
+                const float scale = static_cast<float>(quantization[active[i]].scale);
+                float* value = values.data();
+                float* norm = norms.data();
+                for (size_t p = 0; p < kBlockPixels; p++) {
+                    value[p] = offset + scale * source[p];
+                    norm[p] += value[p] * value[p];
+                }
+                // Четыре эталона за проход: значение канала читается из памяти один раз на четыре суммы
+                const float* bandWeights = weights.data() + static_cast<size_t>(i) * numRefs;
+                int k = 0;
+                for (; k + 4 <= numRefs; k += 4) {
+                    const float w0 = bandWeights[k];
+                    const float w1 = bandWeights[k + 1];
+                    const float w2 = bandWeights[k + 2];
+                    const float w3 = bandWeights[k + 3];
+                    float* d0 = dots.data() + static_cast<size_t>(k) * kBlockPixels;
+                    float* d1 = d0 + kBlockPixels;
+                    float* d2 = d1 + kBlockPixels;
+                    float* d3 = d2 + kBlockPixels;
+                    for (size_t p = 0; p < kBlockPixels; p++) {
+                        const float v = value[p];
+                        d0[p] += w0 * v;
+                        d1[p] += w1 * v;
+                        d2[p] += w2 * v;
+                        d3[p] += w3 * v;
+                    }
+                }
+                for (; k < numRefs; k++) {
+                    const float weight = bandWeights[k];
+                    float* dot = dots.data() + static_cast<size_t>(k) * kBlockPixels;
+                    for (size_t p = 0; p < kBlockPixels; p++) dot[p] += weight * value[p];
+                }
+            }
+
+            // Наибольший косинус - наименьший угол; арккосинус нужен только для углов эталонов
+            for (size_t p = 0; p < kBlockPixels; p++) norms[p] = norms[p] > 0 ? 1.0f / std::sqrt(norms[p]) : 0.0f;
+            std::fill(bestCosine.begin(), bestCosine.end(), -2.0f);
+            std::fill(bestClass.begin(), bestClass.end(), 0);
+            for (int k = 0; k < numRefs; k++) {
+                const float* dot = dots.data() + static_cast<size_t>(k) * kBlockPixels;
+                for (size_t p = 0; p < kBlockPixels; p++) {
+                    cosine[p] = std::clamp(dot[p] * norms[p], -1.0f, 1.0f);
+                    const bool better = cosine[p] > bestCosine[p];
+                    bestCosine[p] = better ? cosine[p] : bestCosine[p];
+                    bestClass[p] = better ? k : bestClass[p];
+                }
+                if (!ruleImages) continue;
+                uint16_t* codes = result.rules.bands[k].data() + begin;
+                for (size_t p = 0; p < count; p++) {
+                    const float angle = norms[p] > 0 ? std::acos(cosine[p]) : static_cast<float>(kPi);
+                    codes[p] = static_cast<uint16_t>(std::min(angle * angleCodes + 0.5f, 65535.0f));
+                }
+            }
+
+            uint8_t* classes = result.classes.data() + begin;
+            for (size_t p = 0; p < count; p++) {
+                const bool matched = norms[p] > 0 && bestCosine[p] >= minCosine;
+                classes[p] = matched ? static_cast<uint8_t>(bestClass[p] + 1) : 0;
+                localCounts[classes[p]]++;
+            }
+        }
+
+        QMutexLocker locker(&mutex);
+        for (int k = 0; k <= numRefs; k++) result.counts[k] += localCounts[k];
+    });
+    return result;
+}
+
+bool SamClassifier::loadLibrary(const QString& filePath, const std::vector<double>& wavelengths, QStringList& names,
+                                std::vector<std::vector<double>>& spectra, QString& error) {
+    QStringList header;
+    std::vector<std::vector<double>> rows;
+    if (!SpectralResampler::readTable(filePath, header, rows, error)) return false;
+
+    names.clear();
+    spectra.clear();
+    const size_t numColumns = rows.front().size();
+    std::vector<std::pair<double, double>> samples;
+    for (size_t column = 1; column < numColumns; column++) {
+        samples.clear();
+        for (const auto& row : rows) {
+            if (column < row.size()) samples.emplace_back(row[0], row[column]);
+        }
+        if (samples.size() < 2) continue;
+
+        std::vector<double> spectrum(wavelengths.size(), std::numeric_limits<double>::quiet_NaN());
+        for (size_t b = 0; b < wavelengths.size(); b++) {
+            const double wavelength = wavelengths[b];
+            if (wavelength <= 0 || wavelength < samples.front().first || wavelength > samples.back().first) continue;
+            auto upper = std::lower_bound(samples.begin(), samples.end(),
+                                          std::make_pair(wavelength, -std::numeric_limits<double>::infinity()));
+            if (upper == samples.begin()) {
+                spectrum[b] = upper->second;
+                continue;
+            }
+            auto lower = upper - 1;
+            const double span = upper->first - lower->first;
+            const double t = span > 0 ? (wavelength - lower->first) / span : 0.0;
+            spectrum[b] = lower->second + t * (upper->second - lower->second);
+        }
+        names << (column < static_cast<size_t>(header.size()) ? header[column] : QString("Спектр %1").arg(column));
+        spectra.push_back(std::move(spectrum));
+    }
+
+    if (spectra.empty()) {
+        error = "В таблице нет ни одного спектра";
+        return false;
+    }
+    return true;
+}
+
+QImage SamClassifier::classOverlay(const std::vector<uint8_t>& classes, uint32_t width, uint32_t height,
+                                   const std::vector<QRgb>& colors, int step) {
+    if (classes.size() != static_cast<size_t>(width) * height || classes.empty()) return QImage();
+    step = std::max(1, step);
+
+    // Класс -> готовый premultiplied-цвет; 0 и классы без цвета прозрачны
+    std::vector<QRgb> palette(256, 0);
+    for (size_t k = 0; k < colors.size() && k + 1 < palette.size(); k++) {
+        palette[k + 1] = qPremultiply(qRgba(qRed(colors[k]), qGreen(colors[k]), qBlue(colors[k]), kOverlayAlpha));
+    }
+
+    const uint32_t outWidth = (width + step - 1) / step;
+    const uint32_t outHeight = (height + step - 1) / step;
+    QImage overlay(outWidth, outHeight, QImage::Format_ARGB32_Premultiplied);
+    const int64_t rowsPerBlock = std::max<int64_t>(1, (1 << 18) / outWidth);
+
+    Parallel::forRange(0, outHeight, rowsPerBlock, [&](int64_t rowBegin, int64_t rowEnd) {
+        for (int64_t outY = rowBegin; outY < rowEnd; outY++) {
+            const uint8_t* row = classes.data() + static_cast<size_t>(outY) * step * width;
+            QRgb* scanLine = reinterpret_cast<QRgb*>(overlay.scanLine(static_cast<int>(outY)));
+            for (uint32_t x = 0; x < outWidth; x++) scanLine[x] = palette[row[static_cast<size_t>(x) * step]];
+        }
+    });
+    return overlay;
+}
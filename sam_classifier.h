@@ -0,0 +1,49 @@
+#ifndef SAM_CLASSIFIER_H
+#define SAM_CLASSIFIER_H
+
+#include <QString>
+#include <QStringList>
+#include <QImage>
+#include <vector>
+#include <cstdint>
+#include "spectral_transform.h"
+
+// Классификация по спектральному углу (SAM): пиксель относится к эталону, угол
+// до которого наименьший и не больше порога. Угол не зависит от яркости пикселя,
+// поэтому освещённость и тени почти не влияют на результат.
+// Эталоны нормируются один раз; блок пикселей читает каждый канал один раз и
+// добавляет его в скалярные произведения со всеми эталонами
+class SamClassifier {
+public:
+    static const int kMaxClasses = 255;
+
+    struct Result {
+        uint32_t numClasses = 0;
+        std::vector<uint8_t> classes;  // 0 - дальше порога от всех эталонов, k + 1 - эталон k
+        std::vector<size_t> counts;    // numClasses + 1: counts[0] - неклассифицированные
+        // Угол до каждого эталона в радианах, шкала [0, π]; пусто, если не запрошены
+        SpectralTransform::CubeProduct rules;
+
+        bool isEmpty() const { return classes.empty(); }
+    };
+
+    // references - эталоны в исходных единицах, по bands.size() значений. Каналы, где
+    // значение хотя бы одного эталона неизвестно (NaN), в угле не участвуют. Пиксель
+    // с нулевым спектром не классифицируется. Блоки пикселей считаются в пуле потоков
+    static Result classify(const std::vector<std::vector<double>>& references, double maxAngle, bool ruleImages,
+                           const std::vector<const uint16_t*>& bands,
+                           const std::vector<SampleQuantization>& quantization, size_t numPixels);
+
+    // Библиотека спектров - таблица SpectralResampler::readTable, по спектру в столбце.
+    // Спектры линейно интерполируются на wavelengths; вне диапазона таблицы и для
+    // каналов без длины волны (0) - NaN
+    static bool loadLibrary(const QString& filePath, const std::vector<double>& wavelengths, QStringList& names,
+                            std::vector<std::vector<double>>& spectra, QString& error);
+
+    // Полупрозрачная карта классов для ImageLabel::setOverlay: каждый step-й пиксель,
+    // colors[k] - цвет класса k, неклассифицированные прозрачны
+    static QImage classOverlay(const std::vector<uint8_t>& classes, uint32_t width, uint32_t height,
+                               const std::vector<QRgb>& colors, int step);
+};
+
+#endif
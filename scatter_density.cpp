@@ -0,0 +1,111 @@
+#include "scatter_density.h"
+#include "parallel_utils.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <cmath>
+
+std::shared_ptr<const ScatterDensity::Density> ScatterDensity::build(const uint16_t* xData, const uint16_t* yData,
+                                                                     uint32_t width, uint32_t height,
+                                                                     const Axis& axisX, const Axis& axisY, int step) {
+    if (!xData || !yData || width == 0 || height == 0) return nullptr;
+    step = std::max(1, step);
+
+    auto density = std::make_shared<Density>();
+    density->axisX = axisX;
+    density->axisY = axisY;
+    density->width = width;
+    density->height = height;
+    density->step = step;
+    density->counts.assign(kBins * kBins, 0);
+
+    // Бины по значению - таблицы, чтобы во внутреннем цикле не было деления
+    std::vector<uint16_t> binX(65536);
+    std::vector<uint16_t> binY(65536);
+    for (int val = 0; val < 65536; val++) {
+        binX[val] = static_cast<uint16_t>(axisX.bin(static_cast<uint16_t>(val)));
+        binY[val] = static_cast<uint16_t>(axisY.bin(static_cast<uint16_t>(val)) * kBins);
+    }
+
+    const uint32_t outWidth = (width + step - 1) / step;
+    const uint32_t outHeight = (height + step - 1) / step;
+    const int64_t rowsPerBlock = std::max<int64_t>(1, (1 << 18) / outWidth);
+    QMutex mutex;
+
+    Parallel::forRange(0, outHeight, rowsPerBlock, [&](int64_t rowBegin, int64_t rowEnd) {
+        std::vector<uint32_t> local(kBins * kBins, 0);
+
+        for (int64_t outY = rowBegin; outY < rowEnd; outY++) {
+            const size_t rowOffset = static_cast<size_t>(outY) * step * width;
+            const uint16_t* rowX = xData + rowOffset;
+            const uint16_t* rowY = yData + rowOffset;
+
+            for (uint32_t x = 0; x < width; x += step) {
+                local[binY[rowY[x]] + binX[rowX[x]]]++;
+            }
+        }
+
+        QMutexLocker locker(&mutex);
+        for (int bin = 0; bin < kBins * kBins; bin++) {
+            density->counts[bin] += local[bin];
+        }
+    });
+
+    density->maxCount = *std::max_element(density->counts.begin(), density->counts.end());
+    return density;
+}
+
+QImage ScatterDensity::toImage(const Density& density, Colormap::Type colormap) {
+    QImage image(kBins, kBins, QImage::Format_RGB32);
+    const std::vector<QRgb>& palette = Colormap::palette(colormap);
+    const double scale = density.maxCount > 0 ? 254.0 / std::log1p(static_cast<double>(density.maxCount)) : 0.0;
+
+    for (int binY = 0; binY < kBins; binY++) {
+        QRgb* scanLine = reinterpret_cast<QRgb*>(image.scanLine(kBins - 1 - binY));
+        const uint32_t* row = density.counts.data() + binY * kBins;
+        for (int binX = 0; binX < kBins; binX++) {
+            // Пустые бины - фон, любой непустой виден хотя бы первым цветом палитры
+            const uint32_t count = row[binX];
+            const int level = count == 0 ? 0 : 1 + static_cast<int>(std::log1p(static_cast<double>(count)) * scale);
+            scanLine[binX] = palette[std::min(level, 255)];
+        }
+    }
+    return image;
+}
+
+QImage ScatterDensity::selectionOverlay(const Density& density, const uint16_t* xData, const uint16_t* yData,
+                                       const QRect& binRect, int step, QRgb color) {
+    const QRect bins = binRect.normalized().intersected(QRect(0, 0, kBins, kBins));
+    if (!xData || !yData || density.width == 0 || density.height == 0 || bins.isEmpty()) return QImage();
+    step = std::max(1, step);
+
+    // Выделение - прямоугольник бинов, поэтому пиксель выбран, если в него попали оба значения:
+    // по таблице на каждую ось, без совместного бина
+    std::vector<uint8_t> selectedX(65536);
+    std::vector<uint8_t> selectedY(65536);
+    for (int val = 0; val < 65536; val++) {
+        const int binX = density.axisX.bin(static_cast<uint16_t>(val));
+        const int binY = density.axisY.bin(static_cast<uint16_t>(val));
+        selectedX[val] = binX >= bins.left() && binX <= bins.right();
+        selectedY[val] = binY >= bins.top() && binY <= bins.bottom();
+    }
+
+    const uint32_t outWidth = (density.width + step - 1) / step;
+    const uint32_t outHeight = (density.height + step - 1) / step;
+    QImage overlay(outWidth, outHeight, QImage::Format_ARGB32_Premultiplied);
+    const QRgb highlight = qPremultiply(color);
+    const int64_t rowsPerBlock = std::max<int64_t>(1, (1 << 18) / outWidth);
+
+    Parallel::forRange(0, outHeight, rowsPerBlock, [&](int64_t rowBegin, int64_t rowEnd) {
+        for (int64_t outY = rowBegin; outY < rowEnd; outY++) {
+            const size_t rowOffset = static_cast<size_t>(outY) * step * density.width;
+            const uint16_t* rowX = xData + rowOffset;
+            const uint16_t* rowY = yData + rowOffset;
+            QRgb* scanLine = reinterpret_cast<QRgb*>(overlay.scanLine(static_cast<int>(outY)));
+            for (uint32_t x = 0; x < outWidth; x++) {
+                const size_t offset = static_cast<size_t>(x) * step;
+                scanLine[x] = selectedX[rowX[offset]] && selectedY[rowY[offset]] ? highlight : 0;
+            }
+        }
+    });
+    return overlay;
+}
@@ -0,0 +1,54 @@
+#ifndef SCATTER_DENSITY_H
+#define SCATTER_DENSITY_H
+
+#include <QImage>
+#include <QRect>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <algorithm>
+#include "colormap.h"
+
+// Двумерная гистограмма пар значений двух каналов (диаграмма рассеяния)
+// и маска пикселей, попавших в выделенную область диаграммы
+class ScatterDensity {
+public:
+    static const int kBins = 256;
+
+    // Значения вне [minVal, maxVal] попадают в крайние бины
+    struct Axis {
+        uint16_t minVal = 0;
+        uint16_t maxVal = 65535;
+
+        int bin(uint16_t value) const {
+            const int clamped = std::min<int>(std::max<int>(value, minVal), maxVal);
+            return static_cast<int>(static_cast<int64_t>(clamped - minVal) * kBins / (maxVal - minVal + 1));
+        }
+        double valueAt(double bin) const { return minVal + bin * (maxVal - minVal + 1) / kBins; }
+    };
+
+    struct Density {
+        Axis axisX;
+        Axis axisY;
+        std::vector<uint32_t> counts;  // counts[binY * kBins + binX]
+        uint32_t maxCount = 0;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        int step = 1;  // гистограмма по каждому step-му пикселю
+    };
+
+    // Строки считаются в пуле потоков. При step > 1 - быстрая оценка по подвыборке
+    static std::shared_ptr<const Density> build(const uint16_t* xData, const uint16_t* yData,
+                                                uint32_t width, uint32_t height,
+                                                const Axis& axisX, const Axis& axisY, int step = 1);
+
+    // kBins x kBins, плотность в логарифмической шкале; ось Y направлена вверх
+    static QImage toImage(const Density& density, Colormap::Type colormap);
+
+    // Полупрозрачная подсветка пикселей, чьи бины попали в binRect. Изображение уменьшено
+    // в step раз; бины считаются заново по каналам xData, yData, на которых построена density
+    static QImage selectionOverlay(const Density& density, const uint16_t* xData, const uint16_t* yData,
+                                   const QRect& binRect, int step, QRgb color);
+};
+
+#endif
@@ -0,0 +1,309 @@
+#include "scatter_plot_dialog.h"
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QPushButton>
+#include <QPainter>
+#include <QFontMetrics>
+#include <QApplication>
+#include <QtConcurrent>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Подсветка строится с таким шагом, чтобы в ней было не больше этого числа пикселей
+const double kMaxOverlayPixels = 16.0 * 1024 * 1024;
+// Пока кнопка мыши зажата, подсветка грубее во столько раз по каждой оси
+const int kBrushPreviewFactor = 4;
+// Число пикселей подвыборки для первой оценки диаграммы
+const double kPreviewPixels = 1024.0 * 1024;
+
+int stepForPixels(uint32_t width, uint32_t height, double maxPixels) {
+    double pixels = static_cast<double>(width) * height;
+    return std::max(1, static_cast<int>(std::ceil(std::sqrt(pixels / maxPixels))));
+}
+
+} // namespace
+
+ScatterPlotWidget::ScatterPlotWidget(QWidget* parent) : QWidget(parent) {
+    setMinimumSize(420, 420);
+    setStyleSheet("background-color: white;");
+}
+
+void ScatterPlotWidget::setDensity(const std::shared_ptr<const ScatterDensity::Density>& newDensity,
+                                   const QString& xLabel, const QString& yLabel) {
+    density = newDensity;
+    densityImage = density ? ScatterDensity::toImage(*density, Colormap::INFERNO) : QImage();
+    labelX = xLabel;
+    labelY = yLabel;
+    update();
+}
+
+void ScatterPlotWidget::clearBrush() {
+    isBrushing = false;
+    hasBrush = false;
+    update();
+}
+
+QRect ScatterPlotWidget::plotRect() const {
+    const int leftMargin = 70;
+    const int bottomMargin = 50;
+    const int otherMargin = 20;
+    int side = std::min(width() - leftMargin - otherMargin, height() - bottomMargin - otherMargin);
+    return QRect(leftMargin, otherMargin, std::max(1, side), std::max(1, side));
+}
+
+QPoint ScatterPlotWidget::binAt(const QPoint& widgetPos) const {
+    QRect rect = plotRect();
+    int binX = (widgetPos.x() - rect.left()) * ScatterDensity::kBins / rect.width();
+    int binY = (rect.bottom() - widgetPos.y()) * ScatterDensity::kBins / rect.height();
+    return QPoint(std::clamp(binX, 0, ScatterDensity::kBins - 1), std::clamp(binY, 0, ScatterDensity::kBins - 1));
+}
+
+void ScatterPlotWidget::paintEvent(QPaintEvent* event) {
+    QPainter painter(this);
+    QRect rect = plotRect();
+
+    if (densityImage.isNull()) {
+        painter.setPen(Qt::gray);
+        painter.drawText(rect, Qt::AlignCenter, "Нет данных");
+        return;
+    }
+
+    painter.drawImage(rect, densityImage);
+
+    painter.setPen(QPen(Qt::black, 1));
+    painter.drawRect(rect.adjusted(0, 0, -1, -1));
+
+    // Подписи границ осей в исходных 16-битных значениях
+    QFontMetrics metrics(painter.font());
+    const ScatterDensity::Axis& axisX = density->axisX;
+    const ScatterDensity::Axis& axisY = density->axisY;
+    painter.drawText(rect.left(), rect.bottom() + metrics.height() + 2, QString::number(axisX.minVal));
+    QString maxXText = QString::number(axisX.maxVal);
+    painter.drawText(rect.right() - metrics.horizontalAdvance(maxXText), rect.bottom() + metrics.height() + 2, maxXText);
+    QString minYText = QString::number(axisY.minVal);
+    painter.drawText(rect.left() - metrics.horizontalAdvance(minYText) - 4, rect.bottom(), minYText);
+    QString maxYText = QString::number(axisY.maxVal);
+    painter.drawText(rect.left() - metrics.horizontalAdvance(maxYText) - 4, rect.top() + metrics.ascent(), maxYText);
+
+    painter.drawText(QRect(rect.left(), rect.bottom() + metrics.height() + 4, rect.width(), metrics.height()),
+                     Qt::AlignCenter, labelX);
+    painter.save();
+    painter.translate(rect.left() - 40, rect.center().y());
+    painter.rotate(-90);
+    painter.drawText(QRect(-rect.height() / 2, -metrics.height(), rect.height(), metrics.height()),
+                     Qt::AlignCenter, labelY);
+    painter.restore();
+
+    if (hasBrush) {
+        QRect bins = brushBins();
+        double scaleX = static_cast<double>(rect.width()) / ScatterDensity::kBins;
+        double scaleY = static_cast<double>(rect.height()) / ScatterDensity::kBins;
+        QRect brushRect(rect.left() + static_cast<int>(bins.left() * scaleX),
+                        rect.top() + static_cast<int>((ScatterDensity::kBins - 1 - bins.bottom()) * scaleY),
+                        std::max(1, static_cast<int>(bins.width() * scaleX)),
+                        std::max(1, static_cast<int>(bins.height() * scaleY)));
+        painter.setPen(QPen(QColor(0, 255, 255), 1, Qt::DashLine));
+        painter.setBrush(QColor(0, 255, 255, 40));
+        painter.drawRect(brushRect);
+    }
+}
+
+void ScatterPlotWidget::mousePressEvent(QMouseEvent* event) {
+    if (event->button() != Qt::LeftButton || !density || !plotRect().contains(event->pos())) return;
+
+    isBrushing = true;
+    hasBrush = true;
+    brushStart = brushEnd = binAt(event->pos());
+    update();
+    emit brushChanged(brushBins(), false);
+}
+
+void ScatterPlotWidget::mouseMoveEvent(QMouseEvent* event) {
+    if (!isBrushing) return;
+
+    QPoint bin = binAt(event->pos());
+    if (bin == brushEnd) return;
+    brushEnd = bin;
+    update();
+    emit brushChanged(brushBins(), false);
+}
+
+void ScatterPlotWidget::mouseReleaseEvent(QMouseEvent* event) {
+    if (event->button() != Qt::LeftButton || !isBrushing) return;
+
+    isBrushing = false;
+    brushEnd = binAt(event->pos());
+    update();
+    emit brushChanged(brushBins(), true);
+}
+
+ScatterPlotDialog::ScatterPlotDialog(HyperspectralImage* image, int bandX, int bandY, QWidget* parent)
+    : QDialog(parent), hyperspectralImage(image) {
+    setWindowTitle("Диаграмма рассеяния");
+    resize(560, 640);
+
+    QVBoxLayout* mainLayout = new QVBoxLayout(this);
+
+    QHBoxLayout* bandLayout = new QHBoxLayout();
+    bandXSelector = new QComboBox();
+    bandYSelector = new QComboBox();
+    for (int i = 0; i < image->getNumDisplayChannels(); i++) {
+        QString channelName = image->getChannelName(i);
+        bandXSelector->addItem(channelName);
+        bandYSelector->addItem(channelName);
+    }
+    bandXSelector->setCurrentIndex(std::clamp(bandX, 0, std::max(0, image->getNumDisplayChannels() - 1)));
+    bandYSelector->setCurrentIndex(std::clamp(bandY, 0, std::max(0, image->getNumDisplayChannels() - 1)));
+
+    bandLayout->addWidget(new QLabel("Ось X:"));
+    bandLayout->addWidget(bandXSelector);
+    bandLayout->addWidget(new QLabel("Ось Y:"));
+    bandLayout->addWidget(bandYSelector);
+    bandLayout->addStretch();
+    mainLayout->addLayout(bandLayout);
+
+    plotWidget = new ScatterPlotWidget();
+    mainLayout->addWidget(plotWidget, 1);
+
+    infoLabel = new QLabel();
+    mainLayout->addWidget(infoLabel);
+
+    QHBoxLayout* buttonLayout = new QHBoxLayout();
+    QPushButton* clearButton = new QPushButton("Снять выделение");
+    QPushButton* closeButton = new QPushButton("Закрыть");
+    buttonLayout->addWidget(clearButton);
+    buttonLayout->addStretch();
+    buttonLayout->addWidget(closeButton);
+    mainLayout->addLayout(buttonLayout);
+
+    densityWatcher = new QFutureWatcher<std::shared_ptr<const ScatterDensity::Density>>(this);
+    connect(densityWatcher, &QFutureWatcher<std::shared_ptr<const ScatterDensity::Density>>::finished,
+            this, &ScatterPlotDialog::onDensityReady);
+
+    connect(bandXSelector, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &ScatterPlotDialog::onBandsChanged);
+    connect(bandYSelector, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &ScatterPlotDialog::onBandsChanged);
+    connect(plotWidget, &ScatterPlotWidget::brushChanged, this, &ScatterPlotDialog::onBrushChanged);
+    connect(clearButton, &QPushButton::clicked, this, [this]() {
+        plotWidget->clearBrush();
+        emit selectionChanged(QImage());
+    });
+    connect(closeButton, &QPushButton::clicked, this, &QDialog::accept);
+
+    overlayStep = stepForPixels(image->getWidth(), image->getHeight(), kMaxOverlayPixels);
+    onBandsChanged();
+}
+
+ScatterPlotDialog::~ScatterPlotDialog() {
+    densityWatcher->waitForFinished();
+}
+
+ScatterDensity::Axis ScatterPlotDialog::axisFor(int channelIndex) const {
+    // Выбросы не должны сжимать основную часть облака в угол
+    auto [minVal, maxVal] = hyperspectralImage->getHistogram(channelIndex)->percentileBounds(0.5, 0.5);
+    ScatterDensity::Axis axis;
+    axis.minVal = minVal;
+    axis.maxVal = std::max(maxVal, minVal);
+    return axis;
+}
+
+void ScatterPlotDialog::onBandsChanged() {
+    // Старая полная гистограмма ещё может считаться: данные каналов живут дольше диалога,
+    // а её результат отбрасывается по поколению
+    densityGeneration++;
+    pendingX = pendingY = nullptr;
+    fullDensity.reset();
+    densityX = densityY = nullptr;
+    plotWidget->clearBrush();
+    emit selectionChanged(QImage());
+
+    const int bandX = bandXSelector->currentIndex();
+    const int bandY = bandYSelector->currentIndex();
+    // В списках есть и виртуальные каналы (компоненты, продукты): они считаются при первом выборе
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    hyperspectralImage->preloadChannels({bandX, bandY});
+    QApplication::restoreOverrideCursor();
+    const std::vector<uint16_t>& xData = hyperspectralImage->get16bitData(bandX);
+    const std::vector<uint16_t>& yData = hyperspectralImage->get16bitData(bandY);
+    const uint32_t width = hyperspectralImage->getWidth();
+    const uint32_t height = hyperspectralImage->getHeight();
+    const size_t numPixels = static_cast<size_t>(width) * height;
+
+    if (numPixels == 0 || xData.size() != numPixels || yData.size() != numPixels) {
+        plotWidget->setDensity(nullptr, QString(), QString());
+        infoLabel->setText("Данные каналов недоступны");
+        return;
+    }
+
+    const ScatterDensity::Axis axisX = axisFor(bandX);
+    const ScatterDensity::Axis axisY = axisFor(bandY);
+    const QString xLabel = bandXSelector->currentText();
+    const QString yLabel = bandYSelector->currentText();
+
+    int previewStep = stepForPixels(width, height, kPreviewPixels);
+    if (previewStep > 1) {
+        plotWidget->setDensity(ScatterDensity::build(xData.data(), yData.data(), width, height, axisX, axisY, previewStep),
+                               xLabel, yLabel);
+        infoLabel->setText(QString("Оценка по каждому %1-му пикселю, идёт полный подсчёт...").arg(previewStep));
+    }
+
+    pendingX = xData.data();
+    pendingY = yData.data();
+    pendingAxisX = axisX;
+    pendingAxisY = axisY;
+    if (!densityWatcher->isRunning()) {
+        startDensityBuild();
+    }
+}
+
+void ScatterPlotDialog::startDensityBuild() {
+    if (!pendingX || !pendingY) return;
+
+    runningDensityGeneration = densityGeneration;
+    runningX = pendingX;
+    runningY = pendingY;
+    pendingX = pendingY = nullptr;
+
+    const uint16_t* xPtr = runningX;
+    const uint16_t* yPtr = runningY;
+    const uint32_t width = hyperspectralImage->getWidth();
+    const uint32_t height = hyperspectralImage->getHeight();
+    const ScatterDensity::Axis axisX = pendingAxisX;
+    const ScatterDensity::Axis axisY = pendingAxisY;
+    densityWatcher->setFuture(QtConcurrent::run([=]() {
+        return ScatterDensity::build(xPtr, yPtr, width, height, axisX, axisY, 1);
+    }));
+}
+
+void ScatterPlotDialog::onDensityReady() {
+    if (runningDensityGeneration == densityGeneration) {
+        fullDensity = densityWatcher->result();
+        densityX = runningX;
+        densityY = runningY;
+        plotWidget->setDensity(fullDensity, bandXSelector->currentText(), bandYSelector->currentText());
+        infoLabel->setText("Выделите область на диаграмме, чтобы подсветить пиксели на изображении");
+    }
+
+    startDensityBuild();
+}
+
+void ScatterPlotDialog::onBrushChanged(const QRect& binRect, bool finished) {
+    if (!fullDensity) return;
+
+    // Пока выделение меняется, подсветка строится по грубой сетке пикселей
+    const int step = finished ? overlayStep : overlayStep * kBrushPreviewFactor;
+    emit selectionChanged(ScatterDensity::selectionOverlay(*fullDensity, densityX, densityY, binRect, step,
+                                                           qRgba(255, 0, 255, 140)));
+
+    uint64_t selected = 0;
+    QRect bins = binRect.normalized().intersected(QRect(0, 0, ScatterDensity::kBins, ScatterDensity::kBins));
+    for (int binY = bins.top(); binY <= bins.bottom(); binY++) {
+        const uint32_t* row = fullDensity->counts.data() + binY * ScatterDensity::kBins;
+        for (int binX = bins.left(); binX <= bins.right(); binX++) selected += row[binX];
+    }
+    const double total = static_cast<double>(fullDensity->width) * fullDensity->height;
+    infoLabel->setText(QString("Выделено пикселей: %1 (%2%)")
+                       .arg(selected)
+                       .arg(total > 0 ? 100.0 * selected / total : 0.0, 0, 'f', 2));
+}
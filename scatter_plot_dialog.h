@@ -0,0 +1,103 @@
+#ifndef SCATTER_PLOT_DIALOG_H
+#define SCATTER_PLOT_DIALOG_H
+
+#include <QDialog>
+#include <QWidget>
+#include <QComboBox>
+#include <QLabel>
+#include <QImage>
+#include <QPaintEvent>
+#include <QMouseEvent>
+#include <QFutureWatcher>
+#include <memory>
+#include <algorithm>
+#include "hyperspectral_image.h"
+#include "scatter_density.h"
+
+class ScatterPlotWidget : public QWidget {
+    Q_OBJECT
+
+public:
+    ScatterPlotWidget(QWidget* parent = nullptr);
+    void setDensity(const std::shared_ptr<const ScatterDensity::Density>& density,
+                    const QString& xLabel, const QString& yLabel);
+    void clearBrush();
+
+signals:
+    // binRect - в бинах диаграммы; finished = false, пока кнопка мыши зажата
+    void brushChanged(const QRect& binRect, bool finished);
+
+protected:
+    void paintEvent(QPaintEvent* event) override;
+    void mousePressEvent(QMouseEvent* event) override;
+    void mouseMoveEvent(QMouseEvent* event) override;
+    void mouseReleaseEvent(QMouseEvent* event) override;
+
+private:
+    QRect plotRect() const;
+    QPoint binAt(const QPoint& widgetPos) const;
+    QRect brushBins() const {
+        return QRect(QPoint(std::min(brushStart.x(), brushEnd.x()), std::min(brushStart.y(), brushEnd.y())),
+                     QPoint(std::max(brushStart.x(), brushEnd.x()), std::max(brushStart.y(), brushEnd.y())));
+    }
+
+    std::shared_ptr<const ScatterDensity::Density> density;
+    QImage densityImage;
+    QString labelX;
+    QString labelY;
+
+    bool isBrushing = false;
+    bool hasBrush = false;
+    QPoint brushStart;
+    QPoint brushEnd;
+};
+
+// Диаграмма рассеяния двух каналов. Сначала показывается оценка по подвыборке,
+// полная гистограмма считается в фоне; выделение на диаграмме подсвечивает пиксели
+class ScatterPlotDialog : public QDialog {
+    Q_OBJECT
+
+public:
+    // Виртуальные каналы пары считаются при выборе, поэтому изображение не const
+    ScatterPlotDialog(HyperspectralImage* image, int bandX, int bandY, QWidget* parent = nullptr);
+    ~ScatterPlotDialog();
+
+signals:
+    // Пустое изображение - снять подсветку
+    void selectionChanged(const QImage& overlay);
+
+private slots:
+    void onBandsChanged();
+    void onDensityReady();
+    void onBrushChanged(const QRect& binRect, bool finished);
+
+private:
+    ScatterDensity::Axis axisFor(int channelIndex) const;
+    void startDensityBuild();
+
+    HyperspectralImage* hyperspectralImage;
+    QComboBox* bandXSelector;
+    QComboBox* bandYSelector;
+    ScatterPlotWidget* plotWidget;
+    QLabel* infoLabel;
+
+    // Полная гистограмма считается в фоне. Результаты с другим поколением отбрасываются;
+    // если подсчёт ещё идёт, следующий запустится по его завершении
+    QFutureWatcher<std::shared_ptr<const ScatterDensity::Density>>* densityWatcher;
+    int densityGeneration = 0;
+    int runningDensityGeneration = -1;
+    const uint16_t* pendingX = nullptr;  // nullptr - новый подсчёт не нужен
+    const uint16_t* pendingY = nullptr;
+    ScatterDensity::Axis pendingAxisX;
+    ScatterDensity::Axis pendingAxisY;
+    const uint16_t* runningX = nullptr;
+    const uint16_t* runningY = nullptr;
+
+    std::shared_ptr<const ScatterDensity::Density> fullDensity;
+    // Каналы, по которым построена fullDensity: по ним считается подсветка
+    const uint16_t* densityX = nullptr;
+    const uint16_t* densityY = nullptr;
+    int overlayStep = 1;  // подсветка не больше kMaxOverlayPixels пикселей
+};
+
+#endif
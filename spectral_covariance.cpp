@@ -0,0 +1,210 @@
+#include "spectral_covariance.h"
+#include "parallel_utils.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Блок "пиксель x канал" в double не больше этого размера остаётся в L2
+const size_t kBlockBytes = 256 * 1024;
+
+// S[i..i+3][j..j+3] += sum_p X[p][i..i+3] * X[p][j..j+3].
+// Шестнадцать сумм живут в регистрах весь проход по блоку: на каждые
+// 16 умножений - 8 чтений из одной строки X и ни одной записи в S
+inline void accumulateKernel4x4(const double* block, int stride, size_t numPixels, int i, int j, double* products) {
+    double c00 = 0, c01 = 0, c02 = 0, c03 = 0;
+    double c10 = 0, c11 = 0, c12 = 0, c13 = 0;
+    double c20 = 0, c21 = 0, c22 = 0, c23 = 0;
+    double c30 = 0, c31 = 0, c32 = 0, c33 = 0;
+
+    for (size_t p = 0; p < numPixels; p++) {
+        const double* x = block + p * stride;
+        const double a0 = x[i], a1 = x[i + 1], a2 = x[i + 2], a3 = x[i + 3];
+        const double b0 = x[j], b1 = x[j + 1], b2 = x[j + 2], b3 = x[j + 3];
+        c00 += a0 * b0; c01 += a0 * b1; c02 += a0 * b2; c03 += a0 * b3;
+        c10 += a1 * b0; c11 += a1 * b1; c12 += a1 * b2; c13 += a1 * b3;
+        c20 += a2 * b0; c21 += a2 * b1; c22 += a2 * b2; c23 += a2 * b3;
+        c30 += a3 * b0; c31 += a3 * b1; c32 += a3 * b2; c33 += a3 * b3;
+    }
+
+    double* s0 = products + static_cast<size_t>(i) * stride + j;
+    double* s1 = s0 + stride;
+    double* s2 = s1 + stride;
+    double* s3 = s2 + stride;
+    s0[0] += c00; s0[1] += c01; s0[2] += c02; s0[3] += c03;
+    s1[0] += c10; s1[1] += c11; s1[2] += c12; s1[3] += c13;
+    s2[0] += c20; s2[1] += c21; s2[2] += c22; s2[3] += c23;
+    s3[0] += c30; s3[1] += c31; s3[2] += c32; s3[3] += c33;
+}
+
+// Суммы произведений X^T X и суммы столбцов по выборке из numSamples строк.
+// fill(first, count, stride, block) пишет строки "отсчёт x канал" с шагом stride
+struct Accumulated {
+    int stride = 0;
+    std::vector<double> products;
+    std::vector<double> sums;
+};
+
+template <typename Fill>
+Accumulated accumulate(int numBands, size_t numSamples, Fill fill) {
+    Accumulated result;
+    // Строка блока дополнена нулями до кратного 4 числа каналов, чтобы ядру не нужны были хвосты
+    const int stride = (numBands + 3) / 4 * 4;
+    const size_t blockPixels = std::clamp<size_t>(kBlockBytes / (sizeof(double) * stride), 16, 4096);
+    const int64_t numBlocks = static_cast<int64_t>((numSamples + blockPixels - 1) / blockPixels);
+    const int64_t blocksPerTask = std::max<int64_t>(1, numBlocks / (4 * Parallel::threadCount()));
+
+    result.stride = stride;
+    result.products.assign(static_cast<size_t>(stride) * stride, 0.0);
+    result.sums.assign(numBands, 0.0);
+    QMutex mutex;
+
+    Parallel::forRange(0, numBlocks, blocksPerTask, [&](int64_t blockBegin, int64_t blockEnd) {
+        std::vector<double> localProducts(static_cast<size_t>(stride) * stride, 0.0);
+        std::vector<double> localSums(numBands, 0.0);
+        std::vector<double> block(blockPixels * stride, 0.0);
+
+        for (int64_t blockIndex = blockBegin; blockIndex < blockEnd; blockIndex++) {
+            const size_t first = static_cast<size_t>(blockIndex) * blockPixels;
+            const size_t count = std::min(blockPixels, numSamples - first);
+            fill(first, count, stride, block.data());
+            for (size_t p = 0; p < count; p++) {
+                const double* row = block.data() + p * stride;
+                for (int b = 0; b < numBands; b++) localSums[b] += row[b];
+            }
+
+            // Только верхний треугольник из блоков 4 x 4
+            for (int i = 0; i < stride; i += 4) {
+                for (int j = i; j < stride; j += 4) {
+                    accumulateKernel4x4(block.data(), stride, count, i, j, localProducts.data());
+                }
+            }
+        }
+
+        QMutexLocker locker(&mutex);
+        for (size_t k = 0; k < result.products.size(); k++) result.products[k] += localProducts[k];
+        for (int b = 0; b < numBands; b++) result.sums[b] += localSums[b];
+    });
+    return result;
+}
+
+// Среднее и несмещённая ковариация по суммам от сдвинутых значений
+SpectralCovariance::Result finish(const Accumulated& accumulated, const std::vector<double>& shift, size_t numSamples) {
+    SpectralCovariance::Result result;
+    const int numBands = static_cast<int>(shift.size());
+    const double n = static_cast<double>(numSamples);
+    result.numBands = numBands;
+    result.count = numSamples;
+    result.mean.resize(numBands);
+    result.covariance.assign(static_cast<size_t>(numBands) * numBands, 0.0);
+
+    std::vector<double> shiftedMean(numBands);
+    for (int b = 0; b < numBands; b++) {
+        shiftedMean[b] = accumulated.sums[b] / n;
+        result.mean[b] = shiftedMean[b] + shift[b];
+    }
+
+    if (numSamples < 2) return result;
+    const int stride = accumulated.stride;
+    for (int i = 0; i < numBands; i++) {
+        for (int j = i; j < numBands; j++) {
+            const double value = (accumulated.products[static_cast<size_t>(i) * stride + j] -
+                                  n * shiftedMean[i] * shiftedMean[j]) / (n - 1.0);
+            result.covariance[static_cast<size_t>(i) * numBands + j] = value;
+            result.covariance[static_cast<size_t>(j) * numBands + i] = value;
+        }
+    }
+    return result;
+}
+
+} // namespace
+
+std::vector<double> SpectralCovariance::Result::correlation() const {
+    std::vector<double> result(covariance.size(), 0.0);
+    for (int i = 0; i < numBands; i++) {
+        for (int j = 0; j < numBands; j++) {
+            const double denominator = std::sqrt(at(i, i) * at(j, j));
+            if (i == j) {
+                result[static_cast<size_t>(i) * numBands + j] = 1.0;
+            } else if (denominator > 0.0) {
+                result[static_cast<size_t>(i) * numBands + j] = std::clamp(at(i, j) / denominator, -1.0, 1.0);
+            }
+        }
+    }
+    return result;
+}
+
+SpectralCovariance::Result SpectralCovariance::compute(const std::vector<const uint16_t*>& bands, size_t numPixels, size_t step) {
+    const int numBands = static_cast<int>(bands.size());
+    step = std::max<size_t>(1, step);
+    const size_t numSamples = (numPixels + step - 1) / step;
+    if (numBands == 0 || numSamples == 0) return Result();
+
+    // Сдвиг на примерное среднее канала: суммы произведений считаются от него,
+    // и вычитание n * m_i * m_j в конце не съедает значащие разряды
+    std::vector<double> shift(numBands, 0.0);
+    const size_t shiftStride = std::max<size_t>(1, numSamples / 1024);
+    for (int b = 0; b < numBands; b++) {
+        double sum = 0.0;
+        size_t count = 0;
+        for (size_t s = 0; s < numSamples; s += shiftStride, count++) {
+            sum += bands[b][s * step];
+        }
+        shift[b] = std::round(sum / count);
+    }
+
+    // Перестановка канал-за-каналом -> пиксель-за-пикселем
+    Accumulated accumulated = accumulate(numBands, numSamples, [&](size_t first, size_t count, int stride, double* block) {
+        for (int b = 0; b < numBands; b++) {
+            const uint16_t* source = bands[b] + first * step;
+            const double bandShift = shift[b];
+            for (size_t p = 0; p < count; p++) {
+                block[p * stride + b] = source[p * step] - bandShift;
+            }
+        }
+    });
+    return finish(accumulated, shift, numSamples);
+}
+
+SpectralCovariance::Result SpectralCovariance::computeShiftDifference(const std::vector<const uint16_t*>& bands,
+                                                                      uint32_t width, uint32_t height) {
+    const int numBands = static_cast<int>(bands.size());
+    if (numBands == 0 || width < 2 || height == 0) return Result();
+
+    // Отсчёт s - разность пикселя и его правого соседа в той же строке
+    const size_t pairsPerRow = width - 1;
+    const size_t numSamples = pairsPerRow * height;
+    Accumulated accumulated = accumulate(numBands, numSamples, [&](size_t first, size_t count, int stride, double* block) {
+        for (int b = 0; b < numBands; b++) {
+            const uint16_t* source = bands[b];
+            size_t row = first / pairsPerRow;
+            size_t column = first % pairsPerRow;
+            for (size_t p = 0; p < count; p++) {
+                const size_t pixel = row * width + column;
+                block[p * stride + b] = static_cast<double>(source[pixel]) - source[pixel + 1];
+                if (++column == pairsPerRow) {
+                    column = 0;
+                    row++;
+                }
+            }
+        }
+    });
+    return finish(accumulated, std::vector<double>(numBands, 0.0), numSamples);
+}
+
+QImage SpectralCovariance::correlationImage(const std::vector<double>& correlation, int numBands) {
+    if (numBands <= 0 || correlation.size() != static_cast<size_t>(numBands) * numBands) return QImage();
+
+    QImage image(numBands, numBands, QImage::Format_RGB32);
+    for (int i = 0; i < numBands; i++) {
+        QRgb* scanLine = reinterpret_cast<QRgb*>(image.scanLine(i));
+        for (int j = 0; j < numBands; j++) {
+            const double r = correlation[static_cast<size_t>(i) * numBands + j];
+            const int fade = static_cast<int>(std::round(255.0 * (1.0 - std::fabs(r))));
+            scanLine[j] = r >= 0.0 ? qRgb(255, fade, fade) : qRgb(fade, fade, 255);
+        }
+    }
+    return image;
+}
@@ -0,0 +1,35 @@
+#ifndef SPECTRAL_COVARIANCE_H
+#define SPECTRAL_COVARIANCE_H
+
+#include <QImage>
+#include <vector>
+#include <cstdint>
+
+// Межканальная ковариация всего куба. Пиксели обрабатываются блоками:
+// блок переставляется в матрицу "пиксель x канал", и её произведение
+// на себя копится блоками 4 x 4 с суммами в регистрах (как в GEMM)
+class SpectralCovariance {
+public:
+    struct Result {
+        int numBands = 0;
+        uint64_t count = 0;             // сколько пикселей учтено
+        std::vector<double> mean;
+        std::vector<double> covariance; // numBands x numBands по строкам, несмещённая
+
+        double at(int i, int j) const { return covariance[static_cast<size_t>(i) * numBands + j]; }
+        // Коэффициенты Пирсона; у канала с нулевой дисперсией - 0 вне диагонали
+        std::vector<double> correlation() const;
+        bool isEmpty() const { return count < 2; }
+    };
+
+    // bands[b] - numPixels значений канала b. step > 1 берёт каждый step-й пиксель
+    static Result compute(const std::vector<const uint16_t*>& bands, size_t numPixels, size_t step = 1);
+    // Ковариация разностей соседних по строке пикселей - оценка шума для MNF:
+    // сигнал соседей почти одинаков, и ковариация разности близка к удвоенной ковариации шума
+    static Result computeShiftDifference(const std::vector<const uint16_t*>& bands, uint32_t width, uint32_t height);
+
+    // numBands x numBands: -1 синий, 0 белый, +1 красный
+    static QImage correlationImage(const std::vector<double>& correlation, int numBands);
+};
+
+#endif
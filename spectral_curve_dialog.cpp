@@ -12,6 +12,14 @@
 #include <QFontMetrics>
 #include <algorithm>
 #include <cmath>
+#include <tuple>
+
+namespace {
+
+// Больше закреплённых спектров рисуется как плотность, а не отдельными линиями
+const size_t kMaxDrawnCurves = 200;
+
+} // namespace
 
 SpectralCurveWidget::SpectralCurveWidget(QWidget* parent) 
     : QWidget(parent), pixelX(0), pixelY(0), showCrosshair(false),
@@ -21,60 +29,140 @@ SpectralCurveWidget::SpectralCurveWidget(QWidget* parent)
     setStyleSheet("background-color: white;");
 }
 
+void SpectralCurveWidget::DataRange::include(const std::vector<SpectralPoint>& data) {
+    for (const auto& point : data) {
+        if (!valid) {
+            minWavelength = maxWavelength = point.wavelength;
+            minValue = maxValue = point.value16;
+            valid = true;
+        } else {
+            minWavelength = std::min(minWavelength, point.wavelength);
+            maxWavelength = std::max(maxWavelength, point.wavelength);
+            minValue = std::min(minValue, point.value16);
+            maxValue = std::max(maxValue, point.value16);
+        }
+    }
+}
+
+void SpectralCurveWidget::DataRange::merge(const DataRange& other) {
+    if (!other.valid) return;
+    if (!valid) {
+        *this = other;
+        return;
+    }
+    minWavelength = std::min(minWavelength, other.minWavelength);
+    maxWavelength = std::max(maxWavelength, other.maxWavelength);
+    minValue = std::min(minValue, other.minValue);
+    maxValue = std::max(maxValue, other.maxValue);
+}
+
 void SpectralCurveWidget::setSpectralData(const std::vector<SpectralPoint>& data) {
+    // Подписи осей зависят от наличия данных и длин волн у текущей кривой
+    const bool hadWavelength = !spectralData.empty() && spectralData[0].hasWavelength;
+    const bool hasWavelength = !data.empty() && data[0].hasWavelength;
+    if (spectralData.empty() != data.empty() || hadWavelength != hasWavelength) {
+        staticLayerDirty = true;
+    }
+    
     spectralData = data;
+    currentPathDirty = true;
+    updateAxes();
+    update();
+}
+
+SpectralCurveWidget::DataRange SpectralCurveWidget::pinnedDataRange() const {
+    DataRange range;
+    if (pinnedSpectra.isEmpty()) return range;
+    
+    const std::vector<double>& wavelengths = pinnedSpectra.getWavelengths();
+    auto [minBand, maxBand] = std::minmax_element(wavelengths.begin(), wavelengths.end());
+    range.valid = true;
+    range.minWavelength = *minBand;
+    range.maxWavelength = *maxBand;
+    range.minValue = pinnedSpectra.getMinValue();
+    range.maxValue = pinnedSpectra.getMaxValue();
+    return range;
+}
+
+SpectralCurveWidget::DataRange SpectralCurveWidget::roiDataRange() const {
+    DataRange range;
+    if (roiStatistics.isEmpty() || roiWavelengths.empty()) return range;
+    
+    auto [minBand, maxBand] = std::minmax_element(roiWavelengths.begin(), roiWavelengths.end());
+    range.valid = true;
+    range.minWavelength = *minBand;
+    range.maxWavelength = *maxBand;
+    range.minValue = *std::min_element(roiStatistics.minimum.begin(), roiStatistics.minimum.end());
+    range.maxValue = *std::max_element(roiStatistics.maximum.begin(), roiStatistics.maximum.end());
+    return range;
+}
+
+void SpectralCurveWidget::setRoiStatistics(const RoiStatistics::Result& statistics, const std::vector<double>& wavelengths) {
+    if (statistics.numBands() != static_cast<int>(wavelengths.size())) return;
+    roiStatistics = statistics;
+    roiWavelengths = wavelengths;
+    pinnedChanged();
+}
+
+void SpectralCurveWidget::clearRoiStatistics() {
+    if (roiStatistics.isEmpty()) return;
+    roiStatistics = RoiStatistics::Result();
+    roiWavelengths.clear();
+    pinnedChanged();
+}
+
+void SpectralCurveWidget::setValueScale(const SampleQuantization& scale, const QString& quantityName) {
+    valueScale = scale;
+    valueName = quantityName;
+    staticLayerDirty = true;
+    update();
+}
+
+QString SpectralCurveWidget::formatAxisValue(double code) const {
+    if (valueScale.offset == 0.0 && valueScale.scale == 1.0) {
+        return QString::number(static_cast<int>(code));
+    }
+    return QString::number(valueScale.decode(code), 'g', 4);
+}
+
+void SpectralCurveWidget::pinnedChanged() {
+    staticLayerDirty = true;
+    updateAxes();
+    update();
+}
+
+void SpectralCurveWidget::updateAxes() {
+    DataRange range;
+    range.include(spectralData);
+    range.merge(pinnedDataRange());
+    range.merge(roiDataRange());
+    if (!range.valid) return;
+    
+    // Ось остаётся прежней, пока данные в ней помещаются и занимают хотя бы половину:
+    // иначе каждое движение мыши сдвигало бы подписи и сбрасывало кэш осей
+    const double wavelengthRange = range.maxWavelength - range.minWavelength;
+    const bool wavelengthFits = range.minWavelength >= minWavelength && range.maxWavelength <= maxWavelength &&
+                                wavelengthRange >= 0.5 * (maxWavelength - minWavelength);
+    if (!wavelengthFits) {
+        minWavelength = range.minWavelength - wavelengthRange * 0.05;
+        maxWavelength = range.maxWavelength + wavelengthRange * 0.05;
+        staticLayerDirty = true;
+    }
     
-    if (!data.empty() || !pinnedPoints.empty()) {
-        // Инициализируем диапазоны
-        bool initialized = false;
-        
-        // Учитываем текущую точку
-        if (!data.empty()) {
-            minWavelength = maxWavelength = data[0].wavelength;
-            minValue = maxValue = data[0].value16;
-            initialized = true;
-            
-            for (const auto& point : data) {
-                minWavelength = std::min(minWavelength, point.wavelength);
-                maxWavelength = std::max(maxWavelength, point.wavelength);
-                minValue = std::min(minValue, point.value16);
-                maxValue = std::max(maxValue, point.value16);
-            }
-        }
-        
-        // Учитываем все закрепленные точки
-        for (const auto& pinnedPoint : pinnedPoints) {
-            for (const auto& point : pinnedPoint.spectralData) {
-                if (!initialized) {
-                    minWavelength = maxWavelength = point.wavelength;
-                    minValue = maxValue = point.value16;
-                    initialized = true;
-                } else {
-                    minWavelength = std::min(minWavelength, point.wavelength);
-                    maxWavelength = std::max(maxWavelength, point.wavelength);
-                    minValue = std::min(minValue, point.value16);
-                    maxValue = std::max(maxValue, point.value16);
-                }
-            }
-        }
-        
-        // Добавляем отступы к диапазонам
-        if (initialized) {
-            double wavelengthRange = maxWavelength - minWavelength;
-            if (wavelengthRange > 0) {
-                minWavelength -= wavelengthRange * 0.05;
-                maxWavelength += wavelengthRange * 0.05;
-            }
-            
-            uint16_t valueRange = maxValue - minValue;
-            if (valueRange > 0) {
-                minValue = std::max(0, static_cast<int>(minValue - valueRange * 0.05));
-                maxValue = std::min(65535, static_cast<int>(maxValue + valueRange * 0.05));
-            }
+    const int valueRange = range.maxValue - range.minValue;
+    const bool valueFits = range.minValue >= minValue && range.maxValue <= maxValue &&
+                           valueRange >= 0.5 * (maxValue - minValue);
+    if (!valueFits) {
+        const uint16_t newMin = std::max(0, static_cast<int>(range.minValue - valueRange * 0.05));
+        const uint16_t newMax = std::min(65535, static_cast<int>(range.maxValue + valueRange * 0.05));
+        if (newMin != minValue || newMax != maxValue) {
+            minValue = newMin;
+            maxValue = newMax;
+            staticLayerDirty = true;
         }
     }
     
-    update();
+    if (staticLayerDirty) currentPathDirty = true;
 }
 
 void SpectralCurveWidget::setCoordinates(int x, int y) {
@@ -82,53 +170,333 @@ void SpectralCurveWidget::setCoordinates(int x, int y) {
     pixelY = y;
 }
 
-void SpectralCurveWidget::addPinnedPoint(int x, int y, const std::vector<SpectralPoint>& data, const QColor& color) {
-    PinnedPoint point;
-    point.x = x;
-    point.y = y;
-    point.spectralData = data;
-    point.color = color;
-    point.label = QString("(%1, %2)").arg(x).arg(y);
-    pinnedPoints.push_back(point);
-    
-    // Пересчитываем диапазоны с учетом новой точки
-    setSpectralData(spectralData);
+bool SpectralCurveWidget::addPinnedPoint(int x, int y, const std::vector<SpectralPoint>& data, const QColor& color,
+                                         int windowSize) {
+    std::vector<double> wavelengths(data.size());
+    std::vector<uint16_t> values(data.size());
+    for (size_t i = 0; i < data.size(); i++) {
+        wavelengths[i] = data[i].wavelength;
+        values[i] = data[i].value16;
+    }
+    const bool hasWavelength = !data.empty() && data[0].hasWavelength;
+    return addPinnedSpectra(QString("(%1, %2)").arg(x).arg(y), color, wavelengths, hasWavelength, values, {QPoint(x, y)},
+                            windowSize);
+}
+
+bool SpectralCurveWidget::addPinnedSpectra(const QString& label, const QColor& color, const std::vector<double>& wavelengths,
+                                           bool hasWavelength, const std::vector<uint16_t>& values,
+                                           const std::vector<QPoint>& positions, int windowSize) {
+    if (!pinnedSpectra.addGroup(label, color, wavelengths, hasWavelength, values, positions, windowSize)) return false;
+    pinnedChanged();
+    return true;
 }
 
-void SpectralCurveWidget::removePinnedPoint(int index) {
-    if (index >= 0 && index < static_cast<int>(pinnedPoints.size())) {
-        pinnedPoints.erase(pinnedPoints.begin() + index);
-        setSpectralData(spectralData);
+bool SpectralCurveWidget::replacePinnedValues(std::vector<uint16_t> values) {
+    if (!pinnedSpectra.replaceValues(std::move(values))) return false;
+    pinnedChanged();
+    return true;
+}
+
+void SpectralCurveWidget::removePinnedGroup(int index) {
+    if (index >= 0 && index < static_cast<int>(pinnedSpectra.getGroups().size())) {
+        pinnedSpectra.removeGroup(index);
+        pinnedChanged();
     }
 }
 
 void SpectralCurveWidget::clearPinnedPoints() {
-    pinnedPoints.clear();
-    setSpectralData(spectralData);
+    pinnedSpectra.clear();
+    pinnedChanged();
 }
 
-void SpectralCurveWidget::paintEvent(QPaintEvent* event) {
-    QPainter painter(this);
-    painter.setRenderHint(QPainter::Antialiasing);
-    
+QRect SpectralCurveWidget::plotRect() const {
     const int margin = 80;
     const int topMargin = 60;
     const int bottomMargin = 80;
-    QRect plotRect(margin, topMargin, width() - 2 * margin, height() - topMargin - bottomMargin);
+    return QRect(margin, topMargin, width() - 2 * margin, height() - topMargin - bottomMargin);
+}
+
+QPointF SpectralCurveWidget::mapToPlot(double wavelength, double value, const QRect& plotRect) const {
+    const double wavelengthRange = maxWavelength > minWavelength ? maxWavelength - minWavelength : 1.0;
+    const double valueRange = maxValue > minValue ? maxValue - minValue : 1.0;
+    return QPointF(plotRect.left() + plotRect.width() * (wavelength - minWavelength) / wavelengthRange,
+                   plotRect.bottom() - plotRect.height() * (value - minValue) / valueRange);
+}
+
+template <typename PointAt>
+void SpectralCurveWidget::buildCurvePaths(size_t count, PointAt pointAt, const QRect& plotRect,
+                                          QPainterPath& line, QPainterPath& markers) const {
+    line = QPainterPath();
+    markers = QPainterPath();
+    if (count < 2) return;
+    
+    auto mapped = [&](size_t i) {
+        const auto point = pointAt(i);
+        return mapToPlot(point.first, point.second, plotRect);
+    };
     
-    drawAxes(painter, plotRect);
+    // Маркеры различимы, только если между точками хотя бы несколько пикселей
+    const int kMinMarkerSpacing = 6;
+    const bool decimate = count > static_cast<size_t>(std::max(1, plotRect.width()));
+    const bool drawMarkers = count * kMinMarkerSpacing <= static_cast<size_t>(std::max(0, plotRect.width()));
+    
+    bool started = false;
+    auto addPoint = [&](const QPointF& point) {
+        if (started) {
+            line.lineTo(point);
+        } else {
+            line.moveTo(point);
+            started = true;
+        }
+    };
     
-    if (!pinnedPoints.empty()) {
-        drawPinnedCurves(painter, plotRect);
+    if (!decimate) {
+        for (size_t i = 0; i < count; i++) {
+            const QPointF point = mapped(i);
+            addPoint(point);
+            if (drawMarkers) markers.addEllipse(point, 3, 3);
+        }
+        return;
+    }
+    
+    // Первая, верхняя, нижняя и последняя точки каждого столбца сохраняют огибающую
+    size_t i = 0;
+    while (i < count) {
+        const QPointF first = mapped(i);
+        const int column = static_cast<int>(std::floor(first.x()));
+        QPointF top = first;
+        QPointF bottom = first;
+        QPointF last = first;
+        
+        size_t j = i + 1;
+        for (; j < count; j++) {
+            const QPointF point = mapped(j);
+            if (static_cast<int>(std::floor(point.x())) != column) break;
+            if (point.y() < top.y()) top = point;
+            if (point.y() > bottom.y()) bottom = point;
+            last = point;
+        }
+        
+        addPoint(first);
+        if (j > i + 1) {
+            addPoint(top);
+            addPoint(bottom);
+            addPoint(last);
+        }
+        i = j;
+    }
+}
+
+template <typename BandAt>
+QPainterPath SpectralCurveWidget::buildBandPath(size_t count, BandAt bandAt, const QRect& plotRect) const {
+    QPainterPath path;
+    if (count < 2) return path;
+    
+    const bool decimate = count > static_cast<size_t>(std::max(1, plotRect.width()));
+    std::vector<QPointF> upper;
+    std::vector<QPointF> lower;
+    upper.reserve(std::min(count, static_cast<size_t>(std::max(0, plotRect.width())) + 1));
+    lower.reserve(upper.capacity());
+    
+    int lastColumn = 0;
+    for (size_t i = 0; i < count; i++) {
+        const auto [wavelength, low, high] = bandAt(i);
+        const QPointF highPoint = mapToPlot(wavelength, high, plotRect);
+        const QPointF lowPoint = mapToPlot(wavelength, low, plotRect);
+        const int column = static_cast<int>(std::floor(highPoint.x()));
+        
+        if (decimate && !upper.empty() && column == lastColumn) {
+            if (highPoint.y() < upper.back().y()) upper.back().setY(highPoint.y());
+            if (lowPoint.y() > lower.back().y()) lower.back().setY(lowPoint.y());
+            continue;
+        }
+        upper.push_back(highPoint);
+        lower.push_back(lowPoint);
+        lastColumn = column;
     }
     
+    path.moveTo(upper.front());
+    for (size_t i = 1; i < upper.size(); i++) path.lineTo(upper[i]);
+    for (size_t i = lower.size(); i-- > 0;) path.lineTo(lower[i]);
+    path.closeSubpath();
+    return path;
+}
+
+void SpectralCurveWidget::paintEvent(QPaintEvent* event) {
+    const QRect rect = plotRect();
+    if (rect != cachedPlotRect) {
+        cachedPlotRect = rect;
+        staticLayerDirty = true;
+        currentPathDirty = true;
+    }
+    if (staticLayerDirty) rebuildStaticLayer(rect);
+    
+    // Поверх кэша - только то, что меняется с каждым движением мыши
+    QPainter painter(this);
+    painter.drawPixmap(0, 0, staticLayer);
+    painter.setRenderHint(QPainter::Antialiasing);
+    
     if (!spectralData.empty()) {
-        drawCurve(painter, plotRect);
+        if (currentPathDirty) {
+            buildCurvePaths(spectralData.size(), [this](size_t i) {
+                return std::make_pair(spectralData[i].wavelength, static_cast<double>(spectralData[i].value16));
+            }, rect, currentLine, currentMarkers);
+            const bool hasSpread = std::any_of(spectralData.begin(), spectralData.end(),
+                                               [](const SpectralPoint& point) { return point.stdDev > 0.0; });
+            currentEnvelope = hasSpread ? buildBandPath(spectralData.size(), [this](size_t i) {
+                const SpectralPoint& point = spectralData[i];
+                return std::make_tuple(point.wavelength, std::max(0.0, point.value16 - point.stdDev),
+                                       point.value16 + point.stdDev);
+            }, rect) : QPainterPath();
+            currentPathDirty = false;
+        }
+        if (!currentEnvelope.isEmpty()) {
+            // Полоса может выходить за оси, подобранные по средним значениям
+            painter.save();
+            painter.setClipRect(rect);
+            painter.setPen(Qt::NoPen);
+            painter.setBrush(QColor(255, 0, 0, 50));
+            painter.drawPath(currentEnvelope);
+            painter.restore();
+        }
+        drawCurvePaths(painter, currentLine, currentMarkers, Qt::red);
     }
     
     if (showCrosshair) {
-        drawCrosshair(painter, plotRect, lastMousePos);
+        drawCrosshair(painter, rect, lastMousePos);
+    }
+}
+
+void SpectralCurveWidget::rebuildStaticLayer(const QRect& plotRect) {
+    const qreal ratio = devicePixelRatioF();
+    staticLayer = QPixmap(size() * ratio);
+    staticLayer.setDevicePixelRatio(ratio);
+    staticLayer.fill(Qt::white);
+    
+    QPainter painter(&staticLayer);
+    painter.setRenderHint(QPainter::Antialiasing);
+    drawAxes(painter, plotRect);
+    
+    if (pinnedSpectra.size() > kMaxDrawnCurves) {
+        drawPinnedDensity(painter, plotRect);
+    } else {
+        drawPinnedCurves(painter, plotRect);
+    }
+    drawRoiStatistics(painter, plotRect);
+    staticLayerDirty = false;
+}
+
+void SpectralCurveWidget::drawPinnedCurves(QPainter& painter, const QRect& plotRect) {
+    const std::vector<double>& wavelengths = pinnedSpectra.getWavelengths();
+    for (const auto& group : pinnedSpectra.getGroups()) {
+        for (size_t row = group.first; row < group.first + group.count; row++) {
+            const uint16_t* values = pinnedSpectra.spectrum(row);
+            QPainterPath line;
+            QPainterPath markers;
+            buildCurvePaths(wavelengths.size(), [&](size_t i) {
+                return std::make_pair(wavelengths[i], static_cast<double>(values[i]));
+            }, plotRect, line, markers);
+            drawCurvePaths(painter, line, markers, group.color);
+        }
+    }
+}
+
+void SpectralCurveWidget::drawRoiStatistics(QPainter& painter, const QRect& plotRect) {
+    if (roiStatistics.isEmpty()) return;
+    
+    const RoiStatistics::Result& stats = roiStatistics;
+    const size_t count = roiWavelengths.size();
+    const QColor color(0, 90, 200);
+    
+    painter.save();
+    painter.setClipRect(plotRect);
+    painter.setPen(Qt::NoPen);
+    painter.setBrush(QColor(color.red(), color.green(), color.blue(), 30));
+    painter.drawPath(buildBandPath(count, [&](size_t i) {
+        return std::make_tuple(roiWavelengths[i], static_cast<double>(stats.minimum[i]),
+                               static_cast<double>(stats.maximum[i]));
+    }, plotRect));
+    painter.setBrush(QColor(color.red(), color.green(), color.blue(), 70));
+    painter.drawPath(buildBandPath(count, [&](size_t i) {
+        return std::make_tuple(roiWavelengths[i], std::max(0.0, stats.mean[i] - stats.stdDev[i]),
+                               stats.mean[i] + stats.stdDev[i]);
+    }, plotRect));
+    painter.restore();
+    
+    QPainterPath line;
+    QPainterPath markers;
+    buildCurvePaths(count, [&](size_t i) {
+        return std::make_pair(roiWavelengths[i], static_cast<double>(stats.median[i]));
+    }, plotRect, line, markers);
+    painter.setPen(QPen(color, 1, Qt::DashLine));
+    painter.setBrush(Qt::NoBrush);
+    painter.drawPath(line);
+    
+    buildCurvePaths(count, [&](size_t i) {
+        return std::make_pair(roiWavelengths[i], stats.mean[i]);
+    }, plotRect, line, markers);
+    drawCurvePaths(painter, line, markers, color);
+    
+    painter.setPen(QPen(color, 1));
+    painter.drawText(plotRect.adjusted(8, 4, -8, -4), Qt::AlignTop | Qt::AlignLeft,
+                     QString::fromUtf8("Область: %1 пикселей (среднее, медиана, ±σ, min-max)").arg(stats.count));
+}
+
+void SpectralCurveWidget::drawPinnedDensity(QPainter& painter, const QRect& plotRect) {
+    if (plotRect.width() <= 0 || plotRect.height() <= 0) return;
+    
+    // Бин значения - строка пикселей графика
+    const PinnedSpectra::Density density = pinnedSpectra.computeDensity(minValue, maxValue, plotRect.height());
+    if (density.maxCount == 0) return;
+    
+    // Каналы по возрастанию длины волны: столбец графика интерполируется между соседними
+    const std::vector<double>& wavelengths = pinnedSpectra.getWavelengths();
+    std::vector<int> order(wavelengths.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = static_cast<int>(i);
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return wavelengths[a] < wavelengths[b]; });
+    
+    const std::vector<QRgb>& palette = Colormap::palette(Colormap::VIRIDIS);
+    const double scale = 254.0 / std::log1p(static_cast<double>(density.maxCount));
+    const double wavelengthRange = maxWavelength > minWavelength ? maxWavelength - minWavelength : 1.0;
+    
+    QImage image(plotRect.width(), plotRect.height(), QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+    for (int column = 0; column < plotRect.width(); column++) {
+        const double wavelength = minWavelength + wavelengthRange * (column + 0.5) / plotRect.width();
+        if (wavelength < wavelengths[order.front()] || wavelength > wavelengths[order.back()]) continue;
+        
+        auto upper = std::lower_bound(order.begin(), order.end(), wavelength,
+                                      [&](int band, double value) { return wavelengths[band] < value; });
+        const int bandB = upper == order.end() ? order.back() : *upper;
+        const int bandA = upper == order.begin() ? bandB : *(upper - 1);
+        const double span = wavelengths[bandB] - wavelengths[bandA];
+        const double t = span > 0.0 ? (wavelength - wavelengths[bandA]) / span : 0.0;
+        
+        for (int bin = 0; bin < density.numBins; bin++) {
+            const uint32_t* row = density.counts.data() + static_cast<size_t>(bin) * density.numBands;
+            const double count = (1.0 - t) * row[bandA] + t * row[bandB];
+            if (count <= 0.0) continue;
+            const int level = 1 + static_cast<int>(std::log1p(count) * scale);
+            image.setPixel(column, density.numBins - 1 - bin, palette[std::min(level, 255)]);
+        }
     }
+    painter.drawImage(plotRect.topLeft(), image);
+    
+    painter.setPen(QPen(Qt::black, 1));
+    painter.drawText(plotRect.adjusted(8, 4, -8, -4), Qt::AlignTop | Qt::AlignRight,
+                     QString::fromUtf8("Плотность: %1 спектров").arg(pinnedSpectra.size()));
+}
+
+void SpectralCurveWidget::drawCurvePaths(QPainter& painter, const QPainterPath& line, const QPainterPath& markers,
+                                         const QColor& color) {
+    painter.setPen(QPen(color, 2));
+    painter.setBrush(Qt::NoBrush);
+    painter.drawPath(line);
+    
+    if (markers.isEmpty()) return;
+    painter.setPen(QPen(color.darker(), 1));
+    painter.setBrush(QBrush(color));
+    painter.drawPath(markers);
 }
 
 void SpectralCurveWidget::drawAxes(QPainter& painter, const QRect& plotRect) {
@@ -161,7 +529,8 @@ void SpectralCurveWidget::drawAxes(QPainter& painter, const QRect& plotRect) {
     painter.save();
     painter.translate(20, plotRect.center().y());
     painter.rotate(-90);
-    painter.drawText(-80, 0, QString::fromUtf8("Яркость (16-бит)"));
+    const bool rawCodes = valueScale.offset == 0.0 && valueScale.scale == 1.0;
+    painter.drawText(-80, 0, rawCodes ? valueName + QString::fromUtf8(" (16-бит)") : valueName);
     painter.restore();
     
     painter.setFont(axisFont);
@@ -196,65 +565,13 @@ void SpectralCurveWidget::drawAxes(QPainter& painter, const QRect& plotRect) {
         painter.setPen(QPen(Qt::black, 1));
         painter.drawLine(plotRect.left() - 5, y, plotRect.left(), y);
         
-        QString label = QString::number(value);
+        QString label = formatAxisValue(value);
         QFontMetrics fm(axisFont);
         int labelWidth = fm.horizontalAdvance(label);
         painter.drawText(plotRect.left() - labelWidth - 10, y + 5, label);
     }
 }
 
-void SpectralCurveWidget::drawCurve(QPainter& painter, const QRect& plotRect) {
-    if (spectralData.size() < 2) return;
-    
-    painter.setPen(QPen(Qt::red, 2));
-    
-    QVector<QPointF> points;
-    for (const auto& point : spectralData) {
-        double x = plotRect.left() + plotRect.width() * 
-                  (point.wavelength - minWavelength) / (maxWavelength - minWavelength);
-        double y = plotRect.bottom() - plotRect.height() * 
-                  (point.value16 - minValue) / static_cast<double>(maxValue - minValue);
-        points.append(QPointF(x, y));
-    }
-    
-    for (int i = 0; i < points.size() - 1; i++) {
-        painter.drawLine(points[i], points[i + 1]);
-    }
-    
-    painter.setPen(QPen(Qt::darkRed, 1));
-    painter.setBrush(QBrush(Qt::red));
-    for (const QPointF& point : points) {
-        painter.drawEllipse(point, 3, 3);
-    }
-}
-
-void SpectralCurveWidget::drawPinnedCurves(QPainter& painter, const QRect& plotRect) {
-    for (const auto& pinnedPoint : pinnedPoints) {
-        if (pinnedPoint.spectralData.size() < 2) continue;
-        
-        painter.setPen(QPen(pinnedPoint.color, 2));
-        
-        QVector<QPointF> points;
-        for (const auto& point : pinnedPoint.spectralData) {
-            double x = plotRect.left() + plotRect.width() * 
-                      (point.wavelength - minWavelength) / (maxWavelength - minWavelength);
-            double y = plotRect.bottom() - plotRect.height() * 
-                      (point.value16 - minValue) / static_cast<double>(maxValue - minValue);
-            points.append(QPointF(x, y));
-        }
-        
-        for (int i = 0; i < points.size() - 1; i++) {
-            painter.drawLine(points[i], points[i + 1]);
-        }
-        
-        painter.setPen(QPen(pinnedPoint.color.darker(), 1));
-        painter.setBrush(QBrush(pinnedPoint.color));
-        for (const QPointF& point : points) {
-            painter.drawEllipse(point, 3, 3);
-        }
-    }
-}
-
 void SpectralCurveWidget::drawCrosshair(QPainter& painter, const QRect& plotRect, const QPoint& mousePos) {
     if (!plotRect.contains(mousePos)) return;
     
@@ -272,13 +589,13 @@ void SpectralCurveWidget::drawCrosshair(QPainter& painter, const QRect& plotRect
     
     QString info;
     if (!spectralData.empty() && spectralData[0].hasWavelength) {
-        info = QString::fromUtf8("λ: %1 нм, Яркость: %2")
+        info = QString::fromUtf8("λ: %1 нм, %2: %3")
                .arg(wavelengthAtCursor, 0, 'f', 1)
-               .arg(valueAtCursor);
+               .arg(valueName, formatAxisValue(valueAtCursor));
     } else {
-        info = QString::fromUtf8("Канал: %1, Яркость: %2")
+        info = QString::fromUtf8("Канал: %1, %2: %3")
                .arg(wavelengthAtCursor, 0, 'f', 0)
-               .arg(valueAtCursor);
+               .arg(valueName, formatAxisValue(valueAtCursor));
     }
     
     QFontMetrics fm(painter.font());
@@ -492,22 +809,26 @@ void SpectralCurveDialog::updateLegend() {
     legendWidget->addItem(currentItem);
     
     // Добавляем закрепленные точки
-    const auto& pinnedPoints = curveWidget->getPinnedPoints();
-    for (size_t i = 0; i < pinnedPoints.size(); i++) {
-        const auto& point = pinnedPoints[i];
+    const PinnedSpectra& pinnedSpectra = curveWidget->getPinnedSpectra();
+    for (const auto& group : pinnedSpectra.getGroups()) {
         QListWidgetItem* item = new QListWidgetItem();
         
         // Создаем цветной индикатор
         QString colorCircle;
-        if (point.color == Qt::blue) colorCircle = "🔵";
-        else if (point.color == Qt::green) colorCircle = "🟢";
-        else if (point.color == QColor(255, 165, 0)) colorCircle = "🟠";
-        else if (point.color == QColor(128, 0, 128)) colorCircle = "🟣";
-        else if (point.color == QColor(0, 128, 128)) colorCircle = "🔷";
+        if (group.color == Qt::blue) colorCircle = "🔵";
+        else if (group.color == Qt::green) colorCircle = "🟢";
+        else if (group.color == QColor(255, 165, 0)) colorCircle = "🟠";
+        else if (group.color == QColor(128, 0, 128)) colorCircle = "🟣";
+        else if (group.color == QColor(0, 128, 128)) colorCircle = "🔷";
         else colorCircle = "⚫";
         
-        item->setText(QString("%1 Точка: (%2, %3)").arg(colorCircle).arg(point.x).arg(point.y));
-        item->setForeground(point.color);
+        if (group.count == 1) {
+            const QPoint point = pinnedSpectra.position(group.first);
+            item->setText(QString("%1 Точка: (%2, %3)").arg(colorCircle).arg(point.x()).arg(point.y()));
+        } else {
+            item->setText(QString("%1 %2").arg(colorCircle).arg(group.label));
+        }
+        item->setForeground(group.color);
         legendWidget->addItem(item);
     }
 }
@@ -548,7 +869,7 @@ void SpectralCurveDialog::onAddPointClicked() {
 void SpectralCurveDialog::onRemovePointClicked() {
     int currentRow = legendWidget->currentRow();
     if (currentRow > 0) {  // Не удаляем текущую точку (индекс 0)
-        curveWidget->removePinnedPoint(currentRow - 1);
+        curveWidget->removePinnedGroup(currentRow - 1);
         updateLegend();
     }
 }
@@ -562,7 +883,7 @@ void SpectralCurveDialog::onClearPointsClicked() {
 void SpectralCurveDialog::onLegendItemDoubleClicked(QListWidgetItem* item) {
     int row = legendWidget->row(item);
     if (row > 0) {  // Не удаляем текущую точку
-        curveWidget->removePinnedPoint(row - 1);
+        curveWidget->removePinnedGroup(row - 1);
         updateLegend();
     }
 }
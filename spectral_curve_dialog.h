@@ -11,9 +11,12 @@
 #include <QPainter>
 #include <QMouseEvent>
 #include <QListWidget>
+#include <QPixmap>
+#include <QPainterPath>
 #include <vector>
 #include "spectral_reader.h"
 #include "hyperspectral_image.h"
+#include "pinned_spectra.h"
 
 struct SpectralPoint {
     double wavelength;
@@ -21,13 +24,7 @@ struct SpectralPoint {
     uint8_t value8;
     int channelIndex;
     bool hasWavelength;
-};
-
-struct PinnedPoint {
-    int x, y;
-    QColor color;
-    std::vector<SpectralPoint> spectralData;
-    QString label;
+    double stdDev = 0.0;  // СКО по окну усреднения; 0 - спектр одного пикселя
 };
 
 class SpectralCurveWidget : public QWidget {
@@ -37,10 +34,23 @@ public:
     SpectralCurveWidget(QWidget* parent = nullptr);
     void setSpectralData(const std::vector<SpectralPoint>& data);
     void setCoordinates(int x, int y);
-    void addPinnedPoint(int x, int y, const std::vector<SpectralPoint>& data, const QColor& color);
-    void removePinnedPoint(int index);
+    // windowSize - окно усреднения, по которому снят спектр точки
+    bool addPinnedPoint(int x, int y, const std::vector<SpectralPoint>& data, const QColor& color, int windowSize = 1);
+    // Сразу много спектров одной группой, например все пиксели области
+    bool addPinnedSpectra(const QString& label, const QColor& color, const std::vector<double>& wavelengths,
+                          bool hasWavelength, const std::vector<uint16_t>& values, const std::vector<QPoint>& positions,
+                          int windowSize = 1);
+    // Значения всех закреплённых спектров, снятые заново (например, в другом виде кривой)
+    bool replacePinnedValues(std::vector<uint16_t> values);
+    void removePinnedGroup(int index);
     void clearPinnedPoints();
-    const std::vector<PinnedPoint>& getPinnedPoints() const { return pinnedPoints; }
+    const PinnedSpectra& getPinnedSpectra() const { return pinnedSpectra; }
+    // Статистика области интереса поверх закреплённых кривых; wavelengths - ось каналов
+    void setRoiStatistics(const RoiStatistics::Result& statistics, const std::vector<double>& wavelengths);
+    void clearRoiStatistics();
+    // Как читать 16-битные коды кривых: подписи оси Y и перекрестия показывают
+    // scale.decode(код). Тождественная шкала - исходные коды, как раньше
+    void setValueScale(const SampleQuantization& scale, const QString& quantityName);
     
 protected:
     void paintEvent(QPaintEvent* event) override;
@@ -48,19 +58,63 @@ protected:
     void leaveEvent(QEvent* event) override;
     
 private:
-    void drawAxes(QPainter& painter, const QRect& plotRect);
-    void drawCurve(QPainter& painter, const QRect& plotRect);
+    // Охват набора кривых по обеим осям
+    struct DataRange {
+        bool valid = false;
+        double minWavelength = 0, maxWavelength = 0;
+        uint16_t minValue = 0, maxValue = 0;
+        
+        void include(const std::vector<SpectralPoint>& data);
+        void merge(const DataRange& other);
+    };
+    
+    QRect plotRect() const;
+    DataRange pinnedDataRange() const;
+    DataRange roiDataRange() const;
+    void pinnedChanged();
+    void updateAxes();
+    QPointF mapToPlot(double wavelength, double value, const QRect& plotRect) const;
+    // Линия и маркеры кривой из count точек pointAt(i) в координатах виджета. Если точек
+    // больше, чем столбцов пикселей, в каждом столбце остаются крайние по высоте точки
+    template <typename PointAt>
+    void buildCurvePaths(size_t count, PointAt pointAt, const QRect& plotRect,
+                         QPainterPath& line, QPainterPath& markers) const;
+    // Замкнутая полоса между границами count точек; bandAt(i) возвращает {длина волны, низ, верх}.
+    // При прореживании в столбце остаются самая высокая верхняя и самая низкая нижняя точки
+    template <typename BandAt>
+    QPainterPath buildBandPath(size_t count, BandAt bandAt, const QRect& plotRect) const;
+    void drawCurvePaths(QPainter& painter, const QPainterPath& line, const QPainterPath& markers, const QColor& color);
+    // Оси и закреплённые кривые меняются редко и рисуются в кэш один раз
+    void rebuildStaticLayer(const QRect& plotRect);
     void drawPinnedCurves(QPainter& painter, const QRect& plotRect);
+    // Когда закреплённых спектров много, вместо линий - плотность "длина волны x значение"
+    void drawPinnedDensity(QPainter& painter, const QRect& plotRect);
+    // Статистика области: полосы min-max и ±СКО, среднее сплошной линией, медиана пунктиром
+    void drawRoiStatistics(QPainter& painter, const QRect& plotRect);
+    void drawAxes(QPainter& painter, const QRect& plotRect);
     void drawCrosshair(QPainter& painter, const QRect& plotRect, const QPoint& mousePos);
     QString formatValue(double value, bool isWavelength);
+    QString formatAxisValue(double code) const;
     
     std::vector<SpectralPoint> spectralData;
-    std::vector<PinnedPoint> pinnedPoints;
+    PinnedSpectra pinnedSpectra;
+    RoiStatistics::Result roiStatistics;
+    SampleQuantization valueScale;
+    QString valueName = QString::fromUtf8("Яркость");
+    std::vector<double> roiWavelengths;
     int pixelX, pixelY;
     QPoint lastMousePos;
     bool showCrosshair;
     double minWavelength, maxWavelength;
     uint16_t minValue, maxValue;
+    
+    QPixmap staticLayer;
+    bool staticLayerDirty = true;
+    QRect cachedPlotRect;
+    QPainterPath currentLine;
+    QPainterPath currentMarkers;
+    QPainterPath currentEnvelope;
+    bool currentPathDirty = true;
 };
 
 class SpectralCurveDialog : public QDialog {
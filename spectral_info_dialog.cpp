@@ -10,11 +10,13 @@
 #include <QApplication>
 #include <QMessageBox>
 
-SpectralInfoDialog::SpectralInfoDialog(const QVector<SpectralBand>& bands, QWidget* parent)
-    : QDialog(parent), spectralBands(bands) {
+SpectralInfoDialog::SpectralInfoDialog(const QVector<SpectralBand>& bands,
+                                       const std::vector<ChannelStatistics::BandStatistics>& statistics,
+                                       QWidget* parent)
+    : QDialog(parent), spectralBands(bands), bandStatistics(statistics) {
     setWindowTitle("Информация о спектральных каналах");
     setMinimumSize(800, 600);
-    resize(1000, 700);
+    resize(1300, 700);
     
     setupUI();
     populateTable();
@@ -28,19 +30,18 @@ void SpectralInfoDialog::setupUI() {
     mainLayout->addWidget(infoLabel);
     
     tableWidget = new QTableWidget();
-    tableWidget->setColumnCount(6);
+    tableWidget->setColumnCount(12);
     
     QStringList headers;
-    headers << "№ в изображении" << "№ канала (XML)" << "Длина волны (нм)" << "Дельта λ (нм)" << "ОЭП" << "Описание";
+    headers << "№ в изображении" << "№ канала (XML)" << "Длина волны (нм)" << "Дельта λ (нм)" << "ОЭП"
+            << "Среднее" << "СКО" << "Асимметрия" << "Эксцесс" << "Шум" << "ОСШ" << "Описание";
     tableWidget->setHorizontalHeaderLabels(headers);
     
     QHeaderView* horizontalHeader = tableWidget->horizontalHeader();
-    horizontalHeader->setSectionResizeMode(0, QHeaderView::ResizeToContents);
-    horizontalHeader->setSectionResizeMode(1, QHeaderView::ResizeToContents);
-    horizontalHeader->setSectionResizeMode(2, QHeaderView::ResizeToContents);
-    horizontalHeader->setSectionResizeMode(3, QHeaderView::ResizeToContents);
-    horizontalHeader->setSectionResizeMode(4, QHeaderView::ResizeToContents);
-    horizontalHeader->setSectionResizeMode(5, QHeaderView::Stretch);
+    for (int column = 0; column < 11; column++) {
+        horizontalHeader->setSectionResizeMode(column, QHeaderView::ResizeToContents);
+    }
+    horizontalHeader->setSectionResizeMode(11, QHeaderView::Stretch);
     
     tableWidget->setAlternatingRowColors(true);
     tableWidget->setSelectionBehavior(QAbstractItemView::SelectRows);
@@ -110,9 +111,26 @@ void SpectralInfoDialog::populateTable() {
         oepItem->setTextAlignment(Qt::AlignCenter);
         tableWidget->setItem(i, 4, oepItem);
         
+        // Статистика канала изображения
+        if (i < static_cast<int>(bandStatistics.size())) {
+            const ChannelStatistics::BandStatistics& stats = bandStatistics[i];
+            tableWidget->setItem(i, 5, createStatisticItem(stats.mean, 2));
+            tableWidget->setItem(i, 6, createStatisticItem(stats.stdDev, 2));
+            tableWidget->setItem(i, 7, createStatisticItem(stats.skewness, 3));
+            tableWidget->setItem(i, 8, createStatisticItem(stats.kurtosis, 3));
+            tableWidget->setItem(i, 9, createStatisticItem(stats.noise, 2));
+            tableWidget->setItem(i, 10, createStatisticItem(stats.snr, 1));
+        } else {
+            for (int column = 5; column <= 10; column++) {
+                QTableWidgetItem* emptyItem = new QTableWidgetItem("—");
+                emptyItem->setTextAlignment(Qt::AlignCenter);
+                tableWidget->setItem(i, column, emptyItem);
+            }
+        }
+        
         // Описание
         QTableWidgetItem* descItem = new QTableWidgetItem(band.description);
-        tableWidget->setItem(i, 5, descItem);
+        tableWidget->setItem(i, 11, descItem);
     }
     
     if (!spectralBands.isEmpty()) {
@@ -166,18 +184,39 @@ void SpectralInfoDialog::populateTable() {
     }
 }
 
+QTableWidgetItem* SpectralInfoDialog::createStatisticItem(double value, int decimals) const {
+    // Число в DisplayRole, чтобы сортировка по столбцу была числовой
+    QTableWidgetItem* item = new QTableWidgetItem();
+    item->setData(Qt::DisplayRole, QString::number(value, 'f', decimals).toDouble());
+    item->setTextAlignment(Qt::AlignCenter);
+    return item;
+}
+
 void SpectralInfoDialog::copyToClipboard() {
     QString text;
-    text += "№ п/п\t№ канала\tДлина волны (нм)\tДельта λ (нм)\tОЭП\tОписание\n";
+    text += "№ п/п\t№ канала\tДлина волны (нм)\tДельта λ (нм)\tОЭП\t"
+            "Среднее\tСКО\tАсимметрия\tЭксцесс\tШум\tОСШ\tОписание\n";
     
     for (int i = 0; i < spectralBands.size(); ++i) {
         const SpectralBand& band = spectralBands[i];
-        text += QString("%1\t%2\t%3\t%4\t%5\t%6\n")
+        QString statistics = "\t\t\t\t\t";
+        if (i < static_cast<int>(bandStatistics.size())) {
+            const ChannelStatistics::BandStatistics& stats = bandStatistics[i];
+            statistics = QString("%1\t%2\t%3\t%4\t%5\t%6")
+                         .arg(stats.mean, 0, 'f', 2)
+                         .arg(stats.stdDev, 0, 'f', 2)
+                         .arg(stats.skewness, 0, 'f', 3)
+                         .arg(stats.kurtosis, 0, 'f', 3)
+                         .arg(stats.noise, 0, 'f', 2)
+                         .arg(stats.snr, 0, 'f', 1);
+        }
+        text += QString("%1\t%2\t%3\t%4\t%5\t%6\t%7\n")
                 .arg(i + 1)
                 .arg(band.bandNumber > 0 ? QString::number(band.bandNumber) : "")
                 .arg(band.wavelength > 0 ? QString::number(band.wavelength, 'f', 3) : "")
                 .arg(band.waveDelta > 0 ? QString::number(band.waveDelta, 'f', 3) : "")
                 .arg(band.oepNum > 0 ? QString::number(band.oepNum) : "")
+                .arg(statistics)
                 .arg(band.description);
     }
     
@@ -8,13 +8,18 @@
 #include <QPushButton>
 #include <QLabel>
 #include <QHeaderView>
+#include <vector>
 #include "spectral_reader.h"
+#include "channel_statistics.h"
 
 class SpectralInfoDialog : public QDialog {
     Q_OBJECT
     
 public:
-    SpectralInfoDialog(const QVector<SpectralBand>& bands, QWidget* parent = nullptr);
+    // statistics[i] относится к i-му каналу изображения; может быть пустым
+    SpectralInfoDialog(const QVector<SpectralBand>& bands,
+                       const std::vector<ChannelStatistics::BandStatistics>& statistics,
+                       QWidget* parent = nullptr);
     
 private slots:
     void copyToClipboard();
@@ -22,8 +27,10 @@ private slots:
 private:
     void setupUI();
     void populateTable();
+    QTableWidgetItem* createStatisticItem(double value, int decimals) const;
     
     QVector<SpectralBand> spectralBands;
+    std::vector<ChannelStatistics::BandStatistics> bandStatistics;
     QTableWidget* tableWidget;
     QLabel* infoLabel;
 };
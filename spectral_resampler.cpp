@@ -0,0 +1,334 @@
+#include "spectral_resampler.h"
+#include "parallel_utils.h"
+#include <QFile>
+#include <QTextStream>
+#include <QRegularExpression>
+#include <QStringList>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+// FWHM = 2 sqrt(2 ln 2) σ
+const double kFwhmToSigma = 1.0 / 2.3548200450309493;
+// Веса меньше этой доли наибольшего в строке отбрасываются: так матрица остаётся разреженной
+const double kRelativeWeightThreshold = 1e-3;
+const size_t kBlockPixels = 4096;
+
+struct BandSpec {
+    const char* name;
+    double center;
+    double fwhm;
+};
+
+// Номинальные центры и ширины полос по документации датчиков
+const BandSpec kSentinel2Bands[] = {
+    {"B1", 442.7, 21}, {"B2", 492.4, 66}, {"B3", 559.8, 36}, {"B4", 664.6, 31},
+    {"B5", 704.1, 15}, {"B6", 740.5, 15}, {"B7", 782.8, 20}, {"B8", 832.8, 106},
+    {"B8A", 864.7, 21}, {"B9", 945.1, 20}, {"B10", 1373.5, 31}, {"B11", 1613.7, 91},
+    {"B12", 2202.4, 175},
+};
+
+const BandSpec kLandsat8Bands[] = {
+    {"B1", 443.0, 16}, {"B2", 482.0, 60}, {"B3", 561.4, 57}, {"B4", 654.6, 37},
+    {"B5", 864.7, 28}, {"B6", 1608.9, 85}, {"B7", 2200.7, 187}, {"B9", 1373.4, 20},
+};
+
+double gaussian(double x, double center, double sigma) {
+    const double d = (x - center) / sigma;
+    return std::exp(-0.5 * d * d);
+}
+
+// Отклик табличной чувствительности с линейной интерполяцией, вне таблицы - 0
+double tabulatedResponse(const std::vector<std::pair<double, double>>& table, double wavelength) {
+    if (table.empty() || wavelength < table.front().first || wavelength > table.back().first) return 0.0;
+    auto upper = std::lower_bound(table.begin(), table.end(), wavelength,
+                                  [](const std::pair<double, double>& point, double value) { return point.first < value; });
+    if (upper == table.begin()) return upper->second;
+    auto lower = upper - 1;
+    const double span = upper->first - lower->first;
+    if (span <= 0) return upper->second;
+    return lower->second + (upper->second - lower->second) * (wavelength - lower->first) / span;
+}
+
+double targetResponse(const SpectralResampler::TargetBand& target, double wavelength) {
+    if (!target.response.empty()) return tabulatedResponse(target.response, wavelength);
+    return gaussian(wavelength, target.center, target.fwhm * kFwhmToSigma);
+}
+
+// Площадь под чувствительностью целевого канала
+double targetArea(const SpectralResampler::TargetBand& target) {
+    if (target.response.empty()) return std::sqrt(2 * kPi) * target.fwhm * kFwhmToSigma;
+    double area = 0.0;
+    for (size_t k = 1; k < target.response.size(); k++) {
+        const auto& a = target.response[k - 1];
+        const auto& b = target.response[k];
+        area += 0.5 * (a.second + b.second) * (b.first - a.first);
+    }
+    return area;
+}
+
+// Интеграл чувствительности целевого канала по [low, high]
+double targetIntegral(const SpectralResampler::TargetBand& target, double low, double high) {
+    if (high <= low) return 0.0;
+    if (target.response.empty()) {
+        const double scale = 1.0 / (target.fwhm * kFwhmToSigma * std::sqrt(2.0));
+        return 0.5 * targetArea(target) * (std::erf((high - target.center) * scale) - std::erf((low - target.center) * scale));
+    }
+
+    double integral = 0.0;
+    for (size_t k = 1; k < target.response.size(); k++) {
+        const double a = std::max(low, target.response[k - 1].first);
+        const double b = std::min(high, target.response[k].first);
+        if (b <= a) continue;
+        integral += 0.5 * (tabulatedResponse(target.response, a) + tabulatedResponse(target.response, b)) * (b - a);
+    }
+    return integral;
+}
+
+// Интеграл произведения чувствительностей исходного канала (гауссова) и целевого
+double overlap(double center, double sigma, const SpectralResampler::TargetBand& target) {
+    if (target.response.empty()) {
+        // Для двух гауссиан интеграл известен в замкнутом виде
+        const double targetSigma = target.fwhm * kFwhmToSigma;
+        const double variance = sigma * sigma + targetSigma * targetSigma;
+        const double d = center - target.center;
+        return std::sqrt(2 * kPi) * sigma * targetSigma / std::sqrt(variance) * std::exp(-0.5 * d * d / variance);
+    }
+
+    double integral = 0.0;
+    for (size_t k = 1; k < target.response.size(); k++) {
+        const auto& a = target.response[k - 1];
+        const auto& b = target.response[k];
+        integral += 0.5 * (a.second * gaussian(a.first, center, sigma) + b.second * gaussian(b.first, center, sigma)) *
+                    (b.first - a.first);
+    }
+    return integral;
+}
+
+} // namespace
+
+QString SpectralResampler::sensorName(Sensor sensor) {
+    switch (sensor) {
+    case SENTINEL2_MSI: return "Sentinel-2 MSI";
+    case LANDSAT8_OLI: return "Landsat 8 OLI";
+    }
+    return QString();
+}
+
+std::vector<SpectralResampler::TargetBand> SpectralResampler::sensorBands(Sensor sensor) {
+    std::vector<TargetBand> bands;
+    auto append = [&bands](const BandSpec* begin, const BandSpec* end) {
+        for (const BandSpec* spec = begin; spec != end; spec++) {
+            TargetBand band;
+            band.name = spec->name;
+            band.center = spec->center;
+            band.fwhm = spec->fwhm;
+            bands.push_back(band);
+        }
+    };
+
+    switch (sensor) {
+    case SENTINEL2_MSI:
+        append(std::begin(kSentinel2Bands), std::end(kSentinel2Bands));
+        break;
+    case LANDSAT8_OLI:
+        append(std::begin(kLandsat8Bands), std::end(kLandsat8Bands));
+        break;
+    }
+    return bands;
+}
+
+bool SpectralResampler::readTable(const QString& filePath, QStringList& names, std::vector<std::vector<double>>& rows,
+                                  QString& error) {
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        error = QString("Не удалось открыть файл: %1").arg(file.errorString());
+        return false;
+    }
+
+    QTextStream in(&file);
+    names.clear();
+    rows.clear();
+    const QRegularExpression separators("[,;\\s\\t]+");
+    while (!in.atEnd()) {
+        const QString line = in.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#')) continue;
+
+        const QStringList parts = line.split(separators, Qt::SkipEmptyParts);
+        std::vector<double> row;
+        bool numeric = true;
+        for (const QString& part : parts) {
+            bool ok = false;
+            row.push_back(part.toDouble(&ok));
+            numeric = numeric && ok;
+        }
+        if (!numeric) {
+            // Нечисловая строка до данных - заголовок с именами столбцов
+            if (rows.empty() && names.isEmpty()) names = parts;
+            continue;
+        }
+        if (row.size() >= 2) rows.push_back(row);
+    }
+
+    const size_t numColumns = rows.empty() ? 0 : rows.front().size();
+    if (rows.size() < 2 || numColumns < 2) {
+        error = "В таблице нет столбца длин волн и хотя бы одного столбца данных";
+        return false;
+    }
+
+    std::sort(rows.begin(), rows.end());
+    const double scale = rows.back()[0] < 30.0 ? 1000.0 : 1.0;
+    for (auto& row : rows) row[0] *= scale;
+    return true;
+}
+
+bool SpectralResampler::loadResponseTable(const QString& filePath, std::vector<TargetBand>& bands, QString& error) {
+    QStringList names;
+    std::vector<std::vector<double>> rows;
+    if (!readTable(filePath, names, rows, error)) return false;
+    const size_t numColumns = rows.front().size();
+
+    bands.clear();
+    for (size_t column = 1; column < numColumns; column++) {
+        TargetBand band;
+        band.name = column < static_cast<size_t>(names.size()) ? names[column] : QString("Канал %1").arg(column);
+        double weighted = 0.0;
+        double total = 0.0;
+        for (const auto& row : rows) {
+            if (column >= row.size()) continue;
+            const double wavelength = row[0];
+            const double response = std::max(0.0, row[column]);
+            band.response.emplace_back(wavelength, response);
+            weighted += wavelength * response;
+            total += response;
+        }
+        if (total <= 0) continue;
+
+        // Центр - взвешенное среднее, ширина - по площади, как у гауссианы той же высоты
+        band.center = weighted / total;
+        const double peak = std::max_element(band.response.begin(), band.response.end(),
+                                             [](const auto& a, const auto& b) { return a.second < b.second; })->second;
+        band.fwhm = targetArea(band) / (peak * std::sqrt(2 * kPi) * kFwhmToSigma);
+        bands.push_back(band);
+    }
+
+    if (bands.empty()) {
+        error = "Все столбцы чувствительности нулевые";
+        return false;
+    }
+    return true;
+}
+
+SpectralResampler::Matrix SpectralResampler::buildMatrix(const std::vector<double>& sourceCenters,
+                                                         const std::vector<double>& sourceFwhm,
+                                                         const std::vector<TargetBand>& targets) {
+    Matrix matrix;
+    const int numSource = static_cast<int>(sourceCenters.size());
+    matrix.numSourceBands = numSource;
+    matrix.rowStart.push_back(0);
+
+    // Шаг сетки вокруг каждого узкого канала - половина расстояния до соседей
+    std::vector<int> order(numSource);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return sourceCenters[a] < sourceCenters[b]; });
+    std::vector<double> spacing(numSource, 0.0);
+    for (int k = 0; k < numSource; k++) {
+        const double left = k > 0 ? sourceCenters[order[k - 1]] : sourceCenters[order[k]];
+        const double right = k + 1 < numSource ? sourceCenters[order[k + 1]] : sourceCenters[order[k]];
+        spacing[order[k]] = 0.5 * (right - left);
+    }
+
+    // Спектральный диапазон куба: крайние каналы расширены на половину своей ширины
+    auto halfWidth = [&](int i) {
+        const double fwhm = i < static_cast<int>(sourceFwhm.size()) ? sourceFwhm[i] : 0.0;
+        return 0.5 * std::max(fwhm, spacing[i]);
+    };
+    const double rangeLow = numSource > 0 ? sourceCenters[order.front()] - halfWidth(order.front()) : 0.0;
+    const double rangeHigh = numSource > 0 ? sourceCenters[order.back()] + halfWidth(order.back()) : 0.0;
+
+    std::vector<double> raw(numSource);
+    for (const TargetBand& target : targets) {
+        for (int i = 0; i < numSource; i++) {
+            const double fwhm = i < static_cast<int>(sourceFwhm.size()) ? sourceFwhm[i] : 0.0;
+            raw[i] = fwhm > 0 ? overlap(sourceCenters[i], fwhm * kFwhmToSigma, target)
+                              : targetResponse(target, sourceCenters[i]) * spacing[i];
+        }
+
+        const double maxWeight = numSource > 0 ? *std::max_element(raw.begin(), raw.end()) : 0.0;
+        const double area = targetArea(target);
+        matrix.coverage.push_back(area > 0 ? std::min(1.0, targetIntegral(target, rangeLow, rangeHigh) / area) : 0.0);
+
+        if (maxWeight > 0) {
+            const size_t rowBegin = matrix.weights.size();
+            double kept = 0.0;
+            for (int i = 0; i < numSource; i++) {
+                if (raw[i] < kRelativeWeightThreshold * maxWeight) continue;
+                matrix.columns.push_back(i);
+                matrix.weights.push_back(raw[i]);
+                kept += raw[i];
+            }
+            for (size_t k = rowBegin; k < matrix.weights.size(); k++) matrix.weights[k] /= kept;
+        }
+        matrix.rowStart.push_back(static_cast<int>(matrix.weights.size()));
+    }
+    return matrix;
+}
+
+SpectralTransform::CubeProduct SpectralResampler::apply(const Matrix& matrix, const std::vector<const uint16_t*>& bands,
+                                                        const std::vector<SampleQuantization>& quantization,
+                                                        size_t numPixels) {
+    SpectralTransform::CubeProduct product;
+    const int numTargets = matrix.numTargetBands();
+    if (numTargets == 0 || numPixels == 0 || static_cast<int>(bands.size()) != matrix.numSourceBands ||
+        quantization.size() != bands.size()) {
+        return product;
+    }
+
+    // Взвешенное среднее не выходит за диапазон своих исходных каналов: шкала
+    // целевого канала - объединение их шкал, для 16-битных файлов тождественная
+    product.bands.assign(numTargets, std::vector<uint16_t>(numPixels));
+    product.quantization.assign(numTargets, SampleQuantization{});
+    std::vector<double> constant(numTargets, 0.0);
+    for (int t = 0; t < numTargets; t++) {
+        double low = 0.0;
+        double high = 0.0;
+        for (int k = matrix.rowStart[t]; k < matrix.rowStart[t + 1]; k++) {
+            const SampleQuantization& source = quantization[matrix.columns[k]];
+            const bool first = k == matrix.rowStart[t];
+            low = first ? source.decode(0) : std::min(low, source.decode(0));
+            high = first ? source.decode(65535) : std::max(high, source.decode(65535));
+            constant[t] += matrix.weights[k] * source.offset;
+        }
+        if (high > low && (low != 0.0 || high != 65535.0)) {
+            product.quantization[t].offset = low;
+            product.quantization[t].scale = (high - low) / 65535.0;
+        }
+    }
+
+    const int64_t numBlocks = static_cast<int64_t>((numPixels + kBlockPixels - 1) / kBlockPixels);
+    const int64_t grainSize = std::max<int64_t>(1, numBlocks / (4 * Parallel::threadCount()));
+    Parallel::forRange(0, numBlocks, grainSize, [&](int64_t blockBegin, int64_t blockEnd) {
+        std::vector<double> accumulator(kBlockPixels);
+        for (int64_t blockIndex = blockBegin; blockIndex < blockEnd; blockIndex++) {
+            const size_t begin = static_cast<size_t>(blockIndex) * kBlockPixels;
+            const size_t count = std::min(kBlockPixels, numPixels - begin);
+            for (int t = 0; t < numTargets; t++) {
+                // Строка матрицы короткая, а блок канала читается подряд: внутренний цикл векторизуется
+                std::fill(accumulator.begin(), accumulator.begin() + count, constant[t]);
+                for (int k = matrix.rowStart[t]; k < matrix.rowStart[t + 1]; k++) {
+                    const double weight = matrix.weights[k] * quantization[matrix.columns[k]].scale;
+                    const uint16_t* source = bands[matrix.columns[k]] + begin;
+                    for (size_t p = 0; p < count; p++) accumulator[p] += weight * source[p];
+                }
+
+                uint16_t* target = product.bands[t].data() + begin;
+                const SampleQuantization& scale = product.quantization[t];
+                for (size_t p = 0; p < count; p++) target[p] = scale.encode(accumulator[p]);
+            }
+        }
+    });
+    return product;
+}
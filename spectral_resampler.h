@@ -0,0 +1,61 @@
+#ifndef SPECTRAL_RESAMPLER_H
+#define SPECTRAL_RESAMPLER_H
+
+#include <QString>
+#include <QStringList>
+#include <vector>
+#include <utility>
+#include "spectral_transform.h"
+
+// Пересчёт куба в каналы другого датчика: значение целевого канала - взвешенное
+// среднее исходных, веса - перекрытие их спектральных чувствительностей.
+// Веса собираются один раз в разреженную матрицу "целевой x исходный канал"
+class SpectralResampler {
+public:
+    enum Sensor {
+        SENTINEL2_MSI,
+        LANDSAT8_OLI
+    };
+
+    // Чувствительность целевого канала: гауссова по center и fwhm или таблица (λ, отклик)
+    struct TargetBand {
+        QString name;
+        double center = 0.0;  // нм
+        double fwhm = 0.0;    // нм
+        std::vector<std::pair<double, double>> response;  // по возрастанию λ; пусто - гауссова
+    };
+
+    // Строки CSR: веса строки нормированы к сумме 1
+    struct Matrix {
+        int numSourceBands = 0;
+        std::vector<int> rowStart;  // numTargetBands() + 1
+        std::vector<int> columns;
+        std::vector<double> weights;
+        // Доля чувствительности целевого канала внутри спектрального диапазона куба (0..1)
+        std::vector<double> coverage;
+
+        int numTargetBands() const { return rowStart.empty() ? 0 : static_cast<int>(rowStart.size()) - 1; }
+        size_t numWeights() const { return weights.size(); }
+    };
+
+    static QString sensorName(Sensor sensor);
+    // Номинальные центры и ширины каналов; чувствительности приближены гауссовыми
+    static std::vector<TargetBand> sensorBands(Sensor sensor);
+    // Таблица CSV или через пробелы: столбец λ и столбцы данных, первая строка -
+    // необязательные имена. Строки по возрастанию λ в нм; λ меньше 30 считаются микрометрами
+    static bool readTable(const QString& filePath, QStringList& names, std::vector<std::vector<double>>& rows,
+                          QString& error);
+    // Таблица readTable с откликом каждого канала в своём столбце
+    static bool loadResponseTable(const QString& filePath, std::vector<TargetBand>& bands, QString& error);
+
+    // sourceFwhm[i] <= 0 - канал считается узким, его вес - отклик в центре на шаг сетки
+    static Matrix buildMatrix(const std::vector<double>& sourceCenters, const std::vector<double>& sourceFwhm,
+                              const std::vector<TargetBand>& targets);
+
+    // Блоки пикселей считаются в пуле потоков; для каждого целевого канала блок
+    // копится из своих исходных каналов подряд по памяти
+    static SpectralTransform::CubeProduct apply(const Matrix& matrix, const std::vector<const uint16_t*>& bands,
+                                                const std::vector<SampleQuantization>& quantization, size_t numPixels);
+};
+
+#endif
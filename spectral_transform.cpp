@@ -0,0 +1,232 @@
+#include "spectral_transform.h"
+#include "parallel_utils.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+
+namespace {
+
+// Блок "пиксель x канал" в double для сотен каналов остаётся в L2
+const size_t kBlockPixels = 1024;
+
+void removeContinuum(const std::vector<double>& wavelengths, const std::vector<double>& values,
+                     std::vector<int>& hull, const std::vector<int>& order, double* result) {
+    const int n = static_cast<int>(values.size());
+
+    // Верхняя оболочка: точка уходит, если она не выше отрезка от предыдущей вершины к новой
+    hull.clear();
+    for (int i = 0; i < n; i++) {
+        while (hull.size() >= 2) {
+            const int a = hull[hull.size() - 2];
+            const int b = hull.back();
+            const double cross = (wavelengths[b] - wavelengths[a]) * (values[i] - values[a]) -
+                                 (values[b] - values[a]) * (wavelengths[i] - wavelengths[a]);
+            if (cross < 0) break;
+            hull.pop_back();
+        }
+        hull.push_back(i);
+    }
+
+    // Вершины оболочки идут по сетке, поэтому отрезок для каждой точки находится сдвигом вперёд
+    size_t segment = 0;
+    for (int i = 0; i < n; i++) {
+        while (segment + 2 < hull.size() && hull[segment + 1] < i) segment++;
+
+        double continuum = values[hull[segment]];
+        if (segment + 1 < hull.size()) {
+            const int a = hull[segment];
+            const int b = hull[segment + 1];
+            const double span = wavelengths[b] - wavelengths[a];
+            if (span > 0) {
+                continuum += (values[b] - values[a]) * (wavelengths[i] - wavelengths[a]) / span;
+            }
+        }
+        result[order[i]] = continuum > 0 ? values[i] / continuum : 1.0;
+    }
+}
+
+void applyStencils(const std::vector<SpectralTransform::Grid::Stencil>& stencils, const std::vector<double>& values,
+                   const std::vector<int>& order, double* result) {
+    for (size_t i = 0; i < stencils.size(); i++) {
+        const auto& stencil = stencils[i];
+        const double* points = values.data() + stencil.first;
+        result[order[i]] = stencil.weights[0] * points[0] + stencil.weights[1] * points[1] + stencil.weights[2] * points[2];
+    }
+}
+
+// Коды пикселей [begin, begin + count) в исходных единицах, затем преобразование по пикселям
+void transformBlock(SpectralTransform::Type type, const SpectralTransform::Grid& grid,
+                    const std::vector<const uint16_t*>& bands, const std::vector<SampleQuantization>& quantization,
+                    size_t begin, size_t count, std::vector<double>& block, std::vector<double>& transformed,
+                    SpectralTransform::Workspace& workspace) {
+    const size_t numBands = bands.size();
+    for (size_t b = 0; b < numBands; b++) {
+        const uint16_t* source = bands[b] + begin;
+        const SampleQuantization& scale = quantization[b];
+        for (size_t p = 0; p < count; p++) {
+            block[p * numBands + b] = scale.decode(source[p]);
+        }
+    }
+    for (size_t p = 0; p < count; p++) {
+        SpectralTransform::apply(type, grid, block.data() + p * numBands, transformed.data() + p * numBands, workspace);
+    }
+}
+
+} // namespace
+
+SpectralTransform::Grid SpectralTransform::Grid::fromWavelengths(const std::vector<double>& wavelengths) {
+    Grid grid;
+    const int n = static_cast<int>(wavelengths.size());
+    grid.order.resize(n);
+    std::iota(grid.order.begin(), grid.order.end(), 0);
+    std::stable_sort(grid.order.begin(), grid.order.end(),
+                     [&](int a, int b) { return wavelengths[a] < wavelengths[b]; });
+    grid.wavelengths.resize(n);
+    for (int i = 0; i < n; i++) grid.wavelengths[i] = wavelengths[grid.order[i]];
+
+    grid.firstDerivative.resize(n);
+    grid.secondDerivative.resize(n);
+    if (n < 3) return grid;
+
+    // Производные интерполяционного многочлена Лагранжа по трём узлам
+    for (int i = 0; i < n; i++) {
+        const int first = std::clamp(i - 1, 0, n - 3);
+        const double x0 = grid.wavelengths[first];
+        const double x1 = grid.wavelengths[first + 1];
+        const double x2 = grid.wavelengths[first + 2];
+        const double d0 = (x0 - x1) * (x0 - x2);
+        const double d1 = (x1 - x0) * (x1 - x2);
+        const double d2 = (x2 - x0) * (x2 - x1);
+        grid.firstDerivative[i].first = first;
+        grid.secondDerivative[i].first = first;
+        // Совпадающие длины волн дают нулевую производную, а не деление на ноль
+        if (d0 == 0 || d1 == 0 || d2 == 0) continue;
+
+        const double t = grid.wavelengths[i];
+        grid.firstDerivative[i].weights = {(2 * t - x1 - x2) / d0, (2 * t - x0 - x2) / d1, (2 * t - x0 - x1) / d2};
+        grid.secondDerivative[i].weights = {2 / d0, 2 / d1, 2 / d2};
+    }
+    return grid;
+}
+
+QString SpectralTransform::typeName(Type type) {
+    switch (type) {
+    case NONE: return "Исходный спектр";
+    case CONTINUUM_REMOVED: return "Удаление континуума";
+    case FIRST_DERIVATIVE: return "Первая производная";
+    case SECOND_DERIVATIVE: return "Вторая производная";
+    }
+    return QString();
+}
+
+void SpectralTransform::apply(Type type, const Grid& grid, const double* values, double* result, Workspace& workspace) {
+    const int n = grid.size();
+    if (type == NONE) {
+        std::copy(values, values + n, result);
+        return;
+    }
+    if (type != CONTINUUM_REMOVED && n < 3) {
+        std::fill(result, result + n, 0.0);
+        return;
+    }
+
+    workspace.sorted.resize(n);
+    for (int i = 0; i < n; i++) workspace.sorted[i] = values[grid.order[i]];
+
+    switch (type) {
+    case CONTINUUM_REMOVED:
+        removeContinuum(grid.wavelengths, workspace.sorted, workspace.hull, grid.order, result);
+        break;
+    case FIRST_DERIVATIVE:
+        applyStencils(grid.firstDerivative, workspace.sorted, grid.order, result);
+        break;
+    case SECOND_DERIVATIVE:
+        applyStencils(grid.secondDerivative, workspace.sorted, grid.order, result);
+        break;
+    case NONE:
+        break;
+    }
+}
+
+SpectralTransform::CubeProduct SpectralTransform::computeCube(Type type, const Grid& grid,
+                                                              const std::vector<int>& outputs,
+                                                              const std::vector<const uint16_t*>& bands,
+                                                              const std::vector<SampleQuantization>& quantization,
+                                                              size_t numPixels) {
+    CubeProduct product;
+    const size_t numBands = bands.size();
+    const size_t numOutputs = outputs.size();
+    if (numBands == 0 || numPixels == 0 || numOutputs == 0 || grid.size() != static_cast<int>(numBands) ||
+        quantization.size() != numBands) {
+        return product;
+    }
+    for (int band : outputs) {
+        if (band < 0 || band >= static_cast<int>(numBands)) return product;
+    }
+
+    product.bands.assign(numOutputs, std::vector<uint16_t>(numPixels));
+    product.quantization.assign(numOutputs, SampleQuantization{});
+    const int64_t numBlocks = static_cast<int64_t>((numPixels + kBlockPixels - 1) / kBlockPixels);
+    const int64_t grainSize = std::max<int64_t>(1, numBlocks / (4 * Parallel::threadCount()));
+
+    if (type == CONTINUUM_REMOVED) {
+        for (auto& scale : product.quantization) scale.scale = 1.0 / 65535.0;
+    } else {
+        // Первый проход - только диапазон каждого канала, коды пишет второй
+        std::vector<double> minimum(numOutputs, std::numeric_limits<double>::max());
+        std::vector<double> maximum(numOutputs, std::numeric_limits<double>::lowest());
+        QMutex mutex;
+        Parallel::forRange(0, numBlocks, grainSize, [&](int64_t blockBegin, int64_t blockEnd) {
+            std::vector<double> block(kBlockPixels * numBands);
+            std::vector<double> transformed(kBlockPixels * numBands);
+            std::vector<double> localMin(numOutputs, std::numeric_limits<double>::max());
+            std::vector<double> localMax(numOutputs, std::numeric_limits<double>::lowest());
+            Workspace workspace;
+            for (int64_t blockIndex = blockBegin; blockIndex < blockEnd; blockIndex++) {
+                const size_t begin = static_cast<size_t>(blockIndex) * kBlockPixels;
+                const size_t count = std::min(kBlockPixels, numPixels - begin);
+                transformBlock(type, grid, bands, quantization, begin, count, block, transformed, workspace);
+                for (size_t p = 0; p < count; p++) {
+                    const double* row = transformed.data() + p * numBands;
+                    for (size_t i = 0; i < numOutputs; i++) {
+                        localMin[i] = std::min(localMin[i], row[outputs[i]]);
+                        localMax[i] = std::max(localMax[i], row[outputs[i]]);
+                    }
+                }
+            }
+
+            QMutexLocker locker(&mutex);
+            for (size_t i = 0; i < numOutputs; i++) {
+                minimum[i] = std::min(minimum[i], localMin[i]);
+                maximum[i] = std::max(maximum[i], localMax[i]);
+            }
+        });
+
+        for (size_t i = 0; i < numOutputs; i++) {
+            product.quantization[i].offset = minimum[i];
+            product.quantization[i].scale = maximum[i] > minimum[i] ? (maximum[i] - minimum[i]) / 65535.0 : 1.0;
+        }
+    }
+
+    Parallel::forRange(0, numBlocks, grainSize, [&](int64_t blockBegin, int64_t blockEnd) {
+        std::vector<double> block(kBlockPixels * numBands);
+        std::vector<double> transformed(kBlockPixels * numBands);
+        Workspace workspace;
+        for (int64_t blockIndex = blockBegin; blockIndex < blockEnd; blockIndex++) {
+            const size_t begin = static_cast<size_t>(blockIndex) * kBlockPixels;
+            const size_t count = std::min(kBlockPixels, numPixels - begin);
+            transformBlock(type, grid, bands, quantization, begin, count, block, transformed, workspace);
+            for (size_t i = 0; i < numOutputs; i++) {
+                uint16_t* target = product.bands[i].data() + begin;
+                const SampleQuantization& scale = product.quantization[i];
+                const size_t band = static_cast<size_t>(outputs[i]);
+                for (size_t p = 0; p < count; p++) {
+                    target[p] = scale.encode(transformed[p * numBands + band]);
+                }
+            }
+        }
+    });
+    return product;
+}
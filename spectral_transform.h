@@ -0,0 +1,67 @@
+#ifndef SPECTRAL_TRANSFORM_H
+#define SPECTRAL_TRANSFORM_H
+
+#include <QString>
+#include <array>
+#include <vector>
+#include <cstdint>
+#include "quantile_sketch.h"
+
+// Преобразования спектров для поиска полос поглощения: удаление континуума
+// (деление на верхнюю выпуклую оболочку) и производные по длине волны.
+// Сетка длин волн может быть неравномерной, а каналы - не по порядку
+class SpectralTransform {
+public:
+    enum Type {
+        NONE,
+        CONTINUUM_REMOVED,
+        FIRST_DERIVATIVE,
+        SECOND_DERIVATIVE
+    };
+
+    // Всё, что зависит только от сетки, считается один раз на куб
+    struct Grid {
+        // Производная в точке по трём соседним каналам сетки, начиная с first;
+        // на краях те же три точки, что и у соседа, - односторонняя разность
+        struct Stencil {
+            int first = 0;
+            std::array<double, 3> weights = {0.0, 0.0, 0.0};
+        };
+
+        std::vector<int> order;           // каналы по возрастанию длины волны
+        std::vector<double> wavelengths;  // в порядке order
+        std::vector<Stencil> firstDerivative;
+        std::vector<Stencil> secondDerivative;
+
+        static Grid fromWavelengths(const std::vector<double>& wavelengths);
+        int size() const { return static_cast<int>(order.size()); }
+    };
+
+    // Буферы одного потока: преобразование пикселя не выделяет память
+    struct Workspace {
+        std::vector<double> sorted;
+        std::vector<int> hull;
+    };
+
+    // Продукт для всего куба: каналы в исходном порядке и их шкалы кодов
+    struct CubeProduct {
+        std::vector<std::vector<uint16_t>> bands;
+        std::vector<SampleQuantization> quantization;
+    };
+
+    static QString typeName(Type type);
+
+    // values и result - grid.size() значений в порядке каналов. Оболочка строится
+    // монотонной цепочкой за один проход по отсортированной сетке
+    static void apply(Type type, const Grid& grid, const double* values, double* result, Workspace& workspace);
+
+    // bands[b] - numPixels кодов канала b, quantization[b] переводит их в исходные единицы.
+    // outputs - нужные каналы продукта, в результате по одному на каждый. Блоки пикселей
+    // считаются в пуле потоков; производные проходят дважды - за диапазоном каналов и
+    // за кодами, континуум всегда кодируется на [0, 1]
+    static CubeProduct computeCube(Type type, const Grid& grid, const std::vector<int>& outputs,
+                                   const std::vector<const uint16_t*>& bands,
+                                   const std::vector<SampleQuantization>& quantization, size_t numPixels);
+};
+
+#endif
@@ -1,6 +1,28 @@
 #include "tiff_reader.h"
+#include "parallel_utils.h"
 #include <QDebug>
 #include <tiffio.h>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+// Столько 32-битных значений чередующихся каналов разбирается за один раз
+const size_t kQuantizationChunkValues = 1 << 20;
+
+void scanlineToFloat(const void* buf, size_t count, uint16_t sampleFormat, float* out) {
+    if (sampleFormat == SAMPLEFORMAT_IEEEFP) {
+        std::memcpy(out, buf, count * sizeof(float));
+    } else if (sampleFormat == SAMPLEFORMAT_INT) {
+        const int32_t* values = static_cast<const int32_t*>(buf);
+        for (size_t i = 0; i < count; i++) out[i] = static_cast<float>(values[i]);
+    } else {
+        const uint32_t* values = static_cast<const uint32_t*>(buf);
+        for (size_t i = 0; i < count; i++) out[i] = static_cast<float>(values[i]);
+    }
+}
+
+} // namespace
 
 bool TiffReader::readTiffInfo(const QString& filePath, TiffInfo& info) {
     TIFF* tif = TIFFOpen(filePath.toLocal8Bit().constData(), "r");
@@ -12,6 +34,7 @@ bool TiffReader::readTiffInfo(const QString& filePath, TiffInfo& info) {
     TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &info.width);
     TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &info.height);
     TIFFGetField(tif, TIFFTAG_BITSPERSAMPLE, &info.bitsPerSample);
+    TIFFGetField(tif, TIFFTAG_SAMPLEFORMAT, &info.sampleFormat);
     
     uint16_t samplesPerPixel = 1;
     TIFFGetField(tif, TIFFTAG_SAMPLESPERPIXEL, &samplesPerPixel);
@@ -33,10 +56,15 @@ bool TiffReader::readTiffInfo(const QString& filePath, TiffInfo& info) {
     return true;
 }
 
-bool TiffReader::loadTiffData(const QString& filePath, std::vector<std::vector<uint16_t>>& channels, const TiffInfo& info) {
+bool TiffReader::loadTiffData(const QString& filePath, std::vector<std::vector<uint16_t>>& channels, const TiffInfo& info,
+                              const ChannelLoadedCallback& onChannelLoaded, std::vector<QuantileSketch>* sketches) {
     TIFF* tif = TIFFOpen(filePath.toLocal8Bit().constData(), "r");
     if (!tif) return false;
 
+    std::vector<QuantileSketch> localSketches;
+    std::vector<QuantileSketch>& bandSketches = sketches ? *sketches : localSketches;
+    bandSketches.assign(info.needsQuantization() ? info.numChannels : 0, QuantileSketch());
+
     channels.clear();
     channels.resize(info.numChannels);
     for (uint32_t i = 0; i < info.numChannels; i++) {
@@ -54,22 +82,38 @@ bool TiffReader::loadTiffData(const QString& filePath, std::vector<std::vector<u
 
     bool result = false;
     if (dirCount > 1 && samplesPerPixel == 1) {
-        result = loadMultiPageTiff(tif, channels, info);
-    } else if (samplesPerPixel > 1) {
-        result = loadSinglePageTiff(tif, channels, info);
+        result = loadMultiPageTiff(tif, channels, info, onChannelLoaded, bandSketches);
     } else {
-        result = loadSingleChannelTiff(tif, channels, info);
+        // Каналы чередуются в строках и готовы только после чтения всего файла
+        if (samplesPerPixel > 1) {
+            result = loadSinglePageTiff(tif, channels, info, bandSketches);
+        } else {
+            result = loadSingleChannelTiff(tif, channels, info, bandSketches);
+        }
+        if (result && onChannelLoaded) {
+            for (uint32_t channelIndex = 0; channelIndex < info.numChannels; channelIndex++) {
+                onChannelLoaded(static_cast<int>(channelIndex));
+            }
+        }
     }
     
     TIFFClose(tif);
     return result;
 }
 
-bool TiffReader::loadMultiPageTiff(void* tif_ptr, std::vector<std::vector<uint16_t>>& channels, const TiffInfo& info) {
+bool TiffReader::loadMultiPageTiff(void* tif_ptr, std::vector<std::vector<uint16_t>>& channels, const TiffInfo& info,
+                                   const ChannelLoadedCallback& onChannelLoaded, std::vector<QuantileSketch>& sketches) {
     TIFF* tif = static_cast<TIFF*>(tif_ptr);
     
     for (uint32_t channelIndex = 0; channelIndex < info.numChannels; channelIndex++) {
         if (TIFFSetDirectory(tif, channelIndex) != 1) continue;
+
+        if (info.needsQuantization()) {
+            if (loadQuantizedPage(tif, channels[channelIndex], info, sketches[channelIndex]) && onChannelLoaded) {
+                onChannelLoaded(static_cast<int>(channelIndex));
+            }
+            continue;
+        }
         
         tdata_t buf = _TIFFmalloc(TIFFScanlineSize(tif));
         if (!buf) continue;
@@ -90,11 +134,16 @@ bool TiffReader::loadMultiPageTiff(void* tif_ptr, std::vector<std::vector<uint16
             }
         }
         _TIFFfree(buf);
+        
+        if (onChannelLoaded) onChannelLoaded(static_cast<int>(channelIndex));
     }
     return true;
 }
 
-bool TiffReader::loadSinglePageTiff(void* tif_ptr, std::vector<std::vector<uint16_t>>& channels, const TiffInfo& info) {
+bool TiffReader::loadSinglePageTiff(void* tif_ptr, std::vector<std::vector<uint16_t>>& channels, const TiffInfo& info,
+                                    std::vector<QuantileSketch>& sketches) {
+    if (info.needsQuantization()) return loadQuantizedInterleaved(tif_ptr, channels, info, sketches);
+
     TIFF* tif = static_cast<TIFF*>(tif_ptr);
     
     tdata_t buf = _TIFFmalloc(TIFFScanlineSize(tif));
@@ -123,7 +172,10 @@ bool TiffReader::loadSinglePageTiff(void* tif_ptr, std::vector<std::vector<uint1
     return true;
 }
 
-bool TiffReader::loadSingleChannelTiff(void* tif_ptr, std::vector<std::vector<uint16_t>>& channels, const TiffInfo& info) {
+bool TiffReader::loadSingleChannelTiff(void* tif_ptr, std::vector<std::vector<uint16_t>>& channels, const TiffInfo& info,
+                                       std::vector<QuantileSketch>& sketches) {
+    if (info.needsQuantization()) return loadQuantizedPage(tif_ptr, channels[0], info, sketches[0]);
+
     TIFF* tif = static_cast<TIFF*>(tif_ptr);
     
     tdata_t buf = _TIFFmalloc(TIFFScanlineSize(tif));
@@ -147,3 +199,88 @@ bool TiffReader::loadSingleChannelTiff(void* tif_ptr, std::vector<std::vector<ui
     _TIFFfree(buf);
     return true;
 }
+
+bool TiffReader::loadQuantizedPage(void* tif_ptr, std::vector<uint16_t>& channel, const TiffInfo& info, QuantileSketch& sketch) {
+    TIFF* tif = static_cast<TIFF*>(tif_ptr);
+
+    tdata_t buf = _TIFFmalloc(TIFFScanlineSize(tif));
+    if (!buf) return false;
+
+    // Непрочитанные строки остаются NaN и не попадают в эскиз
+    std::vector<float> values(static_cast<size_t>(info.width) * info.height, std::numeric_limits<float>::quiet_NaN());
+    for (uint32_t row = 0; row < info.height; row++) {
+        if (TIFFReadScanline(tif, buf, row) != 1) continue;
+        scanlineToFloat(buf, info.width, info.sampleFormat, values.data() + static_cast<size_t>(row) * info.width);
+    }
+    _TIFFfree(buf);
+
+    sketch = QuantileSketch::build(values.data(), values.size());
+    const SampleQuantization quantization = SampleQuantization::fromSketch(sketch);
+    Parallel::forRange(0, static_cast<int64_t>(values.size()), 1 << 16, [&](int64_t begin, int64_t end) {
+        for (int64_t i = begin; i < end; i++) {
+            channel[i] = quantization.encode(values[i]);
+        }
+    });
+    return true;
+}
+
+bool TiffReader::loadQuantizedInterleaved(void* tif_ptr, std::vector<std::vector<uint16_t>>& channels, const TiffInfo& info,
+                                          std::vector<QuantileSketch>& sketches) {
+    TIFF* tif = static_cast<TIFF*>(tif_ptr);
+    const uint32_t numBands = info.numChannels;
+    const size_t rowValues = static_cast<size_t>(info.width) * numBands;
+    const uint32_t chunkRows = static_cast<uint32_t>(std::max<size_t>(1, kQuantizationChunkValues / rowValues));
+
+    tdata_t buf = _TIFFmalloc(TIFFScanlineSize(tif));
+    if (!buf) return false;
+
+    // Весь файл в float не держится: в памяти только chunkRows строк
+    std::vector<float> rows(rowValues * chunkRows);
+    auto readChunk = [&](uint32_t firstRow, uint32_t count) {
+        for (uint32_t r = 0; r < count; r++) {
+            float* out = rows.data() + r * rowValues;
+            if (TIFFReadScanline(tif, buf, firstRow + r) == 1) {
+                scanlineToFloat(buf, rowValues, info.sampleFormat, out);
+            } else {
+                std::fill(out, out + rowValues, std::numeric_limits<float>::quiet_NaN());
+            }
+        }
+    };
+
+    // Проход 1: каждый канал копит свой эскиз, каналы - параллельно
+    for (uint32_t firstRow = 0; firstRow < info.height; firstRow += chunkRows) {
+        const uint32_t count = std::min(chunkRows, info.height - firstRow);
+        readChunk(firstRow, count);
+        Parallel::forRange(0, numBands, 1, [&](int64_t bandBegin, int64_t bandEnd) {
+            for (int64_t band = bandBegin; band < bandEnd; band++) {
+                for (size_t i = band; i < count * rowValues; i += numBands) {
+                    sketches[band].add(rows[i]);
+                }
+            }
+        });
+    }
+
+    std::vector<SampleQuantization> quantizations(numBands);
+    for (uint32_t band = 0; band < numBands; band++) {
+        quantizations[band] = SampleQuantization::fromSketch(sketches[band]);
+    }
+
+    // Проход 2: те же строки кодируются по готовым шкалам
+    for (uint32_t firstRow = 0; firstRow < info.height; firstRow += chunkRows) {
+        const uint32_t count = std::min(chunkRows, info.height - firstRow);
+        readChunk(firstRow, count);
+        Parallel::forRange(0, count, 1, [&](int64_t rowBegin, int64_t rowEnd) {
+            for (int64_t r = rowBegin; r < rowEnd; r++) {
+                const float* scanline = rows.data() + r * rowValues;
+                const size_t offset = static_cast<size_t>(firstRow + r) * info.width;
+                for (uint32_t col = 0; col < info.width; col++) {
+                    for (uint32_t band = 0; band < numBands; band++) {
+                        channels[band][offset + col] = quantizations[band].encode(scanline[col * numBands + band]);
+                    }
+                }
+            }
+        });
+    }
+    _TIFFfree(buf);
+    return true;
+}
@@ -4,6 +4,8 @@
 #include <QString>
 #include <vector>
 #include <cstdint>
+#include <functional>
+#include "quantile_sketch.h"
 
 class TiffReader {
 public:
@@ -12,15 +14,35 @@ public:
         uint32_t height = 0;
         uint32_t numChannels = 0;
         uint16_t bitsPerSample = 16;
+        uint16_t sampleFormat = 1;  // SAMPLEFORMAT_UINT / _INT / _IEEEFP
+
+        // 32-битные целые и float приводятся к 16 битам по диапазону эскиза
+        bool needsQuantization() const { return bitsPerSample == 32; }
     };
 
+    // Вызывается, когда канал полностью декодирован; буферы каналов
+    // выделяются заранее и не перемещаются до конца загрузки
+    using ChannelLoadedCallback = std::function<void(int channelIndex)>;
+
     static bool readTiffInfo(const QString& filePath, TiffInfo& info);
-    static bool loadTiffData(const QString& filePath, std::vector<std::vector<uint16_t>>& channels, const TiffInfo& info);
+    // Для 32-битных данных в sketches попадают эскизы исходных значений каналов,
+    // по ним же SampleQuantization::fromSketch восстанавливает шкалу 16-битных кодов
+    static bool loadTiffData(const QString& filePath, std::vector<std::vector<uint16_t>>& channels, const TiffInfo& info,
+                             const ChannelLoadedCallback& onChannelLoaded = nullptr,
+                             std::vector<QuantileSketch>* sketches = nullptr);
 
 private:
-    static bool loadMultiPageTiff(void* tif, std::vector<std::vector<uint16_t>>& channels, const TiffInfo& info);
-    static bool loadSinglePageTiff(void* tif, std::vector<std::vector<uint16_t>>& channels, const TiffInfo& info);
-    static bool loadSingleChannelTiff(void* tif, std::vector<std::vector<uint16_t>>& channels, const TiffInfo& info);
+    static bool loadMultiPageTiff(void* tif, std::vector<std::vector<uint16_t>>& channels, const TiffInfo& info,
+                                  const ChannelLoadedCallback& onChannelLoaded, std::vector<QuantileSketch>& sketches);
+    static bool loadSinglePageTiff(void* tif, std::vector<std::vector<uint16_t>>& channels, const TiffInfo& info,
+                                   std::vector<QuantileSketch>& sketches);
+    static bool loadSingleChannelTiff(void* tif, std::vector<std::vector<uint16_t>>& channels, const TiffInfo& info,
+                                      std::vector<QuantileSketch>& sketches);
+    // Одна полоса 32-битных значений: эскиз, шкала и 16-битные коды
+    static bool loadQuantizedPage(void* tif, std::vector<uint16_t>& channel, const TiffInfo& info, QuantileSketch& sketch);
+    // Чередующиеся 32-битные каналы: первый проход строит эскизы, второй кодирует
+    static bool loadQuantizedInterleaved(void* tif, std::vector<std::vector<uint16_t>>& channels, const TiffInfo& info,
+                                         std::vector<QuantileSketch>& sketches);
 };
 
 #endif
@@ -0,0 +1,107 @@
+#include "tile_histogram_index.h"
+#include "parallel_utils.h"
+#include <algorithm>
+
+std::shared_ptr<const TileHistogramIndex> TileHistogramIndex::build(const uint16_t* data, uint32_t width, uint32_t height,
+                                                                    uint16_t minVal, uint16_t maxVal) {
+    if (!data || width == 0 || height == 0) return nullptr;
+
+    auto index = std::make_shared<TileHistogramIndex>();
+    index->width = width;
+    index->height = height;
+    index->tilesX = static_cast<int>((width + kTileSize - 1) / kTileSize);
+    index->tilesY = static_cast<int>((height + kTileSize - 1) / kTileSize);
+    index->minVal = minVal;
+
+    const int range = std::max<int>(0, maxVal - minVal) + 1;
+    index->binWidth = (range + kNumBins - 1) / kNumBins;
+    index->numBins = (range + index->binWidth - 1) / index->binWidth;
+
+    const int numBins = index->numBins;
+    const int stride = index->tilesX + 1;
+    index->integral.assign(static_cast<size_t>(index->tilesY + 1) * stride * numBins, 0);
+
+    // Сначала счётчики каждой плитки в ячейку (tileY + 1, tileX + 1), строки плиток параллельно
+    Parallel::forRange(0, index->tilesY, 1, [&](int64_t rowBegin, int64_t rowEnd) {
+        for (int64_t tileY = rowBegin; tileY < rowEnd; tileY++) {
+            for (int tileX = 0; tileX < index->tilesX; tileX++) {
+                uint32_t* counts = index->integral.data() + ((tileY + 1) * stride + tileX + 1) * numBins;
+                const int x0 = tileX * kTileSize;
+                const int y0 = static_cast<int>(tileY) * kTileSize;
+                index->countPixels(data, x0, y0,
+                                   std::min<int>(x0 + kTileSize, width),
+                                   std::min<int>(y0 + kTileSize, height), counts);
+            }
+        }
+    });
+
+    // Затем префиксные суммы по строкам и по столбцам сетки
+    uint32_t* integral = index->integral.data();
+    for (int tileY = 1; tileY <= index->tilesY; tileY++) {
+        for (int tileX = 1; tileX <= index->tilesX; tileX++) {
+            uint32_t* cell = integral + (static_cast<size_t>(tileY) * stride + tileX) * numBins;
+            const uint32_t* left = cell - numBins;
+            const uint32_t* up = cell - static_cast<size_t>(stride) * numBins;
+            const uint32_t* upLeft = up - numBins;
+            for (int bin = 0; bin < numBins; bin++) {
+                cell[bin] += left[bin] + up[bin] - upLeft[bin];
+            }
+        }
+    }
+
+    return index;
+}
+
+void TileHistogramIndex::countPixels(const uint16_t* data, int x0, int y0, int x1, int y1, uint32_t* counts) const {
+    for (int y = y0; y < y1; y++) {
+        const uint16_t* row = data + static_cast<size_t>(y) * width;
+        for (int x = x0; x < x1; x++) {
+            counts[binOf(row[x])]++;
+        }
+    }
+}
+
+ChannelStatistics::Histogram TileHistogramIndex::regionHistogram(const uint16_t* data, int x, int y, int w, int h) const {
+    const int x0 = std::max(0, x);
+    const int y0 = std::max(0, y);
+    const int x1 = std::min<int>(width, x + w);
+    const int y1 = std::min<int>(height, y + h);
+    if (!data || x0 >= x1 || y0 >= y1) return ChannelStatistics::Histogram();
+
+    std::vector<uint32_t> counts(numBins, 0);
+
+    // Плитки, целиком попадающие в прямоугольник; последняя плитка может быть неполной
+    auto tileBoundary = [](int tile, int limit) { return std::min(tile * kTileSize, limit); };
+    const int tileX0 = (x0 + kTileSize - 1) / kTileSize;
+    const int tileY0 = (y0 + kTileSize - 1) / kTileSize;
+    const int tileX1 = x1 == static_cast<int>(width) ? tilesX : x1 / kTileSize;
+    const int tileY1 = y1 == static_cast<int>(height) ? tilesY : y1 / kTileSize;
+
+    if (tileX0 < tileX1 && tileY0 < tileY1) {
+        const uint32_t* bottomRight = integralAt(tileX1, tileY1);
+        const uint32_t* bottomLeft = integralAt(tileX0, tileY1);
+        const uint32_t* topRight = integralAt(tileX1, tileY0);
+        const uint32_t* topLeft = integralAt(tileX0, tileY0);
+        for (int bin = 0; bin < numBins; bin++) {
+            counts[bin] = bottomRight[bin] - bottomLeft[bin] - topRight[bin] + topLeft[bin];
+        }
+
+        const int innerX0 = tileBoundary(tileX0, width);
+        const int innerY0 = tileBoundary(tileY0, height);
+        const int innerX1 = tileBoundary(tileX1, width);
+        const int innerY1 = tileBoundary(tileY1, height);
+
+        countPixels(data, x0, y0, x1, innerY0, counts.data());            // верхняя полоса
+        countPixels(data, x0, innerY1, x1, y1, counts.data());            // нижняя полоса
+        countPixels(data, x0, innerY0, innerX0, innerY1, counts.data());  // левая полоса
+        countPixels(data, innerX1, innerY0, x1, innerY1, counts.data());  // правая полоса
+    } else {
+        countPixels(data, x0, y0, x1, y1, counts.data());
+    }
+
+    std::vector<int> valueCounts(static_cast<size_t>(numBins - 1) * binWidth + 1, 0);
+    for (int bin = 0; bin < numBins; bin++) {
+        valueCounts[static_cast<size_t>(bin) * binWidth] = static_cast<int>(counts[bin]);
+    }
+    return ChannelStatistics::fromCounts(valueCounts, minVal);
+}
@@ -0,0 +1,49 @@
+#ifndef TILE_HISTOGRAM_INDEX_H
+#define TILE_HISTOGRAM_INDEX_H
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include "channel_statistics.h"
+
+// Интегральные гистограммы по сетке плиток одного канала. Гистограмма любого
+// прямоугольника собирается из целых плиток за O(числа бинов) и досчитывается
+// по пикселям краевых полос. Бины огрублены до kNumBins на диапазон канала
+class TileHistogramIndex {
+public:
+    static const int kTileSize = 256;
+    static const int kNumBins = 256;
+
+    static std::shared_ptr<const TileHistogramIndex> build(const uint16_t* data, uint32_t width, uint32_t height,
+                                                           uint16_t minVal, uint16_t maxVal);
+
+    // data - тот же канал, по которому строился индекс. Прямоугольник обрезается
+    // по границам изображения. Счётчик бина приписывается его нижнему значению
+    ChannelStatistics::Histogram regionHistogram(const uint16_t* data, int x, int y, int w, int h) const;
+
+    size_t getMemoryUsage() const { return integral.size() * sizeof(uint32_t); }
+
+private:
+    int binOf(uint16_t value) const {
+        int bin = (static_cast<int>(value) - minVal) / binWidth;
+        return std::min(std::max(bin, 0), numBins - 1);
+    }
+
+    // Накопленные счётчики плиток [0, tileX) x [0, tileY)
+    const uint32_t* integralAt(int tileX, int tileY) const {
+        return integral.data() + (static_cast<size_t>(tileY) * (tilesX + 1) + tileX) * numBins;
+    }
+
+    void countPixels(const uint16_t* data, int x0, int y0, int x1, int y1, uint32_t* counts) const;
+
+    uint32_t width = 0;
+    uint32_t height = 0;
+    int tilesX = 0;
+    int tilesY = 0;
+    int minVal = 0;
+    int binWidth = 1;
+    int numBins = 1;
+    std::vector<uint32_t> integral;  // (tilesY + 1) x (tilesX + 1) x numBins
+};
+
+#endif